@@ -15,51 +15,157 @@
 #include "CharCode.h"
 #include "FileLib.h"
 #include "Huffman.h"
+#include "KeyConv.h"
 #include <stdio.h>
 #include <string.h>
 #include <windows.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 // define -----------------------------
 
 #define MIN_COMPRESS       (4)                     // 最低圧縮バイト数
-#define MAX_SEARCHLISTNUM  (64)                    // 最大一致長を探す為のリストを辿る最大数
-#define MAX_SUBLISTNUM     (65536)                 // 圧縮時間短縮のためのサブリストの最大数
 #define MAX_COPYSIZE       (0x1fff + MIN_COMPRESS) // 参照アドレスからコピー出切る最大サイズ( 圧縮コードが表現できるコピーサイズの最大値 + 最低圧縮バイト数 )
-#define MAX_ADDRESSLISTNUM (1024 * 1024 * 1)       // スライド辞書の最大サイズ
+#define MAX_ADDRESSLISTNUM (1024 * 1024 * 1)       // スライド辞書の標準サイズ
 #define MAX_POSITION       (1 << 24)               // 参照可能な最大相対アドレス( 16MB )
+#define LZ_HASH_BITS       (20)                    // 一致を探す為のハッシュテーブルのビット数
 
 #define GLOBAL_CHAR_CODE 932
 
-uint8_t g_specialKey[768] = {};
-bool g_newCrypt           = false;
-bool g_chacha20           = false;
-uint16_t g_cryptVersion   = 0;
-
-uint8_t g_cc20Key[32]   = { 0xC9, 0x82, 0xF8, 0xB4, 0x2C, 0x93, 0x9E, 0x83, 0x0E, 0xBC, 0xBC, 0x92, 0x68, 0x8D, 0x59, 0xA1, 0x4A, 0x9E, 0x7F, 0xB0, 0xAC, 0xAF, 0x1D, 0x8F, 0x8E, 0xB8, 0x3B, 0x9E, 0xE8, 0x89, 0xD9, 0xAD };
-uint8_t g_cc20Nonce[12] = { 0xFF, 0xBC, 0x2D, 0xAB, 0x9D, 0x8B, 0x0F, 0xB4, 0xBB, 0x9A, 0x69, 0x85 };
-
-
-
 static WCHAR *sjis2utf8(const char *sjis, const int32_t &len);
 static char *utf82sjis(const WCHAR *utf8);
 
 // struct -----------------------------
 
-// 圧縮時間短縮用リスト
-typedef struct LZ_LIST
+// 圧縮レベル毎の一致検索のパラメータ
+typedef struct LZ_LEVELPARAM
+{
+	u32 ChainNum;   // ハッシュチェインを辿る最大数
+	u32 NiceLength; // この長さ以上一致したら探索を打ち切る一致長
+	u32 LazyLength; // この長さ未満の一致の場合は次の位置の一致も調べる( 遅延評価 )
+	u32 GoodLength; // この長さ以上一致している場合は遅延評価で辿るチェインの数を減らす
+	u32 WindowSize; // スライド辞書のサイズ( ２のｎ乗 )
+} LZ_LEVELPARAM;
+
+// 圧縮時の一致検索用ハッシュチェイン
+typedef struct LZ_MATCHFINDER
 {
-	LZ_LIST *next, *prev;
-	u32 address;
-} LZ_LIST;
+	u32 *HashTable;    // 先頭４バイトのハッシュ値毎の最後に登録した位置
+	u32 *ChainTable;   // 同じハッシュ値を持つ一つ前の位置( スライド辞書のサイズ分 )
+	u32 HashBits;      // ハッシュテーブルのビット数
+	u32 WindowMask;    // スライド辞書のサイズ－１
+	u32 NiceLength;    // この長さ以上一致したら探索を打ち切る一致長
+	u32 InsertAddress; // 次にハッシュチェインに登録する位置
+	const u8 *Src;     // 圧縮元データ
+	u32 SrcSize;       // 圧縮元データのサイズ
+} LZ_MATCHFINDER;
+
+// 見つかった一致の情報
+typedef struct LZ_MATCH
+{
+	u32 Conbo;   // 一致長( 0 の場合は一致無し )
+	u32 Address; // 相対アドレス
+	s32 Bonus;   // 圧縮コードにすることで削減できるバイト数
+} LZ_MATCH;
 
 // data -------------------------------
 
 // デフォルト鍵文字列
 static char DefaultKeyString[9] = { 0x44, 0x58, 0x42, 0x44, 0x58, 0x41, 0x52, 0x43, 0x00 }; // "DXLIBARC"
 
+// デフォルトの ChaCha20 の鍵とノンス
+static const u8 DefaultChaCha20Key[32]   = { 0xC9, 0x82, 0xF8, 0xB4, 0x2C, 0x93, 0x9E, 0x83, 0x0E, 0xBC, 0xBC, 0x92, 0x68, 0x8D, 0x59, 0xA1, 0x4A, 0x9E, 0x7F, 0xB0, 0xAC, 0xAF, 0x1D, 0x8F, 0x8E, 0xB8, 0x3B, 0x9E, 0xE8, 0x89, 0xD9, 0xAD };
+static const u8 DefaultChaCha20Nonce[12] = { 0xFF, 0xBC, 0x2D, 0xAB, 0x9D, 0x8B, 0x0F, 0xB4, 0xBB, 0x9A, 0x69, 0x85 };
+
 // ログ文字列の長さ
 size_t LogStringLength = 0;
 
+// アーカイブファイルの展開に使用するスレッドの数
+int DXArchive::DecodeThreadNum = 1;
+
+// 展開するファイルを絞り込む条件
+DARC_DECODEFILTER DXArchive::DecodeFilter;
+
+// アーカイブファイルの作成に使用するスレッドの数
+int DXArchive::EncodeThreadNum = 1;
+
+// データの圧縮に使用する圧縮レベル
+int DXArchive::PressLevel = DXA_PRESSLEVEL_DEFAULT;
+
+// アーカイブファイルを開く時にファイル名検索用のハッシュテーブルを作成するかどうか
+bool DXArchive::NameIndexFlag = true;
+
+// 解凍したファイルのキャッシュのデータ
+typedef struct tagDARC_CACHEENTRY
+{
+	u64 Key;					// アーカイブの識別番号とファイルヘッダのアドレスを合わせた値
+	std::shared_ptr<u8> Data;	// 解凍したデータ
+	u64 Size;					// 解凍したデータのサイズ
+	u64 UseTick;				// 最後に使われた時の番号( 小さいほど長い間使われていない )
+} DARC_CACHEENTRY;
+
+// 解凍したファイルのキャッシュの一区画( 区画毎に排他処理を行う )
+typedef struct tagDARC_CACHESHARD
+{
+	std::mutex Mutex;													// 排他処理用
+	std::list<DARC_CACHEENTRY> List;									// キャッシュしているデータ( 最近使われたものほど先頭にある )
+	std::unordered_map<u64, std::list<DARC_CACHEENTRY>::iterator> Map;	// キャッシュしているデータの検索用
+	u64 UseSize;														// この区画にキャッシュしているデータの総量
+	u64 HitNum, MissNum, EvictNum;										// 各回数
+} DARC_CACHESHARD;
+
+// 解凍したファイルのキャッシュ
+static DARC_CACHESHARD DecodeCacheShard[DXA_DECODECACHE_SHARDNUM];
+
+// 解凍したファイルをキャッシュするメモリの上限と、全ての区画にキャッシュしているデータの総量( 上限は区画に分けずに全体で管理する )
+static std::atomic<u64> DecodeCacheMaxSize(0);
+static std::atomic<u64> DecodeCacheUseSize(0);
+
+// キャッシュしているデータが使われる度に増やす番号
+static std::atomic<u64> DecodeCacheTick(0);
+
+// 次に開いたアーカイブに割り当てる識別番号
+static std::atomic<u64> DecodeCacheArchiveID(1);
+
+// 複数のアーカイブファイルをまとめて展開する処理の一つのスレッドで実行する単位
+typedef struct tagDARC_BATCHTASK
+{
+	size_t Batch;				// 展開するアーカイブの番号
+	size_t JobStart, JobEnd;	// 展開するファイルの範囲( 別形式のアーカイブの場合は使用しない )
+	u64 Cost;					// 処理の大きさの目安
+} DARC_BATCHTASK;
+
+// 複数のアーカイブファイルをまとめて展開する処理のスレッド毎の処理待ちの列
+typedef struct tagDARC_BATCHQUEUE
+{
+	std::mutex Mutex;			// 排他処理用
+	std::deque<size_t> Task;	// 処理待ちの DARC_BATCHTASK の番号( 大きいものほど先頭にある )
+	std::atomic<u64> Cost;		// 列に残っている処理の大きさの合計( 他のスレッドから奪う列を選ぶ時に使用する )
+} DARC_BATCHQUEUE;
+
+// 圧縮レベル毎の一致検索のパラメータ
+static const LZ_LEVELPARAM LZLevelParam[ DXA_PRESSLEVEL_MAX + 1 ] =
+{
+	//  ChainNum     NiceLength    LazyLength    GoodLength    WindowSize
+	{          0,             0,            0,            0, MAX_ADDRESSLISTNUM }, // 0( 未使用 )
+	{          4,            32,            0,            0, MAX_ADDRESSLISTNUM }, // 1
+	{          8,            64,            0,            0, MAX_ADDRESSLISTNUM }, // 2
+	{         16,           128,            0,            0, MAX_ADDRESSLISTNUM }, // 3
+	{         16,            64,           16,            8, MAX_ADDRESSLISTNUM }, // 4
+	{         32,           128,           32,           16, MAX_ADDRESSLISTNUM }, // 5
+	{         64,           256,          128,           32, MAX_ADDRESSLISTNUM }, // 6
+	{        128,          1024,          256,           64, MAX_ADDRESSLISTNUM }, // 7
+	{       1024,  MAX_COPYSIZE,         1024,          256, MAX_ADDRESSLISTNUM }, // 8
+	{       4096,  MAX_COPYSIZE, MAX_COPYSIZE, MAX_COPYSIZE, MAX_POSITION       }, // 9( 最大圧縮 )
+};
+
 // Functions for new Wolf Crypt
 #include "WolfNew.h"
 
@@ -111,77 +217,54 @@ int DXArchive::GetFilePathAndDirPath(TCHAR *Src, TCHAR *FilePath, TCHAR *DirPath
 	return 0;
 }
 
-// ファイルの情報を得る
+// ファイルの情報を得る( カレントディレクトリは変更しないので、複数のスレッドから同時に呼んでも良い )
 DARC_FILEHEAD *DXArchive::GetFileInfo(const TCHAR *FilePath, DARC_DIRECTORY **DirectoryP)
 {
-	DARC_DIRECTORY *OldDir;
+	DARC_DIRECTORY *Dir;
 	DARC_FILEHEAD *FileH;
-	u8 *NameData;
-	int i, j, k, Num, FileHeadSize;
 	SEARCHDATA SearchData;
+	int Point, StrLength;
 
-	// 元のディレクトリを保存しておく
-	OldDir = this->CurrentDirectory;
-
-	// ファイルパスに \ が含まれている場合、ディレクトリ変更を行う
-	if( _tcschr( FilePath, TEXT('\\') ) != NULL )
-	{
-		// カレントディレクトリを目的のファイルがあるディレクトリに変更する
-		if (this->ChangeCurrentDirectoryBase(FilePath, false, &SearchData) >= 0)
-		{
-			// エラーが起きなかった場合はファイル名もディレクトリだったことになるのでエラー
-			goto ERR;
-		}
-	}
-	else
-	{
-		// ファイル名を検索用データに変換する
-		ConvSearchData(&SearchData, FilePath, NULL);
-	}
-
-	// 同名のファイルを探す
-	FileHeadSize = sizeof(DARC_FILEHEAD);
-	FileH        = (DARC_FILEHEAD *)(this->FileP + this->CurrentDirectory->FileHeadAddress);
-	Num          = (int)this->CurrentDirectory->FileHeadNum;
-	for (i = 0; i < Num; i++, FileH = (DARC_FILEHEAD *)((u8 *)FileH + FileHeadSize))
+	// カレントディレクトリから順番にパス中のディレクトリを辿る
+	Dir   = this->CurrentDirectory;
+	Point = 0;
+	for (;;)
 	{
-		// ディレクトリチェック
-		if ((FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) continue;
+		// 文字列を検索用データに変換する
+		ConvSearchData(&SearchData, &FilePath[Point], &StrLength);
+		Point += StrLength;
 
-		// 文字列数とパリティチェック
-		NameData = this->NameP + FileH->NameAddress;
-		if (SearchData.PackNum != ((u16 *)NameData)[0] || SearchData.Parity != ((u16 *)NameData)[1]) continue;
+		// 終端文字で終了した場合はファイル名なのでループから抜ける
+		if (FilePath[Point] == '\0') break;
 
-		// 文字列チェック
-		NameData += 4;
-		for (j = 0, k = 0; j < SearchData.PackNum; j++, k += 4)
-			if (*((u32 *)&SearchData.FileName[k]) != *((u32 *)&NameData[k])) break;
+		// もし \ の前に何も無い場合はルートディレクトリに移る
+		if (StrLength == 0)
+		{
+			Dir = (DARC_DIRECTORY *)this->DirP;
+		}
+		else
+		{
+			// それ以外の場合は同名のディレクトリに移る、無かったらエラー
+			FileH = SearchFileHead(Dir, &SearchData, true);
+			if (FileH == NULL) return NULL;
+			Dir = (DARC_DIRECTORY *)(this->DirP + FileH->DataAddress);
+		}
 
-		// 適合したファイルがあったらここで終了
-		if (SearchData.PackNum == j) break;
+		Point++;
 	}
 
-	// 無かったらエラー
-	if (i == Num) goto ERR;
+	// 同名のファイルを探す、無かったらエラー
+	FileH = SearchFileHead(Dir, &SearchData, false);
+	if (FileH == NULL) return NULL;
 
 	// ディレクトリのアドレスを保存する指定があった場合は保存
 	if (DirectoryP != NULL)
 	{
-		*DirectoryP = this->CurrentDirectory;
+		*DirectoryP = Dir;
 	}
 
-	// ディレクトリを元に戻す
-	this->CurrentDirectory = OldDir;
-
 	// 目的のファイルのアドレスを返す
 	return FileH;
-
-ERR:
-	// ディレクトリを元に戻す
-	this->CurrentDirectory = OldDir;
-
-	// エラー終了
-	return NULL;
 }
 
 // アーカイブ内のカレントディレクトリの情報を取得する
@@ -383,28 +466,33 @@ void DXArchive::fwrite64(void *Data, s64 Size, FILE *fp)
 	}
 }
 
-// 標準ストリームからデータを読み込む( 64bit版 )
-void DXArchive::fread64(void *Buffer, s64 Size, FILE *fp)
+// 標準ストリームからデータを読み込む( 64bit版、戻り値:実際に読み込めたサイズ )
+s64 DXArchive::fread64(void *Buffer, s64 Size, FILE *fp)
 {
-	int ReadSize;
+	int ReadSize, Result;
 	s64 TotalReadSize;
 
 	TotalReadSize = 0;
 	while (TotalReadSize < Size)
 	{
-		if (Size > 0x7fffffff)
+		if (Size - TotalReadSize > 0x7fffffff)
 		{
 			ReadSize = 0x7fffffff;
 		}
 		else
 		{
-			ReadSize = (int)Size;
+			ReadSize = (int)(Size - TotalReadSize);
 		}
 
-		fread((u8 *)Buffer + TotalReadSize, 1, ReadSize, fp);
+		Result = (int)fread((u8 *)Buffer + TotalReadSize, 1, ReadSize, fp);
+
+		TotalReadSize += Result;
 
-		TotalReadSize += ReadSize;
+		// ファイルの終端に達したら終了
+		if (Result != ReadSize) break;
 	}
+
+	return TotalReadSize;
 }
 
 // データを反転させる関数
@@ -507,6 +595,42 @@ size_t DXArchive::CreateKeyFileString(int CharCodeFormat, const char *KeyString,
 	return StartAddr + CL_strlen(CharCodeFormat, (char *)&FileString[StartAddr]) * GetCharCodeFormatUnitSize(CharCodeFormat);
 }
 
+// 指定のディレクトリにあるファイルの鍵用の文字列のディレクトリ部分を作成する
+void DXArchive::CreateKeyDirectoryString(int CharCodeFormat, DARC_DIRECTORY *Directory, u8 *FileTable, u8 *DirectoryTable, u8 *NameTable, std::string *DirectoryString)
+{
+	const char *Name;
+
+	// CreateKeyFileString と同じ順番でルートディレクトリの手前までのディレクトリ名を繋げる
+	DirectoryString->clear();
+	while (Directory->ParentDirectoryAddress != 0xffffffffffffffff)
+	{
+		Name = (const char *)(NameTable + ((DARC_FILEHEAD *)(FileTable + Directory->DirectoryAddress))->NameAddress + 4);
+		DirectoryString->append(Name, CL_strlen(CharCodeFormat, Name) * GetCharCodeFormatUnitSize(CharCodeFormat));
+		Directory = (DARC_DIRECTORY *)(DirectoryTable + Directory->ParentDirectoryAddress);
+	}
+}
+
+// 作成済みのディレクトリ部分を使用して鍵用の文字列を作成する、戻り値は文字列の長さ( 単位：Byte )( 文字列が長すぎて CreateKeyFileString と結果が変わる場合は 0 )
+size_t DXArchive::CreateKeyFileStringFast(int CharCodeFormat, const char *KeyString, size_t KeyStringBytes, const std::string &DirectoryString, DARC_FILEHEAD *FileHead, u8 *NameTable, u8 *FileString)
+{
+	const char *Name = (const char *)(NameTable + FileHead->NameAddress + 4);
+	size_t UnitSize  = GetCharCodeFormatUnitSize(CharCodeFormat);
+	size_t NameBytes = CL_strlen(CharCodeFormat, Name) * UnitSize;
+
+	if (KeyString == NULL) KeyStringBytes = 0;
+
+	// CreateKeyFileString で途中で切り詰められる長さの場合は作成しない
+	if (KeyStringBytes + NameBytes + DirectoryString.size() + UnitSize * 2 > DXA_KEY_STRING_MAXLENGTH - 8) return 0;
+
+	// パスワード、ファイル名、ディレクトリ名の順番に繋げる
+	memcpy(FileString, KeyString, KeyStringBytes);
+	memcpy(FileString + KeyStringBytes, Name, NameBytes);
+	memcpy(FileString + KeyStringBytes + NameBytes, DirectoryString.data(), DirectoryString.size());
+	memset(FileString + KeyStringBytes + NameBytes + DirectoryString.size(), 0, UnitSize);
+
+	return KeyStringBytes + NameBytes + DirectoryString.size();
+}
+
 // 鍵文字列を作成
 void DXArchive::KeyCreate(const char *Source, size_t SourceBytes, u8 *Key)
 {
@@ -567,16 +691,41 @@ void DXArchive::KeyCreate(const char *Source, size_t SourceBytes, u8 *Key)
 	}
 }
 
+// 暗号化のバージョンから暗号化処理の情報を初期化する( Wolf RPG v3.31 以降の鍵は別途作成する )
+void DXArchive::SetupCryptInfo(DARC_CRYPTINFO *Crypt, u16 CryptVersion, const char *KeyString, size_t KeyStringBytes)
+{
+	memset(Crypt, 0, sizeof(DARC_CRYPTINFO));
+
+	Crypt->CryptVersion = CryptVersion;
+	Crypt->NewCrypt     = (CryptVersion >= 331 && CryptVersion < 1000 || CryptVersion >= 1010);
+	Crypt->ChaCha20     = CryptVersion == 0x64 || CryptVersion == 0xC8;
+
+	memcpy(Crypt->ChaCha20Key, DefaultChaCha20Key, sizeof(Crypt->ChaCha20Key));
+	memcpy(Crypt->ChaCha20Nonce, DefaultChaCha20Nonce, sizeof(Crypt->ChaCha20Nonce));
+
+	if (CryptVersion == 0xC8)
+	{
+		std::array<uint8_t, 4> data;
+		std::array<uint8_t, 64> key;
+
+		std::memcpy(data.data(), (uint8_t *)KeyString + KeyStringBytes + 1, 4);
+		chacha20_keySetup(data, key);
+
+		std::memcpy(Crypt->ChaCha20Key, key.data(), 32);
+		std::memcpy(Crypt->ChaCha20Nonce, key.data() + 34, 12);
+	}
+}
+
 // 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-void DXArchive::KeyConv(void *Data, s64 Size, s64 Position, unsigned char *Key)
+void DXArchive::KeyConv(void *Data, s64 Size, s64 Position, unsigned char *Key, const DARC_CRYPTINFO *Crypt)
 {
-	if (g_newCrypt)
+	if (Crypt != NULL && Crypt->NewCrypt)
 	{
-		wolfCrypt(g_specialKey, reinterpret_cast<uint8_t *>(Data), Position, Position + Size, false, g_cryptVersion);
+		wolfCrypt(Crypt->SpecialKey, reinterpret_cast<uint8_t *>(Data), Position, Position + Size, false, Crypt->CryptVersion);
 		return;
 	}
 
-	if (g_chacha20)
+	if (Crypt != NULL && Crypt->ChaCha20)
 	{
 		uint32_t state[16];
 		uint32_t keystream32[16];
@@ -584,7 +733,7 @@ void DXArchive::KeyConv(void *Data, s64 Size, s64 Position, unsigned char *Key)
 		std::memset(state, 0, sizeof(state));
 		std::memset(keystream32, 0, sizeof(keystream32));
 
-		chacha20_init_block(state, g_cc20Key, g_cc20Nonce);
+		chacha20_init_block(state, Crypt->ChaCha20Key, Crypt->ChaCha20Nonce);
 		chacha20_xor(state, keystream32, static_cast<uint32_t>(Position), reinterpret_cast<uint8_t *>(Data), Size);
 		return;
 	}
@@ -594,38 +743,11 @@ void DXArchive::KeyConv(void *Data, s64 Size, s64 Position, unsigned char *Key)
 		return;
 	}
 
-	Position %= DXA_KEY_BYTES;
-
-	if (Size < 0x100000000)
-	{
-		u32 i, j;
-
-		j = (u32)Position;
-		for (i = 0; i < Size; i++)
-		{
-			((u8 *)Data)[i] ^= Key[j];
-
-			j++;
-			if (j == DXA_KEY_BYTES) j = 0;
-		}
-	}
-	else
-	{
-		s64 i, j;
-
-		j = Position;
-		for (i = 0; i < Size; i++)
-		{
-			((u8 *)Data)[i] ^= Key[j];
-
-			j++;
-			if (j == DXA_KEY_BYTES) j = 0;
-		}
-	}
+	KeyConvXor(Data, Size, Position, Key, DXA_KEY_BYTES);
 }
 
 // データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position)
+void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position)
 {
 	s64 pos = 0;
 
@@ -635,7 +757,7 @@ void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *
 		pos = Position == -1 ? _ftelli64(fp) : Position;
 
 		// データを鍵文字列を使って Xor 演算する
-		KeyConv(Data, Size, pos, Key);
+		KeyConv(Data, Size, pos, Key, Crypt);
 	}
 
 	// 書き出す
@@ -644,12 +766,12 @@ void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *
 	if (Key != NULL)
 	{
 		// 再び Xor 演算
-		KeyConv(Data, Size, pos, Key);
+		KeyConv(Data, Size, pos, Key, Crypt);
 	}
 }
 
 // ファイルから読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-void DXArchive::KeyConvFileRead(void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position)
+void DXArchive::KeyConvFileRead(void *Data, s64 Size, FILE *fp, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position)
 {
 	s64 pos = 0;
 
@@ -665,20 +787,262 @@ void DXArchive::KeyConvFileRead(void *Data, s64 Size, FILE *fp, unsigned char *K
 	if (Key != NULL)
 	{
 		// データを鍵文字列を使って Xor 演算
-		KeyConv(Data, Size, pos, Key);
+		KeyConv(Data, Size, pos, Key, Crypt);
+	}
+}
+
+// 展開処理用の読み込み元から読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない、戻り値:実際に読み込めたサイズ )
+s64 DXArchive::KeyConvSourceRead(void *Data, s64 Size, DARC_SOURCE *Src, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position)
+{
+	s64 pos = 0, ReadSize;
+
+	if (Key != NULL)
+	{
+		// 読み込み位置を取得しておく
+		pos = Position == -1 ? SourceTell(Src) : Position;
+	}
+
+	// 読み込む
+	ReadSize = SourceRead(Src, Data, Size);
+
+	if (Key != NULL)
+	{
+		// データを鍵文字列を使って Xor 演算
+		KeyConv(Data, Size, pos, Key, Crypt);
+	}
+
+	return ReadSize;
+}
+
+// 展開処理用の読み込み元の指定の位置から読み込んだデータを鍵文字列を使用して Xor 演算する関数( 読み込み位置は変更しない、Position が -1 の場合は SourcePosition を鍵の位置とする、戻り値:実際に読み込めたサイズ )
+s64 DXArchive::KeyConvSourceReadAt(void *Data, s64 Size, DARC_SOURCE *Src, s64 SourcePosition, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position)
+{
+	s64 ReadSize;
+
+	// 読み込む
+	ReadSize = SourceReadAt(Src, SourcePosition, Data, Size);
+
+	if (Key != NULL)
+	{
+		// データを鍵文字列を使って Xor 演算
+		KeyConv(Data, Size, Position == -1 ? SourcePosition : Position, Key, Crypt);
+	}
+
+	return ReadSize;
+}
+
+// 展開処理用の読み込み元からデータを読み込む( 戻り値:実際に読み込めたサイズ、Size に満たない場合は読み込み元が途中で終わっている )
+s64 DXArchive::SourceRead(DARC_SOURCE *Src, void *Buffer, s64 Size)
+{
+	s64 CopySize, Position;
+
+	// ファイルから読み込む場合は普通に読み込む
+	if (Src->Image == NULL)
+	{
+		Position = Src->ImageCrypt != NULL ? _ftelli64(Src->fp) : 0;
+		CopySize = fread64(Buffer, Size, Src->fp);
+		SourceImageDecrypt(Src, Position, Buffer, CopySize);
+		return CopySize;
+	}
+
+	// イメージの終端を越える部分は０で埋めて、読み込めたサイズを返す
+	CopySize = Src->ImageSize - Src->Position;
+	if (CopySize > Size) CopySize = Size;
+	if (CopySize < 0) CopySize = 0;
+
+	memcpy(Buffer, Src->Image + Src->Position, (size_t)CopySize);
+	if (CopySize < Size) memset((u8 *)Buffer + CopySize, 0, (size_t)(Size - CopySize));
+	SourceImageDecrypt(Src, Src->Position, Buffer, CopySize);
+
+	Src->Position += Size;
+
+	return CopySize;
+}
+
+// 展開処理用の読み込み元の指定の位置からデータを読み込む( 読み込み位置は変更しない、複数のスレッドから同時に呼んで良いのは SourceReadAt 同士のみ )
+s64 DXArchive::SourceReadAt(DARC_SOURCE *Src, s64 Position, void *Buffer, s64 Size)
+{
+	s64 CopySize, OldPosition;
+
+	// ファイルから読み込む場合は他のスレッドに割り込まれないようにロックしてから読み込み、読み込み位置を元に戻す
+	// ( ロックの外で SourceRead や SourceSeek を同時に呼ばれた場合の読み込み位置は保証できない )
+	if (Src->Image == NULL)
+	{
+		_lock_file(Src->fp);
+		OldPosition = _ftelli64(Src->fp);
+		_fseeki64(Src->fp, Position, SEEK_SET);
+		CopySize = fread64(Buffer, Size, Src->fp);
+		_fseeki64(Src->fp, OldPosition, SEEK_SET);
+		_unlock_file(Src->fp);
+		SourceImageDecrypt(Src, Position, Buffer, CopySize);
+		return CopySize;
+	}
+
+	// イメージの終端を越える部分は０で埋めて、読み込めたサイズを返す
+	CopySize = Src->ImageSize - Position;
+	if (CopySize > Size) CopySize = Size;
+	if (CopySize < 0) CopySize = 0;
+
+	memcpy(Buffer, Src->Image + Position, (size_t)CopySize);
+	if (CopySize < Size) memset((u8 *)Buffer + CopySize, 0, (size_t)(Size - CopySize));
+	SourceImageDecrypt(Src, Position, Buffer, CopySize);
+
+	return CopySize;
+}
+
+// 展開処理用の読み込み元から読み込んだデータに掛かっているアーカイブ全体の暗号化を解除する( Position は Buffer の先頭のアーカイブ上の位置 )
+void DXArchive::SourceImageDecrypt(const DARC_SOURCE *Src, s64 Position, void *Buffer, s64 Size)
+{
+	const DARC_IMAGECRYPT *ImageCrypt = Src->ImageCrypt;
+	s64 Start, End;
+
+	if (ImageCrypt == NULL || Size <= 0) return;
+
+	// 鍵で暗号化されている部分は読み込んだ位置の鍵で Xor 演算する
+	Start = std::max(Position, ImageCrypt->CryptStart);
+	End   = std::min(Position + Size, ImageCrypt->CryptEnd);
+	if (Start < End)
+	{
+		wolfCrypt(ImageCrypt->Key, (u8 *)Buffer + (Start - Position), Start, End, false, ImageCrypt->CryptVersion);
+	}
+
+	// AES でも暗号化されている部分は開く時に暗号化を解除しておいたデータに置き換える
+	Start = std::max(Position, ImageCrypt->BodyStart);
+	End   = std::min(Position + Size, ImageCrypt->BodyStart + (s64)ImageCrypt->Body.size());
+	if (Start < End)
+	{
+		memcpy((u8 *)Buffer + (Start - Position), ImageCrypt->Body.data() + (Start - ImageCrypt->BodyStart), (size_t)(End - Start));
+	}
+
+	Start = std::max(Position, ImageCrypt->TableStart);
+	End   = std::min(Position + Size, ImageCrypt->TableStart + (s64)ImageCrypt->Table.size());
+	if (Start < End)
+	{
+		memcpy((u8 *)Buffer + (Start - Position), ImageCrypt->Table.data() + (Start - ImageCrypt->TableStart), (size_t)(End - Start));
 	}
 }
 
-// 指定のディレクトリにあるファイルをアーカイブデータに吐き出す
-int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ENCODEINFO *EncodeInfo)
+// 展開処理用の読み込み元の読み込み位置を変更する
+void DXArchive::SourceSeek(DARC_SOURCE *Src, s64 Position)
+{
+	if (Src->Image == NULL)
+	{
+		_fseeki64(Src->fp, Position, SEEK_SET);
+	}
+	else
+	{
+		Src->Position = Position;
+	}
+}
+
+// 展開処理用の読み込み元の読み込み位置を取得する
+s64 DXArchive::SourceTell(DARC_SOURCE *Src)
+{
+	return Src->Image == NULL ? _ftelli64(Src->fp) : Src->Position;
+}
+
+// 展開処理用の読み込み元のサイズを取得する
+s64 DXArchive::SourceSize(DARC_SOURCE *Src)
+{
+	s64 Pos, Size;
+
+	if (Src->Image != NULL) return Src->ImageSize;
+
+	Pos = _ftelli64(Src->fp);
+	_fseeki64(Src->fp, 0, SEEK_END);
+	Size = _ftelli64(Src->fp);
+	_fseeki64(Src->fp, Pos, SEEK_SET);
+
+	return Size;
+}
+
+// 展開処理用の作業領域から指定サイズのメモリ領域を得る( 足りない場合は拡張する、失敗した場合は NULL )
+void *DXArchive::ScratchAlloc(DARC_SCRATCH *Scratch, u64 Size)
+{
+	// 今までのサイズで足りる場合はそのまま使う
+	if (Scratch->Buffer != NULL && Scratch->Size >= Size)
+		return Scratch->Buffer;
+
+	// 前の内容は必要ないので、解放してから確保しなおす
+	free(Scratch->Buffer);
+	Scratch->Size   = 0;
+	Scratch->Buffer = malloc((size_t)(Size == 0 ? 1 : Size));
+	if (Scratch->Buffer == NULL) return NULL;
+	Scratch->Size = Size;
+
+	return Scratch->Buffer;
+}
+
+// 展開処理用の作業領域を解放する
+void DXArchive::ScratchRelease(DARC_SCRATCH *Scratch)
+{
+	free(Scratch->Buffer);
+	Scratch->Buffer = NULL;
+	Scratch->Size   = 0;
+}
+
+// ファイルを読み込み専用でメモリにマップする( 0:成功  -1:失敗 )
+int DXArchive::MapArchiveFile(DARC_FILEMAP *Map, const TCHAR *Path)
+{
+	LARGE_INTEGER Size;
+
+	Map->FileHandle = INVALID_HANDLE_VALUE;
+	Map->MapHandle  = NULL;
+	Map->Image      = NULL;
+	Map->Size       = 0;
+
+	// ファイルを開く
+	Map->FileHandle = CreateFile(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (Map->FileHandle == INVALID_HANDLE_VALUE) goto ERR;
+
+	// サイズが０のファイルはマップできない
+	if (GetFileSizeEx(Map->FileHandle, &Size) == FALSE || Size.QuadPart <= 0) goto ERR;
+
+	// アドレス空間に収まらない場合はマップしない
+	if ((u64)Size.QuadPart > (u64)(size_t)-1) goto ERR;
+
+	// ファイル全体をマップする
+	Map->MapHandle = CreateFileMapping(Map->FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (Map->MapHandle == NULL) goto ERR;
+
+	Map->Image = (const u8 *)MapViewOfFile(Map->MapHandle, FILE_MAP_READ, 0, 0, 0);
+	if (Map->Image == NULL) goto ERR;
+
+	Map->Size = Size.QuadPart;
+
+	// 終了
+	return 0;
+
+ERR:
+	UnmapArchiveFile(Map);
+
+	// 終了
+	return -1;
+}
+
+// メモリにマップしたファイルを解放する
+void DXArchive::UnmapArchiveFile(DARC_FILEMAP *Map)
+{
+	if (Map->Image != NULL) UnmapViewOfFile(Map->Image);
+	if (Map->MapHandle != NULL) CloseHandle(Map->MapHandle);
+	if (Map->FileHandle != NULL && Map->FileHandle != INVALID_HANDLE_VALUE) CloseHandle(Map->FileHandle);
+
+	Map->FileHandle = INVALID_HANDLE_VALUE;
+	Map->MapHandle  = NULL;
+	Map->Image      = NULL;
+	Map->Size       = 0;
+}
+
+// 指定のディレクトリにあるファイルの情報をアーカイブのテーブルに書き出し、ファイルデータの処理情報を列に追加する
+int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, std::vector<DARC_ENCODEJOB> *JobList)
 {
 	TCHAR DirPath[MAX_PATH];
+	TCHAR SrcPath[MAX_PATH];
 	WIN32_FIND_DATA FindData;
 	HANDLE FindHandle;
 	DARC_DIRECTORY Dir;
 	DARC_DIRECTORY *DirectoryP;
 	DARC_FILEHEAD File;
-	u8 lKey[DXA_KEY_BYTES];
 	size_t KeyStringBufferBytes;
 
 	// ディレクトリの情報を得る
@@ -764,655 +1128,1069 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 			if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
 			{
 				// ディレクトリだった場合の処理
-				if (DirectoryEncode(CharCodeFormat, FindData.cFileName, NameP, DirP, FileP, &Dir, Size, i, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, EncodeInfo) < 0) return -1;
+				if (DirectoryEncode(CharCodeFormat, FindData.cFileName, NameP, DirP, FileP, &Dir, Size, i, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, JobList) < 0) return -1;
 			}
 			else
 			{
 				// ファイルだった場合の処理
+				DARC_ENCODEJOB Job;
 
-				// ファイルのデータをセット
+				// ファイルのデータをセット( データの位置と圧縮後のサイズは書き出す時にセットする )
 				File.NameAddress       = Size->NameSize;
 				File.Time.Create       = (((LONGLONG)FindData.ftCreationTime.dwHighDateTime) << 32) + FindData.ftCreationTime.dwLowDateTime;
 				File.Time.LastAccess   = (((LONGLONG)FindData.ftLastAccessTime.dwHighDateTime) << 32) + FindData.ftLastAccessTime.dwLowDateTime;
 				File.Time.LastWrite    = (((LONGLONG)FindData.ftLastWriteTime.dwHighDateTime) << 32) + FindData.ftLastWriteTime.dwLowDateTime;
 				File.Attributes        = FindData.dwFileAttributes;
-				File.DataAddress       = Size->DataSize;
+				File.DataAddress       = 0;
 				File.DataSize          = (((LONGLONG)FindData.nFileSizeHigh) << 32) + FindData.nFileSizeLow;
 				File.PressDataSize     = 0xffffffffffffffff;
 				File.HuffPressDataSize = 0xffffffffffffffff;
 
-				// 進行状況出力
-				if (EncodeInfo->OutputStatus)
-				{
-					// 処理ファイル名をセット
-					wcscpy(EncodeInfo->ProcessFileName, FindData.cFileName);
-
-					// ファイル数を増やす
-					EncodeInfo->CompFileNum++;
-
-					// 表示
-					EncodeStatusOutput(EncodeInfo);
-				}
-
 				// ファイル名を書き出す
 				Size->NameSize += AddFileNameData(FindData.cFileName, NameP + Size->NameSize);
 
+				// ファイルヘッダを書き出す
+				memcpy(FileP + Dir.FileHeadAddress + sizeof(DARC_FILEHEAD) * i, &File, sizeof(DARC_FILEHEAD));
+
+				// ファイル単位の処理情報をセット( 処理時にはカレントディレクトリが変わっているのでフルパスにしておく )
+				GetFullPathName(FindData.cFileName, MAX_PATH, SrcPath, NULL);
+				Job.File            = File;
+				Job.FileHeadAddress = Dir.FileHeadAddress + sizeof(DARC_FILEHEAD) * i;
+				Job.SrcPath         = SrcPath;
+				Job.FileName        = FindData.cFileName;
+				Job.Buffer          = NULL;
+				Job.Data            = NULL;
+				Job.WriteSize       = 0;
+				Job.Result          = 0;
+				Job.Done            = false;
+
 				// ファイル個別の鍵を作成
 				if (NoKey == false)
 				{
 					KeyStringBufferBytes = CreateKeyFileString(CharCodeFormat, KeyString, KeyStringBytes, DirectoryP, &File, FileP, DirP, NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
+					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, Job.Key);
 				}
 
-				// ファイルデータを書き出す
-				if (File.DataSize != 0)
-				{
-					FILE *SrcP;
-					u64 FileSize, WriteSize, MoveSize;
-					bool Huffman     = false;
-					bool AlwaysPress = false;
+				// 処理情報の列に追加
+				JobList->push_back(Job);
+			}
 
-					// ファイルを開く
-					SrcP = _tfopen(FindData.cFileName, TEXT("rb"));
+			i++;
+		} while (FindNextFile(FindHandle, &FindData) != 0);
 
-					// サイズを得る
-					_fseeki64(SrcP, 0, SEEK_END);
-					FileSize = _ftelli64(SrcP);
-					_fseeki64(SrcP, 0, SEEK_SET);
+		// Find ハンドルを閉じる
+		FindClose(FindHandle);
+	}
 
-					// 圧縮の対象となるファイルフォーマットか調べる
-					{
-						u32 Len;
-						Len = (u32)_tcslen(FindData.cFileName);
-						if (Len > 4)
-						{
-							TCHAR *sp;
-
-							sp = &FindData.cFileName[Len - 3];
-							if (StrICmp(sp, TEXT("wav")) == 0 ||
-								StrICmp(sp, TEXT("jpg")) == 0 ||
-								StrICmp(sp, TEXT("png")) == 0 ||
-								StrICmp(sp, TEXT("mpg")) == 0 ||
-								StrICmp(sp, TEXT("mp3")) == 0 ||
-								StrICmp(sp, TEXT("mp4")) == 0 ||
-								StrICmp(sp, TEXT("m4a")) == 0 ||
-								StrICmp(sp, TEXT("ogg")) == 0 ||
-								StrICmp(sp, TEXT("ogv")) == 0 ||
-								StrICmp(sp, TEXT("ops")) == 0 ||
-								StrICmp(sp, TEXT("wmv")) == 0 ||
-								StrICmp(sp, TEXT("tif")) == 0 ||
-								StrICmp(sp, TEXT("tga")) == 0 ||
-								StrICmp(sp, TEXT("bmp")) == 0 ||
-								StrICmp(sp - 1, TEXT("jpeg")) == 0)
-							{
-								Huffman = true;
-							}
+	// もとのディレクトリをカレントディレクトリにセット
+	SetCurrentDirectory(DirPath);
 
-							// wav や bmp の場合は必ず圧縮する
-							if (StrICmp(sp, TEXT("wav")) == 0 ||
-								StrICmp(sp, TEXT("tga")) == 0 ||
-								StrICmp(sp, TEXT("bmp")) == 0)
-							{
-								AlwaysPress = true;
-							}
-						}
-					}
+	// 終了
+	return 0;
+}
 
-					// AlwaysHuffman が true の場合は必ずハフマン圧縮する
-					if (AlwaysHuffman)
-					{
-						Huffman = true;
-					}
+// ファイルを一つ圧縮し、鍵を適用した書き出すデータを作成する( 無圧縮の場合は Job->Buffer を NULL にして、書き出し時にファイルから転送する )
+// EncodeInfo が NULL 以外の場合は進行状況を出力する
+int DXArchive::FileEncode(DARC_ENCODEJOB *Job, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, bool NoKey, const DARC_CRYPTINFO *Crypt, DARC_ENCODEINFO *EncodeInfo)
+{
+	DARC_FILEHEAD *File = &Job->File;
+	FILE *SrcP;
+	u64 FileSize, WriteSize;
+	bool Huffman     = false;
+	bool AlwaysPress = false;
+
+	Job->Buffer    = NULL;
+	Job->Data      = NULL;
+	Job->WriteSize = 0;
+
+	// データが無い場合は何もしない
+	if (File->DataSize == 0)
+	{
+		return 0;
+	}
 
-					// ハフマン圧縮するサイズが 0 の場合はハフマン圧縮を行わない
-					if (HuffmanEncodeKB == 0)
-					{
-						Huffman = false;
-					}
+	// ファイルを開く
+	SrcP = _tfopen(Job->SrcPath.c_str(), TEXT("rb"));
+	if (SrcP == NULL) return -1;
 
-					// 圧縮の指定がある場合で、
-					// 必ず圧縮するファイルフォーマットか、ファイルサイズが 10MB 以下の場合は圧縮を試みる
-					if (Press == true && (AlwaysPress || File.DataSize < 10 * 1024 * 1024))
-					{
-						void *SrcBuf, *DestBuf;
-						u32 DestSize, Len;
+	// サイズを得る
+	_fseeki64(SrcP, 0, SEEK_END);
+	FileSize = _ftelli64(SrcP);
+	_fseeki64(SrcP, 0, SEEK_SET);
 
-						// 一部のファイル形式の場合は予め弾く
-						if (AlwaysPress == false && (Len = (int)_tcslen(FindData.cFileName)) > 4)
-						{
-							TCHAR *sp;
-
-							sp = &FindData.cFileName[Len - 3];
-							if (StrICmp(sp, TEXT("wav")) == 0 ||
-								StrICmp(sp, TEXT("jpg")) == 0 ||
-								StrICmp(sp, TEXT("png")) == 0 ||
-								StrICmp(sp, TEXT("mpg")) == 0 ||
-								StrICmp(sp, TEXT("mp3")) == 0 ||
-								StrICmp(sp, TEXT("mp4")) == 0 ||
-								StrICmp(sp, TEXT("ogg")) == 0 ||
-								StrICmp(sp, TEXT("ogv")) == 0 ||
-								StrICmp(sp, TEXT("ops")) == 0 ||
-								StrICmp(sp, TEXT("wmv")) == 0 ||
-								StrICmp(sp - 1, TEXT("jpeg")) == 0) goto NOPRESS;
-						}
+	// 圧縮の対象となるファイルフォーマットか調べる
+	{
+		u32 Len;
+		Len = (u32)Job->FileName.length();
+		if (Len > 4)
+		{
+			const TCHAR *sp;
+
+			sp = &Job->FileName.c_str()[Len - 3];
+			if (StrICmp(sp, TEXT("wav")) == 0 ||
+				StrICmp(sp, TEXT("jpg")) == 0 ||
+				StrICmp(sp, TEXT("png")) == 0 ||
+				StrICmp(sp, TEXT("mpg")) == 0 ||
+				StrICmp(sp, TEXT("mp3")) == 0 ||
+				StrICmp(sp, TEXT("mp4")) == 0 ||
+				StrICmp(sp, TEXT("m4a")) == 0 ||
+				StrICmp(sp, TEXT("ogg")) == 0 ||
+				StrICmp(sp, TEXT("ogv")) == 0 ||
+				StrICmp(sp, TEXT("ops")) == 0 ||
+				StrICmp(sp, TEXT("wmv")) == 0 ||
+				StrICmp(sp, TEXT("tif")) == 0 ||
+				StrICmp(sp, TEXT("tga")) == 0 ||
+				StrICmp(sp, TEXT("bmp")) == 0 ||
+				StrICmp(sp - 1, TEXT("jpeg")) == 0)
+			{
+				Huffman = true;
+			}
 
-						// データが丸ごと入るメモリ領域の確保
-						SrcBuf  = malloc((size_t)(FileSize + FileSize * 2 + 64));
-						DestBuf = (u8 *)SrcBuf + FileSize;
+			// wav や bmp の場合は必ず圧縮する
+			if (StrICmp(sp, TEXT("wav")) == 0 ||
+				StrICmp(sp, TEXT("tga")) == 0 ||
+				StrICmp(sp, TEXT("bmp")) == 0)
+			{
+				AlwaysPress = true;
+			}
+		}
+	}
 
-						// ファイルを丸ごと読み込む
-						fread64(SrcBuf, FileSize, SrcP);
+	// AlwaysHuffman が true の場合は必ずハフマン圧縮する
+	if (AlwaysHuffman)
+	{
+		Huffman = true;
+	}
 
-						// 圧縮する場合は強制的に進行状況出力を更新
-						if (EncodeInfo->OutputStatus)
-						{
-							EncodeStatusOutput(EncodeInfo, true);
-						}
-
-						// 圧縮
-						DestSize = Encode(SrcBuf, (u32)FileSize, DestBuf, EncodeInfo->OutputStatus, MaxPress);
-
-						// 殆ど圧縮出来なかった場合は圧縮無しでアーカイブする
-						if (AlwaysPress == false && ((f64)DestSize / (f64)FileSize > 0.90))
-						{
-							_fseeki64(SrcP, 0L, SEEK_SET);
-							free(SrcBuf);
-							goto NOPRESS;
-						}
-
-						// 圧縮データのサイズを保存する
-						File.PressDataSize = DestSize;
-
-						// ハフマン圧縮も行うかどうかで処理を分岐
-						if (Huffman)
-						{
-							u8 *HuffData;
-
-							// ハフマン圧縮するサイズによって処理を分岐
-							if (HuffmanEncodeKB == 0xff || DestSize <= (u64)(HuffmanEncodeKB * 1024 * 2))
-							{
-								// ハフマン圧縮用のメモリ領域を確保
-								HuffData = (u8 *)calloc(1, DestSize * 2 + 256 * 2 + 32);
-
-								// ファイル全体をハフマン圧縮
-								File.HuffPressDataSize = Huffman_Encode(DestBuf, DestSize, HuffData);
-
-								// 圧縮データに鍵を適用して書き出す
-								WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
-							}
-							else
-							{
-								// ハフマン圧縮用のメモリ領域を確保
-								HuffData = (u8 *)calloc(1, HuffmanEncodeKB * 1024 * 2 * 4 + 256 * 2 + 32);
-
-								// ファイルの前後をハフマン圧縮
-								memcpy(HuffData, DestBuf, HuffmanEncodeKB * 1024);
-								memcpy(HuffData + HuffmanEncodeKB * 1024, (u8 *)DestBuf + DestSize - HuffmanEncodeKB * 1024, HuffmanEncodeKB * 1024);
-								File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
-
-								// ハフマン圧縮した部分を書き出す
-								KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+	// ハフマン圧縮するサイズが 0 の場合はハフマン圧縮を行わない
+	if (HuffmanEncodeKB == 0)
+	{
+		Huffman = false;
+	}
 
-								// ハフマン圧縮していない箇所を書き出す
-								WriteSize = File.HuffPressDataSize + DestSize - HuffmanEncodeKB * 1024 * 2;
-								WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite((u8 *)DestBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
-							}
+	// 圧縮の指定がある場合で、
+	// 必ず圧縮するファイルフォーマットか、ファイルサイズが 10MB 以下の場合は圧縮を試みる
+	if (Press == true && (AlwaysPress || File->DataSize < 10 * 1024 * 1024))
+	{
+		void *SrcBuf, *DestBuf;
+		s32 DestSize;
+		u32 Len;
 
-							// メモリの解放
-							free(HuffData);
-						}
-						else
-						{
-							// 圧縮データを反転して書き出す
-							WriteSize = (DestSize + 3) / 4 * 4;
-							KeyConvFileWrite(DestBuf, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
-						}
+		// 一部のファイル形式の場合は予め弾く
+		if (AlwaysPress == false && (Len = (u32)Job->FileName.length()) > 4)
+		{
+			const TCHAR *sp;
+
+			sp = &Job->FileName.c_str()[Len - 3];
+			if (StrICmp(sp, TEXT("wav")) == 0 ||
+				StrICmp(sp, TEXT("jpg")) == 0 ||
+				StrICmp(sp, TEXT("png")) == 0 ||
+				StrICmp(sp, TEXT("mpg")) == 0 ||
+				StrICmp(sp, TEXT("mp3")) == 0 ||
+				StrICmp(sp, TEXT("mp4")) == 0 ||
+				StrICmp(sp, TEXT("ogg")) == 0 ||
+				StrICmp(sp, TEXT("ogv")) == 0 ||
+				StrICmp(sp, TEXT("ops")) == 0 ||
+				StrICmp(sp, TEXT("wmv")) == 0 ||
+				StrICmp(sp - 1, TEXT("jpeg")) == 0) goto NOPRESS;
+		}
 
-						// メモリの解放
-						free(SrcBuf);
-					}
-					else
-					{
-					NOPRESS:
-						// ハフマン圧縮も行うかどうかで処理を分岐
-						if (Press && Huffman)
-						{
-							u8 *SrcBuf, *HuffData;
+		// データが丸ごと入るメモリ領域の確保( ４の倍数に合わせた分の余白も含めて０で初期化する )
+		SrcBuf = calloc(1, (size_t)(FileSize + FileSize * 2 + 64));
+		if (SrcBuf == NULL) goto NOPRESS;
+		DestBuf = (u8 *)SrcBuf + FileSize;
 
-							// データが丸ごと入るメモリ領域の確保
-							SrcBuf = (u8 *)calloc(1, (size_t)(FileSize + 32));
+		// ファイルを丸ごと読み込む
+		fread64(SrcBuf, FileSize, SrcP);
 
-							// ファイルを丸ごと読み込む
-							fread64(SrcBuf, FileSize, SrcP);
+		// 圧縮する場合は強制的に進行状況出力を更新
+		if (EncodeInfo != NULL && EncodeInfo->OutputStatus)
+		{
+			EncodeStatusOutput(EncodeInfo, true);
+		}
 
-							// ハフマン圧縮するサイズによって処理を分岐
-							if (HuffmanEncodeKB == 0xff || FileSize <= HuffmanEncodeKB * 1024 * 2)
-							{
-								// ハフマン圧縮用のメモリ領域を確保
-								HuffData = (u8 *)calloc(1, (size_t)(FileSize * 2 + 256 * 2 + 32));
+		// 圧縮
+		DestSize = Encode(SrcBuf, (u32)FileSize, DestBuf, EncodeInfo != NULL && EncodeInfo->OutputStatus, MaxPress);
 
-								// ファイル全体をハフマン圧縮
-								File.HuffPressDataSize = Huffman_Encode(SrcBuf, FileSize, HuffData);
+		// 圧縮に失敗したか、殆ど圧縮出来なかった場合は圧縮無しでアーカイブする
+		if (DestSize < 0 || (AlwaysPress == false && (f64)DestSize / (f64)FileSize > 0.90))
+		{
+			_fseeki64(SrcP, 0L, SEEK_SET);
+			free(SrcBuf);
+			goto NOPRESS;
+		}
 
-								// 圧縮データに鍵を適用して書き出す
-								WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
-							}
-							else
-							{
-								// ハフマン圧縮用のメモリ領域を確保
-								HuffData = (u8 *)calloc(1, HuffmanEncodeKB * 1024 * 2 * 4 + 256 * 2 + 32);
+		// 圧縮データのサイズを保存する
+		File->PressDataSize = DestSize;
 
-								// ファイルの前後をハフマン圧縮
-								memcpy(HuffData, SrcBuf, HuffmanEncodeKB * 1024);
-								memcpy(HuffData + HuffmanEncodeKB * 1024, SrcBuf + FileSize - HuffmanEncodeKB * 1024, HuffmanEncodeKB * 1024);
-								File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
+		// ハフマン圧縮も行うかどうかで処理を分岐
+		if (Huffman)
+		{
+			u8 *HuffData;
 
-								// ハフマン圧縮した部分を書き出す
-								KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+			// ハフマン圧縮するサイズによって処理を分岐
+			if (HuffmanEncodeKB == 0xff || (u64)DestSize <= (u64)(HuffmanEncodeKB * 1024 * 2))
+			{
+				// ハフマン圧縮用のメモリ領域を確保
+				HuffData = (u8 *)calloc(1, DestSize * 2 + 256 * 2 + 32);
 
-								// ハフマン圧縮していない箇所を書き出す
-								WriteSize = File.HuffPressDataSize + FileSize - HuffmanEncodeKB * 1024 * 2;
-								WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite(SrcBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
-							}
+				// ファイル全体をハフマン圧縮
+				File->HuffPressDataSize = Huffman_Encode(DestBuf, DestSize, HuffData);
 
-							// メモリの解放
-							free(SrcBuf);
-							free(HuffData);
-						}
-						else
-						{
-							// 転送開始
-							WriteSize = 0;
-							while (WriteSize < FileSize)
-							{
-								// 転送サイズ決定
-								MoveSize = DXA_BUFFERSIZE < FileSize - WriteSize ? DXA_BUFFERSIZE : FileSize - WriteSize;
-								MoveSize = (MoveSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+				// 圧縮データに鍵を適用する
+				WriteSize = (File->HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+				if (NoKey == false) KeyConv(HuffData, WriteSize, File->DataSize, Job->Key, Crypt);
 
-								// ファイルの鍵適用読み込み
-								memset(TempBuffer, 0, (size_t)MoveSize);
-								KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : lKey, File.DataSize + WriteSize);
+				Job->Buffer = HuffData;
+				Job->Data   = HuffData;
+			}
+			else
+			{
+				u8 *Data;
 
-								// 書き出し
-								fwrite64(TempBuffer, MoveSize, DestFp);
+				// ハフマン圧縮用のメモリ領域を確保
+				HuffData = (u8 *)calloc(1, HuffmanEncodeKB * 1024 * 2 * 4 + 256 * 2 + 32);
 
-								// 書き出しサイズの加算
-								WriteSize += MoveSize;
-							}
-						}
-					}
+				// ファイルの前後をハフマン圧縮
+				memcpy(HuffData, DestBuf, HuffmanEncodeKB * 1024);
+				memcpy(HuffData + HuffmanEncodeKB * 1024, (u8 *)DestBuf + DestSize - HuffmanEncodeKB * 1024, HuffmanEncodeKB * 1024);
+				File->HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
 
-					// 書き出したファイルを閉じる
-					fclose(SrcP);
+				// ハフマン圧縮した部分の後にハフマン圧縮していない箇所を続ける
+				WriteSize = File->HuffPressDataSize + DestSize - HuffmanEncodeKB * 1024 * 2;
+				WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+				Data      = (u8 *)malloc((size_t)WriteSize);
+				memcpy(Data, HuffData + HuffmanEncodeKB * 1024 * 2, (size_t)File->HuffPressDataSize);
+				memcpy(Data + File->HuffPressDataSize, (u8 *)DestBuf + HuffmanEncodeKB * 1024, (size_t)(WriteSize - File->HuffPressDataSize));
 
-					// データサイズの加算
-					Size->DataSize += WriteSize;
+				// それぞれに鍵を適用する
+				if (NoKey == false)
+				{
+					KeyConv(Data, File->HuffPressDataSize, File->DataSize, Job->Key, Crypt);
+					KeyConv(Data + File->HuffPressDataSize, WriteSize - File->HuffPressDataSize, File->DataSize + File->HuffPressDataSize, Job->Key, Crypt);
 				}
 
-				// ファイルヘッダを書き出す
-				memcpy(FileP + Dir.FileHeadAddress + sizeof(DARC_FILEHEAD) * i, &File, sizeof(DARC_FILEHEAD));
+				// メモリの解放
+				free(HuffData);
+
+				Job->Buffer = Data;
+				Job->Data   = Data;
 			}
 
-			i++;
-		} while (FindNextFile(FindHandle, &FindData) != 0);
+			// メモリの解放
+			free(SrcBuf);
+		}
+		else
+		{
+			// 圧縮データに鍵を適用する
+			WriteSize = (DestSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+			if (NoKey == false) KeyConv(DestBuf, WriteSize, File->DataSize, Job->Key, Crypt);
 
-		// Find ハンドルを閉じる
-		FindClose(FindHandle);
+			Job->Buffer = SrcBuf;
+			Job->Data   = (u8 *)DestBuf;
+		}
 	}
+	else
+	{
+	NOPRESS:
+		// ハフマン圧縮も行うかどうかで処理を分岐
+		if (Press && Huffman)
+		{
+			u8 *SrcBuf, *HuffData;
 
-	// もとのディレクトリをカレントディレクトリにセット
-	SetCurrentDirectory(DirPath);
-
-	// 終了
-	return 0;
-}
-
-// 指定のディレクトリデータにあるファイルを展開する
-int DXArchive::DirectoryDecode(u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, FILE *ArcP, unsigned char *Key, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer)
-{
-	TCHAR DirPath[MAX_PATH];
-
-	// 現在のカレントディレクトリを保存
-	GetCurrentDirectory(MAX_PATH, DirPath);
+			// データが丸ごと入るメモリ領域の確保
+			SrcBuf = (u8 *)calloc(1, (size_t)(FileSize + 32));
 
-	// ディレクトリ情報がある場合は、まず展開用のディレクトリを作成する
-	if (Dir->DirectoryAddress != 0xffffffffffffffff && Dir->ParentDirectoryAddress != 0xffffffffffffffff)
-	{
-		DARC_FILEHEAD *DirFile;
+			// ファイルを丸ごと読み込む
+			fread64(SrcBuf, FileSize, SrcP);
 
-		// DARC_FILEHEAD のアドレスを取得
-		DirFile = (DARC_FILEHEAD *)(FileP + Dir->DirectoryAddress);
+			// ハフマン圧縮するサイズによって処理を分岐
+			if (HuffmanEncodeKB == 0xff || FileSize <= HuffmanEncodeKB * 1024 * 2)
+			{
+				// ハフマン圧縮用のメモリ領域を確保
+				HuffData = (u8 *)calloc(1, (size_t)(FileSize * 2 + 256 * 2 + 32));
 
-		// ディレクトリの作成
-		TCHAR *pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		CreateDirectory(pName, NULL);
-		delete[] pName;
+				// ファイル全体をハフマン圧縮
+				File->HuffPressDataSize = Huffman_Encode(SrcBuf, FileSize, HuffData);
 
-		// そのディレクトリにカレントディレクトリを移す
-		pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		SetCurrentDirectory(pName);
-		delete[] pName;
-	}
+				// 圧縮データに鍵を適用する
+				WriteSize = (File->HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+				if (NoKey == false) KeyConv(HuffData, WriteSize, File->DataSize, Job->Key, Crypt);
 
-	// 展開処理開始
-	{
-		u32 i, FileHeadSize;
-		DARC_FILEHEAD *File;
-		size_t KeyStringBufferBytes;
-		unsigned char lKey[DXA_KEY_BYTES];
+				// メモリの解放
+				free(SrcBuf);
 
-		// 格納されているファイルの数だけ繰り返す
-		FileHeadSize = sizeof(DARC_FILEHEAD);
-		File         = (DARC_FILEHEAD *)(FileP + Dir->FileHeadAddress);
-		for (i = 0; i < Dir->FileHeadNum; i++, File = (DARC_FILEHEAD *)((u8 *)File + FileHeadSize))
-		{
-			// ディレクトリかどうかで処理を分岐
-			if (File->Attributes & FILE_ATTRIBUTE_DIRECTORY)
-			{
-				// ディレクトリの場合は再帰をかける
-				DirectoryDecode(NameP, DirP, FileP, Head, (DARC_DIRECTORY *)(DirP + File->DataAddress), ArcP, Key, KeyString, KeyStringBytes, NoKey, KeyStringBuffer);
+				Job->Buffer = HuffData;
+				Job->Data   = HuffData;
 			}
 			else
 			{
-				FILE *DestP;
-				void *Buffer;
-
-				// ファイルを開く
-				TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
+				u8 *Data;
 
-				if (GetFileAttributes(pName) != 0xFFFFFFFF) 
-				{
-					delete[] pName;
-					continue;
-				}
+				// ハフマン圧縮用のメモリ領域を確保
+				HuffData = (u8 *)calloc(1, HuffmanEncodeKB * 1024 * 2 * 4 + 256 * 2 + 32);
 
-				// ファイルの場合は展開する
+				// ファイルの前後をハフマン圧縮
+				memcpy(HuffData, SrcBuf, HuffmanEncodeKB * 1024);
+				memcpy(HuffData + HuffmanEncodeKB * 1024, SrcBuf + FileSize - HuffmanEncodeKB * 1024, HuffmanEncodeKB * 1024);
+				File->HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
 
-				// バッファを確保する
-				Buffer = malloc(DXA_BUFFERSIZE);
-				if (Buffer == NULL) return -1;
+				// ハフマン圧縮した部分の後にハフマン圧縮していない箇所を続ける
+				WriteSize = File->HuffPressDataSize + FileSize - HuffmanEncodeKB * 1024 * 2;
+				WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+				Data      = (u8 *)malloc((size_t)WriteSize);
+				memcpy(Data, HuffData + HuffmanEncodeKB * 1024 * 2, (size_t)File->HuffPressDataSize);
+				memcpy(Data + File->HuffPressDataSize, SrcBuf + HuffmanEncodeKB * 1024, (size_t)(WriteSize - File->HuffPressDataSize));
 
-				DestP = _tfopen(pName, TEXT("wb"));
-				// ファイル個別の鍵を作成
+				// それぞれに鍵を適用する
 				if (NoKey == false)
 				{
-					KeyStringBufferBytes = CreateKeyFileString((int)Head->CharCodeFormat, KeyString, KeyStringBytes, Dir, File, FileP, DirP, NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
+					KeyConv(Data, File->HuffPressDataSize, File->DataSize, Job->Key, Crypt);
+					KeyConv(Data + File->HuffPressDataSize, WriteSize - File->HuffPressDataSize, File->DataSize + File->HuffPressDataSize, Job->Key, Crypt);
 				}
 
-				delete[] pName;
+				// メモリの解放
+				free(SrcBuf);
+				free(HuffData);
 
-				// データがある場合のみ転送
-				if (File->DataSize != 0)
-				{
-					void *temp;
+				Job->Buffer = Data;
+				Job->Data   = Data;
+			}
+		}
+		else
+		{
+			// 無圧縮の場合は書き出し時にファイルから転送する
+			WriteSize = (FileSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+		}
+	}
 
-					// 初期位置をセットする
-					if (_ftelli64(ArcP) != (s32)(Head->DataStartAddress + File->DataAddress))
-						_fseeki64(ArcP, Head->DataStartAddress + File->DataAddress, SEEK_SET);
+	// 読み込んだファイルを閉じる
+	fclose(SrcP);
 
-					// データが圧縮されているかどうかで処理を分岐
-					if (File->PressDataSize != 0xffffffffffffffff)
-					{
-						// 圧縮されている場合
+	// 書き出すサイズを保存する
+	Job->WriteSize = WriteSize;
 
-						// ハフマン圧縮もされているかどうかで処理を分岐
-						if (File->HuffPressDataSize != 0xffffffffffffffff)
-						{
-							// 圧縮データが収まるメモリ領域の確保
-							temp = malloc((size_t)(File->PressDataSize + File->HuffPressDataSize + File->DataSize));
+	// 終了
+	return 0;
+}
 
-							// 圧縮データの読み込み
-							KeyConvFileRead(temp, File->HuffPressDataSize, ArcP, NoKey ? NULL : lKey, File->DataSize);
+// 圧縮したファイルのデータをアーカイブに書き出し、ファイルヘッダにデータの位置をセットする
+int DXArchive::FileEncodeWrite(DARC_ENCODEJOB *Job, u8 *FileP, SIZESAVE *Size, FILE *DestFp, void *TempBuffer, bool NoKey, const DARC_CRYPTINFO *Crypt)
+{
+	DARC_FILEHEAD *File = &Job->File;
 
-							// ハフマン圧縮を解凍
-							Huffman_Decode(temp, (u8 *)temp + File->HuffPressDataSize);
+	// データの位置をセット
+	File->DataAddress = Size->DataSize;
 
-							// ファイルの前後をハフマン圧縮している場合は処理を分岐
-							if (Head->HuffmanEncodeKB != 0xff && File->PressDataSize > Head->HuffmanEncodeKB * 1024 * 2)
-							{
-								// 解凍したデータの内、後ろ半分を移動する
-								memmove(
-									(u8 *)temp + File->HuffPressDataSize + File->PressDataSize - Head->HuffmanEncodeKB * 1024,
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									Head->HuffmanEncodeKB * 1024);
-
-								// 残りのLZ圧縮データを読み込む
-								KeyConvFileRead(
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									File->PressDataSize - Head->HuffmanEncodeKB * 1024 * 2,
-									ArcP, NoKey ? NULL : lKey, File->DataSize + File->HuffPressDataSize);
-							}
+	if (Job->Data != NULL)
+	{
+		// 圧縮したデータを書き出す
+		fwrite64(Job->Data, Job->WriteSize, DestFp);
 
-							// 解凍
-							Decode((u8 *)temp + File->HuffPressDataSize, (u8 *)temp + File->HuffPressDataSize + File->PressDataSize);
+		// メモリの解放
+		free(Job->Buffer);
+		Job->Buffer = NULL;
+		Job->Data   = NULL;
+	}
+	else
+	if (Job->WriteSize != 0)
+	{
+		FILE *SrcP;
+		u64 WriteSize, MoveSize;
 
-							// 書き出し
-							fwrite64((u8 *)temp + File->HuffPressDataSize + File->PressDataSize, File->DataSize, DestP);
+		// ファイルを開く
+		SrcP = _tfopen(Job->SrcPath.c_str(), TEXT("rb"));
+		if (SrcP == NULL) return -1;
 
-							// メモリの解放
-							free(temp);
-						}
-						else
-						{
-							// 圧縮データが収まるメモリ領域の確保
-							temp = malloc((size_t)(File->PressDataSize + File->DataSize));
+		// 転送開始
+		WriteSize = 0;
+		while (WriteSize < Job->WriteSize)
+		{
+			// 転送サイズ決定
+			MoveSize = DXA_BUFFERSIZE < Job->WriteSize - WriteSize ? DXA_BUFFERSIZE : Job->WriteSize - WriteSize;
 
-							// 圧縮データの読み込み
-							KeyConvFileRead(temp, File->PressDataSize, ArcP, NoKey ? NULL : lKey, File->DataSize);
+			// ファイルの鍵適用読み込み
+			memset(TempBuffer, 0, (size_t)MoveSize);
+			KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : Job->Key, Crypt, File->DataSize + WriteSize);
 
-							// 解凍
-							Decode(temp, (u8 *)temp + File->PressDataSize);
+			// 書き出し
+			fwrite64(TempBuffer, MoveSize, DestFp);
 
-							// 書き出し
-							fwrite64((u8 *)temp + File->PressDataSize, File->DataSize, DestP);
+			// 書き出しサイズの加算
+			WriteSize += MoveSize;
+		}
 
-							// メモリの解放
-							free(temp);
-						}
-					}
-					else
-					{
-						// 圧縮されていない場合
+		// 読み込んだファイルを閉じる
+		fclose(SrcP);
+	}
 
-						// ハフマン圧縮はされているかどうかで処理を分岐
-						if (File->HuffPressDataSize != 0xffffffffffffffff)
-						{
-							// 圧縮データが収まるメモリ領域の確保
-							temp = malloc((size_t)(File->HuffPressDataSize + File->DataSize));
+	// データサイズの加算
+	Size->DataSize += Job->WriteSize;
 
-							// 圧縮データの読み込み
-							KeyConvFileRead(temp, File->HuffPressDataSize, ArcP, NoKey ? NULL : lKey, File->DataSize);
+	// ファイルヘッダを書き出す
+	memcpy(FileP + Job->FileHeadAddress, File, sizeof(DARC_FILEHEAD));
 
-							// ハフマン圧縮を解凍
-							Huffman_Decode(temp, (u8 *)temp + File->HuffPressDataSize);
+	// 終了
+	return 0;
+}
 
-							// ファイルの前後のみハフマン圧縮している場合は処理を分岐
-							if (Head->HuffmanEncodeKB != 0xff && File->DataSize > Head->HuffmanEncodeKB * 1024 * 2)
-							{
-								// 解凍したデータの内、後ろ半分を移動する
-								memmove(
-									(u8 *)temp + File->HuffPressDataSize + File->DataSize - Head->HuffmanEncodeKB * 1024,
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									Head->HuffmanEncodeKB * 1024);
-
-								// 残りのデータを読み込む
-								KeyConvFileRead(
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									File->DataSize - Head->HuffmanEncodeKB * 1024 * 2,
-									ArcP, NoKey ? NULL : lKey, File->DataSize + File->HuffPressDataSize);
-							}
+// ファイル単位の処理情報の列にあるファイルを圧縮してアーカイブに書き出す
+// 圧縮と鍵の適用は複数のスレッドで行い、書き出しは列の順番通りに行うので、結果はスレッドの数に関わらず同じになる
+int DXArchive::FileEncodeJobList(std::vector<DARC_ENCODEJOB> *JobList, u8 *FileP, SIZESAVE *Size, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, bool NoKey, const DARC_CRYPTINFO *Crypt, DARC_ENCODEINFO *EncodeInfo)
+{
+	std::mutex Mutex;
+	std::condition_variable Condition;
+	size_t NextJob, WriteJob, MaxJobAhead;
+	int ThreadNum;
+	int Result = 0;
+
+	// 使用するスレッドの数を決定する
+	ThreadNum = EncodeThreadNum > 0 ? EncodeThreadNum : (int)std::thread::hardware_concurrency();
+	if (ThreadNum > (int)JobList->size()) ThreadNum = (int)JobList->size();
+	if (ThreadNum < 1) ThreadNum = 1;
+
+	// スレッドが一つの場合は順番に圧縮して書き出す
+	if (ThreadNum == 1)
+	{
+		for (WriteJob = 0; WriteJob < JobList->size(); WriteJob++)
+		{
+			DARC_ENCODEJOB *Job = &(*JobList)[WriteJob];
 
-							// 書き出し
-							fwrite64((u8 *)temp + File->HuffPressDataSize, File->DataSize, DestP);
+			// 進行状況出力
+			if (EncodeInfo->OutputStatus)
+			{
+				wcscpy(EncodeInfo->ProcessFileName, Job->FileName.c_str());
+				EncodeInfo->CompFileNum++;
+				EncodeStatusOutput(EncodeInfo);
+			}
 
-							// メモリの解放
-							free(temp);
-						}
-						else
-						{
-							u64 MoveSize, WriteSize;
+			if (FileEncode(Job, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, NoKey, Crypt, EncodeInfo) < 0 ||
+				FileEncodeWrite(Job, FileP, Size, DestFp, TempBuffer, NoKey, Crypt) < 0)
+			{
+				free(Job->Buffer);
+				return -1;
+			}
+		}
+		return 0;
+	}
 
-							// 転送処理開始
-							WriteSize = 0;
-							while (WriteSize < File->DataSize)
-							{
-								MoveSize = File->DataSize - WriteSize > DXA_BUFFERSIZE ? DXA_BUFFERSIZE : File->DataSize - WriteSize;
+	// 圧縮が終わって書き出しを待っているデータでメモリを使い過ぎないように、先行して処理するファイルの数を制限する
+	NextJob     = 0;
+	WriteJob    = 0;
+	MaxJobAhead = (size_t)ThreadNum * 2;
 
-								// ファイルの反転読み込み
-								KeyConvFileRead(Buffer, MoveSize, ArcP, NoKey ? NULL : lKey, File->DataSize + WriteSize);
+	// 圧縮処理( 未処理のファイルを順番に取り出して圧縮する )
+	auto EncodeThread = [&]()
+	{
+		std::unique_lock<std::mutex> Lock(Mutex);
+		size_t JobIndex;
+		int JobResult;
 
-								// 書き出し
-								fwrite64(Buffer, MoveSize, DestP);
+		for (;;)
+		{
+			Condition.wait(Lock, [&] { return NextJob >= JobList->size() || NextJob < WriteJob + MaxJobAhead || Result < 0; });
+			if (NextJob >= JobList->size() || Result < 0) break;
+			JobIndex = NextJob++;
 
-								WriteSize += MoveSize;
-							}
-						}
-					}
-				}
+			Lock.unlock();
+			JobResult = FileEncode(&(*JobList)[JobIndex], Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, NoKey, Crypt, NULL);
+			Lock.lock();
 
-				// ファイルを閉じる
-				fclose(DestP);
+			(*JobList)[JobIndex].Result = JobResult;
+			(*JobList)[JobIndex].Done   = true;
+			Condition.notify_all();
+		}
+	};
 
-				// バッファを開放する
-				free(Buffer);
+	std::vector<std::thread> Threads;
+	int i;
 
-				//////////////////////////////
-				///// Remove Unpack Protection
-				if (isV35(g_cryptVersion))
-				{
-					const std::vector<std::wstring> UNPACK_PROTECTION_FILES = { L"game.dat", L"cdatabase.dat", L"database.dat", L"commonevent.dat" };
-					const uint8_t ANTI_UNPACK_DATA[62]                      = { 0x45, 0x78, 0x74, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6E, 0x67, 0x20, 0x64, 0x61, 0x74, 0x61, 0x20, 0x66, 0x72, 0x6F, 0x6D, 0x20, 0x65, 0x6E, 0x63, 0x72, 0x79, 0x70, 0x74, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6C, 0x65, 0x73, 0x20, 0x76, 0x69, 0x6F, 0x6C, 0x61, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x67, 0x75, 0x69, 0x64, 0x65, 0x6C, 0x69, 0x6E, 0x65, 0x73, 0x2E, 0x00 };
-					const uint32_t ANTI_UNPACK_DATA_SIZE                    = 62;
+	for (i = 0; i < ThreadNum; i++)
+	{
+		Threads.emplace_back(EncodeThread);
+	}
 
-					pName = GetOriginalFileName(NameP + File->NameAddress);
+	// 書き出し処理( 圧縮が終わったファイルから列の順番通りに書き出す )
+	while (WriteJob < JobList->size() && Result == 0)
+	{
+		DARC_ENCODEJOB *Job = &(*JobList)[WriteJob];
 
-					std::wstring fileName = std::wstring(pName);
-					std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
+		{
+			std::unique_lock<std::mutex> Lock(Mutex);
+			Condition.wait(Lock, [&] { return Job->Done; });
+		}
 
-					// As I am not sure if the file name will contain only the actual file name or also a directory
-					// check if the file name ends with any of the unpack protection files
-					bool isUnpackProtectionFile = false;
+		// 進行状況出力
+		if (EncodeInfo->OutputStatus)
+		{
+			wcscpy(EncodeInfo->ProcessFileName, Job->FileName.c_str());
+			EncodeInfo->CompFileNum++;
+			EncodeStatusOutput(EncodeInfo);
+		}
 
-					for (const std::wstring &unpackProtectionFile : UNPACK_PROTECTION_FILES)
-					{
-						if (fileName.ends_with(unpackProtectionFile))
-						{
-							isUnpackProtectionFile = true;
-							break;
-						}
-					}
+		{
+			int JobResult = Job->Result;
 
-					if (isUnpackProtectionFile)
-					{
-						DestP = _tfopen(pName, TEXT("rb"));
+			if (JobResult == 0)
+			{
+				JobResult = FileEncodeWrite(Job, FileP, Size, DestFp, TempBuffer, NoKey, Crypt);
+			}
 
-						// Get the file size
-						_fseeki64(DestP, 0, SEEK_END);
-						int64_t fileSize = _ftelli64(DestP);
+			std::unique_lock<std::mutex> Lock(Mutex);
+			if (JobResult < 0) Result = -1;
+			else WriteJob++;
+			Condition.notify_all();
+		}
+	}
 
-						if (fileSize >= ANTI_UNPACK_DATA_SIZE)
-						{
-							// Check if the file begins with the anti-unpack data
-							_fseeki64(DestP, 0, SEEK_SET);
+	for (i = 0; i < ThreadNum; i++)
+	{
+		Threads[i].join();
+	}
 
-							void *pFileBeginning = malloc(ANTI_UNPACK_DATA_SIZE);
-							fread64(pFileBeginning, ANTI_UNPACK_DATA_SIZE, DestP);
+	// エラーで中断した場合は書き出していないデータを解放する
+	if (Result < 0)
+	{
+		for (; WriteJob < JobList->size(); WriteJob++)
+		{
+			free((*JobList)[WriteJob].Buffer);
+		}
+	}
 
-							if (pFileBeginning && std::memcmp(pFileBeginning, ANTI_UNPACK_DATA, ANTI_UNPACK_DATA_SIZE) == 0)
-							{
-								fileSize -= ANTI_UNPACK_DATA_SIZE;
+	// 終了
+	return Result;
+}
 
-								// Remove the first 62 bytes from the file
-								_fseeki64(DestP, ANTI_UNPACK_DATA_SIZE, SEEK_SET);
+// 指定のディレクトリデータ以下のファイルを展開処理情報の列に追加する( ディレクトリの作成も行う )
+// 展開するファイルを絞り込む条件がある場合は、条件に合わないファイルは列に追加せず、展開するファイルが無いディレクトリは作成しない
+int DXArchive::DirectoryDecodeJobList(int CharCodeFormat, u8 *NameP, u8 *FileP, u8 *DirP, DARC_DIRECTORY *Dir, const std::wstring &DirPath, size_t RootPathLength, const std::string *ParentKeyString, std::vector<DARC_DECODEJOB> *JobList)
+{
+	std::wstring CurrentPath = DirPath;
+	std::shared_ptr<std::string> KeyString(new std::string);
+	bool Filter  = DecodeFilter.Include.empty() == false || DecodeFilter.Exclude.empty() == false;
+	bool Created = Filter == false;
 
-								std::vector<uint8_t> buffer(fileSize);
-								fread64(buffer.data(), fileSize, DestP);
-								fclose(DestP);
+	// 鍵用の文字列のディレクトリ部分を作成する( 親ディレクトリの分がある場合は自分の名前を前に付けるだけで済む )
+	if (ParentKeyString == NULL)
+	{
+		CreateKeyDirectoryString(CharCodeFormat, Dir, FileP, DirP, NameP, KeyString.get());
+	}
+	else if (Dir->ParentDirectoryAddress != 0xffffffffffffffff)
+	{
+		const char *Name = (const char *)(NameP + ((DARC_FILEHEAD *)(FileP + Dir->DirectoryAddress))->NameAddress + 4);
+		KeyString->assign(Name, CL_strlen(CharCodeFormat, Name) * GetCharCodeFormatUnitSize(CharCodeFormat));
+		KeyString->append(*ParentKeyString);
+	}
 
-								DestP = _tfopen(pName, TEXT("wb"));
+	// ディレクトリ情報がある場合は、まず展開用のディレクトリを作成する
+	if (Dir->DirectoryAddress != 0xffffffffffffffff && Dir->ParentDirectoryAddress != 0xffffffffffffffff)
+	{
+		DARC_FILEHEAD *DirFile;
 
-								fwrite64(buffer.data(), fileSize, DestP);
-							}
+		// DARC_FILEHEAD のアドレスを取得
+		DirFile = (DARC_FILEHEAD *)(FileP + Dir->DirectoryAddress);
 
-							free(pFileBeginning);
-						}
+		// ディレクトリの作成
+		TCHAR *pName = GetOriginalFileName(NameP + DirFile->NameAddress);
+		CurrentPath += TEXT("\\");
+		CurrentPath += pName;
+		delete[] pName;
+		if (Filter == false) CreateDirectory(CurrentPath.c_str(), NULL);
+	}
 
-						fclose(DestP);
-					}
+	// 格納されているファイルの数だけ繰り返す
+	{
+		u32 i;
+		DARC_FILEHEAD *File;
 
-					delete[] pName;
-				}
+		File = (DARC_FILEHEAD *)(FileP + Dir->FileHeadAddress);
+		for (i = 0; i < Dir->FileHeadNum; i++, File++)
+		{
+			// ディレクトリかどうかで処理を分岐
+			if (File->Attributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				// ディレクトリの場合は再帰をかける
+				DirectoryDecodeJobList(CharCodeFormat, NameP, FileP, DirP, (DARC_DIRECTORY *)(DirP + File->DataAddress), CurrentPath, RootPathLength, KeyString.get(), JobList);
+			}
+			else
+			{
+				DARC_DECODEJOB Job;
+
+				// ファイルの場合は展開処理情報を追加する
+				TCHAR *pName    = GetOriginalFileName(NameP + File->NameAddress);
+				Job.Directory          = Dir;
+				Job.File               = File;
+				Job.OutputPath         = CurrentPath + TEXT("\\") + pName;
+				Job.DirectoryKeyString = KeyString;
+				delete[] pName;
 
-				///// Remove Unpack Protection
-				//////////////////////////////
+				// 条件に合わないファイルは鍵の作成やデータの読み込みを行わないように列に追加しない
+				if (Filter && CheckDecodeFilter(Job.OutputPath.substr(RootPathLength + 1)) == false) continue;
 
-				// ファイルのタイムスタンプを設定する
+				// 展開するファイルが初めて見つかった場合は、親のディレクトリも含めてディレクトリを作成する
+				if (Created == false)
 				{
-					HANDLE HFile;
-					FILETIME CreateTime, LastAccessTime, LastWriteTime;
-					TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
-					HFile        = CreateFile(pName,
-											  GENERIC_WRITE, 0, NULL,
-											  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-					delete[] pName;
-
-					if (HFile == INVALID_HANDLE_VALUE)
+					size_t Pos;
+
+					for (Pos = RootPathLength + 1; (Pos = CurrentPath.find(TEXT('\\'), Pos)) != std::wstring::npos; Pos++)
 					{
-						HFile = HFile;
+						CreateDirectory(CurrentPath.substr(0, Pos).c_str(), NULL);
 					}
-
-					CreateTime.dwHighDateTime     = (u32)(File->Time.Create >> 32);
-					CreateTime.dwLowDateTime      = (u32)(File->Time.Create & 0xffffffffffffffff);
-					LastAccessTime.dwHighDateTime = (u32)(File->Time.LastAccess >> 32);
-					LastAccessTime.dwLowDateTime  = (u32)(File->Time.LastAccess & 0xffffffffffffffff);
-					LastWriteTime.dwHighDateTime  = (u32)(File->Time.LastWrite >> 32);
-					LastWriteTime.dwLowDateTime   = (u32)(File->Time.LastWrite & 0xffffffffffffffff);
-					SetFileTime(HFile, &CreateTime, &LastAccessTime, &LastWriteTime);
-					CloseHandle(HFile);
+					CreateDirectory(CurrentPath.c_str(), NULL);
+					Created = true;
 				}
 
-				// ファイル属性を付ける
-				pName = GetOriginalFileName(NameP + File->NameAddress);
-				SetFileAttributes(pName, (u32)File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN));
-				delete[] pName;
+				JobList->push_back(std::move(Job));
 			}
 		}
 	}
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory(DirPath);
-
 	// 終了
 	return 0;
 }
 
-// ディレクトリ内のファイルパスを取得する
-int DXArchive::GetDirectoryFilePath(const TCHAR *DirectoryPath, std::vector<std::wstring> *FileNameBuffer)
+// ファイルを一つ展開する
+int DXArchive::FileDecode(u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DECODEJOB *Job, DARC_SOURCE *Src, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, const DARC_CRYPTINFO *Crypt, DARC_SCRATCH *Scratch)
 {
-	WIN32_FIND_DATA FindData;
-	HANDLE FindHandle;
-	int FileNum;
-	TCHAR DirPath[256], String[256];
+	DARC_DIRECTORY *Dir = Job->Directory;
+	DARC_FILEHEAD *File = Job->File;
+	const TCHAR *pName  = Job->OutputPath.c_str();
+	size_t KeyStringBufferBytes;
+	unsigned char lKey[DXA_KEY_BYTES];
+	FILE *DestP;
+	int Result = 0;
 
-	// ディレクトリかどうかをチェックする
-	if (DirectoryPath[0] != '\0')
+	// 既にファイルがある場合は何もしない
+	if (GetFileAttributes(pName) != 0xFFFFFFFF)
 	{
-		FindHandle = FindFirstFile(DirectoryPath, &FindData);
-		if (FindHandle == INVALID_HANDLE_VALUE || (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) return -1;
-		FindClose(FindHandle);
+		return 0;
 	}
 
-	// 指定のフォルダのファイルの名前を取得する
-	FileNum = 0;
-	if (DirectoryPath[0] != '\0')
+	// ファイルを開く
+	DestP = _tfopen(pName, TEXT("wb"));
+	if (DestP == NULL)
 	{
-		_tcscpy(DirPath, DirectoryPath);
-		if (DirPath[_tcslen(DirPath) - 1] != '\\') _tcscat(DirPath, TEXT("\\"));
+		return -1;
+	}
+
+	// ファイル個別の鍵を作成( ディレクトリ部分は作成済みのものを使う )
+	if (NoKey == false)
+	{
+		KeyStringBufferBytes = 0;
+		if (Job->DirectoryKeyString)
+			KeyStringBufferBytes = CreateKeyFileStringFast((int)Head->CharCodeFormat, KeyString, KeyStringBytes, *Job->DirectoryKeyString, File, NameP, (BYTE *)KeyStringBuffer);
+		if (KeyStringBufferBytes == 0)
+			KeyStringBufferBytes = CreateKeyFileString((int)Head->CharCodeFormat, KeyString, KeyStringBytes, Dir, File, FileP, DirP, NameP, (BYTE *)KeyStringBuffer);
+		KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
+	}
+
+	// データがある場合のみ転送
+	if (File->DataSize != 0)
+	{
+		void *temp;
+
+		// 初期位置をセットする
+		if (SourceTell(Src) != (s64)(Head->DataStartAddress + File->DataAddress))
+			SourceSeek(Src, Head->DataStartAddress + File->DataAddress);
+
+		// サイズの大きい圧縮されたファイルは、全体をメモリに読み込まずに少しずつ解凍して書き出す
+		if ((File->PressDataSize != 0xffffffffffffffff || File->HuffPressDataSize != 0xffffffffffffffff) && File->DataSize > DXA_STREAMDECODE_MINSIZE)
+		{
+			DARC_DECODESTREAM Stream;
+			u8 *Data;
+			s64 Size;
+
+			if (DecodeStreamOpen(&Stream, File, Head->HuffmanEncodeKB, Src, Head->DataStartAddress + File->DataAddress, NoKey ? NULL : lKey, Crypt) < 0)
+			{
+				Result = -1;
+			}
+			else
+			{
+				while ((Size = DecodeStreamRead(&Stream, DXA_STREAMWINDOWSIZE, &Data)) > 0)
+				{
+					fwrite64(Data, Size, DestP);
+				}
+				if (Size < 0) Result = -1;
+
+				DecodeStreamClose(&Stream);
+			}
+		}
+		else if (File->PressDataSize != 0xffffffffffffffff)
+		{
+			// 圧縮されている場合
+
+			// ハフマン圧縮もされているかどうかで処理を分岐
+			if (File->HuffPressDataSize != 0xffffffffffffffff)
+			{
+				u64 HuffOriginalSize;
+
+				// 圧縮データが収まるメモリ領域の確保( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+				temp = ScratchAlloc(Scratch, File->PressDataSize + File->HuffPressDataSize + File->DataSize + HUFFMAN_HEAD_MAXSIZE);
+				if (temp == NULL)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 圧縮データの読み込み( アーカイブが途中で終わっていたらエラー )
+				if (KeyConvSourceRead(temp, File->HuffPressDataSize, Src, NoKey ? NULL : lKey, Crypt, File->DataSize) != (s64)File->HuffPressDataSize)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 鍵が違う場合などでハフマン圧縮のヘッダが壊れていたらエラー
+				if (Huffman_GetPressSize(temp, &HuffOriginalSize) > File->HuffPressDataSize || HuffOriginalSize > File->PressDataSize)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// ハフマン圧縮を解凍
+				Huffman_Decode(temp, (u8 *)temp + File->HuffPressDataSize);
+
+				// ファイルの前後をハフマン圧縮している場合は処理を分岐
+				if (Head->HuffmanEncodeKB != 0xff && File->PressDataSize > Head->HuffmanEncodeKB * 1024 * 2)
+				{
+					// 解凍したデータの内、後ろ半分を移動する
+					memmove(
+						(u8 *)temp + File->HuffPressDataSize + File->PressDataSize - Head->HuffmanEncodeKB * 1024,
+						(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+						Head->HuffmanEncodeKB * 1024);
+
+					// 残りのLZ圧縮データを読み込む
+					if (KeyConvSourceRead(
+							(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+							File->PressDataSize - Head->HuffmanEncodeKB * 1024 * 2,
+							Src, NoKey ? NULL : lKey, Crypt, File->DataSize + File->HuffPressDataSize) != (s64)(File->PressDataSize - Head->HuffmanEncodeKB * 1024 * 2))
+					{
+						Result = -1;
+						goto END;
+					}
+				}
+
+				// 解凍して書き出し
+				if (Decode((u8 *)temp + File->HuffPressDataSize, (u8 *)temp + File->HuffPressDataSize + File->PressDataSize, File->PressDataSize, File->DataSize) >= 0)
+					fwrite64((u8 *)temp + File->HuffPressDataSize + File->PressDataSize, File->DataSize, DestP);
+				else
+					Result = -1;
+			}
+			else
+			{
+				// 圧縮データが収まるメモリ領域の確保
+				temp = ScratchAlloc(Scratch, File->PressDataSize + File->DataSize);
+				if (temp == NULL)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 圧縮データの読み込み( アーカイブが途中で終わっていたらエラー )
+				if (KeyConvSourceRead(temp, File->PressDataSize, Src, NoKey ? NULL : lKey, Crypt, File->DataSize) != (s64)File->PressDataSize)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 解凍して書き出し
+				if (Decode(temp, (u8 *)temp + File->PressDataSize, File->PressDataSize, File->DataSize) >= 0)
+					fwrite64((u8 *)temp + File->PressDataSize, File->DataSize, DestP);
+				else
+					Result = -1;
+			}
+		}
+		else
+		{
+			// 圧縮されていない場合
+
+			// ハフマン圧縮はされているかどうかで処理を分岐
+			if (File->HuffPressDataSize != 0xffffffffffffffff)
+			{
+				u64 HuffOriginalSize;
+
+				// 圧縮データが収まるメモリ領域の確保( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+				temp = ScratchAlloc(Scratch, File->HuffPressDataSize + File->DataSize + HUFFMAN_HEAD_MAXSIZE);
+				if (temp == NULL)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 圧縮データの読み込み( アーカイブが途中で終わっていたらエラー )
+				if (KeyConvSourceRead(temp, File->HuffPressDataSize, Src, NoKey ? NULL : lKey, Crypt, File->DataSize) != (s64)File->HuffPressDataSize)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 鍵が違う場合などでハフマン圧縮のヘッダが壊れていたらエラー
+				if (Huffman_GetPressSize(temp, &HuffOriginalSize) > File->HuffPressDataSize || HuffOriginalSize > File->DataSize)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// ハフマン圧縮を解凍
+				Huffman_Decode(temp, (u8 *)temp + File->HuffPressDataSize);
+
+				// ファイルの前後のみハフマン圧縮している場合は処理を分岐
+				if (Head->HuffmanEncodeKB != 0xff && File->DataSize > Head->HuffmanEncodeKB * 1024 * 2)
+				{
+					// 解凍したデータの内、後ろ半分を移動する
+					memmove(
+						(u8 *)temp + File->HuffPressDataSize + File->DataSize - Head->HuffmanEncodeKB * 1024,
+						(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+						Head->HuffmanEncodeKB * 1024);
+
+					// 残りのデータを読み込む
+					if (KeyConvSourceRead(
+							(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+							File->DataSize - Head->HuffmanEncodeKB * 1024 * 2,
+							Src, NoKey ? NULL : lKey, Crypt, File->DataSize + File->HuffPressDataSize) != (s64)(File->DataSize - Head->HuffmanEncodeKB * 1024 * 2))
+					{
+						Result = -1;
+						goto END;
+					}
+				}
+
+				// 書き出し
+				fwrite64((u8 *)temp + File->HuffPressDataSize, File->DataSize, DestP);
+			}
+			else
+			{
+				u64 MoveSize, WriteSize, BufferSize;
+
+				// 転送用のメモリ領域の確保( ファイル全体ではなく一定のサイズ毎に転送する )
+				BufferSize = File->DataSize > DXA_STREAMBUFFERSIZE ? DXA_STREAMBUFFERSIZE : File->DataSize;
+				temp       = ScratchAlloc(Scratch, BufferSize);
+				if (temp == NULL)
+				{
+					Result = -1;
+					goto END;
+				}
+
+				// 転送処理開始
+				WriteSize = 0;
+				while (WriteSize < File->DataSize)
+				{
+					MoveSize = File->DataSize - WriteSize > BufferSize ? BufferSize : File->DataSize - WriteSize;
+
+					// ファイルの反転読み込み( アーカイブが途中で終わっていたらエラー )
+					if (KeyConvSourceRead(temp, MoveSize, Src, NoKey ? NULL : lKey, Crypt, File->DataSize + WriteSize) != (s64)MoveSize)
+					{
+						Result = -1;
+						goto END;
+					}
+
+					// 書き出し
+					fwrite64(temp, MoveSize, DestP);
+
+					WriteSize += MoveSize;
+				}
+			}
+		}
+	}
+
+END:
+	// ファイルを閉じる
+	fclose(DestP);
+
+	// 圧縮データが壊れていた場合は書きかけのファイルを削除する
+	if (Result < 0)
+	{
+		DeleteFile(pName);
+		return -1;
+	}
+
+	//////////////////////////////
+	///// Remove Unpack Protection
+	if (isV35(Crypt->CryptVersion))
+	{
+		const std::vector<std::wstring> UNPACK_PROTECTION_FILES = { L"game.dat", L"cdatabase.dat", L"database.dat", L"commonevent.dat" };
+		const uint8_t ANTI_UNPACK_DATA[62]                      = { 0x45, 0x78, 0x74, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6E, 0x67, 0x20, 0x64, 0x61, 0x74, 0x61, 0x20, 0x66, 0x72, 0x6F, 0x6D, 0x20, 0x65, 0x6E, 0x63, 0x72, 0x79, 0x70, 0x74, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6C, 0x65, 0x73, 0x20, 0x76, 0x69, 0x6F, 0x6C, 0x61, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x67, 0x75, 0x69, 0x64, 0x65, 0x6C, 0x69, 0x6E, 0x65, 0x73, 0x2E, 0x00 };
+		const uint32_t ANTI_UNPACK_DATA_SIZE                    = 62;
+
+		TCHAR *pFileName = GetOriginalFileName(NameP + File->NameAddress);
+
+		std::wstring fileName = std::wstring(pFileName);
+		std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
+
+		delete[] pFileName;
+
+		// As I am not sure if the file name will contain only the actual file name or also a directory
+		// check if the file name ends with any of the unpack protection files
+		bool isUnpackProtectionFile = false;
+
+		for (const std::wstring &unpackProtectionFile : UNPACK_PROTECTION_FILES)
+		{
+			if (fileName.ends_with(unpackProtectionFile))
+			{
+				isUnpackProtectionFile = true;
+				break;
+			}
+		}
+
+		if (isUnpackProtectionFile)
+		{
+			DestP = _tfopen(pName, TEXT("rb"));
+
+			// Get the file size
+			_fseeki64(DestP, 0, SEEK_END);
+			int64_t fileSize = _ftelli64(DestP);
+
+			if (fileSize >= ANTI_UNPACK_DATA_SIZE)
+			{
+				// Check if the file begins with the anti-unpack data
+				_fseeki64(DestP, 0, SEEK_SET);
+
+				void *pFileBeginning = malloc(ANTI_UNPACK_DATA_SIZE);
+				fread64(pFileBeginning, ANTI_UNPACK_DATA_SIZE, DestP);
+
+				if (pFileBeginning && std::memcmp(pFileBeginning, ANTI_UNPACK_DATA, ANTI_UNPACK_DATA_SIZE) == 0)
+				{
+					fileSize -= ANTI_UNPACK_DATA_SIZE;
+
+					// Remove the first 62 bytes from the file
+					_fseeki64(DestP, ANTI_UNPACK_DATA_SIZE, SEEK_SET);
+
+					std::vector<uint8_t> buffer(fileSize);
+					fread64(buffer.data(), fileSize, DestP);
+					fclose(DestP);
+
+					DestP = _tfopen(pName, TEXT("wb"));
+
+					fwrite64(buffer.data(), fileSize, DestP);
+				}
+
+				free(pFileBeginning);
+			}
+
+			fclose(DestP);
+		}
+	}
+
+	///// Remove Unpack Protection
+	//////////////////////////////
+
+	// ファイルのタイムスタンプを設定する
+	{
+		HANDLE HFile;
+		FILETIME CreateTime, LastAccessTime, LastWriteTime;
+		HFile = CreateFile(pName,
+						   GENERIC_WRITE, 0, NULL,
+						   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (HFile == INVALID_HANDLE_VALUE)
+		{
+			HFile = HFile;
+		}
+
+		CreateTime.dwHighDateTime     = (u32)(File->Time.Create >> 32);
+		CreateTime.dwLowDateTime      = (u32)(File->Time.Create & 0xffffffffffffffff);
+		LastAccessTime.dwHighDateTime = (u32)(File->Time.LastAccess >> 32);
+		LastAccessTime.dwLowDateTime  = (u32)(File->Time.LastAccess & 0xffffffffffffffff);
+		LastWriteTime.dwHighDateTime  = (u32)(File->Time.LastWrite >> 32);
+		LastWriteTime.dwLowDateTime   = (u32)(File->Time.LastWrite & 0xffffffffffffffff);
+		SetFileTime(HFile, &CreateTime, &LastAccessTime, &LastWriteTime);
+		CloseHandle(HFile);
+	}
+
+	// ファイル属性を付ける
+	SetFileAttributes(pName, (u32)File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN));
+
+	// 終了
+	return 0;
+}
+
+// 展開処理情報の列にあるファイルを複数のスレッドで展開する
+int DXArchive::FileDecodeJobList(std::vector<DARC_DECODEJOB> *JobList, u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_SOURCE *Src, const TCHAR *ArcPath, const char *KeyString, size_t KeyStringBytes, bool NoKey, const DARC_CRYPTINFO *Crypt)
+{
+	std::atomic<size_t> NextJob(0);
+	std::atomic<int> Result(0);
+	int ThreadNum;
+
+	// 使用するスレッドの数を決定する
+	ThreadNum = DecodeThreadNum > 0 ? DecodeThreadNum : (int)std::thread::hardware_concurrency();
+	if (ThreadNum > (int)JobList->size()) ThreadNum = (int)JobList->size();
+	if (ThreadNum < 1) ThreadNum = 1;
+
+	// 展開処理( スレッド毎に読み込み元を用意し、未処理のファイルを順番に取り出して展開する )
+	auto DecodeThread = [&](DARC_SOURCE *ThreadSrc)
+	{
+		char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
+		DARC_SCRATCH Scratch = { NULL, 0 };
+		size_t JobIndex;
+
+		while ((JobIndex = NextJob.fetch_add(1)) < JobList->size())
+		{
+			if (FileDecode(NameP, DirP, FileP, Head, &(*JobList)[JobIndex], ThreadSrc, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, Crypt, &Scratch) < 0)
+			{
+				Result = -1;
+			}
+		}
+
+		// 作業領域を解放する
+		ScratchRelease(&Scratch);
+	};
+
+	if (ThreadNum == 1)
+	{
+		DecodeThread(Src);
+	}
+	else
+	{
+		std::vector<std::thread> Threads;
+		std::vector<DARC_SOURCE> ThreadSrc(ThreadNum, *Src);
+		int i;
+
+		// メモリ上のイメージは読み込み位置だけをスレッド毎に持ち、ファイルの場合はスレッド毎に開き直す
+		for (i = 1; i < ThreadNum; i++)
+		{
+			if (Src->Image != NULL) continue;
+
+			ThreadSrc[i].fp = _tfopen(ArcPath, TEXT("rb"));
+			if (ThreadSrc[i].fp == NULL) break;
+		}
+		ThreadNum = i;
+
+		for (i = 0; i < ThreadNum; i++)
+		{
+			Threads.emplace_back(DecodeThread, &ThreadSrc[i]);
+		}
+
+		for (i = 0; i < ThreadNum; i++)
+		{
+			Threads[i].join();
+			if (i != 0 && Src->Image == NULL) fclose(ThreadSrc[i].fp);
+		}
+	}
+
+	// 終了
+	return Result;
+}
+
+// ディレクトリ内のファイルパスを取得する
+int DXArchive::GetDirectoryFilePath(const TCHAR *DirectoryPath, std::vector<std::wstring> *FileNameBuffer)
+{
+	WIN32_FIND_DATA FindData;
+	HANDLE FindHandle;
+	int FileNum;
+	TCHAR DirPath[256], String[256];
+
+	// ディレクトリかどうかをチェックする
+	if (DirectoryPath[0] != '\0')
+	{
+		FindHandle = FindFirstFile(DirectoryPath, &FindData);
+		if (FindHandle == INVALID_HANDLE_VALUE || (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) return -1;
+		FindClose(FindHandle);
+	}
+
+	// 指定のフォルダのファイルの名前を取得する
+	FileNum = 0;
+	if (DirectoryPath[0] != '\0')
+	{
+		_tcscpy(DirPath, DirectoryPath);
+		if (DirPath[_tcslen(DirPath) - 1] != '\\') _tcscat(DirPath, TEXT("\\"));
 		_tcscpy(String, DirPath);
 		_tcscat(String, TEXT("*"));
 	}
@@ -1524,73 +2302,175 @@ void DXArchive::AnalyseHuffmanEncode(u64 DataSize, u8 HuffmanEncodeKB, u64 *Head
 	}
 }
 
-// エンコード( 戻り値:圧縮後のサイズ  -1 はエラー  Dest に NULL を入れることも可能 )
-int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool MaxPress)
+// 二つのデータが先頭から何バイト一致しているかを調べる( MaxLength バイトまで )
+static __inline u32 LZ_MatchLength(const u8 *Src1, const u8 *Src2, u32 MaxLength)
 {
-	s32 dstsize;
-	s32 bonus, conbo, conbosize, address, addresssize;
-	s32 maxbonus, maxconbo, maxconbosize, maxaddress, maxaddresssize;
-	u8 keycode, *srcp, *destp, *dp, *sp, *sp2, *sp1;
-	u32 srcaddress, nextprintaddress, code;
-	s32 j;
-	u32 i, m;
-	u32 maxlistnum, maxlistnummask, listaddp;
-	u32 sublistnum, sublistmaxnum;
-	LZ_LIST *listbuf, *listtemp, *list, *newlist;
-	u8 *listfirsttable, *usesublistflagtable, *sublistbuf;
-	u32 searchlistnum;
-
-	// 最大一致長を捜すためのリストを辿る最大数のセット
-	searchlistnum = MaxPress ? 0xffffffff : MAX_SEARCHLISTNUM;
-
-	// サブリストのサイズを決める
-	{
-		if (SrcSize < 100 * 1024) sublistmaxnum = 1;
-		else if (SrcSize < 3 * 1024 * 1024)
-			sublistmaxnum = MAX_SUBLISTNUM / 3;
-		else
-			sublistmaxnum = MAX_SUBLISTNUM;
+	u32 len = 0;
+	u64 data1, data2, diff;
+
+	// ８バイト単位で比較して、一致しなかったら最初に違うバイトの位置を求める
+	while (len + 8 <= MaxLength)
+	{
+		memcpy(&data1, Src1 + len, 8);
+		memcpy(&data2, Src2 + len, 8);
+		diff = data1 ^ data2;
+		if (diff != 0)
+		{
+#ifdef _MSC_VER
+			unsigned long bit;
+#ifdef _WIN64
+			_BitScanForward64(&bit, diff);
+#else
+			if ((u32)diff != 0)
+			{
+				_BitScanForward(&bit, (u32)diff);
+			}
+			else
+			{
+				_BitScanForward(&bit, (u32)(diff >> 32));
+				bit += 32;
+			}
+#endif
+			return len + (u32)(bit >> 3);
+#else
+			return len + (u32)(__builtin_ctzll(diff) >> 3);
+#endif
+		}
+		len += 8;
 	}
 
-	// リストのサイズを決める
+	// 残りは１バイトずつ比較する
+	while (len < MaxLength && Src1[len] == Src2[len])
+		len++;
+
+	return len;
+}
+
+// 指定の位置の先頭４バイトのハッシュ値を得る
+static __inline u32 LZ_Hash(const u8 *Src, u32 HashBits)
+{
+	u32 data;
+
+	memcpy(&data, Src, 4);
+	return (data * 2654435761U) >> (32 - HashBits);
+}
+
+// 指定の位置の直前までのデータをハッシュチェインに登録する
+static __inline void LZ_InsertTo(LZ_MATCHFINDER *Finder, u32 Address)
+{
+	u32 hash;
+
+	// 先頭４バイトが取得できない位置は登録しない
+	while (Finder->InsertAddress < Address && Finder->InsertAddress + MIN_COMPRESS <= Finder->SrcSize)
+	{
+		hash = LZ_Hash(Finder->Src + Finder->InsertAddress, Finder->HashBits);
+		Finder->ChainTable[Finder->InsertAddress & Finder->WindowMask] = Finder->HashTable[hash];
+		Finder->HashTable[hash] = Finder->InsertAddress;
+		Finder->InsertAddress++;
+	}
+	Finder->InsertAddress = Address;
+}
+
+// 指定の位置から始まる一番圧縮効率の良い一致を探す( 見つからなかった場合は Match->Conbo が 0 になる )
+static void LZ_FindMatch(LZ_MATCHFINDER *Finder, u32 Address, u32 ChainNum, LZ_MATCH *Match)
+{
+	const u8 *sp;
+	u32 candidate, address, conbo, maxconbo;
+	s32 bonus, conbosize, addresssize;
+
+	// 直前までの位置と指定の位置を登録する
+	LZ_InsertTo(Finder, Address + 1);
+
+	Match->Conbo   = 0;
+	Match->Address = 0;
+	Match->Bonus   = -1;
+
+	sp        = Finder->Src + Address;
+	candidate = Finder->ChainTable[Address & Finder->WindowMask];
+	maxconbo  = Finder->SrcSize - Address;
+	if (maxconbo > MAX_COPYSIZE) maxconbo = MAX_COPYSIZE;
+
+	// チェインは新しい位置から順に並んでいるので、相対アドレスが辞書の範囲を超えたら終了
+	for (; candidate != 0xffffffff && ChainNum != 0; ChainNum--)
 	{
-		maxlistnum = MAX_ADDRESSLISTNUM;
-		if (maxlistnum > SrcSize)
+		address = Address - candidate;
+		if (address > Finder->WindowMask) break;
+
+		// 後の候補ほど相対アドレスが遠いので、今までより長く一致しない限り採用されない
+		if ((sp - address)[Match->Conbo] == sp[Match->Conbo])
 		{
-			while ((maxlistnum >> 1) > 0x100 && (maxlistnum >> 1) > SrcSize)
-				maxlistnum >>= 1;
+			conbo = LZ_MatchLength(sp - address, sp, maxconbo);
+			if (conbo >= MIN_COMPRESS)
+			{
+				conbosize   = (conbo - MIN_COMPRESS) < 0x20 ? 0 : 1;
+				addresssize = address <= 0x100 ? 0 : (address <= 0x10000 ? 1 : 2);
+				bonus       = (s32)conbo - (3 + conbosize + addresssize);
+
+				if (bonus > Match->Bonus)
+				{
+					Match->Conbo   = conbo;
+					Match->Address = address;
+					Match->Bonus   = bonus;
+
+					// 十分な長さが見つかったら探索を打ち切る
+					if (conbo >= Finder->NiceLength || conbo >= maxconbo) break;
+				}
+			}
 		}
-		maxlistnummask = maxlistnum - 1;
+
+		candidate = Finder->ChainTable[candidate & Finder->WindowMask];
 	}
+}
 
-	// メモリの確保
-	usesublistflagtable = (u8 *)malloc(
-		sizeof(void *) * 65536 +               // メインリストの先頭オブジェクト用領域
-		sizeof(LZ_LIST) * maxlistnum +         // メインリスト用領域
-		sizeof(u8) * 65536 +                   // サブリストを使用しているかフラグ用領域
-		sizeof(void *) * 256 * sublistmaxnum); // サブリスト用領域
+// エンコード( 戻り値:圧縮後のサイズ  -1 はエラー  Dest に NULL を入れることも可能 )
+int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool MaxPress, int Level)
+{
+	s32 dstsize;
+	s32 conbosize, addresssize;
+	u8 keycode, *srcp, *destp, *dp, *sp;
+	u32 srcaddress, nextprintaddress, code, literalsize;
+	u32 i, hashnum, windowsize;
+	const LZ_LEVELPARAM *param;
+	LZ_MATCHFINDER finder;
+	LZ_MATCH match, nextmatch;
+	bool havematch;
+
+	// 圧縮レベルのパラメータを取得する( 最大圧縮指定の場合は最大レベル )
+	if (Level < 0) Level = PressLevel;
+	if (MaxPress) Level = DXA_PRESSLEVEL_MAX;
+	if (Level < DXA_PRESSLEVEL_MIN) Level = DXA_PRESSLEVEL_MIN;
+	if (Level > DXA_PRESSLEVEL_MAX) Level = DXA_PRESSLEVEL_MAX;
+	param = &LZLevelParam[Level];
+
+	// スライド辞書のサイズを決める
+	{
+		windowsize = param->WindowSize;
+		while ((windowsize >> 1) > 0x100 && (windowsize >> 1) > SrcSize)
+			windowsize >>= 1;
+	}
+
+	// ハッシュテーブルのサイズを決める
+	{
+		finder.HashBits = LZ_HASH_BITS;
+		while (finder.HashBits > 10 && ((u32)1 << (finder.HashBits - 1)) > SrcSize)
+			finder.HashBits--;
+		hashnum = (u32)1 << finder.HashBits;
+	}
 
-	// アドレスのセット
-	listfirsttable = usesublistflagtable + sizeof(u8) * 65536;
-	sublistbuf     = listfirsttable + sizeof(void *) * 65536;
-	listbuf        = (LZ_LIST *)(sublistbuf + sizeof(void *) * 256 * sublistmaxnum);
+	// メモリの確保
+	finder.HashTable = (u32 *)malloc(
+		sizeof(u32) * hashnum +     // ハッシュテーブル用領域
+		sizeof(u32) * windowsize);  // ハッシュチェイン用領域
+	if (finder.HashTable == NULL) return -1;
 
 	// 初期化
-	memset(usesublistflagtable, 0, sizeof(u8) * 65536);
-	memset(sublistbuf, 0, sizeof(void *) * 256 * sublistmaxnum);
-	memset(listfirsttable, 0, sizeof(void *) * 65536);
-	list = listbuf;
-	for (i = maxlistnum / 8; i; i--, list += 8)
-	{
-		list[0].address =
-			list[1].address =
-				list[2].address =
-					list[3].address =
-						list[4].address =
-							list[5].address =
-								list[6].address =
-									list[7].address = 0xffffffff;
-	}
+	memset(finder.HashTable, 0xff, sizeof(u32) * hashnum);
+	finder.ChainTable    = finder.HashTable + hashnum;
+	finder.WindowMask    = windowsize - 1;
+	finder.NiceLength    = param->NiceLength;
+	finder.Src           = (u8 *)Src;
+	finder.SrcSize       = SrcSize;
+	finder.InsertAddress = 0;
 
 	srcp  = (u8 *)Src;
 	destp = (u8 *)Dest;
@@ -1640,8 +2520,7 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 	sp               = srcp;
 	srcaddress       = 0;
 	dstsize          = 0;
-	listaddp         = 0;
-	sublistnum       = 0;
+	havematch        = false;
 	nextprintaddress = 1024 * 100;
 	if (OutStatus)
 	{
@@ -1650,111 +2529,36 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 	}
 	while (srcaddress < SrcSize)
 	{
+		// 一致長の長いコードを探す( 前の位置で遅延評価した結果がある場合はそれを使う )
 		// 残りサイズが最低圧縮サイズ以下の場合は圧縮処理をしない
-		if (srcaddress + MIN_COMPRESS >= SrcSize) goto NOENCODE;
-
-		// リストを取得
-		code = *((u16 *)sp);
-		list = (LZ_LIST *)(listfirsttable + code * sizeof(void *));
-		if (usesublistflagtable[code] == 1)
+		if (havematch == false)
 		{
-			list = (LZ_LIST *)((void **)list->next + sp[2]);
+			match.Conbo = 0;
+			if (srcaddress + MIN_COMPRESS < SrcSize)
+				LZ_FindMatch(&finder, srcaddress, param->ChainNum, &match);
 		}
-		else
+		havematch = false;
+
+		// 遅延評価：次の位置から始まる一致の方が効率が良い場合は今の位置を非圧縮コードとして出力する
+		if (match.Conbo != 0 && match.Conbo < param->LazyLength && srcaddress + 1 + MIN_COMPRESS < SrcSize)
 		{
-			if (sublistnum < sublistmaxnum)
-			{
-				list->next = (LZ_LIST *)(sublistbuf + sizeof(void *) * 256 * sublistnum);
-				list       = (LZ_LIST *)((void **)list->next + sp[2]);
+			LZ_FindMatch(&finder, srcaddress + 1, match.Conbo >= param->GoodLength ? (param->ChainNum >> 2) + 1 : param->ChainNum, &nextmatch);
 
-				usesublistflagtable[code] = 1;
-				sublistnum++;
+			literalsize = *sp == keycode ? 2 : 1;
+			if (nextmatch.Conbo != 0 && nextmatch.Bonus + 1 - (s32)literalsize > match.Bonus)
+			{
+				match     = nextmatch;
+				havematch = true;
+				goto NOENCODE;
 			}
 		}
 
-		// 一番一致長の長いコードを探す
-		maxconbo   = -1;
-		maxaddress = -1;
-		maxbonus   = -1;
-		for (m = 0, listtemp = list->next; m < searchlistnum && listtemp != NULL; listtemp = listtemp->next, m++)
+		// 一致コードが見つからなかったら非圧縮コードとして出力
+		if (match.Conbo == 0)
 		{
-			address = srcaddress - listtemp->address;
-			if (address >= MAX_POSITION)
-			{
-				if (listtemp->prev) listtemp->prev->next = listtemp->next;
-				if (listtemp->next) listtemp->next->prev = listtemp->prev;
-				listtemp->address = 0xffffffff;
-				continue;
-			}
-
-			sp2 = &sp[-address];
-			sp1 = sp;
-			if (srcaddress + MAX_COPYSIZE < SrcSize)
-			{
-				conbo = MAX_COPYSIZE / 4;
-				while (conbo && *((u32 *)sp2) == *((u32 *)sp1))
-				{
-					sp2 += 4;
-					sp1 += 4;
-					conbo--;
-				}
-				conbo = MAX_COPYSIZE - (MAX_COPYSIZE / 4 - conbo) * 4;
-
-				while (conbo && *sp2 == *sp1)
-				{
-					sp2++;
-					sp1++;
-					conbo--;
-				}
-				conbo = MAX_COPYSIZE - conbo;
-			}
-			else
-			{
-				for (conbo = 0;
-					 conbo < MAX_COPYSIZE &&
-					 conbo + srcaddress < SrcSize &&
-					 sp[conbo - address] == sp[conbo];
-					 conbo++) {}
-			}
-
-			if (conbo >= 4)
-			{
-				conbosize   = (conbo - MIN_COMPRESS) < 0x20 ? 0 : 1;
-				addresssize = address < 0x100 ? 0 : (address < 0x10000 ? 1 : 2);
-				bonus       = conbo - (3 + conbosize + addresssize);
-
-				if (bonus > maxbonus)
-				{
-					maxconbo       = conbo;
-					maxaddress     = address;
-					maxaddresssize = addresssize;
-					maxconbosize   = conbosize;
-					maxbonus       = bonus;
-				}
-			}
-		}
-
-		// リストに登録
-		newlist = &listbuf[listaddp];
-		if (newlist->address != 0xffffffff)
-		{
-			if (newlist->prev) newlist->prev->next = newlist->next;
-			if (newlist->next) newlist->next->prev = newlist->prev;
-			newlist->address = 0xffffffff;
-		}
-		newlist->address = srcaddress;
-		newlist->prev    = list;
-		newlist->next    = list->next;
-		if (list->next != NULL) list->next->prev = newlist;
-		list->next = newlist;
-		listaddp   = (listaddp + 1) & maxlistnummask;
-
-		// 一致コードが見つからなかったら非圧縮コードとして出力
-		if (maxconbo == -1)
-		{
-		NOENCODE:
-			// キーコードだった場合は２回連続で出力する
-			if (*sp == keycode)
+		NOENCODE:
+			// キーコードだった場合は２回連続で出力する
+			if (*sp == keycode)
 			{
 				if (destp != NULL)
 				{
@@ -1779,6 +2583,8 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 		else
 		{
 			// 見つかった場合は見つけた位置と長さを出力する
+			conbosize   = (match.Conbo - MIN_COMPRESS) < 0x20 ? 0 : 1;
+			addresssize = match.Address <= 0x100 ? 0 : (match.Address <= 0x10000 ? 1 : 2);
 
 			// キーコードと見つけた位置と長さを出力
 			if (destp != NULL)
@@ -1787,10 +2593,10 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 				*dp++ = keycode;
 
 				// 出力する連続長は最低 MIN_COMPRESS あることが前提なので - MIN_COMPRESS したものを出力する
-				maxconbo -= MIN_COMPRESS;
+				code = match.Conbo - MIN_COMPRESS;
 
 				// 連続長０～４ビットと連続長、相対アドレスのビット長を出力
-				*dp = (u8)(((maxconbo & 0x1f) << 3) | (maxconbosize << 2) | maxaddresssize);
+				*dp = (u8)(((code & 0x1f) << 3) | (conbosize << 2) | addresssize);
 
 				// キーコードの連続はキーコードと値の等しい非圧縮コードと
 				// 判断するため、キーコードの値以上の場合は値を＋１する
@@ -1798,70 +2604,27 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 				dp++;
 
 				// 連続長５～１２ビットを出力
-				if (maxconbosize == 1)
-					*dp++ = (u8)((maxconbo >> 5) & 0xff);
-
-				// maxconbo はまだ使うため - MIN_COMPRESS した分を戻す
-				maxconbo += MIN_COMPRESS;
+				if (conbosize == 1)
+					*dp++ = (u8)((code >> 5) & 0xff);
 
 				// 出力する相対アドレスは０が( 現在のアドレス－１ )を挿すので、－１したものを出力する
-				maxaddress--;
+				code = match.Address - 1;
 
 				// 相対アドレスを出力
-				*dp++ = (u8)(maxaddress);
-				if (maxaddresssize > 0)
+				*dp++ = (u8)(code);
+				if (addresssize > 0)
 				{
-					*dp++ = (u8)(maxaddress >> 8);
-					if (maxaddresssize == 2)
-						*dp++ = (u8)(maxaddress >> 16);
+					*dp++ = (u8)(code >> 8);
+					if (addresssize == 2)
+						*dp++ = (u8)(code >> 16);
 				}
 			}
 
 			// 出力サイズを加算
-			dstsize += 3 + maxaddresssize + maxconbosize;
+			dstsize += 3 + addresssize + conbosize;
 
-			// リストに情報を追加
-			if (srcaddress + maxconbo < SrcSize)
-			{
-				sp2 = &sp[1];
-				for (j = 1; j < maxconbo && (u64)&sp2[2] - (u64)srcp < SrcSize; j++, sp2++)
-				{
-					code = *((u16 *)sp2);
-					list = (LZ_LIST *)(listfirsttable + code * sizeof(void *));
-					if (usesublistflagtable[code] == 1)
-					{
-						list = (LZ_LIST *)((void **)list->next + sp2[2]);
-					}
-					else
-					{
-						if (sublistnum < sublistmaxnum)
-						{
-							list->next = (LZ_LIST *)(sublistbuf + sizeof(void *) * 256 * sublistnum);
-							list       = (LZ_LIST *)((void **)list->next + sp2[2]);
-
-							usesublistflagtable[code] = 1;
-							sublistnum++;
-						}
-					}
-
-					newlist = &listbuf[listaddp];
-					if (newlist->address != 0xffffffff)
-					{
-						if (newlist->prev) newlist->prev->next = newlist->next;
-						if (newlist->next) newlist->next->prev = newlist->prev;
-						newlist->address = 0xffffffff;
-					}
-					newlist->address = srcaddress + j;
-					newlist->prev    = list;
-					newlist->next    = list->next;
-					if (list->next != NULL) list->next->prev = newlist;
-					list->next = newlist;
-					listaddp   = (listaddp + 1) & maxlistnummask;
-				}
-			}
-
-			sp += maxconbo;
-			srcaddress += maxconbo;
+			sp += match.Conbo;
+			srcaddress += match.Conbo;
 		}
 
 		// 圧縮率の表示
@@ -1881,57 +2644,205 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 	*((u32 *)&destp[4]) = dstsize + 9;
 
 	// 確保したメモリの解放
-	free(usesublistflagtable);
+	free(finder.HashTable);
 
 	// データのサイズを返す
 	return dstsize + 9;
 }
 
+// 圧縮データ中の次のキーコードの位置を探す( 見つからない場合は End を返す )
+static const u8 *FindKeyCode(const u8 *Start, const u8 *End, u8 KeyCode)
+{
+	const u8 *p = Start;
+
+#ifdef WOLF_SSE2
+	const __m128i key = _mm_set1_epi8((char)KeyCode);
+
+	while (End - p >= 16)
+	{
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), key));
+		if (mask != 0)
+		{
+#ifdef _MSC_VER
+			unsigned long bit;
+			_BitScanForward(&bit, mask);
+			return p + bit;
+#else
+			return p + __builtin_ctz(mask);
+#endif
+		}
+		p += 16;
+	}
+#endif
+
+	while (p < End && *p != KeyCode) p++;
+
+	return p;
+}
+
+// 出力済みのデータの index バイト前から conbo バイトを出力する( 戻り値:出力後の出力位置 )
+// 出力先の終端 dend まで conbo + 32 バイト以上の余裕がある場合は、終端を越えない範囲で多めに書き込む高速な方法でコピーする
+static __inline u8 *LZ_CopyMatch(u8 *dp, const u8 *dend, u32 index, u32 conbo)
+{
+	u8 *ce = dp + conbo;
+
+	if ((size_t)(dend - dp) >= conbo + 32)
+	{
+		u8 *cp = dp;
+
+		if (index >= 32)
+		{
+			// 参照先が３２バイト以上離れている場合は３２バイト単位でコピーする
+			do
+			{
+				memcpy(cp, cp - index, 32);
+				cp += 32;
+			} while (cp < ce);
+		}
+		else if (index >= 16)
+		{
+			// 参照先が１６バイト以上離れている場合は１６バイト単位でコピーする
+			do
+			{
+				memcpy(cp, cp - index, 16);
+				cp += 16;
+			} while (cp < ce);
+		}
+		else
+		{
+			u32 dist = index;
+
+			// 参照先が８バイト未満の場合は最初の８バイトを１バイトずつ作成し、
+			// 以降は周期の倍数で８バイト以上離れた位置から８バイト単位でコピーする
+			if (index < 8)
+			{
+				for (int i = 0; i < 8; i++) cp[i] = *(cp + i - index);
+				cp += 8;
+				dist = index * ((8 + index - 1) / index);
+			}
+
+			while (cp < ce)
+			{
+				memcpy(cp, cp - dist, 8);
+				cp += 8;
+			}
+		}
+	}
+	else if (index >= conbo)
+	{
+		memcpy(dp, dp - index, conbo);
+	}
+	else
+	{
+		// 出力先の終端付近で参照先と重なっている場合は１バイトずつコピーする
+		u8 *cp = dp;
+
+		while (cp < ce)
+		{
+			*cp = *(cp - index);
+			cp++;
+		}
+	}
+
+	return ce;
+}
+
 // デコード( 戻り値:解凍後のサイズ  -1 はエラー  Dest に NULL を入れることも可能 )
-int DXArchive::Decode(void *Src, void *Dest)
+// SrcBufSize は Src の、DestBufSize は Dest のバッファサイズ、圧縮データが壊れていてもバッファの外には読み書きしない
+int DXArchive::Decode(void *Src, void *Dest, s64 SrcBufSize, s64 DestBufSize)
 {
-	u32 srcsize, destsize, code, indexsize, keycode, conbo, index = 0;
-	u8 *srcp, *destp, *dp, *sp;
+	u32 srcsize, destsize, code, keycode, conbo, index;
+	const u8 *srcp, *sp, *send, *lp;
+	u8 *destp, *dp, *dend;
 
 	destp = (u8 *)Dest;
-	srcp  = (u8 *)Src;
+	srcp  = (const u8 *)Src;
+
+	// ヘッダが収まっていない場合はエラー
+	if (SrcBufSize < 9) return -1;
 
 	// 解凍後のデータサイズを得る
-	destsize = *((u32 *)&srcp[0]);
+	destsize = srcp[0] | (srcp[1] << 8) | (srcp[2] << 16) | ((u32)srcp[3] << 24);
 
 	// 圧縮データのサイズを得る
-	srcsize = *((u32 *)&srcp[4]) - 9;
+	srcsize = srcp[4] | (srcp[5] << 8) | (srcp[6] << 16) | ((u32)srcp[7] << 24);
+	if (srcsize < 9 || srcsize > SrcBufSize || destsize > 0x7fffffff) return -1;
+	srcsize -= 9;
 
 	// キーコード
 	keycode = srcp[8];
 
 	// 出力先がない場合はサイズだけ返す
 	if (Dest == NULL)
-		return destsize;
+		return (int)destsize;
+
+	// 出力先が足りない場合はエラー
+	if (destsize > DestBufSize) return -1;
 
 	// 展開開始
-	sp = srcp + 9;
-	dp = destp;
-	while (srcsize)
+	sp   = srcp + 9;
+	send = sp + srcsize;
+	dp   = destp;
+	dend = destp + destsize;
+#ifdef WOLF_SSE2
+	const __m128i key = _mm_set1_epi8((char)keycode);
+#endif
+	while (sp < send)
 	{
 		// キーコードか同かで処理を分岐
 		if (sp[0] != keycode)
 		{
-			// 非圧縮コードの場合はそのまま出力
-			*dp = *sp;
-			dp++;
-			sp++;
-			srcsize--;
+			// 非圧縮コードの場合は次のキーコードまでまとめて出力
+#ifdef WOLF_SSE2
+			// 入出力共に１６バイト以上の余裕がある間は１６バイト単位で出力し、キーコードの位置まで進める
+			if (send - sp >= 16 && dend - dp >= 16)
+			{
+				for (;;)
+				{
+					__m128i v         = _mm_loadu_si128((const __m128i *)sp);
+					unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, key));
+
+					_mm_storeu_si128((__m128i *)dp, v);
+					if (mask != 0)
+					{
+#ifdef _MSC_VER
+						unsigned long bit;
+						_BitScanForward(&bit, mask);
+#else
+						unsigned int bit = __builtin_ctz(mask);
+#endif
+						sp += bit;
+						dp += bit;
+						break;
+					}
+					sp += 16;
+					dp += 16;
+
+					if (send - sp < 16 || dend - dp < 16) break;
+				}
+				continue;
+			}
+#endif
+			lp = FindKeyCode(sp, send, (u8)keycode);
+			if ((size_t)(lp - sp) > (size_t)(dend - dp)) return -1;
+
+			memcpy(dp, sp, lp - sp);
+			dp += lp - sp;
+			sp = lp;
 			continue;
 		}
 
+		// キーコードの後に何もない場合はエラー
+		if (send - sp < 2) return -1;
+
 		// キーコードが連続していた場合はキーコード自体を出力
 		if (sp[1] == keycode)
 		{
+			if (dp == dend) return -1;
+
 			*dp = (u8)keycode;
 			dp++;
 			sp += 2;
-			srcsize -= 2;
 
 			continue;
 		}
@@ -1944,7 +2855,9 @@ int DXArchive::Decode(void *Src, void *Dest)
 		if (code > keycode) code--;
 
 		sp += 2;
-		srcsize -= 2;
+
+		// 参照相対アドレスのバイト数が不正な場合や、圧縮コードが途中で切れている場合はエラー
+		if ((code & 0x3) == 3 || send - sp < (s64)((code >> 2) & 0x1) + (code & 0x3) + 1) return -1;
 
 		// 連続長を取得する
 		conbo = code >> 3;
@@ -1952,251 +2865,604 @@ int DXArchive::Decode(void *Src, void *Dest)
 		{
 			conbo |= *sp << 5;
 			sp++;
-			srcsize--;
 		}
 		conbo += MIN_COMPRESS; // 保存時に減算した最小圧縮バイト数を足す
 
 		// 参照相対アドレスを取得する
-		indexsize = code & 0x3;
-		switch (indexsize)
+		switch (code & 0x3)
 		{
 			case 0:
-				index = *sp;
+				index = sp[0];
 				sp++;
-				srcsize--;
 				break;
 
 			case 1:
-				index = *((u16 *)sp);
+				index = sp[0] | (sp[1] << 8);
 				sp += 2;
-				srcsize -= 2;
 				break;
 
-			case 2:
-				index = *((u16 *)sp) | (sp[2] << 16);
+			default:
+				index = sp[0] | (sp[1] << 8) | (sp[2] << 16);
 				sp += 3;
-				srcsize -= 3;
 				break;
 		}
 		index++; // 保存時に－１しているので＋１する
 
-		// 展開
-		if (index < conbo)
-		{
-			u32 num;
+		// 参照先が出力済みの範囲外か、出力先が足りない場合はエラー
+		if (index > (size_t)(dp - destp) || conbo > (size_t)(dend - dp)) return -1;
 
-			num = index;
-			while (conbo > num)
-			{
-				memcpy(dp, dp - num, num);
-				dp += num;
-				conbo -= num;
-				num += num;
-			}
-			if (conbo != 0)
-			{
-				memcpy(dp, dp - num, conbo);
-				dp += conbo;
-			}
-		}
-		else
-		{
-			memcpy(dp, dp - index, conbo);
-			dp += conbo;
-		}
+		// 展開
+		dp = LZ_CopyMatch(dp, dend, index, conbo);
 	}
 
+	// 解凍後のサイズと一致しない場合はエラー
+	if (dp != dend) return -1;
+
 	// 解凍後のサイズを返す
 	return (int)destsize;
 }
 
-// バイナリデータを元に CRC32 のハッシュ値を計算する
-u32 DXArchive::HashCRC32(const void *SrcData, size_t SrcDataSize)
+// ファイルを少しずつ解凍する処理用に、データの続きを読み込み用バッファに読み込む( 未処理のデータはバッファの先頭に移動する、0:成功  -1:アーカイブが途中で終わっている )
+static int DecodeStreamFill(DARC_DECODESTREAM *Stream)
 {
-	static DWORD CRC32Table[256];
-	static int CRC32TableInit = 0;
-	DWORD CRC                 = 0xffffffff;
-	BYTE *SrcByte             = (BYTE *)SrcData;
-	DWORD i;
-
-	// テーブルが初期化されていなかったら初期化する
-	if (CRC32TableInit == 0)
+	u64 MoveSize;
+	u32 Remain;
+
+	// 未処理のデータをバッファの先頭に移動する
+	Remain = Stream->InSize - Stream->InPosition;
+	if (Remain != 0 && Stream->InPosition != 0)
+		memmove(Stream->InBuffer, Stream->InBuffer + Stream->InPosition, Remain);
+	Stream->InPosition = 0;
+	Stream->InSize     = Remain;
+
+	// 一度に読み込むサイズになるか、データの終端に来るまで読み込む
+	while (Stream->InSize < Stream->FillSize && Stream->ReadSize < Stream->TotalSize)
 	{
-		DWORD Magic = 0xedb88320; // 0x4c11db7 をビットレベルで順番を逆にしたものが 0xedb88320
-		DWORD j;
-
-		for (i = 0; i < 256; i++)
-		{
-			DWORD Data = i;
-			for (j = 0; j < 8; j++)
-			{
-				int b = (Data & 1);
-				Data >>= 1;
-				if (b != 0)
-				{
-					Data ^= Magic;
-				}
-			}
-			CRC32Table[i] = Data;
-		}
+		MoveSize = Stream->FillSize - Stream->InSize;
+		if (MoveSize > Stream->TotalSize - Stream->ReadSize) MoveSize = Stream->TotalSize - Stream->ReadSize;
 
-		// テーブルを初期化したフラグを立てる
-		CRC32TableInit = 1;
-	}
+		if (DXArchive::DecodeStreamReadAt(Stream, Stream->ReadSize, Stream->InBuffer + Stream->InSize, MoveSize) < 0) return -1;
 
-	for (i = 0; i < SrcDataSize; i++)
-	{
-		CRC = CRC32Table[(BYTE)(CRC ^ SrcByte[i])] ^ (CRC >> 8);
+		Stream->InSize += (u32)MoveSize;
+		Stream->ReadSize += MoveSize;
 	}
 
-	return CRC ^ 0xffffffff;
-}
+	// 先頭の少しだけを読み込む場合に余計な読み込みをしないように、一度に読み込むサイズは小さいサイズから倍々で増やしていく
+	if (Stream->FillSize < DXA_STREAMBUFFERSIZE) Stream->FillSize *= 2;
 
-int DXArchive::EncodeArchiveOneDirectoryWolf(const TCHAR *OutputFileName, const TCHAR *DirectoryPath, bool Press, const char *KeyString_, uint16_t cryptVersion)
-{
-	return EncodeArchiveOneDirectory(OutputFileName, DirectoryPath, Press, true, 0xC, KeyString_, false, false, false, cryptVersion);
+	return 0;
 }
 
-// アーカイブファイルを作成する(ディレクトリ一個だけ)
-int DXArchive::EncodeArchiveOneDirectory(const TCHAR *OutputFileName, const TCHAR *DirectoryPath, bool Press, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString_, bool NoKey, bool OutputStatus, bool MaxPress, uint16_t cryptVersion)
+// 先頭部分・途中部分・末尾部分を繋げたデータの指定の位置から読み込む( LZ 圧縮されていない場合は解凍後のデータの任意の位置を読み込める、0:成功  -1:アーカイブが途中で終わっている )
+int DXArchive::DecodeStreamReadAt(DARC_DECODESTREAM *Stream, u64 Position, void *Buffer, u64 Size)
 {
-	int FileNum, Result;
-	// TCHAR **FilePathList, *NameBuffer ;
-
-	std::vector<std::wstring> filePathList;
-
-	// ファイルの数を取得する
-	FileNum = GetDirectoryFilePath(DirectoryPath, NULL);
-	if (FileNum < 0) return -1;
+	u8 *dp = (u8 *)Buffer;
+	u64 Offset, MoveSize;
 
-	// ファイルの数の分だけファイル名とファイルポインタの格納用のメモリを確保する
-	// NameBuffer = (TCHAR *)malloc( FileNum * ( 256 + sizeof(TCHAR ) ) ) ;
-
-	// ファイルのパスを取得する
-	GetDirectoryFilePath(DirectoryPath, &filePathList);
-
-	// ファイルパスのリストを作成する
-	// FilePathList = (TCHAR **)( NameBuffer + FileNum * 256 ) ;
-	// for( i = 0 ; i < FileNum ; i ++ )
-	//	FilePathList[i] = NameBuffer + i * 256 ;
+	while (Size > 0)
+	{
+		MoveSize = Size;
 
-	// エンコード
-	Result = EncodeArchive(OutputFileName, filePathList, FileNum, Press, AlwaysHuffman, HuffmanEncodeKB, KeyString_, NoKey, OutputStatus, MaxPress, cryptVersion);
+		if (Position < Stream->HeadSize)
+		{
+			// 先頭部分はメモリ上からコピーする
+			Offset = Position;
+			if (MoveSize > Stream->HeadSize - Offset) MoveSize = Stream->HeadSize - Offset;
+			memcpy(dp, Stream->HeadData + Offset, (size_t)MoveSize);
+		}
+		else if (Position < Stream->HeadSize + Stream->BodySize)
+		{
+			// 途中部分はアーカイブから読み込む( 読み込み元は他の処理と共有している場合があるので位置を指定して読み込む )
+			Offset = Position - Stream->HeadSize;
+			if (MoveSize > Stream->BodySize - Offset) MoveSize = Stream->BodySize - Offset;
+			if (KeyConvSourceReadAt(dp, MoveSize, Stream->Src, Stream->BodyPosition + Offset, Stream->UseKey ? Stream->Key : NULL, Stream->Crypt, Stream->BodyKeyPosition + Offset) != (s64)MoveSize)
+				return -1;
+		}
+		else
+		{
+			// 末尾部分はメモリ上からコピーする
+			Offset = Position - Stream->HeadSize - Stream->BodySize;
+			if (MoveSize > Stream->FootSize - Offset) MoveSize = Stream->FootSize - Offset;
+			memcpy(dp, Stream->FootData + Offset, (size_t)MoveSize);
+		}
 
-	// 確保したメモリの解放
-	// free( NameBuffer ) ;
+		dp += MoveSize;
+		Position += MoveSize;
+		Size -= MoveSize;
+	}
 
-	// 結果を返す
-	return Result;
+	return 0;
 }
 
-// アーカイブファイルを作成する
-int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std::wstring> &FileOrDirectoryPath, int FileNum, bool Press, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString_, bool NoKey, bool OutputStatus, bool MaxPress, uint16_t cryptVersion)
+// ファイルを少しずつ解凍する準備をする( Dest に DataSize 以上のメモリ領域を渡すとそこに解凍する、0:成功  -1:失敗 )
+int DXArchive::DecodeStreamOpen(DARC_DECODESTREAM *Stream, DARC_FILEHEAD *File, u8 HuffmanEncodeKB, DARC_SOURCE *Src, s64 DataPosition, unsigned char *Key, const DARC_CRYPTINFO *Crypt, void *Dest)
 {
-	DARC_HEAD Head;
-	DARC_DIRECTORY Directory, *DirectoryP;
-	u64 HeaderHuffDataSize;
-	SIZESAVE SizeSave;
-	FILE *DestFp;
-	u8 *NameP, *FileP, *DirP;
-	int i;
-	u32 Type;
-	void *TempBuffer;
-	u8 Key[DXA_KEY_BYTES];
-	char KeyString[DXA_KEY_STRING_LENGTH + 1];
-	size_t KeyStringBytes;
-	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
-	DARC_ENCODEINFO EncodeInfo;
+	u64 PressSize;
 
-	// 状況出力を行う場合はファイルの総数を数える
-	EncodeInfo.CompFileNum  = 0;
-	EncodeInfo.TotalFileNum = 0;
-	EncodeInfo.OutputStatus = OutputStatus;
-	if (EncodeInfo.OutputStatus)
-	{
-		for (i = 0; i < FileNum; i++)
-		{
-			// 指定されたファイルがあるかどうか検査
-			Type = GetFileAttributes(FileOrDirectoryPath[i].c_str());
-			if ((signed int)Type == -1) continue;
+	memset(Stream, 0, sizeof(DARC_DECODESTREAM));
+	Stream->Src      = Src;
+	Stream->Crypt    = Crypt;
+	Stream->UseKey   = Key != NULL;
+	Stream->Press    = File->PressDataSize != 0xffffffffffffffff;
+	Stream->DataSize = File->DataSize;
+	if (Key != NULL) memcpy(Stream->Key, Key, DXA_KEY_BYTES);
 
-			// ファイルのタイプによって処理を分岐
-			if ((Type & FILE_ATTRIBUTE_DIRECTORY) != 0)
-			{
-				FILE_INFOLIST FileList;
+	// 読み込むデータのサイズは LZ 圧縮されている場合は圧縮後のサイズ、されていない場合は元のサイズ
+	PressSize = Stream->Press ? File->PressDataSize : File->DataSize;
 
-				// フォルダ以下のファイルを取得する
-				CreateFileList(FileOrDirectoryPath[i].c_str(), &FileList, TRUE, TRUE, NULL, NULL, NULL);
+	// ハフマン圧縮されているかどうかで処理を分岐
+	if (File->HuffPressDataSize != 0xffffffffffffffff)
+	{
+		void *HuffPressData;
+		u64 HuffSize, DivSize;
 
-				// フォルダ以下のファイル数を加算する
-				EncodeInfo.TotalFileNum += FileList.Num;
+		// ハフマン圧縮データを読み込む( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+		HuffPressData = calloc((size_t)(File->HuffPressDataSize + HUFFMAN_HEAD_MAXSIZE), 1);
+		if (HuffPressData == NULL) goto ERR;
+		if (KeyConvSourceReadAt(HuffPressData, File->HuffPressDataSize, Src, DataPosition, Key, Crypt, File->DataSize) != (s64)File->HuffPressDataSize)
+		{
+			free(HuffPressData);
+			goto ERR;
+		}
 
-				// ファイルリスト情報の後始末
-				ReleaseFileList(&FileList);
-			}
-			else
-			{
-				// ファイルだった場合はファイルの数を増やす
-				EncodeInfo.TotalFileNum++;
-			}
+		// 鍵が違う場合などでハフマン圧縮のヘッダが壊れていたらエラー
+		if (Huffman_GetPressSize(HuffPressData, &HuffSize) > File->HuffPressDataSize || HuffSize > PressSize)
+		{
+			free(HuffPressData);
+			goto ERR;
 		}
-	}
 
-	// 鍵文字列の保存と鍵の作成
-	if (NoKey == false)
-	{
-		// 指定が無い場合はデフォルトの鍵文字列を使用する
-		if (KeyString_ == NULL)
+		// ハフマン圧縮データを解凍
+		Stream->HuffBuffer = malloc((size_t)(HuffSize == 0 ? 1 : HuffSize));
+		if (Stream->HuffBuffer == NULL)
 		{
-			KeyString_ = DefaultKeyString;
+			free(HuffPressData);
+			goto ERR;
 		}
+		Huffman_Decode(HuffPressData, Stream->HuffBuffer);
+		free(HuffPressData);
 
-		KeyStringBytes = CL_strlen(CHARCODEFORMAT_ASCII, KeyString_);
-		if (KeyStringBytes > DXA_KEY_STRING_LENGTH)
+		// ファイルの前後のみハフマン圧縮している場合は、解凍したデータの前半を先頭部分、後半を末尾部分とし、途中部分はアーカイブから読み込む
+		if (HuffmanEncodeKB != 0xff && PressSize > (u64)HuffmanEncodeKB * 1024 * 2)
 		{
-			KeyStringBytes = DXA_KEY_STRING_LENGTH;
+			DivSize = (u64)HuffmanEncodeKB * 1024;
+			if (HuffSize < DivSize * 2) goto ERR;
+
+			Stream->HeadData        = (u8 *)Stream->HuffBuffer;
+			Stream->HeadSize        = DivSize;
+			Stream->BodyPosition    = DataPosition + File->HuffPressDataSize;
+			Stream->BodyKeyPosition = File->DataSize + File->HuffPressDataSize;
+			Stream->BodySize        = PressSize - DivSize * 2;
+			Stream->FootData        = (u8 *)Stream->HuffBuffer + DivSize;
+			Stream->FootSize        = DivSize;
 		}
-		memcpy(KeyString, KeyString_, KeyStringBytes);
-		KeyString[KeyStringBytes] = '\0';
+		else
+		{
+			if (HuffSize < PressSize) goto ERR;
 
-		// 鍵の作成
-		KeyCreate(KeyString, KeyStringBytes, Key);
+			Stream->HeadData = (u8 *)Stream->HuffBuffer;
+			Stream->HeadSize = PressSize;
+		}
+	}
+	else
+	{
+		Stream->BodyPosition    = DataPosition;
+		Stream->BodyKeyPosition = File->DataSize;
+		Stream->BodySize        = PressSize;
 	}
+	Stream->TotalSize = PressSize;
 
-	// ファイル読み込みに使用するバッファの確保
-	TempBuffer = malloc(DXA_BUFFERSIZE);
+	// 読み込み用バッファの確保
+	Stream->InBuffer = (u8 *)malloc(DXA_STREAMBUFFERSIZE);
+	if (Stream->InBuffer == NULL) goto ERR;
+	Stream->FillSize = 0x1000;
 
-	// 出力ファイルを開く
-	DestFp = _tfopen(OutputFileName, TEXT("wb+"));
+	// LZ 圧縮されている場合はヘッダを読み込む
+	if (Stream->Press)
+	{
+		u32 destsize, srcsize;
+		const u8 *sp;
 
-	g_cryptVersion = cryptVersion;
-	g_newCrypt     = (cryptVersion >= 331 && cryptVersion < 1000 || cryptVersion >= 1010);
-	g_chacha20     = cryptVersion == 0x64 || cryptVersion == 0xC8;
+		if (DecodeStreamFill(Stream) < 0 || Stream->InSize < 9) goto ERR;
 
-	if (cryptVersion == 0xC8)
-	{
-		std::array<uint8_t, 4> data;
-		std::array<uint8_t, 64> key;
+		sp       = Stream->InBuffer;
+		destsize = sp[0] | (sp[1] << 8) | (sp[2] << 16) | ((u32)sp[3] << 24);
+		srcsize  = sp[4] | (sp[5] << 8) | (sp[6] << 16) | ((u32)sp[7] << 24);
+		if (destsize != File->DataSize || srcsize < 9 || srcsize > PressSize) goto ERR;
+		Stream->KeyCode    = sp[8];
+		Stream->InPosition = 9;
 
-		std::memcpy(data.data(), (uint8_t *)KeyString_ + KeyStringBytes + 1, 4);
-		chacha20_keySetup(data, key);
+		// 圧縮データの後ろにある余分なデータは読み込まないようにする
+		if (Stream->ReadSize > srcsize)
+		{
+			Stream->InSize -= (u32)(Stream->ReadSize - srcsize);
+			Stream->ReadSize = srcsize;
+		}
+		Stream->TotalSize = srcsize;
+	}
+
+	// 解凍したデータを格納するメモリ領域の準備( LZ 圧縮されていない場合は出力先の指定が無ければ読み込み用バッファをそのまま返す )
+	if (Dest != NULL)
+	{
+		Stream->Window     = (u8 *)Dest;
+		Stream->WindowSize = File->DataSize;
+	}
+	else if (Stream->Press)
+	{
+		Stream->WindowSize  = File->DataSize < DXA_STREAMWINDOWSIZE ? File->DataSize : DXA_STREAMWINDOWSIZE;
+		Stream->Window      = (u8 *)malloc((size_t)(Stream->WindowSize == 0 ? 1 : Stream->WindowSize));
+		Stream->WindowAlloc = true;
+		if (Stream->Window == NULL) goto ERR;
+	}
+
+	// 終了
+	return 0;
+
+ERR:
+	DecodeStreamClose(Stream);
+	return -1;
+}
+
+// ファイルの続きを解凍する( 戻り値:解凍したサイズ( 0:終端  -1:エラー )、*Data には解凍したデータの先頭アドレスが入り、次の呼び出しまで有効 )
+// LZ 圧縮されている場合は圧縮コードの途中で止まらないので、Size より最大で MAX_COPYSIZE バイト多く解凍することがある
+s64 DXArchive::DecodeStreamRead(DARC_DECODESTREAM *Stream, u64 Size, u8 **Data)
+{
+	u32 code, keycode, conbo, index;
+	const u8 *sp, *send, *lp;
+	u8 *dp, *dstart, *dtarget, *dend;
+	u64 Remain;
+
+	// 残りが無い場合は終了
+	Remain = Stream->DataSize - Stream->OutputSize;
+	if (Remain == 0 || Size == 0) return 0;
+	if (Size > Remain) Size = Remain;
+
+	// LZ 圧縮されていない場合は読み込んだデータをそのまま返す
+	if (Stream->Press == false)
+	{
+		if (Stream->InPosition == Stream->InSize && DecodeStreamFill(Stream) < 0) return -1;
+		if (Stream->InPosition == Stream->InSize) return -1;
+
+		if (Size > Stream->InSize - Stream->InPosition) Size = Stream->InSize - Stream->InPosition;
+		dp = Stream->InBuffer + Stream->InPosition;
+		Stream->InPosition += (u32)Size;
+
+		// 出力先が指定されている場合はコピーする
+		if (Stream->Window != NULL)
+		{
+			memcpy(Stream->Window + Stream->WindowUsed, dp, (size_t)Size);
+			dp = Stream->Window + Stream->WindowUsed;
+			Stream->WindowUsed += Size;
+		}
+
+		Stream->OutputSize += Size;
+		*Data = dp;
+		return (s64)Size;
+	}
+
+	// 確保した領域に解凍する場合は、一度に解凍するサイズを制限し、
+	// 空きが足りない場合は参照される可能性のある範囲だけを残して解凍したデータを先頭に移動する
+	if (Stream->WindowAlloc)
+	{
+		if (Size > MAX_POSITION - MAX_COPYSIZE) Size = MAX_POSITION - MAX_COPYSIZE;
+
+		if (Stream->WindowSize - Stream->WindowUsed < Size + MAX_COPYSIZE && Stream->WindowUsed > MAX_POSITION)
+		{
+			memmove(Stream->Window, Stream->Window + Stream->WindowUsed - MAX_POSITION, MAX_POSITION);
+			Stream->WindowUsed = MAX_POSITION;
+		}
+	}
+
+	// 展開開始
+	keycode = Stream->KeyCode;
+	sp      = Stream->InBuffer + Stream->InPosition;
+	send    = Stream->InBuffer + Stream->InSize;
+	dp      = Stream->Window + Stream->WindowUsed;
+	dstart  = dp;
+	dtarget = dp + Size;
+	dend    = dp + (Stream->WindowSize - Stream->WindowUsed < Remain ? Stream->WindowSize - Stream->WindowUsed : Remain);
+	while (dp < dtarget)
+	{
+		// 圧縮コードが途中で切れないように、残りが圧縮コードの最大サイズ( ６バイト )未満になったら続きを読み込む
+		if (send - sp < 6 && Stream->ReadSize < Stream->TotalSize)
+		{
+			Stream->InPosition = (u32)(sp - Stream->InBuffer);
+			if (DecodeStreamFill(Stream) < 0) return -1;
+			sp   = Stream->InBuffer + Stream->InPosition;
+			send = Stream->InBuffer + Stream->InSize;
+		}
+
+		// 圧縮データが足りない場合はエラー
+		if (sp == send) return -1;
+
+		// キーコードか同かで処理を分岐
+		if (sp[0] != keycode)
+		{
+			// 非圧縮コードの場合は次のキーコードまでまとめて出力( 今回解凍するサイズを超える分は次回に回す )
+			lp = FindKeyCode(sp, send, (u8)keycode);
+			if ((size_t)(lp - sp) > (size_t)(dtarget - dp)) lp = sp + (dtarget - dp);
+
+			memcpy(dp, sp, lp - sp);
+			dp += lp - sp;
+			sp = lp;
+			continue;
+		}
+
+		// キーコードの後に何もない場合はエラー
+		if (send - sp < 2) return -1;
+
+		// キーコードが連続していた場合はキーコード自体を出力
+		if (sp[1] == keycode)
+		{
+			*dp = (u8)keycode;
+			dp++;
+			sp += 2;
+
+			continue;
+		}
+
+		// 第一バイトを得る
+		code = sp[1];
+
+		// もしキーコードよりも大きな値だった場合はキーコード
+		// とのバッティング防止の為に＋１しているので－１する
+		if (code > keycode) code--;
+
+		sp += 2;
+
+		// 参照相対アドレスのバイト数が不正な場合や、圧縮コードが途中で切れている場合はエラー
+		if ((code & 0x3) == 3 || send - sp < (s64)((code >> 2) & 0x1) + (code & 0x3) + 1) return -1;
+
+		// 連続長を取得する
+		conbo = code >> 3;
+		if (code & (0x1 << 2))
+		{
+			conbo |= *sp << 5;
+			sp++;
+		}
+		conbo += MIN_COMPRESS; // 保存時に減算した最小圧縮バイト数を足す
+
+		// 参照相対アドレスを取得する
+		switch (code & 0x3)
+		{
+			case 0:
+				index = sp[0];
+				sp++;
+				break;
+
+			case 1:
+				index = sp[0] | (sp[1] << 8);
+				sp += 2;
+				break;
+
+			default:
+				index = sp[0] | (sp[1] << 8) | (sp[2] << 16);
+				sp += 3;
+				break;
+		}
+		index++; // 保存時に－１しているので＋１する
+
+		// 参照先が保持している範囲外か、出力先が足りない場合はエラー
+		if (index > (size_t)(dp - Stream->Window) || conbo > (size_t)(dend - dp)) return -1;
+
+		// 展開
+		dp = LZ_CopyMatch(dp, dend, index, conbo);
+	}
+
+	Stream->InPosition = (u32)(sp - Stream->InBuffer);
+	Stream->WindowUsed += dp - dstart;
+	Stream->OutputSize += dp - dstart;
+
+	// 全て解凍した場合は圧縮データを使い切っていなければエラー
+	if (Stream->OutputSize == Stream->DataSize && (sp != send || Stream->ReadSize != Stream->TotalSize)) return -1;
+
+	// 解凍したサイズを返す
+	*Data = dstart;
+	return dp - dstart;
+}
+
+// ファイルを少しずつ解凍する処理の後始末をする
+void DXArchive::DecodeStreamClose(DARC_DECODESTREAM *Stream)
+{
+	free(Stream->HuffBuffer);
+	free(Stream->InBuffer);
+	if (Stream->WindowAlloc) free(Stream->Window);
+	memset(Stream, 0, sizeof(DARC_DECODESTREAM));
+}
+
+// CRC32 のハッシュ値の計算に使用するテーブル( ８バイトずつ計算するために８種類のテーブルを持つ )
+typedef struct tagCRC32_TABLE
+{
+	u32 Table[8][256];
+
+	tagCRC32_TABLE()
+	{
+		u32 Magic = 0xedb88320; // 0x4c11db7 をビットレベルで順番を逆にしたものが 0xedb88320
+		u32 i, j, Data;
+
+		// １バイト分のテーブル
+		for (i = 0; i < 256; i++)
+		{
+			Data = i;
+			for (j = 0; j < 8; j++)
+			{
+				Data = (Data & 1) != 0 ? (Data >> 1) ^ Magic : Data >> 1;
+			}
+			Table[0][i] = Data;
+		}
+
+		// Table[ n ] は Table[ 0 ] の後ろに n バイトの０が続いた場合の値
+		for (i = 0; i < 256; i++)
+		{
+			for (j = 1; j < 8; j++)
+			{
+				Table[j][i] = (Table[j - 1][i] >> 8) ^ Table[0][Table[j - 1][i] & 0xff];
+			}
+		}
+	}
+} CRC32_TABLE;
+
+// バイナリデータを元に CRC32 のハッシュ値を計算する
+u32 DXArchive::HashCRC32(const void *SrcData, size_t SrcDataSize)
+{
+	// テーブルは最初に呼ばれた時に一度だけ初期化する( 複数のスレッドから同時に呼ばれても良い )
+	static const CRC32_TABLE CRC32;
+	const u32 (*Table)[256] = CRC32.Table;
+	const u8 *SrcByte       = (const u8 *)SrcData;
+	u32 CRC                 = 0xffffffff;
+	u32 Data0, Data1;
+
+	// ８バイトずつ計算する
+	for (; SrcDataSize >= 8; SrcDataSize -= 8, SrcByte += 8)
+	{
+		memcpy(&Data0, SrcByte, 4);
+		memcpy(&Data1, SrcByte + 4, 4);
+		Data0 ^= CRC;
+		CRC = Table[7][Data0 & 0xff] ^ Table[6][(Data0 >> 8) & 0xff] ^ Table[5][(Data0 >> 16) & 0xff] ^ Table[4][Data0 >> 24] ^
+			  Table[3][Data1 & 0xff] ^ Table[2][(Data1 >> 8) & 0xff] ^ Table[1][(Data1 >> 16) & 0xff] ^ Table[0][Data1 >> 24];
+	}
+
+	// 残りは１バイトずつ計算する
+	for (; SrcDataSize > 0; SrcDataSize--, SrcByte++)
+	{
+		CRC = Table[0][(u8)(CRC ^ *SrcByte)] ^ (CRC >> 8);
+	}
+
+	return CRC ^ 0xffffffff;
+}
+
+int DXArchive::EncodeArchiveOneDirectoryWolf(const TCHAR *OutputFileName, const TCHAR *DirectoryPath, bool Press, const char *KeyString_, uint16_t cryptVersion)
+{
+	return EncodeArchiveOneDirectory(OutputFileName, DirectoryPath, Press, true, 0xC, KeyString_, false, false, false, cryptVersion);
+}
+
+// アーカイブファイルを作成する(ディレクトリ一個だけ)
+int DXArchive::EncodeArchiveOneDirectory(const TCHAR *OutputFileName, const TCHAR *DirectoryPath, bool Press, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString_, bool NoKey, bool OutputStatus, bool MaxPress, uint16_t cryptVersion)
+{
+	int FileNum, Result;
+	// TCHAR **FilePathList, *NameBuffer ;
+
+	std::vector<std::wstring> filePathList;
+
+	// ファイルの数を取得する
+	FileNum = GetDirectoryFilePath(DirectoryPath, NULL);
+	if (FileNum < 0) return -1;
+
+	// ファイルの数の分だけファイル名とファイルポインタの格納用のメモリを確保する
+	// NameBuffer = (TCHAR *)malloc( FileNum * ( 256 + sizeof(TCHAR ) ) ) ;
+
+	// ファイルのパスを取得する
+	GetDirectoryFilePath(DirectoryPath, &filePathList);
+
+	// ファイルパスのリストを作成する
+	// FilePathList = (TCHAR **)( NameBuffer + FileNum * 256 ) ;
+	// for( i = 0 ; i < FileNum ; i ++ )
+	//	FilePathList[i] = NameBuffer + i * 256 ;
+
+	// エンコード
+	Result = EncodeArchive(OutputFileName, filePathList, FileNum, Press, AlwaysHuffman, HuffmanEncodeKB, KeyString_, NoKey, OutputStatus, MaxPress, cryptVersion);
+
+	// 確保したメモリの解放
+	// free( NameBuffer ) ;
+
+	// 結果を返す
+	return Result;
+}
+
+// アーカイブファイルを作成する
+int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std::wstring> &FileOrDirectoryPath, int FileNum, bool Press, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString_, bool NoKey, bool OutputStatus, bool MaxPress, uint16_t cryptVersion)
+{
+	DARC_HEAD Head;
+	DARC_DIRECTORY Directory, *DirectoryP;
+	u64 HeaderHuffDataSize;
+	SIZESAVE SizeSave;
+	FILE *DestFp;
+	u8 *NameP, *FileP, *DirP;
+	int i;
+	u32 Type;
+	void *TempBuffer;
+	u8 Key[DXA_KEY_BYTES];
+	char KeyString[DXA_KEY_STRING_LENGTH + 1];
+	size_t KeyStringBytes;
+	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
+	DARC_CRYPTINFO Crypt;
+	DARC_ENCODEINFO EncodeInfo;
+	std::vector<DARC_ENCODEJOB> JobList;
+
+	// 状況出力を行う場合はファイルの総数を数える
+	EncodeInfo.CompFileNum  = 0;
+	EncodeInfo.TotalFileNum = 0;
+	EncodeInfo.OutputStatus = OutputStatus;
+	if (EncodeInfo.OutputStatus)
+	{
+		for (i = 0; i < FileNum; i++)
+		{
+			// 指定されたファイルがあるかどうか検査
+			Type = GetFileAttributes(FileOrDirectoryPath[i].c_str());
+			if ((signed int)Type == -1) continue;
+
+			// ファイルのタイプによって処理を分岐
+			if ((Type & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			{
+				FILE_INFOLIST FileList;
+
+				// フォルダ以下のファイルを取得する
+				CreateFileList(FileOrDirectoryPath[i].c_str(), &FileList, TRUE, TRUE, NULL, NULL, NULL);
+
+				// フォルダ以下のファイル数を加算する
+				EncodeInfo.TotalFileNum += FileList.Num;
+
+				// ファイルリスト情報の後始末
+				ReleaseFileList(&FileList);
+			}
+			else
+			{
+				// ファイルだった場合はファイルの数を増やす
+				EncodeInfo.TotalFileNum++;
+			}
+		}
+	}
+
+	// 鍵文字列の保存と鍵の作成
+	if (NoKey == false)
+	{
+		// 指定が無い場合はデフォルトの鍵文字列を使用する
+		if (KeyString_ == NULL)
+		{
+			KeyString_ = DefaultKeyString;
+		}
+
+		KeyStringBytes = CL_strlen(CHARCODEFORMAT_ASCII, KeyString_);
+		if (KeyStringBytes > DXA_KEY_STRING_LENGTH)
+		{
+			KeyStringBytes = DXA_KEY_STRING_LENGTH;
+		}
+		memcpy(KeyString, KeyString_, KeyStringBytes);
+		KeyString[KeyStringBytes] = '\0';
 
-		std::memcpy(g_cc20Key, key.data(), 32);
-		std::memcpy(g_cc20Nonce, key.data() + 34, 12);
+		// 鍵の作成
+		KeyCreate(KeyString, KeyStringBytes, Key);
 	}
 
+	// ファイル読み込みに使用するバッファの確保
+	TempBuffer = malloc(DXA_BUFFERSIZE);
+
+	// 出力ファイルを開く
+	DestFp = _tfopen(OutputFileName, TEXT("wb+"));
+
+	// 暗号化処理の情報を初期化する
+	SetupCryptInfo(&Crypt, cryptVersion, KeyString_, KeyStringBytes);
+
 	uint8_t *pK2 = nullptr;
 
-	if (g_newCrypt)
+	if (Crypt.NewCrypt)
 	{
 		memset(&Head, 0, sizeof(Head));
 
-		memset(g_specialKey, 0, 768);
-
 		if (cryptVersion >= 1010)
 			pK2 = (uint8_t *)KeyString_ + KeyStringBytes + 1;
 
-		initWolfCrypt(cryptVersion, Head.Reserve, g_specialKey, pK2);
+		initWolfCrypt(cryptVersion, Head.Reserve, Crypt.SpecialKey, pK2);
 	}
 
 	// アーカイブのヘッダを出力する
@@ -2216,7 +3482,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		if (Press == false) Head.Flags |= DXA_FLAG_NO_HEAD_PRESS;
 		SetFileApisToANSI();
 
-		KeyConvFileWrite(&Head, sizeof(DARC_HEAD), DestFp, NoKey ? NULL : Key, 0);
+		KeyConvFileWrite(&Head, sizeof(DARC_HEAD), DestFp, NoKey ? NULL : Key, &Crypt, 0);
 	}
 
 	// 各バッファを確保する
@@ -2269,7 +3535,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 	SizeSave.DirectorySize += sizeof(DARC_DIRECTORY);
 	SizeSave.FileSize += sizeof(DARC_FILEHEAD) * FileNum;
 
-	// 渡されたファイルの数だけ処理を繰り返す
+	// 渡されたファイルの数だけテーブルに情報を書き出し、ファイルデータの処理情報を列に追加する
 	for (i = 0; i < FileNum; i++)
 	{
 		// 指定されたファイルがあるかどうか検査
@@ -2280,41 +3546,28 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		if ((Type & FILE_ATTRIBUTE_DIRECTORY) != 0)
 		{
 			// ディレクトリの場合はディレクトリのアーカイブに回す
-			DirectoryEncode((int)Head.CharCodeFormat, const_cast<wchar_t *>(FileOrDirectoryPath[i].c_str()), NameP, DirP, FileP, &Directory, &SizeSave, i, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, &EncodeInfo);
+			DirectoryEncode((int)Head.CharCodeFormat, const_cast<wchar_t *>(FileOrDirectoryPath[i].c_str()), NameP, DirP, FileP, &Directory, &SizeSave, i, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, &JobList);
 		}
 		else
 		{
 			WIN32_FIND_DATA FindData;
 			HANDLE FindHandle;
 			DARC_FILEHEAD File;
-			u8 lKey[DXA_KEY_BYTES];
+			DARC_ENCODEJOB Job;
 			size_t KeyStringBufferBytes;
 
 			// ファイルの情報を得る
 			FindHandle = FindFirstFile(FileOrDirectoryPath[i].c_str(), &FindData);
 			if (FindHandle == INVALID_HANDLE_VALUE) continue;
 
-			// 進行状況出力
-			if (EncodeInfo.OutputStatus)
-			{
-				// 処理ファイル名をセット
-				wcscpy(EncodeInfo.ProcessFileName, FindData.cFileName);
-
-				// ファイル数を増やす
-				EncodeInfo.CompFileNum++;
-
-				// 表示
-				EncodeStatusOutput(&EncodeInfo);
-			}
-
-			// ファイルヘッダをセットする
+			// ファイルヘッダをセットする( データの位置と圧縮後のサイズは書き出す時にセットする )
 			{
 				File.NameAddress       = SizeSave.NameSize;
 				File.Time.Create       = (((LONGLONG)FindData.ftCreationTime.dwHighDateTime) << 32) + FindData.ftCreationTime.dwLowDateTime;
 				File.Time.LastAccess   = (((LONGLONG)FindData.ftLastAccessTime.dwHighDateTime) << 32) + FindData.ftLastAccessTime.dwLowDateTime;
 				File.Time.LastWrite    = (((LONGLONG)FindData.ftLastWriteTime.dwHighDateTime) << 32) + FindData.ftLastWriteTime.dwLowDateTime;
 				File.Attributes        = FindData.dwFileAttributes;
-				File.DataAddress       = SizeSave.DataSize;
+				File.DataAddress       = 0;
 				File.DataSize          = (((LONGLONG)FindData.nFileSizeHigh) << 32) + FindData.nFileSizeLow;
 				File.PressDataSize     = 0xffffffffffffffff;
 				File.HuffPressDataSize = 0xffffffffffffffff;
@@ -2323,414 +3576,744 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 			// ファイル名を書き出す
 			SizeSave.NameSize += AddFileNameData(FindData.cFileName, NameP + SizeSave.NameSize);
 
-			// ファイル個別の鍵を作成
-			if (NoKey == false)
-			{
+			// ファイルヘッダを書き出す
+			memcpy(FileP + Directory.FileHeadAddress + sizeof(DARC_FILEHEAD) * i, &File, sizeof(DARC_FILEHEAD));
+
+			// ファイル単位の処理情報をセット
+			Job.File            = File;
+			Job.FileHeadAddress = Directory.FileHeadAddress + sizeof(DARC_FILEHEAD) * i;
+			Job.SrcPath         = FileOrDirectoryPath[i];
+			Job.FileName        = FindData.cFileName;
+			Job.Buffer          = NULL;
+			Job.Data            = NULL;
+			Job.WriteSize       = 0;
+			Job.Result          = 0;
+			Job.Done            = false;
+
+			// ファイル個別の鍵を作成
+			if (NoKey == false)
+			{
 				KeyStringBufferBytes = CreateKeyFileString((int)Head.CharCodeFormat, KeyString, KeyStringBytes, DirectoryP, &File, FileP, DirP, NameP, (BYTE *)KeyStringBuffer);
-				KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
+				KeyCreate(KeyStringBuffer, KeyStringBufferBytes, Job.Key);
 			}
 
-			// ファイルデータを書き出す
-			if (File.DataSize != 0)
+			// 処理情報の列に追加
+			JobList.push_back(Job);
+
+			// Find ハンドルを閉じる
+			FindClose(FindHandle);
+		}
+	}
+
+	// ファイルのデータを圧縮して書き出す
+	if (FileEncodeJobList(&JobList, FileP, &SizeSave, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, NoKey, &Crypt, &EncodeInfo) < 0)
+	{
+		fclose(DestFp);
+		free(NameP);
+		free(FileP);
+		free(DirP);
+		free(TempBuffer);
+		EncodeStatusErase();
+		return -1;
+	}
+
+	// バッファに溜め込んだ各種ヘッダデータを出力する
+	{
+		u8 *PressSource;
+		u64 TotalSize = SizeSave.NameSize + SizeSave.FileSize + SizeSave.DirectorySize;
+
+		// 全部のデータを纏める
+		PressSource = (u8 *)malloc((size_t)TotalSize);
+		if (PressSource == NULL) return -1;
+		memcpy(PressSource, NameP, (size_t)SizeSave.NameSize);
+		memcpy(PressSource + SizeSave.NameSize, FileP, (size_t)SizeSave.FileSize);
+		memcpy(PressSource + SizeSave.NameSize + SizeSave.FileSize, DirP, (size_t)SizeSave.DirectorySize);
+
+		// 圧縮するかどうかで処理を分岐
+		if (Press)
+		{
+			u8 *PressData;
+			int LZDataSize;
+
+			// 圧縮する場合
+
+			// 圧縮データを格納するメモリ領域の確保
+			PressData = (u8 *)malloc((size_t)(TotalSize * 4 + 256 * 2 + 32 * 2));
+			if (PressData == NULL) return -1;
+
+			// LZ圧縮
+			LZDataSize = Encode(PressSource, (u32)TotalSize, PressData, false);
+			if (LZDataSize < 0)
 			{
-				FILE *SrcP;
-				u64 FileSize, WriteSize, MoveSize;
-				bool Huffman     = false;
-				bool AlwaysPress = false;
+				free(PressData);
+				free(PressSource);
+				return -1;
+			}
 
-				// ファイルを開く
-				SrcP = _tfopen(FileOrDirectoryPath[i].c_str(), TEXT("rb"));
+			// ハフマン圧縮
+			HeaderHuffDataSize = Huffman_Encode(PressData, (u64)LZDataSize, PressData + TotalSize * 2 + 32);
 
-				// サイズを得る
-				_fseeki64(SrcP, 0, SEEK_END);
-				FileSize = _ftelli64(SrcP);
-				_fseeki64(SrcP, 0, SEEK_SET);
+			// 纏めたものに鍵を適用して出力
+			KeyConvFileWrite(PressData + TotalSize * 2 + 32, HeaderHuffDataSize, DestFp, NoKey ? NULL : Key, &Crypt, 0);
 
-				// 圧縮の対象となるファイルフォーマットか調べる
-				{
-					u32 Len;
-					Len = (u32)_tcslen(FindData.cFileName);
-					if (Len > 4)
-					{
-						TCHAR *sp;
-
-						sp = &FindData.cFileName[Len - 3];
-						if (StrICmp(sp, TEXT("wav")) == 0 ||
-							StrICmp(sp, TEXT("jpg")) == 0 ||
-							StrICmp(sp, TEXT("png")) == 0 ||
-							StrICmp(sp, TEXT("mpg")) == 0 ||
-							StrICmp(sp, TEXT("mp3")) == 0 ||
-							StrICmp(sp, TEXT("mp4")) == 0 ||
-							StrICmp(sp, TEXT("m4a")) == 0 ||
-							StrICmp(sp, TEXT("ogg")) == 0 ||
-							StrICmp(sp, TEXT("ogv")) == 0 ||
-							StrICmp(sp, TEXT("ops")) == 0 ||
-							StrICmp(sp, TEXT("wmv")) == 0 ||
-							StrICmp(sp, TEXT("tif")) == 0 ||
-							StrICmp(sp, TEXT("tga")) == 0 ||
-							StrICmp(sp, TEXT("bmp")) == 0 ||
-							StrICmp(sp - 1, TEXT("jpeg")) == 0)
-						{
-							Huffman = true;
-						}
+			// メモリの解放
+			free(PressData);
+		}
+		else
+		{
+			// 纏めたものに鍵を適用して出力
+			KeyConvFileWrite(PressSource, TotalSize, DestFp, NoKey ? NULL : Key, &Crypt, 0);
+		}
 
-						// wav や bmp の場合は必ず圧縮する
-						if (StrICmp(sp, TEXT("wav")) == 0 ||
-							StrICmp(sp, TEXT("tga")) == 0 ||
-							StrICmp(sp, TEXT("bmp")) == 0)
-						{
-							AlwaysPress = true;
-						}
-					}
-				}
+		// メモリの解放
+		free(PressSource);
+	}
 
-				// AlwaysHuffman が true の場合は必ずハフマン圧縮する
-				if (AlwaysHuffman)
-				{
-					Huffman = true;
-				}
+	// 再びアーカイブのヘッダを出力する
+	{
+		Head.Head                       = DXA_HEAD;
+		Head.Version                    = DXA_VER;
+		Head.HeadSize                   = (u32)(SizeSave.NameSize + SizeSave.FileSize + SizeSave.DirectorySize);
+		Head.DataStartAddress           = sizeof(DARC_HEAD);
+		Head.FileNameTableStartAddress  = SizeSave.DataSize + Head.DataStartAddress;
+		Head.FileTableStartAddress      = SizeSave.NameSize;
+		Head.DirectoryTableStartAddress = Head.FileTableStartAddress + SizeSave.FileSize;
 
-				// ハフマン圧縮するサイズが 0 の場合はハフマン圧縮を行わない
-				if (HuffmanEncodeKB == 0)
-				{
-					Huffman = false;
-				}
+		_fseeki64(DestFp, 0, SEEK_SET);
+		fwrite64(&Head, sizeof(DARC_HEAD), DestFp);
+	}
 
-				// 圧縮の指定がある場合で、
-				// 必ず圧縮するファイルフォーマットか、ファイルサイズが 10MB 以下の場合は圧縮を試みる
-				if (Press == true && (AlwaysPress || File.DataSize < 10 * 1024 * 1024))
-				{
-					void *SrcBuf, *DestBuf;
-					u32 DestSize, Len;
+	if (Crypt.NewCrypt)
+	{
+		uint8_t roundKey[AES_ROUND_KEY_SIZE] = { 0 };
 
-					// 一部のファイル形式の場合は予め弾く
-					if (AlwaysPress == false && (Len = (int)_tcslen(FindData.cFileName)) > 4)
-					{
-						TCHAR *sp;
-
-						sp = &FindData.cFileName[Len - 3];
-						if (StrICmp(sp, TEXT("wav")) == 0 ||
-							StrICmp(sp, TEXT("jpg")) == 0 ||
-							StrICmp(sp, TEXT("png")) == 0 ||
-							StrICmp(sp, TEXT("mpg")) == 0 ||
-							StrICmp(sp, TEXT("mp3")) == 0 ||
-							StrICmp(sp, TEXT("mp4")) == 0 ||
-							StrICmp(sp, TEXT("ogg")) == 0 ||
-							StrICmp(sp, TEXT("ogv")) == 0 ||
-							StrICmp(sp, TEXT("ops")) == 0 ||
-							StrICmp(sp, TEXT("wmv")) == 0 ||
-							StrICmp(sp - 1, TEXT("jpeg")) == 0) goto NOPRESS;
-					}
+		const uint8_t *pPwd = Head.Reserve;
 
-					// データが丸ごと入るメモリ領域の確保
-					SrcBuf  = calloc(1, (size_t)(FileSize + FileSize * 2 + 64));
-					DestBuf = (u8 *)SrcBuf + FileSize;
+		fseek(DestFp, 0, SEEK_END);
+		int32_t size = ftell(DestFp);
+		fseek(DestFp, 0, SEEK_SET);
 
-					// ファイルを丸ごと読み込む
-					fread64(SrcBuf, FileSize, SrcP);
+		uint8_t *pFileData = new uint8_t[size]();
 
-					// 圧縮する場合は強制的に進行状況出力を更新
-					if (EncodeInfo.OutputStatus)
-					{
-						EncodeStatusOutput(&EncodeInfo, true);
-					}
+		size_t ret = fread(pFileData, 1, size, DestFp);
 
-					// 圧縮
-					DestSize = Encode(SrcBuf, (u32)FileSize, DestBuf, EncodeInfo.OutputStatus, MaxPress);
+		initAES128(roundKey, pPwd, pK2, cryptVersion);
 
-					// 殆ど圧縮出来なかった場合は圧縮無しでアーカイブする
-					if (AlwaysPress == false && ((f64)DestSize / (f64)FileSize > 0.90))
-					{
-						_fseeki64(SrcP, 0L, SEEK_SET);
-						free(SrcBuf);
-						goto NOPRESS;
-					}
+		if ((size - 64) < 0x400)
+			return 0;
 
-					// 圧縮データのサイズを保存する
-					File.PressDataSize = DestSize;
+		uint32_t bodySize = 0x400;
 
-					// ハフマン圧縮も行うかどうかで処理を分岐
-					if (Huffman)
-					{
-						u8 *HuffData;
+		if (isV35(cryptVersion))
+		{
+			uint32_t seed = 0;
 
-						// ハフマン圧縮するサイズによって処理を分岐
-						if (HuffmanEncodeKB == 0xff || DestSize <= (u64)(HuffmanEncodeKB * 1024 * 2))
-						{
-							// ハフマン圧縮用のメモリ領域を確保
-							HuffData = (u8 *)calloc(1, DestSize * 2 + 256 * 2 + 32);
+			if (cryptVersion >= 1020)
+				seed = pK2[0] * pK2[1] + pPwd[2] * pPwd[4] + pPwd[11];
+			else
+				seed = pPwd[2] * pPwd[4] + pPwd[12]; // xorShift32 seed
 
-							// ファイル全体をハフマン圧縮
-							File.HuffPressDataSize = Huffman_Encode(DestBuf, DestSize, HuffData);
+			if (!seed) seed = 1;
+			uint32_t xsState = 0;
+			xorshift32(xsState, seed);
 
-							// 圧縮データに鍵を適用して書き出す
-							WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
-						}
-						else
-						{
-							// ハフマン圧縮用のメモリ領域を確保
-							HuffData = (u8 *)calloc(1, HuffmanEncodeKB * 1024 * 2 * 4 + 256 * 2 + 32);
+			if (size >= static_cast<int32_t>(xorshift32(xsState) % 500 + 800))
+				xorshift32(xsState);
 
-							// ファイルの前後をハフマン圧縮
-							memcpy(HuffData, DestBuf, HuffmanEncodeKB * 1024);
-							memcpy(HuffData + HuffmanEncodeKB * 1024, (u8 *)DestBuf + DestSize - HuffmanEncodeKB * 1024, HuffmanEncodeKB * 1024);
-							File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
+			bodySize = size - 64; // 64 is the header size -- maybe replace with a constant
 
-							// ハフマン圧縮した部分を書き出す
-							KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+			if (bodySize >= (xorshift32(xsState) % 500 + 800))
+				bodySize = (xorshift32(xsState) % 500) + 800;
+		}
 
-							// ハフマン圧縮していない箇所を書き出す
-							WriteSize = File.HuffPressDataSize + DestSize - HuffmanEncodeKB * 1024 * 2;
-							WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite((u8 *)DestBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
-						}
+		aesCtrXCrypt(pFileData + 64, roundKey, bodySize);
+		aesCtrXCrypt(pFileData + Head.FileNameTableStartAddress, roundKey, size - static_cast<int32_t>(Head.FileNameTableStartAddress));
 
-						// メモリの解放
-						free(HuffData);
-					}
-					else
-					{
-						// 圧縮データを反転して書き出す
-						WriteSize = (DestSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-						KeyConvFileWrite(DestBuf, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
-					}
+		initWolfCrypt(cryptVersion, pPwd, Crypt.SpecialKey, nullptr, pFileData, 64, size - 64, true, KeyString_);
 
-					// メモリの解放
-					free(SrcBuf);
-				}
+		cryptAddresses(pFileData, pPwd, cryptVersion);
+
+		fseek(DestFp, 0, SEEK_SET);
+		fwrite64(pFileData, size, DestFp);
+
+		delete[] pFileData;
+	}
+
+	// 書き出したファイルを閉じる
+	fclose(DestFp);
+
+	// 確保したバッファを開放する
+	free(NameP);
+	free(FileP);
+	free(DirP);
+	free(TempBuffer);
+
+	// 圧縮状況表示をクリア
+	EncodeStatusErase();
+
+	// 終了
+	return 0;
+}
+
+// 展開するアーカイブファイルを開き、ヘッダのテーブルを展開する( 0:成功  -1:失敗 )
+int DXArchive::DecodeArchiveOpen(DARC_DECODEARCHIVE *Arc, const TCHAR *ArchiveName, const char *KeyString_)
+{
+	u8 Key[DXA_KEY_BYTES];
+	TCHAR ArcPath[MAX_PATH];
+
+	Arc->HeadBuffer = NULL;
+
+	// 鍵文字列の保存と鍵の作成
+	{
+		// 指定が無い場合はデフォルトの鍵文字列を使用する
+		if (KeyString_ == NULL)
+		{
+			KeyString_ = DefaultKeyString;
+		}
+
+		Arc->KeyStringBytes = CL_strlen(CHARCODEFORMAT_ASCII, KeyString_);
+		if (Arc->KeyStringBytes > DXA_KEY_STRING_LENGTH)
+		{
+			Arc->KeyStringBytes = DXA_KEY_STRING_LENGTH;
+		}
+		memcpy(Arc->KeyString, KeyString_, Arc->KeyStringBytes);
+		Arc->KeyString[Arc->KeyStringBytes] = '\0';
+
+		// 鍵の作成
+		KeyCreate(Arc->KeyString, Arc->KeyStringBytes, Key);
+	}
+
+	// アーカイブファイルを開く
+	Arc->ArcP = _tfopen(ArchiveName, TEXT("rb"));
+	if (Arc->ArcP == NULL) return -1;
+
+	// 展開用のスレッドが開き直せるようにアーカイブファイルのフルパスを取得しておく
+	GetFullPathName(ArchiveName, MAX_PATH, ArcPath, NULL);
+	Arc->ArcPath = ArcPath;
+
+	// 読み込み元はアーカイブファイル( メモリにマップできた場合はマップしたイメージ )
+	Arc->Src.fp        = Arc->ArcP;
+	Arc->Src.Image     = NULL;
+	Arc->Src.ImageSize = 0;
+	Arc->Src.Position  = 0;
+	Arc->Src.ImageCrypt = NULL;
+	if (MapArchiveFile(&Arc->ArcMap, ArchiveName) == 0)
+	{
+		Arc->Src.Image     = Arc->ArcMap.Image;
+		Arc->Src.ImageSize = Arc->ArcMap.Size;
+	}
+
+	// ヘッダを解析する
+	{
+		DARC_HEAD &Head = Arc->Head;
+		DARC_SOURCE &Src = Arc->Src;
+		DARC_CRYPTINFO &Crypt = Arc->Crypt;
+		s64 FileSize;
+
+		// ヘッダの読み込み
+		if (SourceRead(&Src, &Head, sizeof(DARC_HEAD)) != sizeof(DARC_HEAD)) goto ERR;
+
+		// ＩＤの検査
+		if (Head.Head != DXA_HEAD)
+		{
+			goto ERR;
+		}
+
+		// バージョン検査
+		if (Head.Version > DXA_VER || Head.Version < DXA_VER_MIN) goto ERR;
+
+		const uint16_t cryptVersion = Head.Flags >> 16;
+
+		// 暗号化処理の情報を初期化する
+		SetupCryptInfo(&Crypt, cryptVersion, KeyString_, Arc->KeyStringBytes);
+
+		if (Crypt.NewCrypt)
+		{
+			const uint8_t *pPwd = Head.Reserve;
+
+			cryptAddresses((uint8_t *)&Head, pPwd, cryptVersion);
+
+			const s64 size = SourceSize(&Src);
+
+			uint8_t *pK2 = nullptr;
+
+			if (cryptVersion >= 1010)
+				pK2 = (uint8_t *)KeyString_ + Arc->KeyStringBytes + 1;
+
+			// Too small to hold the AES encrypted body, so it can't be a valid archive
+			if ((size - 64) < 0x400) goto ERR;
+
+			uint32_t bodySize = 0x400;
+
+			if (isV35(cryptVersion))
+			{
+				uint32_t seed = 0;
+
+				if (cryptVersion >= 1020)
+					seed = pK2[0] * pK2[1] + pPwd[2] * pPwd[4] + pPwd[11];
 				else
-				{
-				NOPRESS:
-					// ハフマン圧縮も行うかどうかで処理を分岐
-					if (Press && Huffman)
-					{
-						u8 *SrcBuf, *HuffData;
+					seed = pPwd[2] * pPwd[4] + pPwd[12]; // xorShift32 seed
+
+				if (!seed) seed = 1;
+				uint32_t xsState = 0;
+				xorshift32(xsState, seed);
+
+				if (size >= static_cast<s64>(xorshift32(xsState) % 500 + 800))
+					xorshift32(xsState);
+
+				// 64 is the header size -- maybe replace with a constant
+				const uint32_t bodyLimit = xorshift32(xsState) % 500 + 800;
+
+				if (size - 64 >= static_cast<s64>(bodyLimit))
+					bodySize = (xorshift32(xsState) % 500) + 800;
+				else
+					bodySize = static_cast<uint32_t>(size - 64);
+			}
+
+			if (Head.FileNameTableStartAddress < 64 || Head.FileNameTableStartAddress > static_cast<u64>(size)) goto ERR;
+
+			// Only the AES encrypted parts (the body and the header tables) are decrypted here and kept in memory;
+			// the wolf keystream is position based, so SourceImageDecrypt removes it from the file data as it is read.
+			// If the tables overlap the body (tiny archives) the whole image is decrypted instead
+			DARC_IMAGECRYPT &ImageCrypt = Arc->ImageCrypt;
+			const bool split = Head.FileNameTableStartAddress >= 64 + bodySize && Head.FileNameTableStartAddress <= static_cast<u64>(size - 64);
+			const s64 bodyEnd = split ? 64 + static_cast<s64>(bodySize) : size;
+
+			ImageCrypt.Body.resize(static_cast<size_t>(bodyEnd - 64));
+			SourceSeek(&Src, 64);
+			if (SourceRead(&Src, ImageCrypt.Body.data(), bodyEnd - 64) != bodyEnd - 64) goto ERR;
+
+			if (split)
+			{
+				ImageCrypt.Table.resize(static_cast<size_t>(size - static_cast<s64>(Head.FileNameTableStartAddress)));
+				SourceSeek(&Src, Head.FileNameTableStartAddress);
+				if (SourceRead(&Src, ImageCrypt.Table.data(), ImageCrypt.Table.size()) != (s64)ImageCrypt.Table.size()) goto ERR;
+			}
+
+			uint8_t roundKey[AES_ROUND_KEY_SIZE] = { 0 };
+			initWolfCrypt(cryptVersion, pPwd, ImageCrypt.Key, nullptr, nullptr, 0, 0, true, KeyString_);
+			initAES128(roundKey, pPwd, pK2, cryptVersion);
+
+			ImageCrypt.CryptVersion = cryptVersion;
+			ImageCrypt.CryptStart   = 64;
+			ImageCrypt.CryptEnd     = size - 64;
+			ImageCrypt.BodyStart    = 64;
+			ImageCrypt.TableStart   = Head.FileNameTableStartAddress;
+
+			wolfCrypt(ImageCrypt.Key, ImageCrypt.Body.data(), 64, std::min(bodyEnd, size - 64), false, cryptVersion);
+			if (split)
+				wolfCrypt(ImageCrypt.Key, ImageCrypt.Table.data(), ImageCrypt.TableStart, size - 64, false, cryptVersion);
+
+			// The AES counter runs on from the body into the tables
+			aesCtrXCrypt(ImageCrypt.Body.data(), roundKey, bodySize); // For v3.31 this has to be 0x400
+			if (split)
+				aesCtrXCrypt(ImageCrypt.Table.data(), roundKey, ImageCrypt.Table.size());
+			else
+				aesCtrXCrypt(ImageCrypt.Body.data() + (Head.FileNameTableStartAddress - 64), roundKey, static_cast<size_t>(size - static_cast<s64>(Head.FileNameTableStartAddress)));
+
+			Src.ImageCrypt = &ImageCrypt;
+			SourceSeek(&Src, sizeof(DARC_HEAD));
+
+			initWolfCrypt(cryptVersion, pPwd, Crypt.SpecialKey, pK2);
+		}
+
+		// 鍵処理が行われていないかを取得する
+		Arc->NoKey = (Head.Flags & DXA_FLAG_NO_KEY) != 0;
+
+		// ヘッダのサイズ分のメモリを確保する
+		Arc->HeadBuffer = (u8 *)malloc((size_t)Head.HeadSize);
+		if (Arc->HeadBuffer == NULL) goto ERR;
+
+		// ヘッダが圧縮されている場合は解凍する
+		if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
+		{
+			// 圧縮されていない場合は普通に読み込む
+			SourceSeek(&Src, Head.FileNameTableStartAddress);
+			if (KeyConvSourceRead(Arc->HeadBuffer, Head.HeadSize, &Src, Arc->NoKey ? NULL : Key, &Crypt, 0) != (s64)Head.HeadSize) goto ERR;
+		}
+		else
+		{
+			void *HuffHeadBuffer;
+			u64 HuffHeadSize;
+			void *LzHeadBuffer;
+			u64 LzHeadSize;
+
+			// ハフマン圧縮されたヘッダのサイズを取得する
+			FileSize = SourceSize(&Src);
+			if (Head.FileNameTableStartAddress >= (u64)FileSize) goto ERR;
+			SourceSeek(&Src, Head.FileNameTableStartAddress);
+			HuffHeadSize = (u64)FileSize - Head.FileNameTableStartAddress;
+
+			// ハフマン圧縮されたヘッダを読み込むメモリを確保する( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+			HuffHeadBuffer = calloc((size_t)(HuffHeadSize + HUFFMAN_HEAD_MAXSIZE), 1);
+			if (HuffHeadBuffer == NULL) goto ERR;
+
+			// ハフマン圧縮されたヘッダをコピーと暗号化解除
+			if (KeyConvSourceRead(HuffHeadBuffer, HuffHeadSize, &Src, Arc->NoKey ? NULL : Key, &Crypt, 0) != (s64)HuffHeadSize)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
+
+			// ハフマン圧縮されたヘッダの解凍後の容量を取得する( 鍵が違う場合などで圧縮データの情報が壊れていたらエラー )
+			if (Huffman_GetPressSize(HuffHeadBuffer, &LzHeadSize) > HuffHeadSize || LzHeadSize < 9 || LzHeadSize > HuffHeadSize * 8)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
+
+			// ハフマン圧縮されたヘッダの解凍後のデータを格納するメモリ用域の確保
+			LzHeadBuffer = malloc((size_t)LzHeadSize);
+			if (LzHeadBuffer == NULL)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
+
+			// ハフマン圧縮されたヘッダを解凍する
+			Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
 
-						// データが丸ごと入るメモリ領域の確保
-						SrcBuf = (u8 *)calloc(1, (size_t)(FileSize + 32));
+			// LZ圧縮されたヘッダを解凍する( 解凍後のサイズがテーブルのサイズと違う場合は壊れているのでエラー )
+			if (Decode(LzHeadBuffer, Arc->HeadBuffer, LzHeadSize, Head.HeadSize) != (s64)Head.HeadSize)
+			{
+				free(HuffHeadBuffer);
+				free(LzHeadBuffer);
+				goto ERR;
+			}
 
-						// ファイルを丸ごと読み込む
-						fread64(SrcBuf, FileSize, SrcP);
+			// メモリの解放
+			free(HuffHeadBuffer);
+			free(LzHeadBuffer);
+		}
 
-						// ハフマン圧縮するサイズによって処理を分岐
-						if (HuffmanEncodeKB == 0xff || FileSize <= HuffmanEncodeKB * 1024 * 2)
-						{
-							// ハフマン圧縮用のメモリ領域を確保
-							HuffData = (u8 *)calloc(1, (size_t)(FileSize * 2 + 256 * 2 + 32));
+		// 鍵が違う場合などにテーブルの外を参照したりディレクトリを循環して辿ったりしないように、テーブルが壊れていないかを調べる
+		if (CheckHeadTable(&Head, Arc->HeadBuffer, (u64)SourceSize(&Src)) < 0) goto ERR;
 
-							// ファイル全体をハフマン圧縮
-							File.HuffPressDataSize = Huffman_Encode(SrcBuf, FileSize, HuffData);
+		// 各アドレスをセットする
+		Arc->NameP = Arc->HeadBuffer;
+		Arc->FileP = Arc->NameP + Head.FileTableStartAddress;
+		Arc->DirP  = Arc->NameP + Head.DirectoryTableStartAddress;
+	}
 
-							// 圧縮データに鍵を適用して書き出す
-							WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
-						}
-						else
-						{
-							// ハフマン圧縮用のメモリ領域を確保
-							HuffData = (u8 *)calloc(1, HuffmanEncodeKB * 1024 * 2 * 4 + 256 * 2 + 32);
+	// 終了
+	return 0;
 
-							// ファイルの前後をハフマン圧縮
-							memcpy(HuffData, SrcBuf, HuffmanEncodeKB * 1024);
-							memcpy(HuffData + HuffmanEncodeKB * 1024, SrcBuf + FileSize - HuffmanEncodeKB * 1024, HuffmanEncodeKB * 1024);
-							File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
+ERR:
+	DecodeArchiveClose(Arc);
 
-							// ハフマン圧縮した部分を書き出す
-							KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+	// 終了
+	return -1;
+}
 
-							// ハフマン圧縮していない箇所を書き出す
-							WriteSize = File.HuffPressDataSize + FileSize - HuffmanEncodeKB * 1024 * 2;
-							WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite(SrcBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
-						}
+// DecodeArchiveOpen で開いたアーカイブファイルを閉じる
+void DXArchive::DecodeArchiveClose(DARC_DECODEARCHIVE *Arc)
+{
+	// ファイルを閉じる
+	if (Arc->ArcP != NULL) fclose(Arc->ArcP);
+	Arc->ArcP = NULL;
+	UnmapArchiveFile(&Arc->ArcMap);
 
-						// メモリの解放
-						free(SrcBuf);
-						free(HuffData);
-					}
-					else
-					{
-						// 転送開始
-						WriteSize = 0;
-						while (WriteSize < FileSize)
-						{
-							// 転送サイズ決定
-							MoveSize = DXA_BUFFERSIZE < FileSize - WriteSize ? DXA_BUFFERSIZE : FileSize - WriteSize;
-							MoveSize = (MoveSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
+	// 暗号化を解除しておいたデータを解放する
+	std::vector<u8>().swap(Arc->ImageCrypt.Body);
+	std::vector<u8>().swap(Arc->ImageCrypt.Table);
+	Arc->Src.ImageCrypt = NULL;
 
-							// ファイルの鍵適用読み込み
-							memset(TempBuffer, 0, (size_t)MoveSize);
-							KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : lKey, File.DataSize + WriteSize);
+	// ヘッダを読み込んでいたメモリを解放する
+	if (Arc->HeadBuffer != NULL) free(Arc->HeadBuffer);
+	Arc->HeadBuffer = NULL;
+}
 
-							// 書き出し
-							fwrite64(TempBuffer, MoveSize, DestFp);
+// アーカイブファイルを展開する
+int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const char *KeyString_)
+{
+	DARC_DECODEARCHIVE Arc;
+	std::vector<DARC_DECODEJOB> JobList;
+	TCHAR OldDir[MAX_PATH];
+	TCHAR OutputFullPath[MAX_PATH];
+	int Result;
 
-							// 書き出しサイズの加算
-							WriteSize += MoveSize;
-						}
-					}
-				}
+	// アーカイブファイルを開いてヘッダを解析する
+	Result = DecodeArchiveOpen(&Arc, ArchiveName, KeyString_);
+	if (Result < 0) return -1;
 
-				// 書き出したファイルを閉じる
-				fclose(SrcP);
+	// 出力先のディレクトリのフルパスを取得する
+	GetCurrentDirectory(MAX_PATH, OldDir);
+	SetCurrentDirectory(OutputPath);
+	GetCurrentDirectory(MAX_PATH, OutputFullPath);
 
-				// データサイズの加算
-				SizeSave.DataSize += WriteSize;
-			}
+	// 展開するファイルの一覧を作成する( ディレクトリはここで作成しておく )
+	DirectoryDecodeJobList((int)Arc.Head.CharCodeFormat, Arc.NameP, Arc.FileP, Arc.DirP, (DARC_DIRECTORY *)Arc.DirP, OutputFullPath, _tcslen(OutputFullPath), NULL, &JobList);
 
-			// ファイルヘッダを書き出す
-			memcpy(FileP + Directory.FileHeadAddress + sizeof(DARC_FILEHEAD) * i, &File, sizeof(DARC_FILEHEAD));
+	// アーカイブの展開を開始する( アーカイブが途中で終わっているなどで展開できないファイルがあった場合はエラー )
+	Result = FileDecodeJobList(&JobList, Arc.NameP, Arc.DirP, Arc.FileP, &Arc.Head, &Arc.Src, Arc.ArcPath.c_str(), Arc.KeyString, Arc.KeyStringBytes, Arc.NoKey, &Arc.Crypt);
 
-			// Find ハンドルを閉じる
-			FindClose(FindHandle);
-		}
-	}
+	// アーカイブファイルを閉じる
+	DecodeArchiveClose(&Arc);
 
-	// バッファに溜め込んだ各種ヘッダデータを出力する
-	{
-		u8 *PressSource;
-		u64 TotalSize = SizeSave.NameSize + SizeSave.FileSize + SizeSave.DirectorySize;
+	// カレントディレクトリを元に戻す
+	SetCurrentDirectory(OldDir);
 
-		// 全部のデータを纏める
-		PressSource = (u8 *)malloc((size_t)TotalSize);
-		if (PressSource == NULL) return -1;
-		memcpy(PressSource, NameP, (size_t)SizeSave.NameSize);
-		memcpy(PressSource + SizeSave.NameSize, FileP, (size_t)SizeSave.FileSize);
-		memcpy(PressSource + SizeSave.NameSize + SizeSave.FileSize, DirP, (size_t)SizeSave.DirectorySize);
+	// 終了
+	return Result < 0 ? -1 : 0;
+}
 
-		// 圧縮するかどうかで処理を分岐
-		if (Press)
+// 複数のアーカイブファイルを一つのスレッドプールでまとめて展開する
+int DXArchive::DecodeArchiveBatch(std::vector<DARC_DECODEBATCH> *BatchList)
+{
+	size_t BatchNum = BatchList->size();
+	std::vector<DARC_DECODEARCHIVE> Arc(BatchNum);
+	std::vector<std::vector<DARC_DECODEJOB>> JobList(BatchNum);
+	std::unique_ptr<std::atomic<size_t>[]> RemainTaskNum(new std::atomic<size_t>[BatchNum]);
+	std::unique_ptr<std::atomic<int>[]> BatchResult(new std::atomic<int>[BatchNum]);
+	std::vector<DARC_BATCHTASK> Task;
+	int ThreadNum;
+	int Result;
+	size_t i, j;
+
+	// 各アーカイブを開いて展開するファイルの一覧を作成し、処理の単位に分ける
+	for (i = 0; i < BatchNum; i++)
+	{
+		DARC_DECODEBATCH *Batch = &(*BatchList)[i];
+		DARC_BATCHTASK NewTask;
+		TCHAR OutputFullPath[MAX_PATH];
+		u64 TotalCost;
+
+		RemainTaskNum[i] = 0;
+		BatchResult[i]   = 0;
+		NewTask.Batch    = i;
+		NewTask.JobStart = 0;
+		NewTask.JobEnd   = 0;
+
+		// 別形式のアーカイブは分けられないので、ファイルのサイズを大きさの目安にした一つの処理にする
+		if (Batch->Decode)
 		{
-			u8 *PressData;
-			int LZDataSize;
+			FILE *fp = _tfopen(Batch->ArchiveName.c_str(), TEXT("rb"));
 
-			// 圧縮する場合
+			NewTask.Cost = DXA_DECODEBATCH_FILECOST;
+			if (fp != NULL)
+			{
+				_fseeki64(fp, 0, SEEK_END);
+				NewTask.Cost += _ftelli64(fp);
+				fclose(fp);
+			}
 
-			// 圧縮データを格納するメモリ領域の確保
-			PressData = (u8 *)malloc((size_t)(TotalSize * 4 + 256 * 2 + 32 * 2));
-			if (PressData == NULL) return -1;
+			RemainTaskNum[i] = 1;
+			Task.push_back(NewTask);
+			continue;
+		}
 
-			// LZ圧縮
-			LZDataSize = Encode(PressSource, (u32)TotalSize, PressData, false);
+		// アーカイブファイルを開いてヘッダを解析する( ファイルのデータは展開する時に読み込むので、同時に開いておくのはヘッダのテーブルだけ )
+		Result = DecodeArchiveOpen(&Arc[i], Batch->ArchiveName.c_str(), Batch->KeyString);
+		if (Result < 0)
+		{
+			BatchResult[i] = -1;
+			continue;
+		}
 
-			// ハフマン圧縮
-			HeaderHuffDataSize = Huffman_Encode(PressData, (u64)LZDataSize, PressData + TotalSize * 2 + 32);
+		// 展開するファイルの一覧を作成する( ディレクトリはここで作成しておく、展開中はカレントディレクトリを使用しない )
+		GetFullPathName(Batch->OutputPath.c_str(), MAX_PATH, OutputFullPath, NULL);
+		DirectoryDecodeJobList((int)Arc[i].Head.CharCodeFormat, Arc[i].NameP, Arc[i].FileP, Arc[i].DirP, (DARC_DIRECTORY *)Arc[i].DirP, OutputFullPath, _tcslen(OutputFullPath), NULL, &JobList[i]);
 
-			// 纏めたものに鍵を適用して出力
-			KeyConvFileWrite(PressData + TotalSize * 2 + 32, HeaderHuffDataSize, DestFp, NoKey ? NULL : Key, 0);
+		TotalCost = 0;
+		for (j = 0; j < JobList[i].size(); j++)
+		{
+			TotalCost += JobList[i][j].File->DataSize + DXA_DECODEBATCH_FILECOST;
+		}
 
-			// メモリの解放
-			free(PressData);
+		// 小さいアーカイブは一つの処理にまとめ、大きいアーカイブはファイル単位の処理に分ける
+		if (JobList[i].size() == 0)
+		{
+			DecodeArchiveClose(&Arc[i]);
+		}
+		else if (TotalCost < DXA_DECODEBATCH_SPLITSIZE)
+		{
+			NewTask.JobEnd = JobList[i].size();
+			NewTask.Cost   = TotalCost;
+			RemainTaskNum[i] = 1;
+			Task.push_back(NewTask);
 		}
 		else
 		{
-			// 纏めたものに鍵を適用して出力
-			KeyConvFileWrite(PressSource, TotalSize, DestFp, NoKey ? NULL : Key, 0);
+			for (j = 0; j < JobList[i].size(); j++)
+			{
+				NewTask.JobStart = j;
+				NewTask.JobEnd   = j + 1;
+				NewTask.Cost     = JobList[i][j].File->DataSize + DXA_DECODEBATCH_FILECOST;
+				Task.push_back(NewTask);
+			}
+			RemainTaskNum[i] = JobList[i].size();
 		}
-
-		// メモリの解放
-		free(PressSource);
 	}
 
-	// 再びアーカイブのヘッダを出力する
-	{
-		Head.Head                       = DXA_HEAD;
-		Head.Version                    = DXA_VER;
-		Head.HeadSize                   = (u32)(SizeSave.NameSize + SizeSave.FileSize + SizeSave.DirectorySize);
-		Head.DataStartAddress           = sizeof(DARC_HEAD);
-		Head.FileNameTableStartAddress  = SizeSave.DataSize + Head.DataStartAddress;
-		Head.FileTableStartAddress      = SizeSave.NameSize;
-		Head.DirectoryTableStartAddress = Head.FileTableStartAddress + SizeSave.FileSize;
+	// 大きい処理から順に並べる
+	std::stable_sort(Task.begin(), Task.end(), [](const DARC_BATCHTASK &A, const DARC_BATCHTASK &B) { return A.Cost > B.Cost; });
 
-		_fseeki64(DestFp, 0, SEEK_SET);
-		fwrite64(&Head, sizeof(DARC_HEAD), DestFp);
-	}
+	// 使用するスレッドの数を決定する
+	ThreadNum = DecodeThreadNum > 0 ? DecodeThreadNum : (int)std::thread::hardware_concurrency();
+	if (ThreadNum > (int)Task.size()) ThreadNum = (int)Task.size();
+	if (ThreadNum < 1) ThreadNum = 1;
 
-	if (g_newCrypt)
+	// 処理をスレッド毎の列に順番に配る( どのスレッドも大きい処理から始める )
+	std::vector<DARC_BATCHQUEUE> Queue(ThreadNum);
+	for (i = 0; i < (size_t)ThreadNum; i++)
 	{
-		uint8_t roundKey[AES_ROUND_KEY_SIZE] = { 0 };
+		Queue[i].Cost = 0;
+	}
+	for (i = 0; i < Task.size(); i++)
+	{
+		Queue[i % ThreadNum].Task.push_back(i);
+		Queue[i % ThreadNum].Cost += Task[i].Cost;
+	}
 
-		const uint8_t *pPwd = Head.Reserve;
+	// 処理を一つ取り出す( 自分の列が空の場合は、残っている処理が一番大きい列から奪う )
+	auto PopTask = [&](int ThreadIndex, size_t *TaskIndex) -> bool
+	{
+		for (;;)
+		{
+			int Victim = ThreadIndex;
 
-		fseek(DestFp, 0, SEEK_END);
-		int32_t size = ftell(DestFp);
-		fseek(DestFp, 0, SEEK_SET);
+			if (Queue[ThreadIndex].Cost == 0)
+			{
+				u64 MaxCost = 0;
+				int k;
 
-		uint8_t *pFileData = new uint8_t[size]();
+				Victim = -1;
+				for (k = 0; k < ThreadNum; k++)
+				{
+					u64 Cost = Queue[k].Cost;
+					if (Cost <= MaxCost) continue;
+					MaxCost = Cost;
+					Victim  = k;
+				}
 
-		size_t ret = fread(pFileData, 1, size, DestFp);
+				// どの列にも残っていなければ終了
+				if (Victim < 0) return false;
+			}
 
-		initAES128(roundKey, pPwd, pK2, cryptVersion);
+			std::lock_guard<std::mutex> Lock(Queue[Victim].Mutex);
+			if (Queue[Victim].Task.empty()) continue;
 
-		if ((size - 64) < 0x400)
-			return 0;
+			*TaskIndex = Queue[Victim].Task.front();
+			Queue[Victim].Task.pop_front();
+			Queue[Victim].Cost -= Task[*TaskIndex].Cost;
+			return true;
+		}
+	};
 
-		uint32_t bodySize = 0x400;
+	// 展開処理( 読み込み元はスレッド毎にアーカイブを初めて処理する時に用意する )
+	auto DecodeThread = [&](int ThreadIndex)
+	{
+		std::vector<DARC_SOURCE> ThreadSrc(BatchNum);
+		std::vector<bool> ThreadSrcValid(BatchNum, false);
+		char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
+		DARC_SCRATCH Scratch = { NULL, 0 };
+		size_t TaskIndex;
+		size_t k;
 
-		if (isV35(cryptVersion))
+		while (PopTask(ThreadIndex, &TaskIndex))
 		{
-			uint32_t seed = 0;
-
-			if (cryptVersion >= 1020)
-				seed = pK2[0] * pK2[1] + pPwd[2] * pPwd[4] + pPwd[11];
-			else
-				seed = pPwd[2] * pPwd[4] + pPwd[12]; // xorShift32 seed
+			DARC_BATCHTASK *CurTask   = &Task[TaskIndex];
+			DARC_DECODEBATCH *Batch   = &(*BatchList)[CurTask->Batch];
+			DARC_DECODEARCHIVE *CurArc = &Arc[CurTask->Batch];
 
-			if (!seed) seed = 1;
-			xorshift32(seed);
+			// 別形式のアーカイブはそのまま展開する
+			if (Batch->Decode)
+			{
+				if (Batch->Decode() < 0) BatchResult[CurTask->Batch] = -1;
+				continue;
+			}
 
-			if (size >= static_cast<int32_t>(xorshift32() % 500 + 800))
-				xorshift32();
+			// メモリ上のイメージは読み込み位置だけをスレッド毎に持ち、ファイルの場合はスレッド毎に開き直す
+			if (ThreadSrcValid[CurTask->Batch] == false)
+			{
+				ThreadSrc[CurTask->Batch] = CurArc->Src;
+				if (CurArc->Src.Image == NULL)
+				{
+					ThreadSrc[CurTask->Batch].fp = _tfopen(CurArc->ArcPath.c_str(), TEXT("rb"));
+				}
+				ThreadSrcValid[CurTask->Batch] = true;
+			}
 
-			bodySize = size - 64; // 64 is the header size -- maybe replace with a constant
+			if (CurArc->Src.Image == NULL && ThreadSrc[CurTask->Batch].fp == NULL)
+			{
+				BatchResult[CurTask->Batch] = -1;
+			}
+			else
+			{
+				for (k = CurTask->JobStart; k < CurTask->JobEnd; k++)
+				{
+					if (FileDecode(CurArc->NameP, CurArc->DirP, CurArc->FileP, &CurArc->Head, &JobList[CurTask->Batch][k], &ThreadSrc[CurTask->Batch], CurArc->KeyString, CurArc->KeyStringBytes, CurArc->NoKey, KeyStringBuffer, &CurArc->Crypt, &Scratch) < 0)
+					{
+						BatchResult[CurTask->Batch] = -1;
+					}
+				}
+			}
 
-			if (bodySize >= (xorshift32() % 500 + 800))
-				bodySize = (xorshift32() % 500) + 800;
+			// アーカイブの最後の処理が終わったらアーカイブを閉じる
+			if (--RemainTaskNum[CurTask->Batch] == 0)
+			{
+				DecodeArchiveClose(CurArc);
+			}
 		}
 
-		aesCtrXCrypt(pFileData + 64, roundKey, bodySize);
-		aesCtrXCrypt(pFileData + Head.FileNameTableStartAddress, roundKey, size - static_cast<int32_t>(Head.FileNameTableStartAddress));
-
-		initWolfCrypt(cryptVersion, pPwd, g_specialKey, nullptr, pFileData, 64, size - 64, true, KeyString_);
-
-		cryptAddresses(pFileData, pPwd, cryptVersion);
+		// 開き直したアーカイブファイルを閉じる
+		for (k = 0; k < BatchNum; k++)
+		{
+			if (ThreadSrcValid[k] && ThreadSrc[k].Image == NULL && ThreadSrc[k].fp != NULL) fclose(ThreadSrc[k].fp);
+		}
 
-		fseek(DestFp, 0, SEEK_SET);
-		fwrite64(pFileData, size, DestFp);
+		// 作業領域を解放する
+		ScratchRelease(&Scratch);
+	};
 
-		delete[] pFileData;
+	if (ThreadNum == 1)
+	{
+		DecodeThread(0);
 	}
+	else
+	{
+		std::vector<std::thread> Threads;
+		int k;
 
-	// 書き出したファイルを閉じる
-	fclose(DestFp);
+		for (k = 0; k < ThreadNum; k++)
+		{
+			Threads.emplace_back(DecodeThread, k);
+		}
 
-	// 確保したバッファを開放する
-	free(NameP);
-	free(FileP);
-	free(DirP);
-	free(TempBuffer);
+		for (k = 0; k < ThreadNum; k++)
+		{
+			Threads[k].join();
+		}
+	}
 
-	// 圧縮状況表示をクリア
-	EncodeStatusErase();
+	// 結果を保存する
+	Result = 0;
+	for (i = 0; i < BatchNum; i++)
+	{
+		(*BatchList)[i].Result = BatchResult[i];
+		if (BatchResult[i] < 0) Result = -1;
+	}
 
 	// 終了
-	return 0;
+	return Result;
 }
 
-// アーカイブファイルを展開する
-int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const char *KeyString_)
+// アーカイブファイルのヘッダとテーブルだけを解析して、指定の鍵文字列で展開できそうかを調べる( -1:展開できない  0～100:展開できる確からしさ )
+int DXArchive::ProbeArchive(const TCHAR *ArchiveName, const char *KeyString_)
 {
-	u8 *HeadBuffer = NULL;
 	DARC_HEAD Head;
-	u8 *FileP, *NameP, *DirP;
+	DARC_SOURCE Src;
+	DARC_CRYPTINFO Crypt;
 	FILE *ArcP = NULL;
-	TCHAR OldDir[MAX_PATH];
+	u8 *HeadBuffer = NULL;
+	u8 *HuffHeadBuffer = NULL;
+	u8 *LzHeadBuffer = NULL;
 	u8 Key[DXA_KEY_BYTES];
 	char KeyString[DXA_KEY_STRING_LENGTH + 1];
 	size_t KeyStringBytes;
-	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
 	bool NoKey;
+	s64 FileSize;
+	int Score = -1;
 
 	// 鍵文字列の保存と鍵の作成
 	{
@@ -2756,208 +4339,396 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 	ArcP = _tfopen(ArchiveName, TEXT("rb"));
 	if (ArcP == NULL) return -1;
 
-	// 出力先のディレクトリにカレントディレクトリを変更する
-	GetCurrentDirectory(MAX_PATH, OldDir);
-	SetCurrentDirectory(OutputPath);
+	Src.fp        = ArcP;
+	Src.Image     = NULL;
+	Src.ImageSize = 0;
+	Src.Position  = 0;
+	Src.ImageCrypt = NULL;
+	FileSize      = SourceSize(&Src);
 
-	// ヘッダを解析する
+	// ヘッダの読み込み
+	if (FileSize < (s64)sizeof(DARC_HEAD)) goto END;
+	SourceRead(&Src, &Head, sizeof(DARC_HEAD));
+
+	// ＩＤとバージョンの検査
+	if (Head.Head != DXA_HEAD) goto END;
+	if (Head.Version > DXA_VER || Head.Version < DXA_VER_MIN) goto END;
+
+	// 鍵処理が行われていないかを取得する
+	NoKey = (Head.Flags & DXA_FLAG_NO_KEY) != 0;
+
+	// 暗号化処理の情報を初期化する
+	SetupCryptInfo(&Crypt, (u16)(Head.Flags >> 16), KeyString_, KeyStringBytes);
+
+	// Wolf RPG v3.31 以降の暗号化はアーカイブ全体を復号しないとテーブルを読めないので、ヘッダの検査だけで済ませる
+	if (Crypt.NewCrypt)
 	{
-		s64 FileSize;
+		Score = 0;
+		goto END;
+	}
 
-		// ヘッダの読み込み
-		fread64(&Head, sizeof(DARC_HEAD), ArcP);
+	// テーブルがファイルの中に収まっているか調べる
+	if (Head.FileNameTableStartAddress < sizeof(DARC_HEAD) ||
+		Head.FileNameTableStartAddress >= (u64)FileSize ||
+		Head.DataStartAddress > Head.FileNameTableStartAddress)
+		goto END;
 
-		// ＩＤの検査
-		if (Head.Head != DXA_HEAD)
-		{
-			goto ERR;
-		}
+	// ヘッダが圧縮されているかどうかで処理を分岐
+	SourceSeek(&Src, Head.FileNameTableStartAddress);
+	if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
+	{
+		// 圧縮されていない場合はテーブルがファイルの終端を越えていないか調べてから読み込む
+		if (Head.HeadSize > (u64)FileSize - Head.FileNameTableStartAddress) goto END;
 
-		// バージョン検査
-		if (Head.Version > DXA_VER || Head.Version < DXA_VER_MIN) goto ERR;
+		HeadBuffer = (u8 *)malloc((size_t)Head.HeadSize);
+		if (HeadBuffer == NULL) goto END;
 
-		const uint16_t cryptVersion = Head.Flags >> 16;
+		if (KeyConvSourceRead(HeadBuffer, Head.HeadSize, &Src, NoKey ? NULL : Key, &Crypt, 0) != (s64)Head.HeadSize) goto END;
+	}
+	else
+	{
+		u64 HuffHeadSize;
+		u64 LzHeadSize;
 
-		g_cryptVersion = cryptVersion;
-		g_newCrypt     = (cryptVersion >= 331 && cryptVersion < 1000 || cryptVersion >= 1010);
-		g_chacha20     = cryptVersion == 0x64 || cryptVersion == 0xC8;
+		// 鍵が違う場合は圧縮データの情報も壊れているので、範囲外を読まないように後ろに余白を付けて読み込む
+		HuffHeadSize   = (u64)FileSize - Head.FileNameTableStartAddress;
+		HuffHeadBuffer = (u8 *)calloc((size_t)(HuffHeadSize + HUFFMAN_HEAD_MAXSIZE), 1);
+		if (HuffHeadBuffer == NULL) goto END;
 
-		if (cryptVersion == 0xC8)
-		{
-			std::array<uint8_t, 4> data;
-			std::array<uint8_t, 64> key;
+		KeyConvSourceRead(HuffHeadBuffer, HuffHeadSize, &Src, NoKey ? NULL : Key, &Crypt, 0);
 
-			std::memcpy(data.data(), (uint8_t *)KeyString_ + KeyStringBytes + 1, 4);
-			chacha20_keySetup(data, key);
+		// ハフマン圧縮されたデータが読み込んだ範囲に収まっていない場合は鍵が違う
+		if (Huffman_GetPressSize(HuffHeadBuffer, &LzHeadSize) > HuffHeadSize) goto END;
+		if (LzHeadSize < 9 || LzHeadSize > HuffHeadSize * 8) goto END;
 
-			std::memcpy(g_cc20Key, key.data(), 32);
-			std::memcpy(g_cc20Nonce, key.data() + 34, 12);
-		}
+		LzHeadBuffer = (u8 *)malloc((size_t)LzHeadSize);
+		if (LzHeadBuffer == NULL) goto END;
+		Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
 
-		if (g_newCrypt)
-		{
-			const uint8_t *pPwd = Head.Reserve;
+		// LZ圧縮されたデータの先頭にある解凍後のサイズがヘッダのサイズと一致しない場合も鍵が違う
+		if (*((u32 *)LzHeadBuffer) != Head.HeadSize) goto END;
 
-			memset(g_specialKey, 0, 768);
-			cryptAddresses((uint8_t *)&Head, pPwd, cryptVersion);
+		HeadBuffer = (u8 *)malloc((size_t)Head.HeadSize);
+		if (HeadBuffer == NULL) goto END;
 
-			fseek(ArcP, 0, SEEK_END);
-			int32_t size = ftell(ArcP);
-			fseek(ArcP, 0, SEEK_SET);
+		if (Decode(LzHeadBuffer, HeadBuffer, LzHeadSize, Head.HeadSize) < 0) goto END;
+	}
 
-			uint8_t *pFileData = new uint8_t[size]();
+	// テーブルの内容を調べる
+	Score = CheckHeadTable(&Head, HeadBuffer, (u64)FileSize);
 
-			size_t ret = fread(pFileData, 1, size, ArcP);
+END:
+	if (HeadBuffer != NULL) free(HeadBuffer);
+	if (HuffHeadBuffer != NULL) free(HuffHeadBuffer);
+	if (LzHeadBuffer != NULL) free(LzHeadBuffer);
+	fclose(ArcP);
 
-			// Replace the beginning of the file data with the decrypted header
-			std::memcpy(pFileData, &Head, sizeof(DARC_HEAD));
+	// 終了
+	return Score;
+}
 
-			uint8_t roundKey[AES_ROUND_KEY_SIZE] = { 0 };
-			initWolfCrypt(cryptVersion, pPwd, g_specialKey, nullptr, pFileData, 64, size - 64, true, KeyString_);
+// アーカイブファイルのヘッダのテーブルだけを展開して、格納されているファイルの情報を一つずつ Output に渡す( データの読み込みと解凍は行わない、0:成功  -1:失敗 )
+int DXArchive::ListArchive(const TCHAR *ArchiveName, const std::function<void(const DARC_LISTENTRY &Entry)> &Output, const char *KeyString_)
+{
+	DARC_DECODEARCHIVE Arc;
+	int Result;
 
-			uint8_t *pK2 = nullptr;
+	// アーカイブファイルを開いてヘッダのテーブルだけを展開する
+	Result = DecodeArchiveOpen(&Arc, ArchiveName, KeyString_);
+	if (Result < 0) return -1;
 
-			if (cryptVersion >= 1010)
-				pK2 = (uint8_t *)KeyString_ + KeyStringBytes + 1;
+	// ファイルの情報を列挙する
+	DirectoryList(Arc.NameP, Arc.FileP, Arc.DirP, &Arc.Head, (DARC_DIRECTORY *)Arc.DirP, std::wstring(), Output);
 
-			initAES128(roundKey, pPwd, pK2, cryptVersion);
+	// アーカイブファイルを閉じる
+	DecodeArchiveClose(&Arc);
 
-			if ((size - 64) < 0x400)
-				return 0;
+	// 終了
+	return 0;
+}
 
-			uint32_t bodySize = 0x400;
+// 指定のディレクトリデータ以下のファイルの情報を Output に渡す( ディレクトリはその中のファイルより先に渡す )
+int DXArchive::DirectoryList(u8 *NameP, u8 *FileP, u8 *DirP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, const std::wstring &DirPath, const std::function<void(const DARC_LISTENTRY &Entry)> &Output)
+{
+	DARC_LISTENTRY Entry;
+	DARC_FILEHEAD *File;
+	u32 i;
 
-			if (isV35(cryptVersion))
-			{
-				uint32_t seed = 0;
+	File = (DARC_FILEHEAD *)(FileP + Dir->FileHeadAddress);
+	for (i = 0; i < Dir->FileHeadNum; i++, File++)
+	{
+		// アーカイブ内のパスを作成する
+		TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
+		Entry.Path = DirPath.empty() ? std::wstring(pName) : DirPath + TEXT("\\") + pName;
+		delete[] pName;
 
-				if (cryptVersion >= 1020)
-					seed = pK2[0] * pK2[1] + pPwd[2] * pPwd[4] + pPwd[11];
-				else
-					seed = pPwd[2] * pPwd[4] + pPwd[12]; // xorShift32 seed
+		Entry.File = File;
 
-				if (!seed) seed = 1;
-				xorshift32(seed);
+		// ディレクトリかどうかで処理を分岐
+		if (File->Attributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			// ディレクトリの場合は情報を渡してから再帰をかける
+			Entry.DataPosition = 0;
+			Output(Entry);
+
+			DirectoryList(NameP, FileP, DirP, Head, (DARC_DIRECTORY *)(DirP + File->DataAddress), Entry.Path, Output);
+		}
+		else
+		{
+			// ファイルの場合はデータの位置を求めて情報を渡す
+			Entry.DataPosition = Head->DataStartAddress + File->DataAddress;
+			Output(Entry);
+		}
+	}
 
-				if (size >= static_cast<int32_t>(xorshift32() % 500 + 800))
-					xorshift32();
+	// 終了
+	return 0;
+}
 
-				bodySize = size - 64; // 64 is the header size -- maybe replace with a constant
+// 解凍したヘッダのテーブルが正しいかを調べる( -1:壊れている  0～100:ファイルの情報の内、名前のパリティとデータの位置が正しいものの割合 )
+int DXArchive::CheckHeadTable(DARC_HEAD *Head, u8 *HeadBuffer, u64 ArchiveSize)
+{
+	DARC_DIRECTORY *Dir;
+	DARC_FILEHEAD *FileH;
+	u64 i, j, k, NameSize, FileTableSize, DirTableSize, DirNum, DataLimit, Size, CheckNum, ValidNum;
+	u8 *NameP, *FileP, *DirP, *NameData;
+	u32 PackNum, Parity;
+
+	// 各テーブルの大きさを求める
+	if (Head->FileTableStartAddress > Head->DirectoryTableStartAddress ||
+		Head->DirectoryTableStartAddress > Head->HeadSize ||
+		Head->FileTableStartAddress < 4 ||
+		Head->DataStartAddress > ArchiveSize)
+		return -1;
+	NameSize      = Head->FileTableStartAddress;
+	FileTableSize = Head->DirectoryTableStartAddress - Head->FileTableStartAddress;
+	DirTableSize  = Head->HeadSize - Head->DirectoryTableStartAddress;
+	DirNum        = DirTableSize / sizeof(DARC_DIRECTORY);
+	DataLimit     = ArchiveSize - Head->DataStartAddress;
+	if (DirNum == 0) return -1;
+
+	NameP = HeadBuffer;
+	FileP = NameP + Head->FileTableStartAddress;
+	DirP  = NameP + Head->DirectoryTableStartAddress;
+
+	// ルートディレクトリには親ディレクトリが無い
+	Dir = (DARC_DIRECTORY *)DirP;
+	if (Dir->ParentDirectoryAddress != 0xffffffffffffffff) return -1;
+
+	// 全てのディレクトリとファイルの情報を調べる
+	std::vector<bool> DirReferenced((size_t)DirNum, false);
+	CheckNum = 0;
+	ValidNum = 0;
+	for (i = 0; i < DirNum; i++, Dir++)
+	{
+		// 親ディレクトリと自分のファイル情報とファイル情報の列がテーブルの範囲内にあるか
+		// ( 構造体の途中を指していたり、構造体がテーブルの終端を越えていたら壊れている )
+		if (i != 0 &&
+			(Dir->ParentDirectoryAddress > DirTableSize - sizeof(DARC_DIRECTORY) || Dir->ParentDirectoryAddress % sizeof(DARC_DIRECTORY) != 0 ||
+			 FileTableSize < sizeof(DARC_FILEHEAD) || Dir->DirectoryAddress > FileTableSize - sizeof(DARC_FILEHEAD) || Dir->DirectoryAddress % sizeof(DARC_FILEHEAD) != 0))
+			return -1;
+		if (Dir->FileHeadAddress > FileTableSize || Dir->FileHeadAddress % sizeof(DARC_FILEHEAD) != 0 ||
+			Dir->FileHeadNum > (FileTableSize - Dir->FileHeadAddress) / sizeof(DARC_FILEHEAD))
+			return -1;
 
-				if (bodySize >= (xorshift32() % 500 + 800))
-					bodySize = (xorshift32() % 500) + 800;
+		FileH = (DARC_FILEHEAD *)(FileP + Dir->FileHeadAddress);
+		for (j = 0; j < Dir->FileHeadNum; j++, FileH++)
+		{
+			// 名前がテーブルの範囲内にあるか
+			if (FileH->NameAddress > NameSize - 4) return -1;
+			NameData = NameP + FileH->NameAddress;
+			PackNum  = ((u16 *)NameData)[0];
+			if (PackNum * 8 > NameSize - 4 - FileH->NameAddress) return -1;
+
+			// ディレクトリの場合はディレクトリの情報がテーブルの範囲内にあり、親ディレクトリとしてこのディレクトリを指しているか
+			// ( 親を指していなかったり、二箇所から参照されていたりすると、辿る時に循環したり同じディレクトリを何度も辿ったりする )
+			if ((FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			{
+				if (FileH->DataAddress > DirTableSize - sizeof(DARC_DIRECTORY) || FileH->DataAddress % sizeof(DARC_DIRECTORY) != 0 ||
+					((DARC_DIRECTORY *)(DirP + FileH->DataAddress))->ParentDirectoryAddress != (u64)((u8 *)Dir - DirP) ||
+					DirReferenced[FileH->DataAddress / sizeof(DARC_DIRECTORY)])
+					return -1;
+				DirReferenced[FileH->DataAddress / sizeof(DARC_DIRECTORY)] = true;
 			}
 
-			aesCtrXCrypt(pFileData + 64, roundKey, bodySize); // For v3.31 this has to be 0x400
-			aesCtrXCrypt(pFileData + Head.FileNameTableStartAddress, roundKey, size - static_cast<int32_t>(Head.FileNameTableStartAddress));
-
-			// Write to file
-			FILE *fp = fopen("decrypt_temp", "wb");
-			fwrite(pFileData, size, 1, fp);
-			fclose(fp);
-
-			delete[] pFileData;
+			// 以下は壊れていても展開はできるので、確からしさにだけ反映する
+			CheckNum++;
 
-			// Close the current arc file and open the decrypted one
-			fclose(ArcP);
+			// 大文字にした名前の合計値がパリティと一致するか
+			Parity = 0;
+			for (k = 0; k < PackNum * 4; k++)
+				Parity += NameData[4 + k];
+			if ((u16)Parity != ((u16 *)NameData)[1]) continue;
 
-			ArcP = fopen("decrypt_temp", "rb");
-			fseek(ArcP, sizeof(DARC_HEAD), SEEK_SET);
+			// ファイルのデータがアーカイブの中に収まっているか
+			if ((FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+			{
+				Size = FileH->HuffPressDataSize != 0xffffffffffffffff ? FileH->HuffPressDataSize :
+					   FileH->PressDataSize     != 0xffffffffffffffff ? FileH->PressDataSize : FileH->DataSize;
+				if (Size > DataLimit || FileH->DataAddress > DataLimit - Size) continue;
+			}
 
-			initWolfCrypt(cryptVersion, pPwd, g_specialKey, pK2);
+			ValidNum++;
 		}
+	}
 
-		// 鍵処理が行われていないかを取得する
-		NoKey = (Head.Flags & DXA_FLAG_NO_KEY) != 0;
-
-		// ヘッダのサイズ分のメモリを確保する
-		HeadBuffer = (u8 *)malloc((size_t)Head.HeadSize);
-		if (HeadBuffer == NULL) goto ERR;
+	// ファイルが一つも無い場合はテーブルの構造が正しいことしか分からない
+	if (CheckNum == 0) return 0;
 
-		// ヘッダが圧縮されている場合は解凍する
-		if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
-		{
-			// 圧縮されていない場合は普通に読み込む
-			KeyConvFileRead(HeadBuffer, Head.HeadSize, ArcP, NoKey ? NULL : Key, 0);
-		}
-		else
-		{
-			void *HuffHeadBuffer;
-			u64 HuffHeadSize;
-			void *LzHeadBuffer;
-			u64 LzHeadSize;
+	return (int)(ValidNum * 100 / CheckNum);
+}
 
-			// ハフマン圧縮されたヘッダのサイズを取得する
-			_fseeki64(ArcP, 0, SEEK_END);
-			FileSize = _ftelli64(ArcP);
-			_fseeki64(ArcP, Head.FileNameTableStartAddress, SEEK_SET);
-			HuffHeadSize = (u32)(FileSize - _ftelli64(ArcP));
+// アーカイブファイルの展開に使用するスレッドの数を設定する( 0 以下:論理コア数 )
+void DXArchive::SetDecodeThreadNum(int ThreadNum)
+{
+	DecodeThreadNum = ThreadNum;
+}
 
-			// ハフマン圧縮されたヘッダを読み込むメモリを確保する
-			HuffHeadBuffer = malloc((size_t)HuffHeadSize);
-			if (HuffHeadBuffer == NULL) goto ERR;
+// アーカイブファイルの展開に使用するスレッドの数を取得する
+int DXArchive::GetDecodeThreadNum(void)
+{
+	return DecodeThreadNum;
+}
 
-			// ハフマン圧縮されたヘッダをコピーと暗号化解除
-			KeyConvFileRead(HuffHeadBuffer, HuffHeadSize, ArcP, NoKey ? NULL : Key, 0);
+// 展開するファイルをアーカイブ内のパスで絞り込む( 両方とも空の場合は全て展開する、0:成功  -1:正規表現が正しくない )
+int DXArchive::SetDecodeFilter(const std::vector<std::wstring> &Include, const std::vector<std::wstring> &Exclude, bool Regex)
+{
+	DARC_DECODEFILTER Filter;
+	size_t i;
 
-			// ハフマン圧縮されたヘッダの解凍後の容量を取得する
-			LzHeadSize = Huffman_Decode(HuffHeadBuffer, NULL);
+	Filter.Include = Include;
+	Filter.Exclude = Exclude;
+	Filter.Regex   = Regex;
 
-			// ハフマン圧縮されたヘッダの解凍後のデータを格納するメモリ用域の確保
-			LzHeadBuffer = malloc((size_t)LzHeadSize);
-			if (LzHeadBuffer == NULL)
+	// 正規表現の場合は予めコンパイルしておく
+	if (Regex)
+	{
+		try
+		{
+			for (i = 0; i < Include.size(); i++)
 			{
-				free(HuffHeadBuffer);
-				goto ERR;
+				Filter.IncludeRegex.emplace_back(Include[i], std::regex_constants::ECMAScript | std::regex_constants::icase);
+			}
+			for (i = 0; i < Exclude.size(); i++)
+			{
+				Filter.ExcludeRegex.emplace_back(Exclude[i], std::regex_constants::ECMAScript | std::regex_constants::icase);
 			}
+		}
+		catch (const std::regex_error &)
+		{
+			return -1;
+		}
+	}
 
-			// ハフマン圧縮されたヘッダを解凍する
-			Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
+	DecodeFilter = std::move(Filter);
 
-			// LZ圧縮されたヘッダを解凍する
-			Decode(LzHeadBuffer, HeadBuffer);
+	// 終了
+	return 0;
+}
 
-			// メモリの解放
-			free(HuffHeadBuffer);
-			free(LzHeadBuffer);
-		}
+// アーカイブ内のパスが展開するファイルを絞り込む条件に合うかを調べる
+bool DXArchive::CheckDecodeFilter(const std::wstring &Path)
+{
+	size_t i;
+	bool Match;
 
-		// 各アドレスをセットする
-		NameP = HeadBuffer;
-		FileP = NameP + Head.FileTableStartAddress;
-		DirP  = NameP + Head.DirectoryTableStartAddress;
+	// Include の指定がある場合はどれかに一致する必要がある
+	Match = DecodeFilter.Include.empty();
+	for (i = 0; Match == false && i < DecodeFilter.Include.size(); i++)
+	{
+		Match = DecodeFilter.Regex ?
+			std::regex_search(Path, DecodeFilter.IncludeRegex[i]) :
+			WildCardMatch(DecodeFilter.Include[i].c_str(), Path.c_str());
 	}
+	if (Match == false) return false;
 
-	// アーカイブの展開を開始する
-	DirectoryDecode(NameP, DirP, FileP, &Head, (DARC_DIRECTORY *)DirP, ArcP, Key, KeyString, KeyStringBytes, NoKey, KeyStringBuffer);
+	// Exclude のどれかに一致する場合は展開しない
+	for (i = 0; i < DecodeFilter.Exclude.size(); i++)
+	{
+		if (DecodeFilter.Regex ?
+			std::regex_search(Path, DecodeFilter.ExcludeRegex[i]) :
+			WildCardMatch(DecodeFilter.Exclude[i].c_str(), Path.c_str()))
+			return false;
+	}
 
-	// ファイルを閉じる
-	fclose(ArcP);
+	return true;
+}
 
-	// ヘッダを読み込んでいたメモリを解放する
-	free(HeadBuffer);
+// ワイルドカードを含むパターンと文字列を比較する( * は \ も含めた任意の文字列、? は任意の一文字、大文字と小文字、\ と / は区別しない )
+bool DXArchive::WildCardMatch(const TCHAR *Pattern, const TCHAR *Str)
+{
+	const TCHAR *StarPattern = NULL;
+	const TCHAR *StarStr     = NULL;
 
-	if (g_newCrypt)
+	while (*Str != '\0')
 	{
-		// Remove the decrypted file
-		remove("decrypt_temp");
+		TCHAR p = *Pattern == '/' ? '\\' : (TCHAR)towlower(*Pattern);
+		TCHAR c = *Str == '/' ? '\\' : (TCHAR)towlower(*Str);
+
+		if (*Pattern == '*')
+		{
+			// * の後から比較をやり直せるように位置を保存しておく
+			StarPattern = ++Pattern;
+			StarStr     = Str;
+		}
+		else if (*Pattern != '\0' && (*Pattern == '?' || p == c))
+		{
+			Pattern++;
+			Str++;
+		}
+		else if (StarPattern != NULL)
+		{
+			// 一致しなかったら直前の * が一文字多く一致したものとしてやり直す
+			Pattern = StarPattern;
+			Str     = ++StarStr;
+		}
+		else
+		{
+			return false;
+		}
 	}
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory(OldDir);
+	// 残りのパターンが * だけなら一致
+	while (*Pattern == '*') Pattern++;
+	return *Pattern == '\0';
+}
 
-	// 終了
-	return 0;
+// アーカイブファイルの作成に使用するスレッドの数を設定する
+void DXArchive::SetEncodeThreadNum(int ThreadNum)
+{
+	EncodeThreadNum = ThreadNum;
+}
 
-ERR:
-	if (HeadBuffer != NULL) free(HeadBuffer);
-	if (ArcP != NULL) fclose(ArcP);
+// アーカイブファイルの作成に使用するスレッドの数を取得する
+int DXArchive::GetEncodeThreadNum(void)
+{
+	return EncodeThreadNum;
+}
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory(OldDir);
+// データの圧縮に使用する圧縮レベルを設定する
+void DXArchive::SetPressLevel(int Level)
+{
+	if (Level < DXA_PRESSLEVEL_MIN) Level = DXA_PRESSLEVEL_MIN;
+	if (Level > DXA_PRESSLEVEL_MAX) Level = DXA_PRESSLEVEL_MAX;
+	PressLevel = Level;
+}
 
-	// 終了
-	return -1;
+// データの圧縮に使用する圧縮レベルを取得する
+int DXArchive::GetPressLevel(void)
+{
+	return PressLevel;
+}
+
+// アーカイブファイルを開く時にファイル名検索用のハッシュテーブルを作成するかどうかを設定する
+void DXArchive::SetNameIndex(bool Flag)
+{
+	NameIndexFlag = Flag;
+}
+
+// アーカイブファイルを開く時にファイル名検索用のハッシュテーブルを作成するかどうかを取得する
+bool DXArchive::GetNameIndex(void)
+{
+	return NameIndexFlag;
 }
 
 // コンストラクタ
@@ -2968,6 +4739,14 @@ DXArchive::DXArchive(TCHAR *ArchivePath)
 	this->NameP = this->DirP = this->FileP = NULL;
 	this->CurrentDirectory                 = NULL;
 	this->CacheBuffer                      = NULL;
+	this->ArchiveID                        = 0;
+	this->FileKeyNum                       = 0;
+	memset(&this->Crypt, 0, sizeof(this->Crypt));
+	memset(&this->Source, 0, sizeof(this->Source));
+	this->FileMap.FileHandle = NULL;
+	this->FileMap.MapHandle  = NULL;
+	this->FileMap.Image      = NULL;
+	this->FileMap.Size       = 0;
 
 	if (ArchivePath != NULL)
 	{
@@ -3006,7 +4785,6 @@ int DXArchive::DirectoryKeyConv(DARC_DIRECTORY *Dir, char *KeyStringBuffer)
 		u32 i, FileHeadSize;
 		DARC_FILEHEAD *File;
 		unsigned char lKey[DXA_KEY_BYTES];
-		size_t KeyStringBufferBytes;
 
 		// 格納されているファイルの数だけ繰り返す
 		FileHeadSize = sizeof(DARC_FILEHEAD);
@@ -3031,30 +4809,38 @@ int DXArchive::DirectoryKeyConv(DARC_DIRECTORY *Dir, char *KeyStringBuffer)
 					// データ位置をセットする
 					DataP = (u8 *)this->fp + this->Head.DataStartAddress + File->DataAddress;
 
-					// ファイル個別の鍵を作成
+					// ファイル個別の鍵を取得
 					if (NoKey == false)
 					{
-						KeyStringBufferBytes = CreateKeyFileString((int)this->Head.CharCodeFormat, this->KeyString, this->KeyStringBytes, Dir, File, this->FileP, this->DirP, this->NameP, (BYTE *)KeyStringBuffer);
-						KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
+						GetFileKey(Dir, File, lKey);
 					}
 
 					// ハフマン圧縮されているかどうかで処理を分岐
 					if (File->HuffPressDataSize != 0xffffffffffffffff)
 					{
+						u64 PressSize;
+
 						// ハフマン圧縮されている場合
-						KeyConv(DataP, File->HuffPressDataSize, File->DataSize, lKey);
+						KeyConv(DataP, File->HuffPressDataSize, File->DataSize, lKey, &this->Crypt);
+
+						// ファイルの前後のみハフマン圧縮している場合は、ハフマン圧縮データの後ろにある途中部分も処理する
+						PressSize = File->PressDataSize != 0xffffffffffffffff ? File->PressDataSize : File->DataSize;
+						if (this->Head.HuffmanEncodeKB != 0xff && PressSize > (u64)this->Head.HuffmanEncodeKB * 1024 * 2)
+						{
+							KeyConv(DataP + File->HuffPressDataSize, PressSize - (u64)this->Head.HuffmanEncodeKB * 1024 * 2, File->DataSize + File->HuffPressDataSize, lKey, &this->Crypt);
+						}
 					}
 					else
 						// データが圧縮されているかどうかで処理を分岐
 						if (File->PressDataSize != 0xffffffffffffffff)
 						{
 							// 圧縮されている場合
-							KeyConv(DataP, File->PressDataSize, File->DataSize, lKey);
+							KeyConv(DataP, File->PressDataSize, File->DataSize, lKey, &this->Crypt);
 						}
 						else
 						{
 							// 圧縮されていない場合
-							KeyConv(DataP, File->DataSize, File->DataSize, lKey);
+							KeyConv(DataP, File->DataSize, File->DataSize, lKey, &this->Crypt);
 						}
 				}
 			}
@@ -3075,6 +4861,18 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 	this->fp = _tfopen(ArchivePath, TEXT("rb"));
 	if (this->fp == NULL) return -1;
 
+	// 読み込み元をセットする( メモリにマップできた場合はマップしたイメージから読み込む )
+	this->Source.fp        = this->fp;
+	this->Source.Image     = NULL;
+	this->Source.ImageSize = 0;
+	this->Source.Position  = 0;
+	this->Source.ImageCrypt = NULL;
+	if (MapArchiveFile(&this->FileMap, ArchivePath) == 0)
+	{
+		this->Source.Image     = this->FileMap.Image;
+		this->Source.ImageSize = this->FileMap.Size;
+	}
+
 	// 鍵文字列の保存と鍵の作成
 	{
 		// 指定が無い場合はデフォルトの鍵文字列を使用する
@@ -3098,7 +4896,7 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 	// ヘッダを解析する
 	{
 		// ヘッダの読み込み
-		fread64(&this->Head, sizeof(DARC_HEAD), this->fp);
+		if (SourceRead(&this->Source, &this->Head, sizeof(DARC_HEAD)) != sizeof(DARC_HEAD)) goto ERR;
 
 		// ＩＤの検査
 		if (this->Head.Head != DXA_HEAD)
@@ -3112,6 +4910,9 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 		// 鍵処理が行われていないかを取得する
 		this->NoKey = (Head.Flags & DXA_FLAG_NO_KEY) != 0;
 
+		// 暗号化処理の情報を初期化する
+		SetupCryptInfo(&this->Crypt, (u16)(this->Head.Flags >> 16), KeyString_, KeyStringBytes);
+
 		// ヘッダのサイズ分のメモリを確保する
 		this->HeadBuffer = (u8 *)malloc((size_t)this->Head.HeadSize);
 		if (this->HeadBuffer == NULL) goto ERR;
@@ -3120,8 +4921,8 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 		if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
 		{
 			// 圧縮されていない場合は普通に読み込む
-			_fseeki64(this->fp, this->Head.FileNameTableStartAddress, SEEK_SET);
-			KeyConvFileRead(HeadBuffer, this->Head.HeadSize, this->fp, this->NoKey ? NULL : this->Key, 0);
+			SourceSeek(&this->Source, this->Head.FileNameTableStartAddress);
+			if (KeyConvSourceRead(HeadBuffer, this->Head.HeadSize, &this->Source, this->NoKey ? NULL : this->Key, &this->Crypt, 0) != (s64)this->Head.HeadSize) goto ERR;
 		}
 		else
 		{
@@ -3132,20 +4933,28 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 			s64 FileSize;
 
 			// 圧縮されたヘッダの容量を取得する
-			_fseeki64(this->fp, 0, SEEK_END);
-			FileSize = _ftelli64(this->fp);
-			_fseeki64(this->fp, this->Head.FileNameTableStartAddress, SEEK_SET);
-			HuffHeadSize = (u32)(FileSize - _ftelli64(this->fp));
+			FileSize = SourceSize(&this->Source);
+			if (this->Head.FileNameTableStartAddress >= (u64)FileSize) goto ERR;
+			SourceSeek(&this->Source, this->Head.FileNameTableStartAddress);
+			HuffHeadSize = (u64)FileSize - this->Head.FileNameTableStartAddress;
 
-			// ハフマン圧縮されたヘッダを読み込むメモリを確保する
-			HuffHeadBuffer = malloc((size_t)HuffHeadSize);
+			// ハフマン圧縮されたヘッダを読み込むメモリを確保する( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+			HuffHeadBuffer = calloc((size_t)(HuffHeadSize + HUFFMAN_HEAD_MAXSIZE), 1);
 			if (HuffHeadBuffer == NULL) goto ERR;
 
 			// ハフマン圧縮されたヘッダをメモリに読み込む
-			KeyConvFileRead(HuffHeadBuffer, HuffHeadSize, this->fp, NoKey ? NULL : Key, 0);
+			if (KeyConvSourceRead(HuffHeadBuffer, HuffHeadSize, &this->Source, NoKey ? NULL : Key, &this->Crypt, 0) != (s64)HuffHeadSize)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
 
-			// ハフマン圧縮されたヘッダの解凍後の容量を取得する
-			LzHeadSize = Huffman_Decode(HuffHeadBuffer, NULL);
+			// ハフマン圧縮されたヘッダの解凍後の容量を取得する( 鍵が違う場合などで圧縮データの情報が壊れていたらエラー )
+			if (Huffman_GetPressSize(HuffHeadBuffer, &LzHeadSize) > HuffHeadSize || LzHeadSize < 9 || LzHeadSize > HuffHeadSize * 8)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
 
 			// ハフマン圧縮されたヘッダの解凍後のデータを格納するメモリ用域の確保
 			LzHeadBuffer = malloc((size_t)LzHeadSize);
@@ -3158,14 +4967,22 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 			// ハフマン圧縮されたヘッダを解凍する
 			Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
 
-			// LZ圧縮されたヘッダを解凍する
-			Decode(LzHeadBuffer, this->HeadBuffer);
+			// LZ圧縮されたヘッダを解凍する( 解凍後のサイズがテーブルのサイズと違う場合は壊れているのでエラー )
+			if (Decode(LzHeadBuffer, this->HeadBuffer, LzHeadSize, this->Head.HeadSize) != (s64)this->Head.HeadSize)
+			{
+				free(HuffHeadBuffer);
+				free(LzHeadBuffer);
+				goto ERR;
+			}
 
 			// メモリの解放
 			free(HuffHeadBuffer);
 			free(LzHeadBuffer);
 		}
 
+		// 鍵が違う場合などにテーブルの外を参照したりディレクトリを循環して辿ったりしないように、テーブルが壊れていないかを調べる
+		if (CheckHeadTable(&this->Head, this->HeadBuffer, (u64)SourceSize(&this->Source)) < 0) goto ERR;
+
 		// 各アドレスをセットする
 		this->NameP = this->HeadBuffer;
 		this->FileP = this->NameP + this->Head.FileTableStartAddress;
@@ -3175,6 +4992,15 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 	// カレントディレクトリのセット
 	this->CurrentDirectory = (DARC_DIRECTORY *)this->DirP;
 
+	// ファイル名検索用のハッシュテーブルを作成する( 失敗した場合は先頭から順番に調べる )
+	BuildNameIndex();
+
+	// 作成済みのファイル個別の鍵を保存しておく領域を用意する
+	SetupFileKeyTable();
+
+	// 解凍したファイルのキャッシュで使用する識別番号を割り当てる
+	this->ArchiveID = DecodeCacheArchiveID++;
+
 	// メモリイメージから開いている、フラグを倒す
 	MemoryOpenFlag = false;
 
@@ -3187,6 +5013,8 @@ ERR:
 		fclose(this->fp);
 		this->fp = NULL;
 	}
+	UnmapArchiveFile(&this->FileMap);
+	memset(&this->Source, 0, sizeof(this->Source));
 	if (this->HeadBuffer != NULL)
 	{
 		free(this->HeadBuffer);
@@ -3236,6 +5064,14 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 		_fseeki64(fp, 0L, SEEK_END);
 		ArchiveSize = _ftelli64(fp);
 		_fseeki64(fp, 0L, SEEK_SET);
+
+		// ヘッダも収まっていない場合はエラー
+		if (ArchiveSize < (s64)sizeof(DARC_HEAD))
+		{
+			fclose(fp);
+			return -1;
+		}
+
 		ArchiveImage = malloc((size_t)ArchiveSize);
 		if (ArchiveImage == NULL)
 		{
@@ -3252,7 +5088,7 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 	// ＩＤが違う場合はエラー
 	if (Head.Head != DXA_HEAD)
 	{
-		return -1;
+		goto ERR;
 	}
 
 	// ポインタを保存
@@ -3269,6 +5105,9 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 		// 鍵処理が行われていないかを取得する
 		this->NoKey = (Head.Flags & DXA_FLAG_NO_KEY) != 0;
 
+		// 暗号化処理の情報を初期化する
+		SetupCryptInfo(&this->Crypt, (u16)(this->Head.Flags >> 16), KeyString_, KeyStringBytes);
+
 		// ヘッダのサイズ分のメモリを確保する
 		this->HeadBuffer = (u8 *)malloc((size_t)this->Head.HeadSize);
 		if (this->HeadBuffer == NULL) goto ERR;
@@ -3276,9 +5115,10 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 		// ヘッダが圧縮されている場合は解凍する
 		if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
 		{
-			// 圧縮されていない場合は普通に読み込む
+			// 圧縮されていない場合はテーブルがファイルの終端を越えていないか調べてから読み込む
+			if (this->Head.FileNameTableStartAddress > (u64)ArchiveSize || this->Head.HeadSize > (u64)ArchiveSize - this->Head.FileNameTableStartAddress) goto ERR;
 			memcpy(HeadBuffer, (u8 *)this->fp + this->Head.FileNameTableStartAddress, this->Head.HeadSize);
-			if (this->NoKey == false) KeyConv(HeadBuffer, this->Head.HeadSize, 0, this->Key);
+			if (this->NoKey == false) KeyConv(HeadBuffer, this->Head.HeadSize, 0, this->Key, &this->Crypt);
 		}
 		else
 		{
@@ -3288,18 +5128,23 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 			u64 LzHeadSize;
 
 			// ハフマン圧縮されたヘッダの容量を取得する
-			HuffHeadSize = (u32)((u64)ArchiveSize - this->Head.FileNameTableStartAddress);
+			if (this->Head.FileNameTableStartAddress >= (u64)ArchiveSize) goto ERR;
+			HuffHeadSize = (u64)ArchiveSize - this->Head.FileNameTableStartAddress;
 
-			// ハフマン圧縮されたヘッダを読み込むメモリを確保する
-			HuffHeadBuffer = malloc((size_t)HuffHeadSize);
+			// ハフマン圧縮されたヘッダを読み込むメモリを確保する( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+			HuffHeadBuffer = calloc((size_t)(HuffHeadSize + HUFFMAN_HEAD_MAXSIZE), 1);
 			if (HuffHeadBuffer == NULL) goto ERR;
 
 			// 圧縮されたヘッダをコピーと暗号化解除
 			memcpy(HuffHeadBuffer, (u8 *)this->fp + this->Head.FileNameTableStartAddress, (size_t)HuffHeadSize);
-			if (this->NoKey == false) KeyConv(HuffHeadBuffer, HuffHeadSize, 0, this->Key);
+			if (this->NoKey == false) KeyConv(HuffHeadBuffer, HuffHeadSize, 0, this->Key, &this->Crypt);
 
-			// ハフマン圧縮されたヘッダの解凍後の容量を取得する
-			LzHeadSize = Huffman_Decode(HuffHeadBuffer, NULL);
+			// ハフマン圧縮されたヘッダの解凍後の容量を取得する( 鍵が違う場合などで圧縮データの情報が壊れていたらエラー )
+			if (Huffman_GetPressSize(HuffHeadBuffer, &LzHeadSize) > HuffHeadSize || LzHeadSize < 9 || LzHeadSize > HuffHeadSize * 8)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
 
 			// ハフマン圧縮されたヘッダの解凍後のデータを格納するメモリ用域の確保
 			LzHeadBuffer = malloc((size_t)LzHeadSize);
@@ -3312,14 +5157,22 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 			// ハフマン圧縮されたヘッダを解凍する
 			Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
 
-			// LZ圧縮されたヘッダを解凍する
-			Decode(LzHeadBuffer, this->HeadBuffer);
+			// LZ圧縮されたヘッダを解凍する( 解凍後のサイズがテーブルのサイズと違う場合は壊れているのでエラー )
+			if (Decode(LzHeadBuffer, this->HeadBuffer, LzHeadSize, this->Head.HeadSize) != (s64)this->Head.HeadSize)
+			{
+				free(HuffHeadBuffer);
+				free(LzHeadBuffer);
+				goto ERR;
+			}
 
 			// メモリの解放
 			free(HuffHeadBuffer);
 			free(LzHeadBuffer);
 		}
 
+		// 鍵が違う場合などにテーブルの外を参照したりディレクトリを循環して辿ったりしないように、テーブルが壊れていないかを調べる
+		if (CheckHeadTable(&this->Head, this->HeadBuffer, (u64)ArchiveSize) < 0) goto ERR;
+
 		// 各アドレスをセットする
 		this->NameP = this->HeadBuffer;
 		this->FileP = this->NameP + this->Head.FileTableStartAddress;
@@ -3329,9 +5182,25 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 	// カレントディレクトリのセット
 	this->CurrentDirectory = (DARC_DIRECTORY *)this->DirP;
 
+	// ファイル名検索用のハッシュテーブルを作成する( 失敗した場合は先頭から順番に調べる )
+	BuildNameIndex();
+
+	// 作成済みのファイル個別の鍵を保存しておく領域を用意する
+	SetupFileKeyTable();
+
+	// 解凍したファイルのキャッシュで使用する識別番号を割り当てる
+	this->ArchiveID = DecodeCacheArchiveID++;
+
 	// メモリイメージから開いているフラグを立てる
 	MemoryOpenFlag = true;
 
+	// ファイルの読み込みはメモリ上のイメージから行う
+	this->Source.fp        = NULL;
+	this->Source.Image     = (u8 *)this->fp;
+	this->Source.ImageSize = ArchiveSize;
+	this->Source.Position  = 0;
+	this->Source.ImageCrypt = NULL;
+
 	// 全てのファイルの暗号化を解除する
 	if (this->NoKey == false)
 	{
@@ -3349,6 +5218,14 @@ int DXArchive::OpenArchiveFileMem(const TCHAR *ArchivePath, const char *KeyStrin
 	return 0;
 
 ERR:
+	// 読み込んだイメージを解放する
+	free(ArchiveImage);
+	this->fp = NULL;
+	if (this->HeadBuffer != NULL)
+	{
+		free(this->HeadBuffer);
+		this->HeadBuffer = NULL;
+	}
 
 	// 終了
 	return -1;
@@ -3362,6 +5239,9 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 	// 既になんらかのアーカイブを開いていた場合はエラー
 	if (this->fp != NULL) return -1;
 
+	// ヘッダも収まっていない場合はエラー
+	if (ArchiveSize < (s64)sizeof(DARC_HEAD)) return -1;
+
 	// 鍵文字列の保存と鍵の作成
 	{
 		// 指定が無い場合はデフォルトの鍵文字列を使用する
@@ -3405,6 +5285,9 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 		// 鍵処理が行われていないかを取得する
 		this->NoKey = (Head.Flags & DXA_FLAG_NO_KEY) != 0;
 
+		// 暗号化処理の情報を初期化する
+		SetupCryptInfo(&this->Crypt, (u16)(this->Head.Flags >> 16), KeyString_, KeyStringBytes);
+
 		// ヘッダのサイズ分のメモリを確保する
 		this->HeadBuffer = (u8 *)malloc((size_t)this->Head.HeadSize);
 		if (this->HeadBuffer == NULL) goto ERR;
@@ -3412,9 +5295,10 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 		// ヘッダが圧縮されている場合は解凍する
 		if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
 		{
-			// 圧縮されていない場合は普通に読み込む
+			// 圧縮されていない場合はテーブルがファイルの終端を越えていないか調べてから読み込む
+			if (this->Head.FileNameTableStartAddress > (u64)ArchiveSize || this->Head.HeadSize > (u64)ArchiveSize - this->Head.FileNameTableStartAddress) goto ERR;
 			memcpy(HeadBuffer, (u8 *)this->fp + this->Head.FileNameTableStartAddress, this->Head.HeadSize);
-			if (this->NoKey == false) KeyConv(HeadBuffer, this->Head.HeadSize, 0, this->Key);
+			if (this->NoKey == false) KeyConv(HeadBuffer, this->Head.HeadSize, 0, this->Key, &this->Crypt);
 		}
 		else
 		{
@@ -3424,18 +5308,23 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 			u64 LzHeadSize;
 
 			// ハフマン圧縮されたヘッダの容量を取得する
-			HuffHeadSize = (u32)((u64)ArchiveSize - this->Head.FileNameTableStartAddress);
+			if (this->Head.FileNameTableStartAddress >= (u64)ArchiveSize) goto ERR;
+			HuffHeadSize = (u64)ArchiveSize - this->Head.FileNameTableStartAddress;
 
-			// ハフマン圧縮されたヘッダを読み込むメモリを確保する
-			HuffHeadBuffer = malloc((size_t)HuffHeadSize);
+			// ハフマン圧縮されたヘッダを読み込むメモリを確保する( ハフマン圧縮のヘッダを確認する為に余分に確保する )
+			HuffHeadBuffer = calloc((size_t)(HuffHeadSize + HUFFMAN_HEAD_MAXSIZE), 1);
 			if (HuffHeadBuffer == NULL) goto ERR;
 
 			// ハフマン圧縮されたヘッダをコピーと暗号化解除
 			memcpy(HuffHeadBuffer, (u8 *)this->fp + this->Head.FileNameTableStartAddress, (size_t)HuffHeadSize);
-			if (this->NoKey == false) KeyConv(HuffHeadBuffer, HuffHeadSize, 0, this->Key);
+			if (this->NoKey == false) KeyConv(HuffHeadBuffer, HuffHeadSize, 0, this->Key, &this->Crypt);
 
-			// ハフマン圧縮されたヘッダの解凍後の容量を取得する
-			LzHeadSize = Huffman_Decode(HuffHeadBuffer, NULL);
+			// ハフマン圧縮されたヘッダの解凍後の容量を取得する( 鍵が違う場合などで圧縮データの情報が壊れていたらエラー )
+			if (Huffman_GetPressSize(HuffHeadBuffer, &LzHeadSize) > HuffHeadSize || LzHeadSize < 9 || LzHeadSize > HuffHeadSize * 8)
+			{
+				free(HuffHeadBuffer);
+				goto ERR;
+			}
 
 			// ハフマン圧縮されたヘッダの解凍後のデータを格納するメモリ用域の確保
 			LzHeadBuffer = malloc((size_t)LzHeadSize);
@@ -3448,14 +5337,22 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 			// ハフマン圧縮されたヘッダを解凍する
 			Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
 
-			// LZ圧縮されたヘッダを解凍する
-			Decode(LzHeadBuffer, this->HeadBuffer);
+			// LZ圧縮されたヘッダを解凍する( 解凍後のサイズがテーブルのサイズと違う場合は壊れているのでエラー )
+			if (Decode(LzHeadBuffer, this->HeadBuffer, LzHeadSize, this->Head.HeadSize) != (s64)this->Head.HeadSize)
+			{
+				free(HuffHeadBuffer);
+				free(LzHeadBuffer);
+				goto ERR;
+			}
 
 			// メモリの解放
 			free(HuffHeadBuffer);
 			free(LzHeadBuffer);
 		}
 
+		// 鍵が違う場合などにテーブルの外を参照したりディレクトリを循環して辿ったりしないように、テーブルが壊れていないかを調べる
+		if (CheckHeadTable(&this->Head, this->HeadBuffer, (u64)ArchiveSize) < 0) goto ERR;
+
 		// 各アドレスをセットする
 		this->NameP = this->HeadBuffer;
 		this->FileP = this->NameP + this->Head.FileTableStartAddress;
@@ -3465,9 +5362,25 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 	// カレントディレクトリのセット
 	this->CurrentDirectory = (DARC_DIRECTORY *)this->DirP;
 
+	// ファイル名検索用のハッシュテーブルを作成する( 失敗した場合は先頭から順番に調べる )
+	BuildNameIndex();
+
+	// 作成済みのファイル個別の鍵を保存しておく領域を用意する
+	SetupFileKeyTable();
+
+	// 解凍したファイルのキャッシュで使用する識別番号を割り当てる
+	this->ArchiveID = DecodeCacheArchiveID++;
+
 	// メモリイメージから開いているフラグを立てる
 	MemoryOpenFlag = true;
 
+	// ファイルの読み込みはメモリ上のイメージから行う
+	this->Source.fp        = NULL;
+	this->Source.Image     = (u8 *)this->fp;
+	this->Source.ImageSize = ArchiveSize;
+	this->Source.Position  = 0;
+	this->Source.ImageCrypt = NULL;
+
 	// 全てのファイルの暗号化を解除する
 	if (this->NoKey == false)
 	{
@@ -3485,6 +5398,13 @@ int DXArchive::OpenArchiveMem(void *ArchiveImage, s64 ArchiveSize, const char *K
 	return 0;
 
 ERR:
+	this->fp = NULL;
+	if (this->HeadBuffer != NULL)
+	{
+		free(this->HeadBuffer);
+		this->HeadBuffer = NULL;
+	}
+
 	// 終了
 	return -1;
 }
@@ -3506,7 +5426,7 @@ int DXArchive::CloseArchiveFile(void)
 			{
 				char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
 				DirectoryKeyConv((DARC_DIRECTORY *)this->DirP, KeyStringBuffer);
-				KeyConv(this->HeadBuffer, this->Head.HeadSize, 0, this->Key);
+				KeyConv(this->HeadBuffer, this->Head.HeadSize, 0, this->Key, &this->Crypt);
 			}
 		}
 		else
@@ -3519,11 +5439,26 @@ int DXArchive::CloseArchiveFile(void)
 	{
 		// アーカイブファイルを閉じる
 		fclose(this->fp);
+
+		// マップしたイメージを解放する
+		UnmapArchiveFile(&this->FileMap);
+		memset(&this->Source, 0, sizeof(this->Source));
 	}
 
 	// ヘッダバッファを解放
 	free(this->HeadBuffer);
 
+	// ファイル名検索用のハッシュテーブルを解放
+	std::vector<u32>().swap(this->NameIndex);
+
+	// 作成済みのファイル個別の鍵を解放
+	this->FileKey.reset();
+	this->FileKeyNum = 0;
+
+	// 解凍したファイルのキャッシュからこのアーカイブのファイルを破棄する
+	if (this->ArchiveID != 0) DecodeCacheRemoveArchive(this->ArchiveID);
+	this->ArchiveID = 0;
+
 	// ポインタ初期化
 	this->fp         = NULL;
 	this->HeadBuffer = NULL;
@@ -3534,47 +5469,203 @@ int DXArchive::CloseArchiveFile(void)
 	return 0;
 }
 
-// アーカイブ内のディレクトリパスを変更する( 0:成功  -1:失敗 )
-int DXArchive::ChangeCurrentDirectoryFast(SEARCHDATA *SearchData)
+// アーカイブ内のディレクトリパスを変更する( 0:成功  -1:失敗 )
+int DXArchive::ChangeCurrentDirectoryFast(SEARCHDATA *SearchData)
+{
+	DARC_FILEHEAD *FileH;
+
+	// カレントディレクトリから同名のディレクトリを探す、無かったらエラー
+	FileH = SearchFileHead(this->CurrentDirectory, SearchData, true);
+	if (FileH == NULL) return -1;
+
+	// 在ったらカレントディレクトリを変更
+	this->CurrentDirectory = (DARC_DIRECTORY *)(this->DirP + FileH->DataAddress);
+
+	// 正常終了
+	return 0;
+}
+
+// ファイル名検索用のハッシュ値を得る( ディレクトリのアドレスと大文字にしたファイル名から求める )
+static __inline u32 NameIndexHash(u64 DirectoryAddress, const u8 *Name, u16 PackNum)
+{
+	u32 hash, data;
+	int i;
+
+	hash = 2166136261U ^ (u32)DirectoryAddress ^ (u32)(DirectoryAddress >> 32);
+	for (i = 0; i < PackNum; i++)
+	{
+		memcpy(&data, &Name[i * 4], 4);
+		hash = (hash ^ data) * 16777619U;
+	}
+	return hash ^ (hash >> 16);
+}
+
+// 指定のディレクトリから検索用データと同名のファイル又はディレクトリを探す( 無かった場合は NULL )
+DARC_FILEHEAD *DXArchive::SearchFileHead(DARC_DIRECTORY *Dir, const SEARCHDATA *SearchData, bool Directory)
+{
+	DARC_FILEHEAD *FileH;
+	u64 DirAddress, FileNo, FileStart, FileEnd;
+	u32 Index, Mask, Entry;
+	int i, j, k, Num;
+	u8 *NameData;
+
+	// ハッシュテーブルが無い場合はディレクトリ内を先頭から順番に調べる
+	if (this->NameIndex.empty())
+	{
+		FileH = (DARC_FILEHEAD *)(this->FileP + Dir->FileHeadAddress);
+		Num   = (int)Dir->FileHeadNum;
+		for (i = 0; i < Num; i++, FileH++)
+		{
+			// ディレクトリチェック
+			if (((FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) != Directory) continue;
+
+			// 文字列数とパリティチェック
+			NameData = this->NameP + FileH->NameAddress;
+			if (SearchData->PackNum != ((u16 *)NameData)[0] || SearchData->Parity != ((u16 *)NameData)[1]) continue;
+
+			// 文字列チェック
+			NameData += 4;
+			for (j = 0, k = 0; j < SearchData->PackNum; j++, k += 4)
+				if (*((u32 *)&SearchData->FileName[k]) != *((u32 *)&NameData[k])) break;
+
+			// 適合したファイルがあったらここで終了
+			if (SearchData->PackNum == j) return FileH;
+		}
+
+		return NULL;
+	}
+
+	// ハッシュテーブルから探す( 同じ名前が複数ある場合は登録順に見つかるので、先頭から調べた場合と同じ結果になる )
+	DirAddress = (u64)((u8 *)Dir - this->DirP);
+	FileStart  = Dir->FileHeadAddress / sizeof(DARC_FILEHEAD);
+	FileEnd    = FileStart + Dir->FileHeadNum;
+	Mask       = (u32)this->NameIndex.size() - 1;
+	Index      = NameIndexHash(DirAddress, SearchData->FileName, SearchData->PackNum) & Mask;
+	for (; (Entry = this->NameIndex[Index]) != 0; Index = (Index + 1) & Mask)
+	{
+		// 指定のディレクトリのファイルかチェック
+		FileNo = Entry - 1;
+		if (FileNo < FileStart || FileNo >= FileEnd) continue;
+		FileH = (DARC_FILEHEAD *)this->FileP + FileNo;
+
+		// ディレクトリチェック
+		if (((FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) != Directory) continue;
+
+		// 文字列数とパリティチェック
+		NameData = this->NameP + FileH->NameAddress;
+		if (SearchData->PackNum != ((u16 *)NameData)[0] || SearchData->Parity != ((u16 *)NameData)[1]) continue;
+
+		// 文字列チェック
+		NameData += 4;
+		if (memcmp(SearchData->FileName, NameData, SearchData->PackNum * 4) == 0) return FileH;
+	}
+
+	return NULL;
+}
+
+// ファイル名検索用のハッシュテーブルを作成する( 0:成功  -1:失敗 )
+int DXArchive::BuildNameIndex(void)
+{
+	DARC_DIRECTORY *Dir;
+	DARC_FILEHEAD *FileH;
+	u64 i, j, DirNum, FileNum, NameSize, FileTableSize, DirAddress, FileNo;
+	u32 Index, Mask, TableSize;
+	u8 *NameData;
+
+	this->NameIndex.clear();
+
+	// 作成しない設定の場合は何もしない
+	if (NameIndexFlag == false) return 0;
+
+	// 各テーブルの大きさを求める
+	NameSize      = this->Head.FileTableStartAddress;
+	FileTableSize = this->Head.DirectoryTableStartAddress - this->Head.FileTableStartAddress;
+	FileNum       = FileTableSize / sizeof(DARC_FILEHEAD);
+	DirNum        = (this->Head.HeadSize - this->Head.DirectoryTableStartAddress) / sizeof(DARC_DIRECTORY);
+	if (this->Head.DirectoryTableStartAddress < this->Head.FileTableStartAddress ||
+		this->Head.HeadSize < this->Head.DirectoryTableStartAddress ||
+		FileNum == 0 || FileNum >= 0x40000000)
+		return -1;
+
+	// テーブルのサイズはファイルの数の倍以上の２のn乗にする
+	for (TableSize = 16; TableSize < FileNum * 2; TableSize <<= 1) {}
+	Mask = TableSize - 1;
+	this->NameIndex.assign(TableSize, 0);
+
+	// 全てのディレクトリのファイルを登録する
+	Dir = (DARC_DIRECTORY *)this->DirP;
+	for (i = 0; i < DirNum; i++, Dir++)
+	{
+		// テーブルの範囲外を指している場合は作成しない( 先頭から順番に調べる )
+		if (Dir->FileHeadNum == 0) continue;
+		if (Dir->FileHeadAddress % sizeof(DARC_FILEHEAD) != 0 ||
+			Dir->FileHeadAddress / sizeof(DARC_FILEHEAD) + Dir->FileHeadNum > FileNum)
+			goto ERR;
+
+		DirAddress = i * sizeof(DARC_DIRECTORY);
+		FileNo     = Dir->FileHeadAddress / sizeof(DARC_FILEHEAD);
+		FileH      = (DARC_FILEHEAD *)this->FileP + FileNo;
+		for (j = 0; j < Dir->FileHeadNum; j++, FileH++, FileNo++)
+		{
+			if (FileH->NameAddress + 4 > NameSize) goto ERR;
+			NameData = this->NameP + FileH->NameAddress;
+			if (FileH->NameAddress + 4 + ((u16 *)NameData)[0] * 4 > NameSize) goto ERR;
+
+			// 空いている位置に登録する
+			Index = NameIndexHash(DirAddress, NameData + 4, ((u16 *)NameData)[0]) & Mask;
+			while (this->NameIndex[Index] != 0)
+				Index = (Index + 1) & Mask;
+			this->NameIndex[Index] = (u32)(FileNo + 1);
+		}
+	}
+
+	return 0;
+
+ERR:
+	this->NameIndex.clear();
+	return -1;
+}
+
+// 作成済みのファイル個別の鍵を保存しておく領域を用意する
+void DXArchive::SetupFileKeyTable(void)
 {
-	DARC_FILEHEAD *FileH;
-	int i, j, k, Num;
-	u8 *NameData, *PathData;
-	u16 PackNum, Parity;
-
-	PackNum  = SearchData->PackNum;
-	Parity   = SearchData->Parity;
-	PathData = SearchData->FileName;
+	this->FileKeyNum = (this->Head.DirectoryTableStartAddress - this->Head.FileTableStartAddress) / sizeof(DARC_FILEHEAD);
+	this->FileKey.reset(new (std::nothrow) std::atomic<u64>[(size_t)this->FileKeyNum]());
 
-	// カレントディレクトリから同名のディレクトリを探す
-	FileH = (DARC_FILEHEAD *)(this->FileP + this->CurrentDirectory->FileHeadAddress);
-	Num   = (s32)this->CurrentDirectory->FileHeadNum;
-	for (i = 0; i < Num; i++, FileH++)
-	{
-		// ディレクトリチェック
-		if ((FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) continue;
-
-		// 文字列数とパリティチェック
-		NameData = this->NameP + FileH->NameAddress;
-		if (PackNum != ((u16 *)NameData)[0] || Parity != ((u16 *)NameData)[1]) continue;
+	// 確保できなかった場合は毎回作成する
+	if (this->FileKey == NULL) this->FileKeyNum = 0;
+}
 
-		// 文字列チェック
-		NameData += 4;
-		for (j = 0, k = 0; j < PackNum; j++, k += 4)
-			if (*((u32 *)&PathData[k]) != *((u32 *)&NameData[k])) break;
+// ファイル個別の鍵を取得する( 一度作成した鍵は保存しておき、次からはそれを返す )
+void DXArchive::GetFileKey(DARC_DIRECTORY *Directory, DARC_FILEHEAD *FileHead, u8 *Key)
+{
+	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
+	size_t KeyStringBufferBytes;
+	u64 Index, Data;
+	int i;
 
-		// 適合したディレクトリがあったらここで終了
-		if (PackNum == j) break;
+	// 作成済みの場合はそれを返す
+	Index = (u64)((u8 *)FileHead - this->FileP) / sizeof(DARC_FILEHEAD);
+	Data  = Index < this->FileKeyNum ? this->FileKey[(size_t)Index].load(std::memory_order_relaxed) : 0;
+	if (Data != 0)
+	{
+		for (i = 0; i < DXA_KEY_BYTES; i++)
+			Key[i] = (u8)(Data >> (i * 8));
+		return;
 	}
 
-	// 無かったらエラー
-	if (i == Num) return -1;
-
-	// 在ったらカレントディレクトリを変更
-	this->CurrentDirectory = (DARC_DIRECTORY *)(this->DirP + FileH->DataAddress);
+	// 鍵を作成する
+	KeyStringBufferBytes = CreateKeyFileString((int)this->Head.CharCodeFormat, this->KeyString, this->KeyStringBytes, Directory, FileHead, this->FileP, this->DirP, this->NameP, (BYTE *)KeyStringBuffer);
+	KeyCreate(KeyStringBuffer, KeyStringBufferBytes, Key);
 
-	// 正常終了
-	return 0;
+	// 次からは作成した鍵を返す( 複数のスレッドが同時に作成しても同じ値になる )
+	if (Index < this->FileKeyNum)
+	{
+		Data = (u64)1 << 56;
+		for (i = 0; i < DXA_KEY_BYTES; i++)
+			Data |= (u64)Key[i] << (i * 8);
+		this->FileKey[(size_t)Index].store(Data, std::memory_order_relaxed);
+	}
 }
 
 // アーカイブ内のディレクトリパスを変更する( 0:成功  -1:失敗 )
@@ -3756,11 +5847,10 @@ int DXArchive::GetCurrentDir(TCHAR *DirPathBuffer, int BufferLength)
 s64 DXArchive::LoadFileToMem(const TCHAR *FilePath, void *Buffer, u64 BufferLength)
 {
 	DARC_FILEHEAD *FileH;
-	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
-	size_t KeyStringBufferBytes;
 	unsigned char lKey[DXA_KEY_BYTES];
 	DARC_DIRECTORY *Directory;
-	void *HuffDataBuffer = NULL;
+	bool UseCache = false;
+	bool UseKey;
 
 	// 指定のファイルの情報を得る
 	FileH = this->GetFileInfo(FilePath, &Directory);
@@ -3772,177 +5862,62 @@ s64 DXArchive::LoadFileToMem(const TCHAR *FilePath, void *Buffer, u64 BufferLeng
 		return (s64)FileH->DataSize;
 	}
 
-	// 足りている場合はバッファーに読み込む
-
-	// ファイルが圧縮されているかどうかで処理を分岐
-	if (FileH->PressDataSize != 0xffffffffffffffff)
+	// 圧縮されている場合は解凍したファイルのキャッシュを調べ、あった場合はコピーして終了
+	if (DecodeCacheMaxSize != 0 && FileH->DataSize != 0 &&
+		(FileH->PressDataSize != 0xffffffffffffffff || FileH->HuffPressDataSize != 0xffffffffffffffff))
 	{
-		// 圧縮されている場合
-
-		// ハフマン圧縮されているかどうかで処理を分岐
-		if (FileH->HuffPressDataSize != 0xffffffffffffffff)
+		std::shared_ptr<u8> CacheData = DecodeCacheGet(this->ArchiveID, (u64)((u8 *)FileH - this->FileP));
+		if (CacheData)
 		{
-			// メモリ上に読み込んでいるかどうかで処理を分岐
-			if (MemoryOpenFlag == true)
-			{
-				// ハフマン圧縮を解凍したデータを格納するメモリ領域の確保
-				HuffDataBuffer = malloc((size_t)FileH->PressDataSize);
-				if (HuffDataBuffer == NULL) return -1;
-
-				// ハフマン圧縮データを解凍
-				Huffman_Decode((u8 *)this->fp + this->Head.DataStartAddress + FileH->DataAddress, HuffDataBuffer);
-
-				// メモリ上の圧縮データを解凍する
-				Decode(HuffDataBuffer, Buffer);
-
-				// メモリを解放
-				free(HuffDataBuffer);
-			}
-			else
-			{
-				void *temp;
-
-				// 圧縮データをメモリに読み込んでから解凍する
-
-				// 圧縮データが収まるメモリ領域の確保
-				temp = malloc((size_t)(FileH->PressDataSize + FileH->HuffPressDataSize));
-
-				// 圧縮データの読み込み
-				_fseeki64(this->fp, this->Head.DataStartAddress + FileH->DataAddress, SEEK_SET);
-
-				// ファイル個別の鍵を作成
-				if (this->NoKey == false)
-				{
-					KeyStringBufferBytes = CreateKeyFileString((int)this->Head.CharCodeFormat, this->KeyString, this->KeyStringBytes, Directory, FileH, this->FileP, this->DirP, this->NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
-				}
-
-				// 暗号化解除読み込み
-				KeyConvFileRead(temp, FileH->HuffPressDataSize, this->fp, this->NoKey ? NULL : lKey, FileH->DataSize);
-
-				// ハフマン圧縮データを解凍
-				Huffman_Decode(temp, (u8 *)temp + FileH->HuffPressDataSize);
-
-				// 解凍
-				Decode((u8 *)temp + FileH->HuffPressDataSize, Buffer);
-
-				// メモリの解放
-				free(temp);
-			}
+			memcpy(Buffer, CacheData.get(), (size_t)FileH->DataSize);
+			return 0;
 		}
-		else
-		{
-			// メモリ上に読み込んでいるかどうかで処理を分岐
-			if (MemoryOpenFlag == true)
-			{
-				// メモリ上の圧縮データを解凍する
-				Decode((u8 *)this->fp + this->Head.DataStartAddress + FileH->DataAddress, Buffer);
-			}
-			else
-			{
-				void *temp;
-
-				// 圧縮データをメモリに読み込んでから解凍する
 
-				// 圧縮データが収まるメモリ領域の確保
-				temp = malloc((size_t)FileH->PressDataSize);
-
-				// 圧縮データの読み込み
-				_fseeki64(this->fp, this->Head.DataStartAddress + FileH->DataAddress, SEEK_SET);
+		// 無かった場合は解凍した後でキャッシュに追加する
+		UseCache = true;
+	}
 
-				// ファイル個別の鍵を作成
-				if (this->NoKey == false)
-				{
-					KeyStringBufferBytes = CreateKeyFileString((int)this->Head.CharCodeFormat, this->KeyString, this->KeyStringBytes, Directory, FileH, this->FileP, this->DirP, this->NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
-				}
+	// 足りている場合はバッファーに読み込む
+	// ファイル個別の鍵を取得( メモリ上に読み込んでいる場合は開いた時に暗号化を解除してあるので鍵は使わない )
+	UseKey = this->NoKey == false && MemoryOpenFlag == false;
+	if (UseKey)
+	{
+		GetFileKey(Directory, FileH, lKey);
+	}
 
-				KeyConvFileRead(temp, FileH->PressDataSize, this->fp, this->NoKey ? NULL : lKey, FileH->DataSize);
+	// 圧縮されているかどうかで処理を分岐
+	if (FileH->PressDataSize != 0xffffffffffffffff || FileH->HuffPressDataSize != 0xffffffffffffffff)
+	{
+		DARC_DECODESTREAM Stream;
+		u8 *Data;
+		s64 Size;
 
-				// 解凍
-				Decode(temp, Buffer);
+		// 圧縮データ全体をメモリに読み込まずに、少しずつ読み込みながらバッファーに直接解凍する
+		if (DecodeStreamOpen(&Stream, FileH, this->Head.HuffmanEncodeKB, &this->Source, this->Head.DataStartAddress + FileH->DataAddress, UseKey ? lKey : NULL, &this->Crypt, Buffer) < 0)
+			return -1;
 
-				// メモリの解放
-				free(temp);
-			}
+		while ((Size = DecodeStreamRead(&Stream, FileH->DataSize, &Data)) > 0)
+		{
 		}
+
+		DecodeStreamClose(&Stream);
+		if (Size < 0) return -1;
 	}
 	else
 	{
-		// 圧縮されていない場合
-
-		// ハフマン圧縮されているかどうかで処理を分岐
-		if (FileH->HuffPressDataSize != 0xffffffffffffffff)
-		{
-			// メモリ上に読み込んでいるかどうかで処理を分岐
-			if (MemoryOpenFlag == true)
-			{
-				// ハフマン圧縮を解凍したデータを格納するメモリ領域の確保
-				HuffDataBuffer = malloc((size_t)FileH->PressDataSize);
-				if (HuffDataBuffer == NULL) return -1;
-
-				// ハフマン圧縮データを解凍
-				Huffman_Decode((u8 *)this->fp + this->Head.DataStartAddress + FileH->DataAddress, HuffDataBuffer);
-
-				// コピー
-				memcpy(Buffer, HuffDataBuffer, (size_t)FileH->DataSize);
-
-				// メモリを解放
-				free(HuffDataBuffer);
-			}
-			else
-			{
-				void *temp;
-
-				// 圧縮データをメモリに読み込んでから解凍する
-
-				// ハフマン圧縮データが収まるメモリ領域の確保
-				temp = malloc((size_t)FileH->HuffPressDataSize);
-
-				// 圧縮データの読み込み
-				_fseeki64(this->fp, this->Head.DataStartAddress + FileH->DataAddress, SEEK_SET);
-
-				// ファイル個別の鍵を作成
-				if (this->NoKey == false)
-				{
-					KeyStringBufferBytes = CreateKeyFileString((int)this->Head.CharCodeFormat, this->KeyString, this->KeyStringBytes, Directory, FileH, this->FileP, this->DirP, this->NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
-				}
-
-				// 暗号化解除読み込み
-				KeyConvFileRead(temp, FileH->HuffPressDataSize, this->fp, this->NoKey ? NULL : lKey, FileH->DataSize);
-
-				// ハフマン圧縮データを解凍
-				Huffman_Decode(temp, Buffer);
+		// 圧縮されていない場合はそのまま読み込む( アーカイブが途中で終わっていたらエラー )
+		if (KeyConvSourceReadAt(Buffer, FileH->DataSize, &this->Source, this->Head.DataStartAddress + FileH->DataAddress, UseKey ? lKey : NULL, &this->Crypt, FileH->DataSize) != (s64)FileH->DataSize)
+			return -1;
+	}
 
-				// メモリの解放
-				free(temp);
-			}
-		}
-		else
+	// 解凍したデータをキャッシュに追加する
+	if (UseCache)
+	{
+		std::shared_ptr<u8> CacheData((u8 *)malloc((size_t)FileH->DataSize), free);
+		if (CacheData)
 		{
-			// メモリ上に読み込んでいるかどうかで処理を分岐
-			if (MemoryOpenFlag == true)
-			{
-				// コピー
-				memcpy(Buffer, (u8 *)this->fp + this->Head.DataStartAddress + FileH->DataAddress, (size_t)FileH->DataSize);
-			}
-			else
-			{
-				// ファイルポインタを移動
-				_fseeki64(this->fp, this->Head.DataStartAddress + FileH->DataAddress, SEEK_SET);
-
-				// 読み込み
-
-				// ファイル個別の鍵を作成
-				if (this->NoKey == false)
-				{
-					KeyStringBufferBytes = CreateKeyFileString((int)this->Head.CharCodeFormat, this->KeyString, this->KeyStringBytes, Directory, FileH, this->FileP, this->DirP, this->NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
-				}
-
-				KeyConvFileRead(Buffer, FileH->DataSize, this->fp, this->NoKey ? NULL : lKey, FileH->DataSize);
-			}
+			memcpy(CacheData.get(), Buffer, (size_t)FileH->DataSize);
+			DecodeCacheAdd(this->ArchiveID, (u64)((u8 *)FileH - this->FileP), CacheData, FileH->DataSize);
 		}
 	}
 
@@ -3984,6 +5959,185 @@ int DXArchive::GetFileInfo(const TCHAR *FilePath, u64 *PositionP, u64 *SizeP)
 	return 0;
 }
 
+// アーカイブの識別番号とファイルヘッダのアドレスから解凍したファイルのキャッシュを検索する値を得る
+static __inline u64 DecodeCacheKey(u64 ArchiveID, u64 FileOffset)
+{
+	// ヘッダのサイズは 32bit に収まるのでファイルヘッダのアドレスは下位 32bit に入れる
+	return (ArchiveID << 32) | (FileOffset & 0xffffffff);
+}
+
+// 解凍したファイルのキャッシュの検索する値から区画を得る
+static __inline DARC_CACHESHARD *DecodeCacheGetShard(u64 Key)
+{
+	return &DecodeCacheShard[((Key * 0x9E3779B97F4A7C15ULL) >> 32) % DXA_DECODECACHE_SHARDNUM];
+}
+
+// 解凍したファイルのキャッシュ全体の使用量が上限を超えていたら、全ての区画の中で最も長い間使われていないものから破棄する
+// ( 区画の排他処理は一つずつ行うので、区画のロックを持っていない状態で呼ぶ )
+static void DecodeCacheShrink(void)
+{
+	DARC_CACHESHARD *Oldest;
+	u64 OldestTick;
+	int i;
+
+	while (DecodeCacheUseSize > DecodeCacheMaxSize)
+	{
+		// 各区画の一番後ろにあるデータの内、最も長い間使われていないものがある区画を探す
+		Oldest     = NULL;
+		OldestTick = 0;
+		for (i = 0; i < DXA_DECODECACHE_SHARDNUM; i++)
+		{
+			std::lock_guard<std::mutex> Lock(DecodeCacheShard[i].Mutex);
+			if (DecodeCacheShard[i].List.empty()) continue;
+			if (Oldest == NULL || DecodeCacheShard[i].List.back().UseTick < OldestTick)
+			{
+				Oldest     = &DecodeCacheShard[i];
+				OldestTick = DecodeCacheShard[i].List.back().UseTick;
+			}
+		}
+		if (Oldest == NULL) break;
+
+		// 見つけた区画の一番後ろにあるデータを破棄する( 探している間に他のスレッドに変更されていても区画の中で一番古いものを破棄する )
+		{
+			std::lock_guard<std::mutex> Lock(Oldest->Mutex);
+			if (Oldest->List.empty()) continue;
+
+			Oldest->UseSize -= Oldest->List.back().Size;
+			DecodeCacheUseSize -= Oldest->List.back().Size;
+			Oldest->Map.erase(Oldest->List.back().Key);
+			Oldest->List.pop_back();
+			Oldest->EvictNum++;
+		}
+	}
+}
+
+// LoadFileToMem と OpenFile で解凍したファイルをキャッシュするメモリの上限を設定する( 0:キャッシュしない )
+void DXArchive::SetDecodeCacheSize(u64 Size)
+{
+	DecodeCacheMaxSize = Size;
+
+	// 上限を超えた分を破棄する
+	DecodeCacheShrink();
+}
+
+// LoadFileToMem と OpenFile で解凍したファイルをキャッシュするメモリの上限を取得する
+u64 DXArchive::GetDecodeCacheSize(void)
+{
+	return DecodeCacheMaxSize;
+}
+
+// 解凍したファイルのキャッシュの状態を取得する
+void DXArchive::GetDecodeCacheStatus(DARC_CACHESTATUS *Status)
+{
+	int i;
+
+	memset(Status, 0, sizeof(DARC_CACHESTATUS));
+	Status->MaxSize = DecodeCacheMaxSize;
+	for (i = 0; i < DXA_DECODECACHE_SHARDNUM; i++)
+	{
+		std::lock_guard<std::mutex> Lock(DecodeCacheShard[i].Mutex);
+		Status->UseSize += DecodeCacheShard[i].UseSize;
+		Status->EntryNum += DecodeCacheShard[i].List.size();
+		Status->HitNum += DecodeCacheShard[i].HitNum;
+		Status->MissNum += DecodeCacheShard[i].MissNum;
+		Status->EvictNum += DecodeCacheShard[i].EvictNum;
+	}
+}
+
+// 解凍したファイルのキャッシュを全て破棄する( 回数の情報も初期化する )
+void DXArchive::ClearDecodeCache(void)
+{
+	int i;
+
+	for (i = 0; i < DXA_DECODECACHE_SHARDNUM; i++)
+	{
+		std::lock_guard<std::mutex> Lock(DecodeCacheShard[i].Mutex);
+		DecodeCacheUseSize -= DecodeCacheShard[i].UseSize;
+		DecodeCacheShard[i].List.clear();
+		DecodeCacheShard[i].Map.clear();
+		DecodeCacheShard[i].UseSize  = 0;
+		DecodeCacheShard[i].HitNum   = 0;
+		DecodeCacheShard[i].MissNum  = 0;
+		DecodeCacheShard[i].EvictNum = 0;
+	}
+}
+
+// 解凍したファイルのキャッシュから指定のファイルを取得する( 無かった場合は空 )
+std::shared_ptr<u8> DXArchive::DecodeCacheGet(u64 ArchiveID, u64 FileOffset)
+{
+	u64 Key                 = DecodeCacheKey(ArchiveID, FileOffset);
+	DARC_CACHESHARD *Shard  = DecodeCacheGetShard(Key);
+	std::lock_guard<std::mutex> Lock(Shard->Mutex);
+
+	auto Find = Shard->Map.find(Key);
+	if (Find == Shard->Map.end())
+	{
+		Shard->MissNum++;
+		return std::shared_ptr<u8>();
+	}
+
+	// 使われたので先頭に移動する
+	Shard->List.splice(Shard->List.begin(), Shard->List, Find->second);
+	Find->second->UseTick = ++DecodeCacheTick;
+	Shard->HitNum++;
+
+	return Find->second->Data;
+}
+
+// 解凍したファイルをキャッシュに追加する( 上限を超える場合は最近使われていないものから破棄する )
+void DXArchive::DecodeCacheAdd(u64 ArchiveID, u64 FileOffset, const std::shared_ptr<u8> &Data, u64 Size)
+{
+	u64 Key                 = DecodeCacheKey(ArchiveID, FileOffset);
+	DARC_CACHESHARD *Shard  = DecodeCacheGetShard(Key);
+	DARC_CACHEENTRY Entry;
+
+	// キャッシュ全体の上限より大きいデータは追加しない
+	if (Size > DecodeCacheMaxSize) return;
+
+	{
+		std::lock_guard<std::mutex> Lock(Shard->Mutex);
+
+		// 既に他のスレッドが追加したデータは追加しない
+		if (Shard->Map.find(Key) != Shard->Map.end()) return;
+
+		Entry.Key     = Key;
+		Entry.Data    = Data;
+		Entry.Size    = Size;
+		Entry.UseTick = ++DecodeCacheTick;
+		Shard->List.push_front(Entry);
+		Shard->Map[Key] = Shard->List.begin();
+		Shard->UseSize += Size;
+		DecodeCacheUseSize += Size;
+	}
+
+	// 上限を超えた分を破棄する( 追加したデータは一番新しいので最後まで残る )
+	DecodeCacheShrink();
+}
+
+// 指定のアーカイブのファイルをキャッシュから破棄する
+void DXArchive::DecodeCacheRemoveArchive(u64 ArchiveID)
+{
+	int i;
+
+	for (i = 0; i < DXA_DECODECACHE_SHARDNUM; i++)
+	{
+		std::lock_guard<std::mutex> Lock(DecodeCacheShard[i].Mutex);
+		for (auto Entry = DecodeCacheShard[i].List.begin(); Entry != DecodeCacheShard[i].List.end();)
+		{
+			if ((Entry->Key >> 32) != (ArchiveID & 0xffffffff))
+			{
+				Entry++;
+				continue;
+			}
+
+			DecodeCacheShard[i].UseSize -= Entry->Size;
+			DecodeCacheUseSize -= Entry->Size;
+			DecodeCacheShard[i].Map.erase(Entry->Key);
+			Entry = DecodeCacheShard[i].List.erase(Entry);
+		}
+	}
+}
+
 // アーカイブファイル中の指定のファイルを、クラス内のバッファに読み込む
 void *DXArchive::LoadFileToCache(const TCHAR *FilePath)
 {
@@ -4034,7 +6188,7 @@ int DXArchive::ClearCache(void)
 }
 
 // アーカイブファイル中の指定のファイルを開き、ファイルアクセス用オブジェクトを作成する
-DXArchiveFile *DXArchive::OpenFile(const TCHAR *FilePath)
+DXArchiveFile *DXArchive::OpenFile(const TCHAR *FilePath, bool Lazy)
 {
 	DARC_FILEHEAD *FileH;
 	DARC_DIRECTORY *Directory;
@@ -4048,120 +6202,158 @@ DXArchiveFile *DXArchive::OpenFile(const TCHAR *FilePath)
 	if (FileH == NULL) return NULL;
 
 	// 新しく DXArchiveFile クラスを作成する
-	CDArc = new DXArchiveFile(FileH, Directory, this);
+	CDArc = new DXArchiveFile(FileH, Directory, this, Lazy);
 
 	// DXArchiveFile クラスのポインタを返す
 	return CDArc;
 }
 
 // コンストラクタ
-DXArchiveFile::DXArchiveFile(DARC_FILEHEAD *FileHead, DARC_DIRECTORY *Directory, DXArchive *Archive)
+DXArchiveFile::DXArchiveFile(DARC_FILEHEAD *FileHead, DARC_DIRECTORY *Directory, DXArchive *Archive, bool Lazy)
 {
-	void *temp;
-
 	this->FileData   = FileHead;
 	this->Archive    = Archive;
 	this->EOFFlag    = FALSE;
 	this->FilePoint  = 0;
 	this->DataBuffer = NULL;
+	this->StreamOpen = false;
 
-	// 鍵を作成する
-	if (this->Archive->GetNoKey() == false)
+	// 圧縮されている場合は解凍したファイルのキャッシュを調べ、あった場合はキャッシュのデータを共有する
+	bool UseCache = false;
+	if (DXArchive::GetDecodeCacheSize() != 0 && FileHead->DataSize != 0 &&
+		(FileHead->PressDataSize != 0xffffffffffffffff || FileHead->HuffPressDataSize != 0xffffffffffffffff))
 	{
-		char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
-		size_t KeyStringBufferBytes;
+		this->CacheData = DXArchive::DecodeCacheGet(this->Archive->GetArchiveID(), (u64)((u8 *)FileHead - this->Archive->GetFileHeadTable()));
+		if (this->CacheData)
+		{
+			this->DataBuffer = this->CacheData.get();
+			return;
+		}
 
-		KeyStringBufferBytes = DXArchive::CreateKeyFileString(
-			(int)this->Archive->GetHeader()->CharCodeFormat,
-			this->Archive->GetKeyString(),
-			this->Archive->GetKeyStringBytes(),
-			Directory,
-			FileHead,
-			this->Archive->GetFileHeadTable(),
-			this->Archive->GetDirectoryTable(),
-			this->Archive->GetNameTable(),
-			(BYTE *)KeyStringBuffer);
-		DXArchive::KeyCreate(KeyStringBuffer, KeyStringBufferBytes, Key);
+		// 無かった場合は解凍した後でキャッシュに追加する( 読み込む時に解凍する場合は追加しない )
+		UseCache = Lazy == false;
 	}
 
-	// ファイルが圧縮されている場合は解凍データが収まるメモリ領域の確保
-	if (FileHead->PressDataSize != 0xffffffffffffffff ||
-		FileHead->HuffPressDataSize != 0xffffffffffffffff)
+	// 鍵を取得する
+	if (this->Archive->GetNoKey() == false)
 	{
-		// 解凍データが収まるメモリ領域の確保
-		this->DataBuffer = malloc((size_t)FileHead->DataSize);
+		this->Archive->GetFileKey(Directory, FileHead, Key);
 	}
 
-	// ファイルが圧縮されている場合はここで読み込んで解凍してしまう
-	if (FileHead->PressDataSize != 0xffffffffffffffff)
+	// ファイルが圧縮されている場合はここで読み込んで解凍してしまう( 読み込む時に解凍する場合は何もしない )
+	if (Lazy == false &&
+		(FileHead->PressDataSize != 0xffffffffffffffff ||
+		 FileHead->HuffPressDataSize != 0xffffffffffffffff))
 	{
-		// ハフマン圧縮もされているかどうかで処理を分岐
-		if (FileHead->HuffPressDataSize != 0xffffffffffffffff)
-		{
-			// 圧縮データが収まるメモリ領域の確保
-			temp = malloc((size_t)(FileHead->PressDataSize + FileHead->HuffPressDataSize));
-
-			// 圧縮データの読み込み
-			_fseeki64(this->Archive->GetFilePointer(), this->Archive->GetHeader()->DataStartAddress + FileHead->DataAddress, SEEK_SET);
-
-			// 鍵解除読み込み
-			DXArchive::KeyConvFileRead(temp, FileHead->HuffPressDataSize, this->Archive->GetFilePointer(), this->Archive->GetNoKey() ? NULL : Key, FileHead->DataSize);
-
-			// ハフマン圧縮データを解凍
-			Huffman_Decode(temp, (u8 *)temp + FileHead->HuffPressDataSize);
+		DARC_DECODESTREAM Stream;
+		u8 *Data;
+		s64 Size = -1;
 
-			// 解凍
-			DXArchive::Decode((u8 *)temp + FileHead->HuffPressDataSize, this->DataBuffer);
-
-			// メモリの解放
-			free(temp);
+		// 解凍データが収まるメモリ領域の確保( キャッシュに追加する場合はキャッシュと共有できる形で確保する )
+		if (UseCache)
+		{
+			this->CacheData  = std::shared_ptr<u8>((u8 *)malloc((size_t)FileHead->DataSize), free);
+			this->DataBuffer = this->CacheData.get();
 		}
 		else
 		{
-			// 圧縮データが収まるメモリ領域の確保
-			temp = malloc((size_t)FileHead->PressDataSize);
-
-			// 圧縮データの読み込み
-			_fseeki64(this->Archive->GetFilePointer(), this->Archive->GetHeader()->DataStartAddress + FileHead->DataAddress, SEEK_SET);
-			DXArchive::KeyConvFileRead(temp, FileHead->PressDataSize, this->Archive->GetFilePointer(), this->Archive->GetNoKey() ? NULL : Key, FileHead->DataSize);
-
-			// 解凍
-			DXArchive::Decode(temp, this->DataBuffer);
-
-			// メモリの解放
-			free(temp);
+			this->DataBuffer = malloc((size_t)FileHead->DataSize);
 		}
-	}
-	else
-		// ハフマン圧縮だけされているかどうかで処理を分岐
-		if (FileHead->HuffPressDataSize != 0xffffffffffffffff)
-		{
-			// 圧縮データが収まるメモリ領域の確保
-			temp = malloc((size_t)FileHead->HuffPressDataSize);
-
-			// 圧縮データの読み込み
-			_fseeki64(this->Archive->GetFilePointer(), this->Archive->GetHeader()->DataStartAddress + FileHead->DataAddress, SEEK_SET);
-
-			// 暗号化解除読み込み
-			DXArchive::KeyConvFileRead(temp, FileHead->HuffPressDataSize, this->Archive->GetFilePointer(), this->Archive->GetNoKey() ? NULL : Key, FileHead->DataSize);
+		if (this->DataBuffer == NULL) return;
 
-			// ハフマン圧縮データを解凍
-			Huffman_Decode(temp, this->DataBuffer);
-
-			// メモリの解放
-			free(temp);
+		// 圧縮データ全体をメモリに読み込まずに、少しずつ読み込みながら直接解凍する
+		if (DXArchive::DecodeStreamOpen(&Stream, FileHead, this->Archive->GetHeader()->HuffmanEncodeKB, this->Archive->GetSource(), this->Archive->GetHeader()->DataStartAddress + FileHead->DataAddress, this->Archive->GetNoKey() ? NULL : Key, this->Archive->GetCryptInfo(), this->DataBuffer) == 0)
+		{
+			while ((Size = DXArchive::DecodeStreamRead(&Stream, FileHead->DataSize, &Data)) > 0)
+			{
+			}
+			DXArchive::DecodeStreamClose(&Stream);
 		}
+
+		// 圧縮データが壊れている場合は不定のデータを返さないように０で埋める
+		if (Size < 0)
+			memset(this->DataBuffer, 0, (size_t)FileHead->DataSize);
+		else if (UseCache)
+			DXArchive::DecodeCacheAdd(this->Archive->GetArchiveID(), (u64)((u8 *)FileHead - this->Archive->GetFileHeadTable()), this->CacheData, FileHead->DataSize);
+	}
 }
 
 // デストラクタ
 DXArchiveFile::~DXArchiveFile()
 {
+	// キャッシュと共有しているデータはキャッシュ側で解放する
+	if (this->CacheData)
+	{
+		this->CacheData.reset();
+		this->DataBuffer = NULL;
+	}
+
 	// メモリの解放
 	if (this->DataBuffer != NULL)
 	{
 		free(this->DataBuffer);
 		this->DataBuffer = NULL;
 	}
+
+	// 解凍処理の後始末
+	if (this->StreamOpen)
+	{
+		DXArchive::DecodeStreamClose(&this->Stream);
+		this->StreamOpen = false;
+	}
+}
+
+// ファイルポインタの位置から、必要な分だけ解凍して読み込む( 0:成功  -1:失敗 )
+int DXArchiveFile::StreamRead(u8 *Buffer, u64 Size)
+{
+	DARC_DECODESTREAM *Stream = &this->Stream;
+	u64 Position              = this->FilePoint;
+	u64 Start, MoveSize;
+	u8 *Data;
+
+	// まだ解凍を始めていないか、既に保持していない位置を読み込む場合は最初から解凍しなおす
+	if (this->StreamOpen == false || (Stream->Press && Position < Stream->OutputSize - Stream->WindowUsed))
+	{
+		if (this->StreamOpen) DXArchive::DecodeStreamClose(Stream);
+		this->StreamOpen = false;
+
+		if (DXArchive::DecodeStreamOpen(Stream, this->FileData, this->Archive->GetHeader()->HuffmanEncodeKB, this->Archive->GetSource(), this->Archive->GetHeader()->DataStartAddress + this->FileData->DataAddress, this->Archive->GetNoKey() ? NULL : Key, this->Archive->GetCryptInfo()) < 0)
+			return -1;
+		this->StreamOpen = true;
+	}
+
+	// LZ 圧縮されていない場合は指定の位置から直接読み込む
+	if (Stream->Press == false)
+	{
+		return DXArchive::DecodeStreamReadAt(Stream, Position, Buffer, Size);
+	}
+
+	// LZ 圧縮されている場合は解凍済みの範囲から転送し、足りない場合は続きを解凍する
+	while (Size > 0)
+	{
+		if (Position < Stream->OutputSize)
+		{
+			Start    = Stream->OutputSize - Stream->WindowUsed;
+			MoveSize = Stream->OutputSize - Position < Size ? Stream->OutputSize - Position : Size;
+			memcpy(Buffer, Stream->Window + (Position - Start), (size_t)MoveSize);
+
+			Buffer += MoveSize;
+			Position += MoveSize;
+			Size -= MoveSize;
+			continue;
+		}
+
+		// 解凍できなかった場合は次に読み込む時に最初からやり直す
+		if (DXArchive::DecodeStreamRead(Stream, Position + Size - Stream->OutputSize, &Data) <= 0)
+		{
+			DXArchive::DecodeStreamClose(Stream);
+			this->StreamOpen = false;
+			return -1;
+		}
+	}
+
+	// 終了
+	return 0;
 }
 
 // ファイルの内容を読み込む
@@ -4172,13 +6364,6 @@ s64 DXArchiveFile::Read(void *Buffer, s64 ReadLength)
 	// EOF フラグが立っていたら０を返す
 	if (this->EOFFlag == TRUE) return 0;
 
-	// アーカイブファイルポインタと、仮想ファイルポインタが一致しているか調べる
-	// 一致していなかったらアーカイブファイルポインタを移動する
-	if (this->DataBuffer == NULL && _ftelli64(this->Archive->GetFilePointer()) != (s32)(this->FileData->DataAddress + this->Archive->GetHeader()->DataStartAddress + this->FilePoint))
-	{
-		_fseeki64(this->Archive->GetFilePointer(), this->FileData->DataAddress + this->Archive->GetHeader()->DataStartAddress + this->FilePoint, SEEK_SET);
-	}
-
 	// EOF 検出
 	if (this->FileData->DataSize == this->FilePoint)
 	{
@@ -4190,13 +6375,20 @@ s64 DXArchiveFile::Read(void *Buffer, s64 ReadLength)
 	ReadSize = ReadLength < (s64)(this->FileData->DataSize - this->FilePoint) ? ReadLength : this->FileData->DataSize - this->FilePoint;
 
 	// データを読み込む
-	if (this->DataBuffer == NULL)
+	if (this->DataBuffer != NULL)
+	{
+		memcpy(Buffer, (u8 *)this->DataBuffer + this->FilePoint, (size_t)ReadSize);
+	}
+	else if (this->FileData->PressDataSize != 0xffffffffffffffff || this->FileData->HuffPressDataSize != 0xffffffffffffffff)
 	{
-		DXArchive::KeyConvFileRead(Buffer, ReadSize, this->Archive->GetFilePointer(), this->Archive->GetNoKey() ? NULL : Key, this->FileData->DataSize + this->FilePoint);
+		// 圧縮されている場合は必要な分だけ解凍する
+		if (StreamRead((u8 *)Buffer, (u64)ReadSize) < 0) return -1;
 	}
 	else
 	{
-		memcpy(Buffer, (u8 *)this->DataBuffer + this->FilePoint, (size_t)ReadSize);
+		// 圧縮されていない場合はアーカイブの読み込み位置を変更せずに、ファイルポインタの位置から直接読み込む
+		if (DXArchive::KeyConvSourceReadAt(Buffer, ReadSize, this->Archive->GetSource(), this->Archive->GetHeader()->DataStartAddress + this->FileData->DataAddress + this->FilePoint, this->Archive->GetNoKey() ? NULL : Key, this->Archive->GetCryptInfo(), this->FileData->DataSize + this->FilePoint) != ReadSize)
+			return -1;
 	}
 
 	// EOF フラグを倒す
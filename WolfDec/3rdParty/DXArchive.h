@@ -16,6 +16,10 @@
 #include <stdio.h>
 #include <tchar.h>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <regex>
 #include <string>
 #include <vector>
 
@@ -74,9 +78,19 @@
 #define DXA_VER							(0x0008)		// バージョン
 #define DXA_VER_MIN						(0x0008)		// 対応している最低バージョン
 #define DXA_BUFFERSIZE					(0x1000000)		// アーカイブ作成時に使用するバッファのサイズ
+#define DXA_STREAMBUFFERSIZE			(0x40000)		// 圧縮されていないファイルを展開する時に一度に転送するサイズ( 少しずつ解凍する場合の圧縮データの読み込み単位も兼ねる )
+#define DXA_STREAMWINDOWSIZE			(0x2000000)		// 少しずつ解凍する場合に解凍したデータを保持する領域のサイズ( 参照可能な最大相対アドレスの２倍 )
+#define DXA_STREAMDECODE_MINSIZE		(0x2000000)		// 展開時にこのサイズより大きい圧縮されたファイルは少しずつ解凍して書き出す
+#define DXA_DECODECACHE_SHARDNUM		(16)			// 解凍したファイルのキャッシュの分割数( 分割した単位で排他処理を行う )
+#define DXA_DECODEBATCH_SPLITSIZE		(0x1000000)		// 複数のアーカイブをまとめて展開する時に、ファイルの合計サイズがこれ以上のアーカイブはファイル単位に分けて展開する
+#define DXA_DECODEBATCH_FILECOST		(0x1000)		// 複数のアーカイブをまとめて展開する時に、ファイル一つの処理の大きさの目安としてサイズに加える値( ファイルの作成に掛かる分 )
 #define DXA_KEY_BYTES					(7)				// 鍵のバイト数
 #define DXA_KEY_STRING_LENGTH			(63)			// 鍵用文字列の長さ
 #define DXA_KEY_STRING_MAXLENGTH		(2048)			// 鍵用文字列バッファのサイズ
+#define DXA_SPECIAL_KEY_BYTES			(768)			// Wolf RPG v3.31 以降の暗号化用の鍵のバイト数
+#define DXA_PRESSLEVEL_MIN				(1)				// 最も速い圧縮レベル
+#define DXA_PRESSLEVEL_DEFAULT			(6)				// 標準の圧縮レベル
+#define DXA_PRESSLEVEL_MAX				(9)				// 最も圧縮率の高い圧縮レベル( 最大圧縮指定時に使用 )
 
 // フラグ
 #define DXA_FLAG_NO_KEY					(0x00000001)	// 鍵処理無し
@@ -177,6 +191,171 @@ typedef struct tagDARC_ENCODEINFO
 	bool OutputStatus ;				// 状況出力を行うかどうか
 } DARC_ENCODEINFO ;
 
+// アーカイブ毎の暗号化処理の情報
+typedef struct tagDARC_CRYPTINFO
+{
+	u16 CryptVersion ;							// 暗号化のバージョン( DARC_HEAD のメンバ変数 Flags の上位16bit )
+	bool NewCrypt ;								// Wolf RPG v3.31 以降の暗号化を使用しているかどうか
+	bool ChaCha20 ;								// ChaCha20 による暗号化を使用しているかどうか
+	u8 SpecialKey[ DXA_SPECIAL_KEY_BYTES ] ;	// Wolf RPG v3.31 以降の暗号化用の鍵
+	u8 ChaCha20Key[ 32 ] ;						// ChaCha20 の鍵
+	u8 ChaCha20Nonce[ 12 ] ;					// ChaCha20 のノンス
+} DARC_CRYPTINFO ;
+
+// 展開処理用のファイル単位の処理情報
+typedef struct tagDARC_DECODEJOB
+{
+	DARC_DIRECTORY *Directory ;		// ファイルが格納されているディレクトリの情報
+	DARC_FILEHEAD *File ;			// ファイルの情報
+	std::wstring OutputPath ;		// 展開先のファイルパス
+	std::shared_ptr<std::string> DirectoryKeyString ;	// 鍵用の文字列のディレクトリ部分( ディレクトリ毎に一度だけ作成して、同じディレクトリのファイルで共有する )
+} DARC_DECODEJOB ;
+
+// アーカイブ作成処理用のファイル単位の処理情報
+typedef struct tagDARC_ENCODEJOB
+{
+	DARC_FILEHEAD File ;			// ファイルの情報( データの位置は書き出す時にセットする )
+	u64 FileHeadAddress ;			// ファイルの情報を格納するファイル情報テーブル上のアドレス
+	std::wstring SrcPath ;			// アーカイブするファイルのパス
+	std::wstring FileName ;			// アーカイブするファイルの名前
+	u8 Key[ DXA_KEY_BYTES ] ;		// ファイル個別の鍵
+	void *Buffer ;					// 書き出すデータを格納しているメモリ領域( NULL の場合は書き出す時にファイルから転送する )
+	u8 *Data ;						// 書き出すデータの先頭
+	u64 WriteSize ;					// 書き出すデータのサイズ
+	int Result ;					// 圧縮処理の結果( 0:成功  -1:失敗 )
+	bool Done ;						// 圧縮処理が終わっているかどうか
+} DARC_ENCODEJOB ;
+
+// 解凍したファイルのキャッシュの状態
+typedef struct tagDARC_CACHESTATUS
+{
+	u64 MaxSize ;					// キャッシュに使用するメモリの上限( 0 の場合はキャッシュしない )
+	u64 UseSize ;					// キャッシュしているデータの総量
+	u64 EntryNum ;					// キャッシュしているファイルの数
+	u64 HitNum ;					// キャッシュから読み込めた回数
+	u64 MissNum ;					// キャッシュに無かった回数
+	u64 EvictNum ;					// 上限を超えたためにキャッシュから追い出したファイルの数
+} DARC_CACHESTATUS ;
+
+// 展開処理用の作業領域( スレッド毎に持ち、今までに一番大きかったファイルのサイズまで拡張して使い回す )
+typedef struct tagDARC_SCRATCH
+{
+	void *Buffer ;					// 作業領域の先頭アドレス
+	u64 Size ;						// 作業領域のサイズ
+} DARC_SCRATCH ;
+
+// Wolf RPG v3.31 以降のアーカイブ全体に掛かっている暗号化を、読み込む度に解除するための情報( DecodeArchiveOpen で作成する )
+typedef struct tagDARC_IMAGECRYPT
+{
+	u8 Key[ DXA_SPECIAL_KEY_BYTES ] ;	// アーカイブ全体の暗号化の解除用の鍵
+	u16 CryptVersion ;				// 暗号化のバージョン
+	s64 CryptStart, CryptEnd ;		// 鍵で暗号化されている範囲
+	std::vector<u8> Body ;			// 暗号化を解除済みのデータの先頭部分( AES でも暗号化されている部分 )
+	s64 BodyStart ;					// Body のアーカイブ上の位置
+	std::vector<u8> Table ;			// 暗号化を解除済みのヘッダのテーブル( 同上 )
+	s64 TableStart ;				// Table のアーカイブ上の位置
+} DARC_IMAGECRYPT ;
+
+// 展開処理用のアーカイブの読み込み元の情報
+typedef struct tagDARC_SOURCE
+{
+	FILE *fp ;						// アーカイブファイルのポインタ( Image が NULL の場合に使用する )
+	const u8 *Image ;				// メモリ上のアーカイブイメージ( NULL の場合はファイルから読み込む )
+	s64 ImageSize ;					// アーカイブイメージのサイズ
+	s64 Position ;					// アーカイブイメージ上の読み込み位置
+	const DARC_IMAGECRYPT *ImageCrypt ;	// 読み込んだデータに掛かっているアーカイブ全体の暗号化を解除するための情報( NULL の場合は解除しない )
+} DARC_SOURCE ;
+
+// 圧縮されたファイルを先頭から少しずつ解凍する処理の情報
+// 圧縮データは「メモリ上の先頭部分」「アーカイブから読み込む途中部分」「メモリ上の末尾部分」を繋げたものとして扱う
+// ( ハフマン圧縮されている部分は開く時に解凍してメモリ上に置く )
+typedef struct tagDARC_DECODESTREAM
+{
+	DARC_SOURCE *Src ;				// 圧縮データの読み込み元
+	const DARC_CRYPTINFO *Crypt ;	// 暗号化処理の情報
+	u8 Key[ DXA_KEY_BYTES ] ;		// ファイル個別の鍵
+	bool UseKey ;					// 鍵を使用するかどうか
+	bool Press ;					// LZ 圧縮されているかどうか( false の場合は読み込んだデータをそのまま出力する )
+
+	void *HuffBuffer ;				// ハフマン圧縮を解凍したデータを格納するメモリ領域
+	const u8 *HeadData ;			// データの先頭部分( メモリ上 )
+	u64 HeadSize ;					// データの先頭部分のサイズ
+	s64 BodyPosition ;				// データの途中部分のアーカイブ上の位置
+	s64 BodyKeyPosition ;			// データの途中部分の鍵の位置
+	u64 BodySize ;					// データの途中部分のサイズ
+	const u8 *FootData ;			// データの末尾部分( メモリ上 )
+	u64 FootSize ;					// データの末尾部分のサイズ
+	u64 TotalSize ;					// 読み込むデータ全体のサイズ
+	u64 ReadSize ;					// 読み込み済みのデータのサイズ
+
+	u8 *InBuffer ;					// データの読み込み用バッファ( DXA_STREAMBUFFERSIZE バイト )
+	u32 InPosition ;				// 読み込み用バッファ内の未処理のデータの位置
+	u32 InSize ;					// 読み込み用バッファ内のデータのサイズ
+	u32 FillSize ;					// 読み込み用バッファに一度に読み込むサイズ( 最初は小さく、読み込む度に DXA_STREAMBUFFERSIZE まで大きくする )
+	u8 KeyCode ;					// LZ 圧縮データのキーコード
+
+	u8 *Window ;					// 解凍したデータを格納するメモリ領域( 参照される可能性のある範囲を保持する )
+	u64 WindowSize ;				// Window のサイズ
+	u64 WindowUsed ;				// Window 内の解凍したデータのサイズ
+	bool WindowAlloc ;				// Window を確保したかどうか( false の場合は呼び出し側が用意した全体が収まるメモリ領域 )
+	u64 DataSize ;					// 解凍後のデータのサイズ
+	u64 OutputSize ;				// 解凍済みのデータのサイズ
+} DARC_DECODESTREAM ;
+
+// 読み込み専用でメモリにマップしたファイルの情報
+typedef struct tagDARC_FILEMAP
+{
+	void *FileHandle ;				// ファイルのハンドル( HANDLE )
+	void *MapHandle ;				// ファイルマッピングオブジェクトのハンドル( HANDLE )
+	const u8 *Image ;				// マップしたファイルイメージの先頭アドレス( NULL:マップしていない )
+	s64 Size ;						// マップしたファイルイメージのサイズ
+} DARC_FILEMAP ;
+
+// 展開するファイルを絞り込む条件( SetDecodeFilter で設定する )
+typedef struct tagDARC_DECODEFILTER
+{
+	std::vector<std::wstring> Include ;		// 展開するファイルのアーカイブ内のパスのパターン( 空の場合は全てのファイル )
+	std::vector<std::wstring> Exclude ;		// 展開しないファイルのアーカイブ内のパスのパターン( Include より優先する )
+	bool Regex ;							// パターンが正規表現かどうか( false:ワイルドカード( * と ? が使用でき、パス全体と比較する )  true:パスの一部と一致すれば良い )
+	std::vector<std::wregex> IncludeRegex ;	// Include をコンパイルした正規表現
+	std::vector<std::wregex> ExcludeRegex ;	// Exclude をコンパイルした正規表現
+} DARC_DECODEFILTER ;
+
+// 展開処理用のアーカイブ単位の情報( DecodeArchiveOpen で作成する )
+typedef struct tagDARC_DECODEARCHIVE
+{
+	DARC_HEAD Head ;				// アーカイブのヘッダ
+	u8 *HeadBuffer ;				// 展開したヘッダのテーブルを格納しているメモリ領域
+	u8 *NameP, *FileP, *DirP ;		// 各種テーブル(名前情報テーブル、ファイルヘッダ情報テーブル、ディレクトリ情報テーブル)へのポインタ
+	FILE *ArcP ;					// アーカイブファイルのポインタ
+	DARC_FILEMAP ArcMap ;			// メモリにマップしたアーカイブファイルの情報
+	DARC_SOURCE Src ;				// アーカイブの読み込み元
+	std::wstring ArcPath ;			// アーカイブファイルのフルパス( 展開用のスレッドが開き直す時に使用する )
+	char KeyString[ DXA_KEY_STRING_LENGTH + 1 ] ;	// 鍵文字列
+	size_t KeyStringBytes ;			// 鍵文字列のバイト数
+	bool NoKey ;					// 鍵処理を行わないかどうか
+	DARC_CRYPTINFO Crypt ;			// 暗号化処理の情報
+	DARC_IMAGECRYPT ImageCrypt ;	// アーカイブ全体に掛かっている暗号化の情報( Wolf RPG v3.31 以降の場合のみ使用する、Src から参照される )
+} DARC_DECODEARCHIVE ;
+
+// 複数のアーカイブファイルをまとめて展開する処理のアーカイブ単位の情報
+typedef struct tagDARC_DECODEBATCH
+{
+	std::wstring ArchiveName ;		// 展開するアーカイブファイルのパス
+	std::wstring OutputPath ;		// 展開先のディレクトリのパス( 予め作成しておく )
+	const char *KeyString ;			// 鍵文字列( NULL の場合はデフォルトの鍵文字列 )
+	std::function<int( void )> Decode ;	// この形式以外のアーカイブを展開する処理( 空でない場合は ArchiveName の展開の代わりにこれを一つのスレッドで実行する、0:成功  -1:失敗 )
+	int Result ;					// 展開の結果( 0:成功  -1:失敗 )
+} DARC_DECODEBATCH ;
+
+// アーカイブに格納されているファイルの情報( ListArchive で一つずつ渡される )
+typedef struct tagDARC_LISTENTRY
+{
+	std::wstring Path ;				// アーカイブ内のパス( ディレクトリの区切りは \ )
+	const DARC_FILEHEAD *File ;		// ファイルヘッダ( サイズ、時間情報、属性、渡された処理の中でのみ有効 )
+	u64 DataPosition ;				// アーカイブファイル上のデータの位置( ディレクトリの場合は 0 )
+} DARC_LISTENTRY ;
+
 // class ----------------------------------------
 
 // アーカイブクラス
@@ -198,17 +377,33 @@ public :
 	static int 			EncodeArchiveOneDirectory(const TCHAR *OutputFileName, const TCHAR *FolderPath, bool Press = false, bool AlwaysHuffman = false, u8 HuffmanEncodeKB = 0, const char *KeyString_ = NULL, bool NoKey = false, bool OutputStatus = true, bool MaxPress = false, uint16_t cryptVersion = 0);                               // アーカイブファイルを作成する(ディレクトリ一個だけ)
 	static int			EncodeArchiveOneDirectoryWolf(const TCHAR *OutputFileName, const TCHAR *DirectoryPath, bool Press = false, const char *KeyString_ = NULL, uint16_t cryptVersion = 0);
 	static int			DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const char *KeyString_ = NULL ) ;								// アーカイブファイルを展開する
+	static int			DecodeArchiveBatch( std::vector<DARC_DECODEBATCH> *BatchList ) ;										// 複数のアーカイブファイルを一つのスレッドプールでまとめて展開する( 大きいものから順に展開し、大きいアーカイブはファイル単位に分けて複数のスレッドで展開する、0:全て成功  -1:失敗したものがある )
+	static int			ListArchive(const TCHAR *ArchiveName, const std::function<void( const DARC_LISTENTRY &Entry )> &Output, const char *KeyString_ = NULL ) ;	// アーカイブファイルのヘッダのテーブルだけを展開して、格納されているファイルの情報を一つずつ Output に渡す( データの読み込みと解凍は行わない、0:成功  -1:失敗 )
+	static int			ProbeArchive(const TCHAR *ArchiveName, const char *KeyString_ = NULL ) ;												// アーカイブファイルのヘッダとテーブルだけを解析して、指定の鍵文字列で展開できそうかを調べる( -1:展開できない  0～100:展開できる確からしさ )
+	static void			SetDecodeThreadNum( int ThreadNum ) ;														// アーカイブファイルの展開に使用するスレッドの数を設定する( 0 以下:論理コア数 )
+	static int			GetDecodeThreadNum( void ) ;																// アーカイブファイルの展開に使用するスレッドの数を取得する
+	static int			SetDecodeFilter( const std::vector<std::wstring> &Include, const std::vector<std::wstring> &Exclude, bool Regex = false ) ;	// 展開するファイルをアーカイブ内のパスで絞り込む( 両方とも空の場合は全て展開する、0:成功  -1:正規表現が正しくない )
+	static void			SetEncodeThreadNum( int ThreadNum ) ;														// アーカイブファイルの作成に使用するスレッドの数を設定する( 0 以下:論理コア数 )
+	static int			GetEncodeThreadNum( void ) ;																// アーカイブファイルの作成に使用するスレッドの数を取得する
+	static void			SetPressLevel( int Level ) ;																// データの圧縮に使用する圧縮レベルを設定する( DXA_PRESSLEVEL_MIN:速度優先 ～ DXA_PRESSLEVEL_MAX:圧縮率優先 )
+	static int			GetPressLevel( void ) ;																		// データの圧縮に使用する圧縮レベルを取得する
+	static void			SetNameIndex( bool Flag ) ;																	// アーカイブファイルを開く時にファイル名検索用のハッシュテーブルを作成するかどうかを設定する( デフォルト:true )
+	static bool			GetNameIndex( void ) ;																		// アーカイブファイルを開く時にファイル名検索用のハッシュテーブルを作成するかどうかを取得する
+	static void			SetDecodeCacheSize( u64 Size ) ;															// LoadFileToMem と OpenFile で解凍したファイルをキャッシュするメモリの上限を設定する( 0:キャッシュしない( デフォルト ) )
+	static u64			GetDecodeCacheSize( void ) ;																// LoadFileToMem と OpenFile で解凍したファイルをキャッシュするメモリの上限を取得する
+	static void			GetDecodeCacheStatus( DARC_CACHESTATUS *Status ) ;											// 解凍したファイルのキャッシュの状態を取得する
+	static void			ClearDecodeCache( void ) ;																	// 解凍したファイルのキャッシュを全て破棄する( 回数の情報も初期化する )
 
 	int					OpenArchiveFile( const TCHAR *ArchivePath, const char *KeyString_ = NULL ) ;				// アーカイブファイルを開く( 0:成功  -1:失敗 )
 	int					OpenArchiveFileMem( const TCHAR *ArchivePath, const char *KeyString_ = NULL ) ;			// アーカイブファイルを開き最初にすべてメモリ上に読み込んでから処理する( 0:成功  -1:失敗 )
 	int					OpenArchiveMem( void *ArchiveImage, s64 ArchiveSize, const char *KeyString_ = NULL ) ;	// メモリ上にあるアーカイブファイルイメージを開く( 0:成功  -1:失敗 )
 	int					CloseArchiveFile( void ) ;																// アーカイブファイルを閉じる
 
-	s64					LoadFileToMem( const TCHAR *FilePath, void *Buffer, u64 BufferLength ) ;		// アーカイブファイル中の指定のファイルをメモリに読み込む( -1:エラー 0以上:ファイルサイズ )
+	s64					LoadFileToMem( const TCHAR *FilePath, void *Buffer, u64 BufferLength ) ;		// アーカイブファイル中の指定のファイルをメモリに読み込む( -1:エラー 0以上:ファイルサイズ、複数のスレッドから同時に呼んでも良い )
 	s64					GetFileSize( const TCHAR *FilePath ) ;										// アーカイブファイル中の指定のファイルをサイズを取得する( -1:エラー )
 	int					GetFileInfo( const TCHAR *FilePath, u64 *PositionP, u64 *SizeP ) ;			// アーカイブファイル中の指定のファイルのファイル内の位置とファイルの大きさを得る( -1:エラー )
 	void				*GetFileImage( void ) ;														// アーカイブファイルをメモリに読み込んだ場合のファイルイメージが格納されている先頭アドレスを取得する( メモリから開いている場合のみ有効、圧縮している場合は、圧縮された状態のデータが格納されているので注意 )
-	class DXArchiveFile *OpenFile( const TCHAR *FilePath ) ;											// アーカイブファイル中の指定のファイルを開き、ファイルアクセス用オブジェクトを作成する( ファイルから開いている場合のみ有効 )
+	class DXArchiveFile *OpenFile( const TCHAR *FilePath, bool Lazy = false ) ;							// アーカイブファイル中の指定のファイルを開き、ファイルアクセス用オブジェクトを作成する( ファイルから開いている場合のみ有効、Lazy が true の場合は開く時には解凍せず、読み込む時に必要な分だけ解凍する )
 
 	void *				LoadFileToCache( const TCHAR *FilePath ) ;									// アーカイブファイル中の指定のファイルを、クラス内のキャッシュバッファに読み込む
 	int					ClearCache( void ) ;															// キャッシュバッファを開放する
@@ -220,28 +415,54 @@ public :
 
 	// 以下は割と内部で使用
 	static void fwrite64( void *Data, s64 Size, FILE *fp ) ;													// 標準ストリームにデータを書き込む( 64bit版 )
-	static void fread64( void *Buffer, s64 Size, FILE *fp ) ;													// 標準ストリームからデータを読み込む( 64bit版 )
+	static s64 fread64( void *Buffer, s64 Size, FILE *fp ) ;													// 標準ストリームからデータを読み込む( 64bit版、戻り値:実際に読み込めたサイズ )
 	static void NotConv( void *Data , s64 Size ) ;																// データを反転させる関数
 	static void NotConvFileWrite( void *Data, s64 Size, FILE *fp ) ;											// データを反転させてファイルに書き出す関数
 	static void NotConvFileRead( void *Data, s64 Size, FILE *fp ) ;												// データを反転させてファイルから読み込む関数
 	static size_t CreateKeyFileString( int CharCodeFormat, const char *KeyString, size_t KeyStringBytes, DARC_DIRECTORY *Directory, DARC_FILEHEAD *FileHead, u8 *FileTable, u8 *DirectoryTable, u8 *NameTable, u8 *FileString ) ;	// カレントディレクトリにある指定のファイルの鍵用の文字列を作成する、戻り値は文字列の長さ( 単位：Byte )( FileString は DXA_KEY_STRING_MAXLENGTH の長さが必要 )
+	static void CreateKeyDirectoryString( int CharCodeFormat, DARC_DIRECTORY *Directory, u8 *FileTable, u8 *DirectoryTable, u8 *NameTable, std::string *DirectoryString ) ;	// 指定のディレクトリにあるファイルの鍵用の文字列のディレクトリ部分を作成する
+	static size_t CreateKeyFileStringFast( int CharCodeFormat, const char *KeyString, size_t KeyStringBytes, const std::string &DirectoryString, DARC_FILEHEAD *FileHead, u8 *NameTable, u8 *FileString ) ;	// 作成済みのディレクトリ部分を使用して鍵用の文字列を作成する、戻り値は文字列の長さ( 単位：Byte )( 文字列が長すぎて CreateKeyFileString と結果が変わる場合は 0 )
 	static void KeyCreate( const char *Source, size_t SourceBytes, u8 *Key ) ;									// 鍵文字列を作成
-	static void KeyConv( void *Data, s64 Size, s64 Position, unsigned char *Key ) ;								// 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-	static void KeyConvFileWrite( void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position = -1 ) ;		// データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-	static void KeyConvFileRead( void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position = -1 ) ;		// ファイルから読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static void SetupCryptInfo( DARC_CRYPTINFO *Crypt, u16 CryptVersion, const char *KeyString, size_t KeyStringBytes ) ;	// 暗号化のバージョンから暗号化処理の情報を初期化する( Wolf RPG v3.31 以降の鍵は別途作成する )
+	static void KeyConv( void *Data, s64 Size, s64 Position, unsigned char *Key, const DARC_CRYPTINFO *Crypt ) ;								// 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static void KeyConvFileWrite( void *Data, s64 Size, FILE *fp, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position = -1 ) ;		// データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static void KeyConvFileRead( void *Data, s64 Size, FILE *fp, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position = -1 ) ;		// ファイルから読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static s64 KeyConvSourceRead( void *Data, s64 Size, DARC_SOURCE *Src, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position = -1 ) ;	// 展開処理用の読み込み元から読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static s64 KeyConvSourceReadAt( void *Data, s64 Size, DARC_SOURCE *Src, s64 SourcePosition, unsigned char *Key, const DARC_CRYPTINFO *Crypt, s64 Position = -1 ) ;	// 展開処理用の読み込み元の指定の位置から読み込んだデータを鍵文字列を使用して Xor 演算する関数( 読み込み位置は変更しない )
+	static s64 SourceRead( DARC_SOURCE *Src, void *Buffer, s64 Size ) ;										// 展開処理用の読み込み元からデータを読み込む( 戻り値:実際に読み込めたサイズ )
+	static s64 SourceReadAt( DARC_SOURCE *Src, s64 Position, void *Buffer, s64 Size ) ;						// 展開処理用の読み込み元の指定の位置からデータを読み込む( 読み込み位置は変更しない、複数のスレッドから同時に呼んで良いのは SourceReadAt 同士のみ )
+	static void SourceImageDecrypt( const DARC_SOURCE *Src, s64 Position, void *Buffer, s64 Size ) ;			// 展開処理用の読み込み元から読み込んだデータに掛かっているアーカイブ全体の暗号化を解除する
+	static void SourceSeek( DARC_SOURCE *Src, s64 Position ) ;													// 展開処理用の読み込み元の読み込み位置を変更する
+	static s64 SourceTell( DARC_SOURCE *Src ) ;																	// 展開処理用の読み込み元の読み込み位置を取得する
+	static s64 SourceSize( DARC_SOURCE *Src ) ;																	// 展開処理用の読み込み元のサイズを取得する
+	static void *ScratchAlloc( DARC_SCRATCH *Scratch, u64 Size ) ;												// 展開処理用の作業領域から指定サイズのメモリ領域を得る( 足りない場合は拡張する、失敗した場合は NULL )
+	static void ScratchRelease( DARC_SCRATCH *Scratch ) ;														// 展開処理用の作業領域を解放する
+	static std::shared_ptr<u8> DecodeCacheGet( u64 ArchiveID, u64 FileOffset ) ;								// 解凍したファイルのキャッシュから指定のファイルを取得する( 無かった場合は空 )
+	static void DecodeCacheAdd( u64 ArchiveID, u64 FileOffset, const std::shared_ptr<u8> &Data, u64 Size ) ;	// 解凍したファイルをキャッシュに追加する( 上限を超える場合は最近使われていないものから破棄する )
+	static void DecodeCacheRemoveArchive( u64 ArchiveID ) ;														// 指定のアーカイブのファイルをキャッシュから破棄する
+	static int DecodeStreamOpen( DARC_DECODESTREAM *Stream, DARC_FILEHEAD *File, u8 HuffmanEncodeKB, DARC_SOURCE *Src, s64 DataPosition, unsigned char *Key, const DARC_CRYPTINFO *Crypt, void *Dest = NULL ) ;	// ファイルを少しずつ解凍する準備をする( Dest に DataSize 以上のメモリ領域を渡すとそこに解凍する、0:成功  -1:失敗 )
+	static s64 DecodeStreamRead( DARC_DECODESTREAM *Stream, u64 Size, u8 **Data ) ;								// ファイルの続きを解凍する( 戻り値:解凍したサイズ( 0:終端  -1:エラー )、*Data には解凍したデータの先頭アドレスが入り、次の呼び出しまで有効 )
+	static int DecodeStreamReadAt( DARC_DECODESTREAM *Stream, u64 Position, void *Buffer, u64 Size ) ;		// ファイルを少しずつ解凍する処理の読み込み元の指定の位置から読み込む( LZ 圧縮されていない場合は解凍後のデータの任意の位置を読み込める、0:成功  -1:アーカイブが途中で終わっている )
+	static void DecodeStreamClose( DARC_DECODESTREAM *Stream ) ;												// ファイルを少しずつ解凍する処理の後始末をする
+	static int MapArchiveFile( DARC_FILEMAP *Map, const TCHAR *Path ) ;											// ファイルを読み込み専用でメモリにマップする( 0:成功  -1:失敗 )
+	static void UnmapArchiveFile( DARC_FILEMAP *Map ) ;															// メモリにマップしたファイルを解放する
 	static DATE_RESULT DateCmp( DARC_FILETIME *date1, DARC_FILETIME *date2 ) ;									// どちらが新しいかを比較する
-	static int Encode( void *Src, u32 SrcSize, void *Dest, bool OutStatus = true, bool MaxPress = false ) ;		// データを圧縮する( 戻り値:圧縮後のデータサイズ )
-	static int Decode( void *Src, void *Dest ) ;																// データを解凍する( 戻り値:解凍後のデータサイズ )
+	static int Encode( void *Src, u32 SrcSize, void *Dest, bool OutStatus = true, bool MaxPress = false, int Level = -1 ) ;	// データを圧縮する( 戻り値:圧縮後のデータサイズ  -1:エラー  Level が負の場合は SetPressLevel で設定したレベル )
+	static int Decode( void *Src, void *Dest, s64 SrcBufSize, s64 DestBufSize ) ;								// データを解凍する( 戻り値:解凍後のデータサイズ  -1:エラー )
 	static u32 HashCRC32( const void *SrcData, size_t SrcDataSize ) ;											// バイナリデータを元に CRC32 のハッシュ値を計算する
 
 	DARC_DIRECTORY *GetCurrentDirectoryInfo( void ) ;															// アーカイブ内のカレントディレクトリの情報を取得する
-	DARC_FILEHEAD *GetFileInfo( const TCHAR *FilePath, DARC_DIRECTORY **DirectoryP = NULL ) ;					// ファイルの情報を得る
+	DARC_FILEHEAD *GetFileInfo( const TCHAR *FilePath, DARC_DIRECTORY **DirectoryP = NULL ) ;					// ファイルの情報を得る( カレントディレクトリは変更しないので、複数のスレッドから同時に呼んでも良い )
 	inline DARC_HEAD *GetHeader( void ){ return &Head ; }
 	inline u8 *GetKey( void ){ return Key ; }
 	inline bool GetNoKey( void ){ return NoKey ; }
 	inline char *GetKeyString( void ){ return KeyString ; }
+	inline DARC_CRYPTINFO *GetCryptInfo( void ){ return &Crypt ; }
 	inline size_t GetKeyStringBytes( void ){ return KeyStringBytes ; }
 	inline FILE *GetFilePointer( void ){ return fp ; }
+	inline DARC_SOURCE *GetSource( void ){ return &Source ; }
+	inline u64 GetArchiveID( void ){ return ArchiveID ; }
+	void GetFileKey( DARC_DIRECTORY *Directory, DARC_FILEHEAD *FileHead, u8 *Key ) ;							// ファイル個別の鍵を取得する( 一度作成した鍵は保存しておき、次からはそれを返す )
 	inline u8 *GetNameP( void ){ return NameP ; }
 	inline u8 *GetFileHeadTable( void ){ return FileP ; }
 	inline u8 *GetDirectoryTable( void ){ return DirP ; }
@@ -249,6 +470,8 @@ public :
 
 protected :
 	FILE *fp ;							// アーカイブファイルのポインタ	
+	DARC_FILEMAP FileMap ;				// メモリにマップしたアーカイブファイルの情報
+	DARC_SOURCE Source ;				// ファイルから開いている場合の読み込み元( マップできた場合はマップしたイメージから読み込む )
 	u8 *HeadBuffer ;					// ヘッダーバッファー
 	u8 *FileP, *DirP, *NameP ;			// 各種テーブル(ファイルヘッダ情報テーブル、ディレクトリ情報テーブル、名前情報テーブル)へのポインタ
 	DARC_DIRECTORY *CurrentDirectory ;	// カレントディレクトリデータへのポインタ
@@ -262,9 +485,20 @@ protected :
 	u8 Key[ DXA_KEY_BYTES ] ;			// 鍵
 	char KeyString[ DXA_KEY_STRING_LENGTH + 1 ] ;	// 鍵文字列
 	size_t KeyStringBytes ;				// 鍵文字列のバイト数
+	DARC_CRYPTINFO Crypt ;				// 暗号化処理の情報
+	u64 ArchiveID ;						// 開いているアーカイブを識別する番号( 解凍したファイルのキャッシュで使用する、開いていない場合は 0 )
+	std::unique_ptr<std::atomic<u64>[]> FileKey ;	// 作成済みのファイル個別の鍵( ファイルヘッダの番号毎に下位７バイトが鍵、最上位バイトが 1 の場合は作成済み )
+	u64 FileKeyNum ;					// FileKey の要素数
+	std::vector<u32> NameIndex ;		// ファイル名検索用のハッシュテーブル( ファイルヘッダの番号＋１、０は空き、作成していない場合は空 )
 
 	DARC_HEAD Head ;					// アーカイブのヘッダ
 
+	static int DecodeThreadNum ;		// アーカイブファイルの展開に使用するスレッドの数
+	static DARC_DECODEFILTER DecodeFilter ;	// 展開するファイルを絞り込む条件
+	static int EncodeThreadNum ;		// アーカイブファイルの作成に使用するスレッドの数
+	static int PressLevel ;				// データの圧縮に使用する圧縮レベル
+	static bool NameIndexFlag ;			// アーカイブファイルを開く時にファイル名検索用のハッシュテーブルを作成するかどうか
+
 	// サイズ保存用構造体
 	typedef struct tagSIZESAVE
 	{
@@ -282,8 +516,19 @@ protected :
 		u16 PackNum ;
 	} SEARCHDATA ;
 
-	static int DirectoryEncode( int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ENCODEINFO *EncodeInfo ) ;	// 指定のディレクトリにあるファイルをアーカイブデータに吐き出す
-	static int DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, FILE *ArcP, unsigned char *Key, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer ) ;											// 指定のディレクトリデータにあるファイルを展開する
+	static int DirectoryEncode( int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, std::vector<DARC_ENCODEJOB> *JobList ) ;	// 指定のディレクトリにあるファイルの情報をテーブルに書き出し、ファイルデータの処理情報を列に追加する
+	static int FileEncode( DARC_ENCODEJOB *Job, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, bool NoKey, const DARC_CRYPTINFO *Crypt, DARC_ENCODEINFO *EncodeInfo ) ;	// ファイルを一つ圧縮して鍵を適用した書き出すデータを作成する
+	static int FileEncodeWrite( DARC_ENCODEJOB *Job, u8 *FileP, SIZESAVE *Size, FILE *DestFp, void *TempBuffer, bool NoKey, const DARC_CRYPTINFO *Crypt ) ;	// 圧縮したファイルのデータをアーカイブに書き出す
+	static int FileEncodeJobList( std::vector<DARC_ENCODEJOB> *JobList, u8 *FileP, SIZESAVE *Size, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, bool NoKey, const DARC_CRYPTINFO *Crypt, DARC_ENCODEINFO *EncodeInfo ) ;	// ファイル単位の処理情報の列にあるファイルを複数のスレッドで圧縮し、順番通りにアーカイブに書き出す
+	static int DecodeArchiveOpen( DARC_DECODEARCHIVE *Arc, const TCHAR *ArchiveName, const char *KeyString_ ) ;	// 展開するアーカイブファイルを開き、ヘッダのテーブルを展開する( 0:成功  -1:失敗 )
+	static void DecodeArchiveClose( DARC_DECODEARCHIVE *Arc ) ;													// DecodeArchiveOpen で開いたアーカイブファイルを閉じる
+	static int FileDecodeJobList( std::vector<DARC_DECODEJOB> *JobList, u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_SOURCE *Src, const TCHAR *ArcPath, const char *KeyString, size_t KeyStringBytes, bool NoKey, const DARC_CRYPTINFO *Crypt ) ;											// 展開処理情報の列にあるファイルを複数のスレッドで展開する
+	static int DirectoryDecodeJobList( int CharCodeFormat, u8 *NameP, u8 *FileP, u8 *DirP, DARC_DIRECTORY *Dir, const std::wstring &DirPath, size_t RootPathLength, const std::string *ParentKeyString, std::vector<DARC_DECODEJOB> *JobList ) ;	// 指定のディレクトリデータ以下のファイルを展開処理情報の列に追加する( ディレクトリの作成も行う、RootPathLength は展開先のディレクトリのパスの長さ、ParentKeyString は親ディレクトリの鍵用の文字列( NULL の場合はここで作成する ) )
+	static bool CheckDecodeFilter( const std::wstring &Path ) ;							// アーカイブ内のパスが展開するファイルを絞り込む条件に合うかを調べる
+	static bool WildCardMatch( const TCHAR *Pattern, const TCHAR *Str ) ;				// ワイルドカードを含むパターンと文字列を比較する( 大文字と小文字、\ と / は区別しない )
+	static int DirectoryList( u8 *NameP, u8 *FileP, u8 *DirP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, const std::wstring &DirPath, const std::function<void( const DARC_LISTENTRY &Entry )> &Output ) ;	// 指定のディレクトリデータ以下のファイルの情報を Output に渡す
+	static int CheckHeadTable( DARC_HEAD *Head, u8 *HeadBuffer, u64 ArchiveSize ) ;		// 解凍したヘッダのテーブルが正しいかを調べる( -1:壊れている  0～100:ファイルの情報の内、名前のパリティとデータの位置が正しいものの割合 )
+	static int FileDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DECODEJOB *Job, DARC_SOURCE *Src, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, const DARC_CRYPTINFO *Crypt, DARC_SCRATCH *Scratch ) ;	// ファイルを一つ展開する
 	static int StrICmp( const TCHAR *Str1, const TCHAR *Str2 ) ;							// 比較対照の文字列中の大文字を小文字として扱い比較する( 0:等しい  1:違う )
 	static int ConvSearchData( SEARCHDATA *Dest, const TCHAR *Src, int *Length ) ;		// 文字列を検索用のデータに変換( ヌル文字か \ があったら終了 )
 	static int AddFileNameData( const TCHAR *FileName, u8 *FileNameTable ) ;				// ファイル名データを追加する( 戻り値は使用したデータバイト数 )
@@ -293,6 +538,9 @@ protected :
 	static void EncodeStatusOutput( DARC_ENCODEINFO *EncodeInfo, bool Always = false ) ;		// エンコードの進行状況を表示する
 	static void AnalyseHuffmanEncode( u64 DataSize, u8 HuffmanEncodeKB, u64 *HeadDataSize, u64 *FootDataSize ) ;	// ハフマン圧縮をする前後のサイズを取得する
 	int	ChangeCurrentDirectoryFast( SEARCHDATA *SearchData ) ;							// アーカイブ内のディレクトリパスを変更する( 0:成功  -1:失敗 )
+	DARC_FILEHEAD *SearchFileHead( DARC_DIRECTORY *Dir, const SEARCHDATA *SearchData, bool Directory ) ;	// 指定のディレクトリから検索用データと同名のファイル又はディレクトリを探す( 無かった場合は NULL )
+	int BuildNameIndex( void ) ;																				// ファイル名検索用のハッシュテーブルを作成する( 0:成功  -1:失敗 )
+	void SetupFileKeyTable( void ) ;																			// 作成済みのファイル個別の鍵を保存しておく領域を用意する
 	int	ChangeCurrentDirectoryBase( const TCHAR *DirectoryPath, bool ErrorIsDirectoryReset, SEARCHDATA *LastSearchData = NULL ) ;		// アーカイブ内のディレクトリパスを変更する( 0:成功  -1:失敗 )
 	int DirectoryKeyConv( DARC_DIRECTORY *Dir, char *KeyStringBuffer ) ;										// 指定のディレクトリデータの暗号化を解除する( 丸ごとメモリに読み込んだ場合用 )
 
@@ -309,23 +557,29 @@ protected :
 
 
 // アーカイブされたファイルのアクセス用のクラス
+// ( アーカイブの読み込み位置は変更しないので、同じアーカイブから開いた別々のオブジェクトを複数のスレッドから同時に使用しても良い )
 class DXArchiveFile
 {
 protected :
 	DARC_FILEHEAD *FileData ;		// ファイルデータへのポインタ
 	DXArchive *Archive ;			// アーカイブクラスへのポインタ
 	void *DataBuffer ;				// メモリにデータを展開した際のバッファのポインタ
+	std::shared_ptr<u8> CacheData ;	// 解凍したファイルのキャッシュと共有しているデータ( 共有している場合は DataBuffer はこのデータを指す )
+	DARC_DECODESTREAM Stream ;		// 読み込む時に必要な分だけ解凍する場合の解凍処理の情報
+	bool StreamOpen ;				// Stream を使用しているかどうか
 
 	u8 Key[ DXA_KEY_BYTES ] ;		// 鍵
 
 	int EOFFlag ;					// EOFフラグ
 	u64 FilePoint ;					// ファイルポインタ
 
+	int StreamRead( u8 *Buffer, u64 Size ) ;					// ファイルポインタの位置から、必要な分だけ解凍して読み込む( 0:成功  -1:失敗 )
+
 public :
-	DXArchiveFile( DARC_FILEHEAD *FileHead, DARC_DIRECTORY *Directory, DXArchive *Archive ) ;
+	DXArchiveFile( DARC_FILEHEAD *FileHead, DARC_DIRECTORY *Directory, DXArchive *Archive, bool Lazy = false ) ;
 	~DXArchiveFile() ;
 
-	s64 Read( void *Buffer, s64 ReadLength ) ;					// ファイルの内容を読み込む
+	s64 Read( void *Buffer, s64 ReadLength ) ;					// ファイルの内容を読み込む( 戻り値:読み込んだサイズ  -1:エラー )
 	s64 Seek( s64 SeekPoint, s64 SeekMode ) ;					// ファイルポインタを変更する
 	s64 Tell( void ) ;											// 現在のファイルポインタを得る
 	s64 Eof( void ) ;											// ファイルの終端に来ているか、のフラグを得る
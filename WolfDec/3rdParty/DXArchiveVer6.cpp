@@ -12,6 +12,7 @@
 
 // include ----------------------------
 #include "DXArchiveVer6.h"
+#include "KeyConv.h"
 #include <stdio.h>
 #include <windows.h>
 #include <stdint.h>
@@ -479,34 +480,7 @@ void DXArchive_VER6::KeyCreate( const char *Source, unsigned char *Key )
 // 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEYSTR_LENGTH_VER6 の長さがなければならない )
 void DXArchive_VER6::KeyConv( void *Data, s64 Size, s64 Position, unsigned char *Key )
 {
-	Position %= DXA_KEYSTR_LENGTH_VER6 ;
-
-	if( Size < 0x100000000 )
-	{
-		u32 i, j ;
-
-		j = ( u32 )Position ;
-		for( i = 0 ; i < Size ; i ++ )
-		{
-			((u8 *)Data)[i] ^= Key[j] ;
-
-			j ++ ;
-			if( j == DXA_KEYSTR_LENGTH_VER6 ) j = 0 ;
-		}
-	}
-	else
-	{
-		s64 i, j ;
-
-		j = Position ;
-		for( i = 0 ; i < Size ; i ++ )
-		{
-			((u8 *)Data)[i] ^= Key[j] ;
-
-			j ++ ;
-			if( j == DXA_KEYSTR_LENGTH_VER6 ) j = 0 ;
-		}
-	}
+	KeyConvXor( Data, Size, Position, Key, DXA_KEYSTR_LENGTH_VER6 ) ;
 }
 
 // データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEYSTR_LENGTH_VER6 の長さがなければならない )
@@ -1826,6 +1800,158 @@ ERR :
 	return -1 ;
 }
 
+// アーカイブファイルのヘッダとテーブルだけを解析して、指定の鍵文字列で展開できそうかを調べる( -1:展開できない  0～100:展開できる確からしさ )
+int DXArchive_VER6::ProbeArchive( const TCHAR *ArchiveName, const char *KeyString )
+{
+	u8 *HeadBuffer = NULL ;
+	DARC_HEAD_VER6 Head ;
+	FILE *ArcP = NULL ;
+	u8 Key[DXA_KEYSTR_LENGTH_VER6] ;
+	u64 FileSize ;
+	int Score = -1 ;
+
+	// 鍵文字列の作成
+	KeyCreate( KeyString, Key ) ;
+
+	// アーカイブファイルを開く
+	ArcP = _tfopen( ArchiveName, TEXT("rb") ) ;
+	if( ArcP == NULL ) return -1 ;
+
+	// ファイルのサイズを取得する
+	_fseeki64( ArcP, 0L, SEEK_END ) ;
+	FileSize = ( u64 )_ftelli64( ArcP ) ;
+	_fseeki64( ArcP, 0L, SEEK_SET ) ;
+	if( FileSize < sizeof( DARC_HEAD_VER6 ) ) goto END ;
+
+	// ヘッダを解析する
+	{
+		KeyConvFileRead( &Head, sizeof( DARC_HEAD_VER6 ), ArcP, Key, 0 ) ;
+
+		// ＩＤの検査
+		if( Head.Head != DXA_HEAD_VER6 )
+			goto END ;
+
+		// バージョン検査
+		if( Head.Version > DXA_VER_VER6 || Head.Version < 0x0006 ) goto END ;
+
+		// テーブルがファイルの中に収まっていない場合は鍵が違う
+		if( Head.FileNameTableStartAddress > FileSize ||
+			Head.HeadSize > FileSize - Head.FileNameTableStartAddress ||
+			Head.DataStartAddress > Head.FileNameTableStartAddress )
+			goto END ;
+
+		// ヘッダのサイズ分のメモリを確保する
+		HeadBuffer = ( u8 * )malloc( ( size_t )Head.HeadSize ) ;
+		if( HeadBuffer == NULL ) goto END ;
+
+		// ヘッダパックをメモリに読み込む
+		_fseeki64( ArcP, Head.FileNameTableStartAddress, SEEK_SET ) ;
+		KeyConvFileRead( HeadBuffer, Head.HeadSize, ArcP, Key, 0 ) ;
+	}
+
+	// テーブルの内容を調べる
+	Score = CheckHeadTable( &Head, HeadBuffer, FileSize ) ;
+
+END :
+	if( HeadBuffer != NULL ) free( HeadBuffer ) ;
+	fclose( ArcP ) ;
+
+	// 終了
+	return Score ;
+}
+
+// 読み込んだヘッダのテーブルが正しいかを調べる( -1:壊れている  0～100:ファイルの情報の内、名前のパリティとデータの位置が正しいものの割合 )
+int DXArchive_VER6::CheckHeadTable( DARC_HEAD_VER6 *Head, u8 *HeadBuffer, u64 ArchiveSize )
+{
+	DARC_DIRECTORY_VER6 *Dir ;
+	DARC_FILEHEAD_VER6 *FileH ;
+	u64 i, j, k, NameSize, FileTableSize, DirTableSize, DirNum, DataLimit, Size, CheckNum, ValidNum ;
+	u32 PackNum, Parity ;
+	u8 *NameP, *FileP, *DirP, *NameData ;
+
+	// 各テーブルの大きさを求める
+	if( Head->FileTableStartAddress > Head->DirectoryTableStartAddress ||
+		Head->DirectoryTableStartAddress > Head->HeadSize ||
+		Head->FileTableStartAddress < 4 ||
+		Head->DataStartAddress > ArchiveSize )
+		return -1 ;
+	NameSize      = Head->FileTableStartAddress ;
+	FileTableSize = Head->DirectoryTableStartAddress - Head->FileTableStartAddress ;
+	DirTableSize  = Head->HeadSize - Head->DirectoryTableStartAddress ;
+	DirNum        = DirTableSize / sizeof( DARC_DIRECTORY_VER6 ) ;
+	DataLimit     = ArchiveSize - Head->DataStartAddress ;
+	if( DirNum == 0 ) return -1 ;
+
+	NameP = HeadBuffer ;
+	FileP = NameP + Head->FileTableStartAddress ;
+	DirP  = NameP + Head->DirectoryTableStartAddress ;
+
+	// ルートディレクトリには親ディレクトリが無い
+	Dir = ( DARC_DIRECTORY_VER6 * )DirP ;
+	if( Dir->ParentDirectoryAddress != 0xffffffffffffffff ) return -1 ;
+
+	// 全てのディレクトリとファイルの情報を調べる
+	std::vector<bool> DirReferenced( ( size_t )DirNum, false ) ;
+	CheckNum = 0 ;
+	ValidNum = 0 ;
+	for( i = 0 ; i < DirNum ; i ++, Dir ++ )
+	{
+		// 親ディレクトリと自分のファイル情報とファイル情報の列がテーブルの範囲内にあるか
+		// ( 構造体の途中を指していたり、構造体がテーブルの終端を越えていたら壊れている )
+		if( i != 0 &&
+			( Dir->ParentDirectoryAddress > DirTableSize - sizeof( DARC_DIRECTORY_VER6 ) || Dir->ParentDirectoryAddress % sizeof( DARC_DIRECTORY_VER6 ) != 0 ||
+			  FileTableSize < sizeof( DARC_FILEHEAD_VER6 ) || Dir->DirectoryAddress > FileTableSize - sizeof( DARC_FILEHEAD_VER6 ) || Dir->DirectoryAddress % sizeof( DARC_FILEHEAD_VER6 ) != 0 ) )
+			return -1 ;
+		if( Dir->FileHeadAddress > FileTableSize || Dir->FileHeadAddress % sizeof( DARC_FILEHEAD_VER6 ) != 0 ||
+			Dir->FileHeadNum > ( FileTableSize - Dir->FileHeadAddress ) / sizeof( DARC_FILEHEAD_VER6 ) )
+			return -1 ;
+
+		FileH = ( DARC_FILEHEAD_VER6 * )( FileP + Dir->FileHeadAddress ) ;
+		for( j = 0 ; j < Dir->FileHeadNum ; j ++, FileH ++ )
+		{
+			// 名前がテーブルの範囲内にあるか
+			if( FileH->NameAddress > NameSize - 4 ) return -1 ;
+			NameData = NameP + FileH->NameAddress ;
+			PackNum  = ( ( u16 * )NameData )[0] ;
+			if( PackNum * 8 > NameSize - 4 - FileH->NameAddress ) return -1 ;
+
+			// ディレクトリの場合はディレクトリの情報がテーブルの範囲内にあり、親ディレクトリとしてこのディレクトリを指しているか
+			// ( 親を指していなかったり、二箇所から参照されていたりすると、辿る時に循環したり同じディレクトリを何度も辿ったりする )
+			if( ( FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY ) != 0 )
+			{
+				if( FileH->DataAddress > DirTableSize - sizeof( DARC_DIRECTORY_VER6 ) || FileH->DataAddress % sizeof( DARC_DIRECTORY_VER6 ) != 0 ||
+					( ( DARC_DIRECTORY_VER6 * )( DirP + FileH->DataAddress ) )->ParentDirectoryAddress != ( u64 )( ( u8 * )Dir - DirP ) ||
+					DirReferenced[ FileH->DataAddress / sizeof( DARC_DIRECTORY_VER6 ) ] )
+					return -1 ;
+				DirReferenced[ FileH->DataAddress / sizeof( DARC_DIRECTORY_VER6 ) ] = true ;
+			}
+
+			// 以下は壊れていても展開はできるので、確からしさにだけ反映する
+			CheckNum ++ ;
+
+			// 大文字にした名前の合計値がパリティと一致するか
+			Parity = 0 ;
+			for( k = 0 ; k < PackNum * 4 ; k ++ )
+				Parity += NameData[4 + k] ;
+			if( ( u16 )Parity != ( ( u16 * )NameData )[1] ) continue ;
+
+			// ファイルのデータがアーカイブの中に収まっているか
+			if( ( FileH->Attributes & FILE_ATTRIBUTE_DIRECTORY ) == 0 )
+			{
+				Size = FileH->PressDataSize != 0xffffffffffffffff ? FileH->PressDataSize : FileH->DataSize ;
+				if( Size > DataLimit || FileH->DataAddress > DataLimit - Size ) continue ;
+			}
+
+			ValidNum ++ ;
+		}
+	}
+
+	// ファイルが一つも無い場合はテーブルの構造が正しいことしか分からない
+	if( CheckNum == 0 ) return 0 ;
+
+	return ( int )( ValidNum * 100 / CheckNum ) ;
+}
+
 
 
 // コンストラクタ
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
+#include <stdlib.h>
 
 // data type ------------------------------------
 
@@ -37,6 +38,30 @@ struct BIT_STREAM
 	u8 Bits ;
 } ;
 
+// 解凍用の６４ビット単位で先読みするビット読み込み用データ構造体
+struct BIT_READER
+{
+	const u8 *Buffer ;		// 次に読み込むアドレス
+	const u8 *BufferEnd ;	// 圧縮データの終端
+	u64 BitBuffer ;			// 先読みしたビット( 下位ビットから順に使う )
+	u32 BitCount ;			// BitBuffer に残っているビット数
+} ;
+
+// 解凍用テーブルの参照に使うビット数
+#define HUFFMAN_TABLE_BITS		(12)
+
+// 解凍用テーブルの要素
+// 先頭 HUFFMAN_TABLE_BITS ビットで決まる数値データを最大２個まで格納する、
+// ビット列がそれより長い数値データの場合は途中の結合データのインデックスを格納する
+struct HUFFMAN_TABLE_ENTRY
+{
+	u8  Data[ 2 ] ;		// 数値データ
+	u8  DataNum ;		// 数値データの数( 0 の場合は Node から結合データを辿る )
+	u8  BitNum ;		// 使用するビット数( DataNum 個分 )
+	u8  FirstBitNum ;	// 最初の数値データのビット数
+	u16 Node ;			// DataNum が 0 の場合に続きを辿る結合データのインデックス
+} ;
+
 // 圧縮データの情報
 //   6bit      圧縮前のデータのサイズのビット数(A) - 1( 0=1ビット 63=64ビット )
 //   (A)bit    圧縮前のデータのサイズ
@@ -55,6 +80,11 @@ static void BitStream_Write( BIT_STREAM *BitStream, u8 BitNum, u64 OutputData )
 static u64  BitStream_Read(  BIT_STREAM *BitStream, u8 BitNum ) ;						// ビット単位の数値の読み込みを行う
 static u8   BitStream_GetBitNum( u64 Data ) ;											// 指定の数値のビット数を取得する
 static u64  BitStream_GetBytes( BIT_STREAM *BitStream ) ;								// ビット単位の入出力データのサイズ( バイト数 )を取得する
+static void BitReader_Init(   BIT_READER *BitReader, const void *Buffer, u64 Size ) ;	// 解凍用のビット読み込みの初期化
+static void BitReader_Refill( BIT_READER *BitReader ) ;								// 解凍用のビット読み込みの先読みビットを５７ビット以上に補充する
+static u64  Huffman_ReadHead( u8 *Press, u64 *OriginalSize, u64 *PressSize, u16 *Weight ) ;	// 圧縮データの情報を読み込む( 戻り値:圧縮データの情報のサイズ( バイト数 ) )
+static void Huffman_BuildTree( HUFFMAN_NODE *Node ) ;									// 数値データの出現数から結合データを構築する
+static void Huffman_SetBitArray( HUFFMAN_NODE *Node ) ;									// 結合データから各数値データの圧縮後のビット列を割り出す
 
 // code -----------------------------------------
 
@@ -127,6 +157,139 @@ u64 BitStream_GetBytes( BIT_STREAM *BitStream )
 	return BitStream->Bytes + ( BitStream->Bits != 0 ? 1 : 0 ) ;
 }
 
+// 解凍用のビット読み込みの初期化
+void BitReader_Init( BIT_READER *BitReader, const void *Buffer, u64 Size )
+{
+	BitReader->Buffer    = ( const u8 * )Buffer ;
+	BitReader->BufferEnd = ( const u8 * )Buffer + Size ;
+	BitReader->BitBuffer = 0 ;
+	BitReader->BitCount  = 0 ;
+	BitReader_Refill( BitReader ) ;
+}
+
+// 解凍用のビット読み込みの先読みビットを５７ビット以上に補充する
+// 圧縮データの終端以降は０のビットが続いているものとして扱う
+__inline void BitReader_Refill( BIT_READER *BitReader )
+{
+	if( BitReader->BitCount > 56 )
+	{
+		return ;
+	}
+
+	// ８バイト以上残っている場合はまとめて読み込む
+	if( BitReader->BufferEnd - BitReader->Buffer >= 8 )
+	{
+		u64 Data ;
+
+		memcpy( &Data, BitReader->Buffer, 8 ) ;
+		BitReader->BitBuffer |= Data << BitReader->BitCount ;
+		BitReader->Buffer    += ( 63 - BitReader->BitCount ) >> 3 ;
+		BitReader->BitCount  |= 56 ;
+		return ;
+	}
+
+	// 終端付近は１バイトずつ読み込む
+	while( BitReader->BitCount <= 56 && BitReader->Buffer < BitReader->BufferEnd )
+	{
+		BitReader->BitBuffer |= ( u64 )*BitReader->Buffer << BitReader->BitCount ;
+		BitReader->Buffer ++ ;
+		BitReader->BitCount += 8 ;
+	}
+	if( BitReader->BitCount <= 56 )
+	{
+		BitReader->BitCount = 64 ;
+	}
+}
+
+// 出現数と要素配列のインデックスを組み合わせた並べ替え用の値を比較する
+static int Huffman_CompareSortKey( const void *Key1, const void *Key2 )
+{
+	u64 k1 = *( const u64 * )Key1 ;
+	u64 k2 = *( const u64 * )Key2 ;
+
+	return k1 < k2 ? -1 : ( k1 > k2 ? 1 : 0 ) ;
+}
+
+// 数値データの出現数から結合データを構築する( Node[0]～[255] の Weight をセットしておくこと、天辺は Node[510] )
+//
+// 出現数が一番少ない要素と二番目に少ない要素を繋いでいく( 出現数が同じ場合は要素配列のインデックスが小さい方を優先 )、
+// 結合データの出現数は作成順に増えていくので、並べ替えた数値データと作成順の結合データの２つの列の先頭を比べるだけで済む
+void Huffman_BuildTree( HUFFMAN_NODE *Node )
+{
+	u64 SortKey[ 256 ] ;
+	int DataIndex, NodeIndex, NodeNum ;
+	int MinNode[ 2 ] ;
+	int i, j ;
+
+	// 数値データを出現数の少ない順に並べる( 出現数は 0～65535 の範囲なので下位１６ビットにインデックスを入れる )
+	for( i = 0 ; i < 256 ; i ++ )
+	{
+		Node[i].ChildNode[0] = -1 ;    // 数値データが終点なので -1 をセットする
+		Node[i].ChildNode[1] = -1 ;    // 数値データが終点なので -1 をセットする
+		Node[i].ParentNode = -1 ;      // まだどの要素とも結合されていないので -1 をセットする
+		SortKey[ i ] = ( Node[ i ].Weight << 16 ) | ( u64 )i ;
+	}
+	qsort( SortKey, 256, sizeof( u64 ), Huffman_CompareSortKey ) ;
+
+	DataIndex = 0 ;   // 次に結合する数値データの SortKey 上の位置
+	NodeIndex = 256 ; // 次に結合する結合データの要素配列のインデックス
+	NodeNum = 256 ;   // 次に新しく作る結合データの要素配列のインデックス
+	while( NodeNum < 256 + 255 )
+	{
+		// 出現数値の低い要素二つを取り出す( 出現数が同じ場合はインデックスの小さい数値データが先 )
+		for( j = 0 ; j < 2 ; j ++ )
+		{
+			if( DataIndex < 256 &&
+				( NodeIndex >= NodeNum || Node[ SortKey[ DataIndex ] & 0xffff ].Weight <= Node[ NodeIndex ].Weight ) )
+			{
+				MinNode[ j ] = ( int )( SortKey[ DataIndex ] & 0xffff ) ;
+				DataIndex ++ ;
+			}
+			else
+			{
+				MinNode[ j ] = NodeIndex ;
+				NodeIndex ++ ;
+			}
+		}
+
+		// 二つの要素を繋いで新しい要素(結合データ)を作る
+		Node[NodeNum].ParentNode = -1 ;
+		Node[NodeNum].Weight = Node[MinNode[0]].Weight + Node[MinNode[1]].Weight ;
+		Node[NodeNum].ChildNode[0] = MinNode[0] ;    // この結合部で 0 を選んだら出現数値が一番少ない要素に繋がる
+		Node[NodeNum].ChildNode[1] = MinNode[1] ;    // この結合部で 1 を選んだら出現数値が二番目に少ない要素に繋がる
+
+		// 結合された要素二つに、自分達に何の値が割り当てられたかと結合データのインデックスをセットする
+		Node[MinNode[0]].Index = 0 ;
+		Node[MinNode[1]].Index = 1 ;
+		Node[MinNode[0]].ParentNode = NodeNum ;
+		Node[MinNode[1]].ParentNode = NodeNum ;
+
+		NodeNum ++ ;
+	}
+	Node[510].ParentNode = -1 ;
+}
+
+// 結合データから各数値データの圧縮後のビット列を割り出す
+//
+// 結合データは必ず子の要素より後ろにあるので、天辺から順に親のビット列の後ろに自分のインデックスを足していく
+// ( ビット列は天辺に近い方から BitArray の下位ビットに格納する )
+void Huffman_SetBitArray( HUFFMAN_NODE *Node )
+{
+	int i, Parent ;
+
+	Node[510].BitNum = 0 ;
+	memset( Node[510].BitArray, 0, sizeof( Node[510].BitArray ) ) ;
+
+	for( i = 509 ; i >= 0 ; i -- )
+	{
+		Parent = Node[i].ParentNode ;
+
+		Node[i].BitNum = Node[Parent].BitNum + 1 ;
+		memcpy( Node[i].BitArray, Node[Parent].BitArray, sizeof( Node[i].BitArray ) ) ;
+		Node[i].BitArray[ Node[Parent].BitNum / 8 ] |= ( unsigned char )( Node[i].Index << ( Node[Parent].BitNum % 8 ) ) ;
+	}
+}
+
 // データを圧縮
 //
 // 戻り値:圧縮後のサイズ  0 はエラー  Dest に NULL を入れると圧縮データ格納に必要なサイズが返る
@@ -148,16 +311,10 @@ u64 Huffman_Encode( void *Src, u64 SrcSize, void *Dest )
 
     // 各数値の圧縮後のビット列を算出する
     {
-        int NodeIndex, MinNode1, MinNode2 ;
-        int NodeNum, DataNum ;
-
         // 数値データを初期化する
         for( i = 0 ; i < 256 ; i ++ )
         {
             Node[i].Weight = 0 ;           // 出現数はこれから算出するので０に初期化
-            Node[i].ChildNode[0] = -1 ;    // 数値データが終点なので -1 をセットする
-            Node[i].ChildNode[1] = -1 ;    // 数値データが終点なので -1 をセットする
-            Node[i].ParentNode = -1 ;      // まだどの要素とも結合されていないので -1 をセットする
         }
 
         // 各数値の出現数をカウント
@@ -172,166 +329,11 @@ u64 Huffman_Encode( void *Src, u64 SrcSize, void *Dest )
 			Node[ i ].Weight = Node[ i ].Weight * 0xffff / SrcSize ;
 		}
 
-        // 出現数の少ない数値データ or 結合データを繋いで
-        // 新しい結合データを作成、全ての要素を繋いで残り１個になるまで繰り返す
-        DataNum = 256 ; // 残り要素数
-        NodeNum = 256 ; // 次に新しく作る結合データの要素配列のインデックス
-        while( DataNum > 1 )
-        {
-            // 出現数値の低い要素二つを探す
-            {
-                MinNode1 = -1 ;
-                MinNode2 = -1 ;
-                
-                // 残っている要素全てを調べるまでループ
-                NodeIndex = 0 ;
-                for( i = 0 ; i < DataNum ; NodeIndex ++ )
-                {
-                    // もう既に何処かの要素と結合されている場合は対象外
-                    if( Node[NodeIndex].ParentNode != -1 ) continue ;
-                    
-                    i ++ ;
-                    
-                    // まだ有効な要素をセットしていないか、より出現数値の
-                    // 少ない要素が見つかったら更新
-                    if( MinNode1 == -1 || Node[MinNode1].Weight > Node[NodeIndex].Weight )
-                    {
-                        // 今まで一番出現数値が少なかったと思われた
-                        // 要素は二番目に降格
-                        MinNode2 = MinNode1 ;
+        // 出現数の少ない数値データ or 結合データを繋いで結合データを作成する
+		Huffman_BuildTree( Node ) ;
 
-                        // 新しい一番の要素の要素配列のインデックスを保存
-                        MinNode1 = NodeIndex ;
-                    }
-                    else
-                    {
-                        // 一番よりは出現数値が多くても、二番目よりは出現数値が
-                        // 少ないかもしれないので一応チェック(又は二番目に出現数値の
-                        // 少ない要素がセットされていなかった場合もセット)
-                        if( MinNode2 == -1 || Node[MinNode2].Weight > Node[NodeIndex].Weight )
-                        {
-                            MinNode2 = NodeIndex ;
-                        }
-                    }
-                }
-            }
-            
-            // 二つの要素を繋いで新しい要素(結合データ)を作る
-            Node[NodeNum].ParentNode = -1 ;  // 新しいデータは当然まだ何処とも繋がっていないので -1 
-            Node[NodeNum].Weight = Node[MinNode1].Weight + Node[MinNode2].Weight ;    // 出現数値は二つの数値を足したものをセットする
-            Node[NodeNum].ChildNode[0] = MinNode1 ;    // この結合部で 0 を選んだら出現数値が一番少ない要素に繋がる
-            Node[NodeNum].ChildNode[1] = MinNode2 ;    // この結合部で 1 を選んだら出現数値が二番目に少ない要素に繋がる
-
-            // 結合された要素二つに、自分達に何の値が割り当てられたかをセットする
-            Node[MinNode1].Index = 0 ;    // 一番出現数値が少ない要素は 0 番
-            Node[MinNode2].Index = 1 ;    // 二番目に出現数値が少ない要素は 1 番
-
-            // 結合された要素二つに、自分達を結合した結合データの要素配列インデックスをセットする
-            Node[MinNode1].ParentNode = NodeNum ;
-            Node[MinNode2].ParentNode = NodeNum ;
-
-            // 要素の数を一個増やす
-            NodeNum ++ ;
-
-            // 残り要素の数は、一つ要素が新しく追加された代わりに
-            // 二つの要素が結合されて検索の対象から外れたので
-            // 結果 1 - 2 で -1 
-            DataNum -- ;
-        }
-        
         // 各数値の圧縮後のビット列を割り出す
-        {
-            unsigned char TempBitArray[32] ;
-            int TempBitIndex, TempBitCount, BitIndex, BitCount ;
-        
-            // 数値データの種類の数だけ繰り返す
-            for( i = 0 ; i < 256 ; i ++ )
-            {
-                // 数値データから結合データを上へ上へと辿ってビット数を数える
-                {
-                    // ビット数を初期化しておく
-                    Node[i].BitNum = 0 ;
-                    
-                    // 一時的に数値データから遡っていったときのビット列を保存する処理の準備
-                    TempBitIndex = 0 ;
-                    TempBitCount = 0 ;
-                    TempBitArray[TempBitIndex] = 0 ;
-                    
-                    // 何処かと結合されている限りカウントし続ける(天辺は何処とも結合されていないので終点だと分かる)
-                    for( NodeIndex = ( int )i ; Node[NodeIndex].ParentNode != -1 ; NodeIndex = Node[NodeIndex].ParentNode )
-                    {
-                        // 配列要素一つに入るビットデータは８個なので、同じ配列要素に
-                        // 既に８個保存していたら次の配列要素に保存先を変更する
-                        if( TempBitCount == 8 )
-                        {
-                            TempBitCount = 0 ;
-                            TempBitIndex ++ ;
-                            TempBitArray[TempBitIndex] = 0 ;
-                        }
-                        
-                        // 新しく書き込む情報で今までのデータを上書きしてしまわないように１ビット左にシフトする
-                        TempBitArray[TempBitIndex] <<= 1 ;
-
-                        // 結合データに割り振られたインデックスを最下位ビット(一番右側のビット)に書き込む
-                        TempBitArray[TempBitIndex] |= (unsigned char)Node[NodeIndex].Index ;
-
-                        // 保存したビット数を増やす
-                        TempBitCount ++ ;
-
-                        // ビット数を増やす
-                        Node[i].BitNum ++ ;
-                    }
-                }
-				
-                // TempBitArray に溜まったデータは数値データから結合データを天辺に向かって
-                // 上へ上へと遡っていった時のビット列なので、逆さまにしないと圧縮後のビット
-                // 配列として使えない(展開時に天辺の結合データから数値データまで辿ることが
-                // 出来ない)ので、順序を逆さまにしたものを数値データ内のビット列バッファに保存する
-                {
-                    BitCount = 0 ;
-                    BitIndex = 0 ;
-                    
-                    // 最初のバッファを初期化しておく
-                    // (全部 論理和(or)演算 で書き込むので、最初から１になっている
-                    // ビットに０を書き込んでも１のままになってしまうため)
-                    Node[i].BitArray[BitIndex] = 0 ;
-                    
-                    // 一時的に保存しておいたビット列の最初まで遡る
-                    while( TempBitIndex >= 0 )
-                    {
-                        // 書き込んだビット数が一つの配列要素に入る８ビットに
-                        // 達してしまったら次の配列要素に移る
-                        if( BitCount == 8 )
-                        {
-                            BitCount = 0 ;
-                            BitIndex ++ ;
-                            Node[i].BitArray[BitIndex] = 0 ;
-                        }
-
-                        // まだ何も書き込まれていないビットアドレスに１ビット書き込む
-                        Node[i].BitArray[BitIndex] |= (unsigned char)( ( TempBitArray[TempBitIndex] & 1 ) << BitCount ) ;
-						
-                        // 書き込み終わったビットはもういらないので次のビットを
-                        // 書き込めるように１ビット右にシフトする
-                        TempBitArray[TempBitIndex] >>= 1 ;
-                        
-                        // １ビット書き込んだので残りビット数を１個減らす
-                        TempBitCount -- ;
-                        
-                        // もし現在書き込み元となっている配列要素に書き込んでいない
-                        // ビット情報が無くなったら次の配列要素に移る
-                        if( TempBitCount == 0 )
-                        {
-                            TempBitIndex -- ;
-                            TempBitCount = 8 ;
-                        }
-                        
-                        // 書き込んだビット数を増やす
-                        BitCount ++ ;
-                    }
-                }
-            }
-        }
+		Huffman_SetBitArray( Node ) ;
     }
 
     // 変換処理
@@ -495,6 +497,54 @@ u64 Huffman_Encode( void *Src, u64 SrcSize, void *Dest )
     }
 }
 
+// 圧縮データの情報を読み込む( 戻り値:圧縮データの情報のサイズ( バイト数 ) )
+u64 Huffman_ReadHead( u8 *Press, u64 *OriginalSize, u64 *PressSize, u16 *Weight )
+{
+	BIT_STREAM BitStream ;
+	u8 BitNum ;
+	u8 Minus ;
+	u16 SaveData ;
+	int i ;
+
+	BitStream_Init( &BitStream, Press, true ) ;
+
+	*OriginalSize = BitStream_Read( &BitStream, ( u8 )( BitStream_Read( &BitStream, 6 ) + 1 ) ) ;
+	*PressSize    = BitStream_Read( &BitStream, ( u8 )( BitStream_Read( &BitStream, 6 ) + 1 ) ) ;
+
+	// 出現頻度のテーブルを復元する
+	BitNum      = ( u8 )( BitStream_Read( &BitStream, 3 ) + 1 ) * 2 ;
+	Minus       = ( u8 )BitStream_Read( &BitStream, 1 ) ;
+	SaveData    = ( u16 )BitStream_Read( &BitStream, BitNum ) ;
+	Weight[ 0 ] = SaveData ;
+	for( i = 1 ; i < 256 ; i ++ )
+	{
+		BitNum      = ( u8 )( BitStream_Read( &BitStream, 3 ) + 1 ) * 2 ;
+		Minus       = ( u8 )BitStream_Read( &BitStream, 1 ) ;
+		SaveData    = ( u16 )BitStream_Read( &BitStream, BitNum ) ;
+		Weight[ i ] = Minus == 1 ? Weight[ i - 1 ] - SaveData : Weight[ i - 1 ] + SaveData ;
+	}
+
+	return BitStream_GetBytes( &BitStream ) ;
+}
+
+// 圧縮データ全体のサイズを取得する
+//
+// 戻り値:圧縮データの情報を含めた圧縮データのサイズ  OriginalSize に解凍後のサイズが入る( NULL 可 )
+// Press には少なくとも HUFFMAN_HEAD_MAXSIZE バイトのデータが必要
+u64 Huffman_GetPressSize( void *Press, u64 *OriginalSize )
+{
+	u64 Original, PressSize, HeadSize ;
+	u16 Weight[ 256 ] ;
+
+	HeadSize = Huffman_ReadHead( ( u8 * )Press, &Original, &PressSize, Weight ) ;
+	if( OriginalSize != NULL )
+	{
+		*OriginalSize = Original ;
+	}
+
+	return HeadSize + PressSize ;
+}
+
 // 圧縮データを解凍
 //
 // 戻り値:解凍後のサイズ  0 はエラー  Dest に NULL を入れると解凍データ格納に必要なサイズが返る
@@ -516,32 +566,7 @@ u64 Huffman_Decode( void *Press, void *Dest )
     DestPoint = ( unsigned char * )Dest ;
 
     // 圧縮データの情報を取得する
-	{
-		BIT_STREAM BitStream ;
-		u8 BitNum ;
-		u8 Minus ;
-		u16 SaveData ;
-
-		BitStream_Init( &BitStream, PressPoint, true ) ;
-
-		OriginalSize = BitStream_Read( &BitStream, ( u8 )( BitStream_Read( &BitStream, 6 ) + 1 ) ) ;
-		PressSize    = BitStream_Read( &BitStream, ( u8 )( BitStream_Read( &BitStream, 6 ) + 1 ) ) ;
-
-		// 出現頻度のテーブルを復元する
-		BitNum      = ( u8 )( BitStream_Read( &BitStream, 3 ) + 1 ) * 2 ;
-		Minus       = ( u8 )BitStream_Read( &BitStream, 1 ) ;
-		SaveData    = ( u16 )BitStream_Read( &BitStream, BitNum ) ;
-		Weight[ 0 ] = SaveData ;
-        for( i = 1 ; i < 256 ; i ++ )
-        {
-			BitNum      = ( u8 )( BitStream_Read( &BitStream, 3 ) + 1 ) * 2 ;
-			Minus       = ( u8 )BitStream_Read( &BitStream, 1 ) ;
-			SaveData    = ( u16 )BitStream_Read( &BitStream, BitNum ) ;
-			Weight[ i ] = Minus == 1 ? Weight[ i - 1 ] - SaveData : Weight[ i - 1 ] + SaveData ;
-        }
-
-		HeadSize = BitStream_GetBytes( &BitStream ) ;
-	}
+	HeadSize = Huffman_ReadHead( PressPoint, &OriginalSize, &PressSize, Weight ) ;
     
     // Dest が NULL の場合は 解凍後のデータのサイズを返す
     if( Dest == NULL )
@@ -550,323 +575,157 @@ u64 Huffman_Decode( void *Press, void *Dest )
     // 解凍後のデータのサイズを取得する
     DestSize = OriginalSize ;
 
-    // 各数値の結合データを構築する
+    // 各数値の結合データを構築する( 圧縮時と同じ処理です )
     {
-        int NodeIndex, MinNode1, MinNode2 ;
-        int NodeNum, DataNum ;
-
-        // 数値データを初期化する
-        for( i = 0 ; i < 256 + 255 ; i ++ )
+        for( i = 0 ; i < 256 ; i ++ )
         {
             Node[i].Weight = Weight[i] ;    // 出現数は保存しておいたデータからコピー
-            Node[i].ChildNode[0] = -1 ;    // 数値データが終点なので -1 をセットする
-            Node[i].ChildNode[1] = -1 ;    // 数値データが終点なので -1 をセットする
-            Node[i].ParentNode = -1 ;      // まだどの要素とも結合されていないので -1 をセットする
         }
 
-        // 出現数の少ない数値データ or 結合データを繋いで
-        // 新しい結合データを作成、全ての要素を繋いで残り１個になるまで繰り返す
-        // (圧縮時と同じコードです)
-        DataNum = 256 ; // 残り要素数
-        NodeNum = 256 ; // 次に新しく作る結合データの要素配列のインデックス
-        while( DataNum > 1 )
-        {
-            // 出現数値の低い要素二つを探す
-            {
-                MinNode1 = -1 ;
-                MinNode2 = -1 ;
-                
-                // 残っている要素全てを調べるまでループ
-                NodeIndex = 0 ;
-                for( i = 0 ; i < DataNum ; NodeIndex ++ )
-                {
-                    // もう既に何処かの要素と結合されている場合は対象外
-                    if( Node[NodeIndex].ParentNode != -1 ) continue ;
-                    
-                    i ++ ;
-                    
-                    // まだ有効な要素をセットしていないか、より出現数値の
-                    // 少ない要素が見つかったら更新
-                    if( MinNode1 == -1 || Node[MinNode1].Weight > Node[NodeIndex].Weight )
-                    {
-                        // 今まで一番出現数値が少なかったと思われた
-                        // 要素は二番目に降格
-                        MinNode2 = MinNode1 ;
-
-                        // 新しい一番の要素の要素配列のインデックスを保存
-                        MinNode1 = NodeIndex ;
-                    }
-                    else
-                    {
-                        // 一番よりは出現数値が多くても、二番目よりは出現数値が
-                        // 少ないかもしれないので一応チェック(又は二番目に出現数値の
-                        // 少ない要素がセットされていなかった場合もセット)
-                        if( MinNode2 == -1 || Node[MinNode2].Weight > Node[NodeIndex].Weight )
-                        {
-                            MinNode2 = NodeIndex ;
-                        }
-                    }
-                }
-            }
-            
-            // 二つの要素を繋いで新しい要素(結合データ)を作る
-            Node[NodeNum].ParentNode = -1 ;  // 新しいデータは当然まだ何処とも繋がっていないので -1 
-            Node[NodeNum].Weight = Node[MinNode1].Weight + Node[MinNode2].Weight ;    // 出現数値は二つの数値を足したものをセットする
-            Node[NodeNum].ChildNode[0] = MinNode1 ;    // この結合部で 0 を選んだら出現数値が一番少ない要素に繋がる
-            Node[NodeNum].ChildNode[1] = MinNode2 ;    // この結合部で 1 を選んだら出現数値が二番目に少ない要素に繋がる
-
-            // 結合された要素二つに、自分達に何の値が割り当てられたかをセットする
-            Node[MinNode1].Index = 0 ;    // 一番出現数値が少ない要素は 0 番
-            Node[MinNode2].Index = 1 ;    // 二番目に出現数値が少ない要素は 1 番
-
-            // 結合された要素二つに、自分達を結合した結合データの要素配列インデックスをセットする
-            Node[MinNode1].ParentNode = NodeNum ;
-            Node[MinNode2].ParentNode = NodeNum ;
-
-            // 要素の数を一個増やす
-            NodeNum ++ ;
-
-            // 残り要素の数は、一つ要素が新しく追加された代わりに
-            // 二つの要素が結合されて検索の対象から外れたので
-            // 結果 1 - 2 で -1 
-            DataNum -- ;
-        }
-
-        // 各数値の圧縮時のビット列を割り出す
-        {
-            unsigned char TempBitArray[32] ;
-            int TempBitIndex, TempBitCount, BitIndex, BitCount ;
-        
-            // 数値データと結合データの数だけ繰り返す
-            for( i = 0 ; i < 256 + 254 ; i ++ )
-            {
-                // 数値データから結合データを上へ上へと辿ってビット数を数える
-                {
-                    // ビット数を初期化しておく
-                    Node[i].BitNum = 0 ;
-                    
-                    // 一時的に数値データから遡っていったときのビット列を保存する処理の準備
-                    TempBitIndex = 0 ;
-                    TempBitCount = 0 ;
-                    TempBitArray[TempBitIndex] = 0 ;
-                    
-                    // 何処かと結合されている限りカウントし続ける(天辺は何処とも結合されていないので終点だと分かる)
-                    for( NodeIndex = ( int )i ; Node[NodeIndex].ParentNode != -1 ; NodeIndex = Node[NodeIndex].ParentNode )
-                    {
-                        // 配列要素一つに入るビットデータは８個なので、同じ配列要素に
-                        // 既に８個保存していたら次の配列要素に保存先を変更する
-                        if( TempBitCount == 8 )
-                        {
-                            TempBitCount = 0 ;
-                            TempBitIndex ++ ;
-                            TempBitArray[TempBitIndex] = 0 ;
-                        }
-                        
-                        // 新しく書き込む情報で今までのデータを上書きしてしまわないように１ビット左にシフトする
-                        TempBitArray[TempBitIndex] <<= 1 ;
-
-                        // 結合データに割り振られたインデックスを最下位ビット(一番右側のビット)に書き込む
-                        TempBitArray[TempBitIndex] |= (unsigned char)Node[NodeIndex].Index ;
-
-                        // 保存したビット数を増やす
-                        TempBitCount ++ ;
-
-                        // ビット数を増やす
-                        Node[i].BitNum ++ ;
-                    }
-                }
-				
-                // TempBitArray に溜まったデータは数値データから結合データを天辺に向かって
-                // 上へ上へと遡っていった時のビット列なので、逆さまにしないと圧縮後のビット
-                // 配列として使えない(展開時に天辺の結合データから数値データまで辿ることが
-                // 出来ない)ので、順序を逆さまにしたものを数値データ内のビット列バッファに保存する
-                {
-                    BitCount = 0 ;
-                    BitIndex = 0 ;
-                    
-                    // 最初のバッファを初期化しておく
-                    // (全部 論理和(or)演算 で書き込むので、最初から１になっている
-                    // ビットに０を書き込んでも１のままになってしまうため)
-                    Node[i].BitArray[BitIndex] = 0 ;
-                    
-                    // 一時的に保存しておいたビット列の最初まで遡る
-                    while( TempBitIndex >= 0 )
-                    {
-                        // 書き込んだビット数が一つの配列要素に入る８ビットに
-                        // 達してしまったら次の配列要素に移る
-                        if( BitCount == 8 )
-                        {
-                            BitCount = 0 ;
-                            BitIndex ++ ;
-                            Node[i].BitArray[BitIndex] = 0 ;
-                        }
-
-                        // まだ何も書き込まれていないビットアドレスに１ビット書き込む
-                        Node[i].BitArray[BitIndex] |= (unsigned char)( ( TempBitArray[TempBitIndex] & 1 ) << BitCount ) ;
-						
-                        // 書き込み終わったビットはもういらないので次のビットを
-                        // 書き込めるように１ビット右にシフトする
-                        TempBitArray[TempBitIndex] >>= 1 ;
-                        
-                        // １ビット書き込んだので残りビット数を１個減らす
-                        TempBitCount -- ;
-                        
-                        // もし現在書き込み元となっている配列要素に書き込んでいない
-                        // ビット情報が無くなったら次の配列要素に移る
-                        if( TempBitCount == 0 )
-                        {
-                            TempBitIndex -- ;
-                            TempBitCount = 8 ;
-                        }
-                        
-                        // 書き込んだビット数を増やす
-                        BitCount ++ ;
-                    }
-                }
-            }
-		}
+		Huffman_BuildTree( Node ) ;
     }
 
     // 解凍処理
     {
-        unsigned char *PressData ;
-        int PressBitCounter, PressBitData, Index, NodeIndex ;
-		int NodeIndexTable[ 512 ] ;
-		int j ;
-
-		// 各ビット配列がどのノードに繋がるかのテーブルを作成する
+		static const int TableSize = 1 << HUFFMAN_TABLE_BITS ;
+		HUFFMAN_TABLE_ENTRY *Table ;
+		BIT_READER BitReader ;
+		u16 Code[ 256 + 255 ] ;
+		u8 Depth[ 256 + 255 ] ;
+		int NodeIndex, Parent, j ;
+
+		// 先頭 HUFFMAN_TABLE_BITS ビットからどの数値データ( 又は結合データ )に辿り着くかのテーブルを作成する
+		Table = ( HUFFMAN_TABLE_ENTRY * )malloc( sizeof( HUFFMAN_TABLE_ENTRY ) * TableSize ) ;
+		if( Table == NULL )
 		{
-			u16 BitMask[ 9 ] ;
+			return 0 ;
+		}
 
-			for( i = 0 ; i < 9 ; i ++ )
+		// 天辺から順に HUFFMAN_TABLE_BITS ビット以内の各要素のビット列を割り出し、
+		// 数値データならビット列が一致する全ての要素に、HUFFMAN_TABLE_BITS ビット目の結合データならその要素にセットする
+		// ( 結合データは必ず子の要素より後ろにあるので、後ろから処理すれば親は処理済みになっている )
+		Code[ 510 ] = 0 ;
+		Depth[ 510 ] = 0 ;
+		for( NodeIndex = 509 ; NodeIndex >= 0 ; NodeIndex -- )
+		{
+			Parent = Node[ NodeIndex ].ParentNode ;
+			if( Depth[ Parent ] >= HUFFMAN_TABLE_BITS )
 			{
-				BitMask[ i ] = ( u16 )( ( 1 << ( i + 1 ) ) - 1 ) ;
+				Depth[ NodeIndex ] = HUFFMAN_TABLE_BITS + 1 ;
+				continue ;
 			}
+			Depth[ NodeIndex ] = ( u8 )( Depth[ Parent ] + 1 ) ;
+			Code[ NodeIndex ] = ( u16 )( Code[ Parent ] | ( Node[ NodeIndex ].Index << Depth[ Parent ] ) ) ;
 
-			for( i = 0 ; i < 512 ; i ++ )
+			if( NodeIndex <= 255 )
 			{
-				NodeIndexTable[ i ] = -1 ;
-
-				// ビット列に適合したノードを探す
-				for( j = 0 ; j < 256 + 254 ; j ++ )
+				for( j = Code[ NodeIndex ] ; j < TableSize ; j += 1 << Depth[ NodeIndex ] )
 				{
-					u16 BitArray01 ;
-
-					if( Node[ j ].BitNum > 9 )
-					{
-						continue ;
-					}
-
-					BitArray01 = ( u16 )Node[ j ].BitArray[ 0 ] | ( Node[ j ].BitArray[ 1 ] << 8 ) ;
-					if( ( i & BitMask[ Node[ j ].BitNum - 1 ] ) == ( BitArray01 & BitMask[ Node[ j ].BitNum - 1 ] ) )
-					{
-						NodeIndexTable[ i ] = j ;
-						break ;
-					}
+					Table[ j ].Data[ 0 ] = ( u8 )NodeIndex ;
+					Table[ j ].DataNum = 1 ;
+					Table[ j ].BitNum = Depth[ NodeIndex ] ;
+					Table[ j ].FirstBitNum = Depth[ NodeIndex ] ;
 				}
 			}
+			else
+			if( Depth[ NodeIndex ] == HUFFMAN_TABLE_BITS )
+			{
+				Table[ Code[ NodeIndex ] ].DataNum = 0 ;
+				Table[ Code[ NodeIndex ] ].BitNum = HUFFMAN_TABLE_BITS ;
+				Table[ Code[ NodeIndex ] ].FirstBitNum = 0 ;
+				Table[ Code[ NodeIndex ] ].Node = ( u16 )NodeIndex ;
+			}
+		}
+
+		// 一つ目の数値データの後の残りのビットで二つ目の数値データが決まる場合は追加する
+		// ( 残りのビットを参照する要素は前にあるので、一つ目の数値データの情報はそのまま残っている )
+		for( i = 0 ; i < TableSize ; i ++ )
+		{
+			HUFFMAN_TABLE_ENTRY *Entry = &Table[ i ] ;
+			const HUFFMAN_TABLE_ENTRY *Next ;
+
+			if( Entry->DataNum != 1 || Entry->FirstBitNum >= HUFFMAN_TABLE_BITS )
+			{
+				continue ;
+			}
+
+			Next = &Table[ i >> Entry->FirstBitNum ] ;
+			if( Next->DataNum != 0 && Next->FirstBitNum <= HUFFMAN_TABLE_BITS - Entry->FirstBitNum )
+			{
+				Entry->Data[ 1 ] = Next->Data[ 0 ] ;
+				Entry->DataNum = 2 ;
+				Entry->BitNum = ( u8 )( Entry->FirstBitNum + Next->FirstBitNum ) ;
+			}
 		}
 
         // 圧縮データ本体の先頭アドレスをセット
         // (圧縮データ本体は元のサイズ、圧縮後のサイズ、各数値の出現数等を
         // 格納するデータ領域の後にある)
-        PressData = PressPoint + HeadSize ;
-
-        // 解凍したデータの格納アドレスを初期化
-        DestSizeCounter = 0 ;
-        
-        // 圧縮データの参照アドレスを初期化
-        PressSizeCounter = 0 ;
-        
-        // 圧縮ビットデータのカウンタを初期化
-        PressBitCounter = 0 ;
-        
-        // 圧縮データの１バイト目をセット
-        PressBitData = PressData[PressSizeCounter] ;
+		BitReader_Init( &BitReader, PressPoint + HeadSize, PressSize ) ;
 
         // 圧縮前のデータサイズになるまで解凍処理を繰り返す
-        for( DestSizeCounter = 0 ; DestSizeCounter < DestSize ; DestSizeCounter ++ )
+		DestSizeCounter = 0 ;
+        while( DestSizeCounter < DestSize )
         {
-            // ビット列から数値データを検索する
-            {
-				// 最後の17byte分のデータは天辺から探す( 最後の次のバイトを読み出そうとしてメモリの不正なアクセスになる可能性があるため )
-				if( DestSizeCounter >= DestSize - 17 )
-				{
-					// 結合データの天辺は一番最後の結合データが格納される５１０番目(０番から数える)
-					// 天辺から順に下に降りていく
-					NodeIndex = 510 ;
-				}
-				else
-				{
-					// それ以外の場合はテーブルを使用する
+			const HUFFMAN_TABLE_ENTRY *Entry ;
 
-                    // もし PressBitData に格納されている全ての
-                    // ビットデータを使い切ってしまった場合は次の
-                    // ビットデータをセットする
-                    if( PressBitCounter == 8 )
-                    {
-                        PressSizeCounter ++ ;
-                        PressBitData = PressData[PressSizeCounter] ;
-                        PressBitCounter = 0 ;
-                    }
+			BitReader_Refill( &BitReader ) ;
 
-					// 圧縮データを9bit分用意する
-					PressBitData = ( PressBitData | ( PressData[ PressSizeCounter + 1 ] << ( 8 - PressBitCounter ) ) ) & 0x1ff ;
-
-					// テーブルから最初の結合データを探す
-					NodeIndex = NodeIndexTable[ PressBitData ] ;
-
-					// 使った分圧縮データのアドレスを進める
-					PressBitCounter += Node[ NodeIndex ].BitNum ;
-					if( PressBitCounter >= 16 )
-					{
-						PressSizeCounter += 2 ;
-						PressBitCounter -= 16 ;
-						PressBitData = PressData[PressSizeCounter] >> PressBitCounter ;
-					}
-					else
-					if( PressBitCounter >= 8 )
-					{
-						PressSizeCounter ++ ;
-						PressBitCounter -= 8 ;
-						PressBitData = PressData[PressSizeCounter] >> PressBitCounter ;
-					}
-					else
-					{
-						PressBitData >>= Node[ NodeIndex ].BitNum ;
-					}
+			// 先読みビットが５７ビット以上あるので、出力先に余裕があれば補充せずにもう一回テーブルを引く
+			Entry = &Table[ BitReader.BitBuffer & ( TableSize - 1 ) ] ;
+			if( Entry->DataNum != 0 && DestSizeCounter + 3 < DestSize )
+			{
+				DestPoint[ DestSizeCounter     ] = Entry->Data[ 0 ] ;
+				DestPoint[ DestSizeCounter + 1 ] = Entry->Data[ 1 ] ;
+				DestSizeCounter += Entry->DataNum ;
+				BitReader.BitBuffer >>= Entry->BitNum ;
+				BitReader.BitCount   -= Entry->BitNum ;
+			}
+
+			Entry = &Table[ BitReader.BitBuffer & ( TableSize - 1 ) ] ;
+
+			// 数値データが決まる場合は二つ分書き込んでから決まった数だけ進める( 最後の１バイトは一つ目のみ )
+			if( Entry->DataNum != 0 && DestSizeCounter + 1 < DestSize )
+			{
+				DestPoint[ DestSizeCounter     ] = Entry->Data[ 0 ] ;
+				DestPoint[ DestSizeCounter + 1 ] = Entry->Data[ 1 ] ;
+				DestSizeCounter += Entry->DataNum ;
+				BitReader.BitBuffer >>= Entry->BitNum ;
+				BitReader.BitCount   -= Entry->BitNum ;
+				continue ;
+			}
+
+			if( Entry->DataNum != 0 )
+			{
+				DestPoint[ DestSizeCounter ] = Entry->Data[ 0 ] ;
+				DestSizeCounter ++ ;
+				BitReader.BitBuffer >>= Entry->FirstBitNum ;
+				BitReader.BitCount   -= Entry->FirstBitNum ;
+				continue ;
+			}
+
+			// ビット列が長い場合は途中の結合データから数値データに辿り着くまで下りていく
+			BitReader.BitBuffer >>= HUFFMAN_TABLE_BITS ;
+			BitReader.BitCount   -= HUFFMAN_TABLE_BITS ;
+			NodeIndex = Entry->Node ;
+			while( NodeIndex > 255 )
+			{
+				if( BitReader.BitCount == 0 )
+				{
+					BitReader_Refill( &BitReader ) ;
 				}
-                
-                // 数値データに辿り着くまで結合データを下りていく
-                while( NodeIndex > 255 )
-                {
-                    // もし PressBitData に格納されている全ての
-                    // ビットデータを使い切ってしまった場合は次の
-                    // ビットデータをセットする
-                    if( PressBitCounter == 8 )
-                    {
-                        PressSizeCounter ++ ;
-                        PressBitData = PressData[PressSizeCounter] ;
-                        PressBitCounter = 0 ;
-                    }
-                    
-                    // １ビット取得する
-                    Index = PressBitData & 1 ;
-                    
-                    // 使用した１ビット分だけ右にシフトする
-                    PressBitData >>= 1 ;
-                    
-                    // 使用したビット数を一個増やす
-                    PressBitCounter ++ ;
-                    
-                    // 次の要素(結合データか数値データかはまだ分からない)に移る
-                    NodeIndex = Node[NodeIndex].ChildNode[Index] ;
-                }
-            }
+
+				NodeIndex = Node[ NodeIndex ].ChildNode[ BitReader.BitBuffer & 1 ] ;
+				BitReader.BitBuffer >>= 1 ;
+				BitReader.BitCount -- ;
+			}
 
             // 辿り着いた数値データを出力
-            DestPoint[DestSizeCounter] = (unsigned char)NodeIndex ;
+			DestPoint[ DestSizeCounter ] = ( unsigned char )NodeIndex ;
+			DestSizeCounter ++ ;
         }
+
+		free( Table ) ;
     }
 
     // 解凍後のサイズを返す
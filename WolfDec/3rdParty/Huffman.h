@@ -42,6 +42,9 @@
 #define NULL	(0)
 #endif
 
+// 圧縮データの情報の最大サイズ( 6 + 64 + 6 + 64 + ( 3 + 1 + 16 ) * 256 ビット )
+#define HUFFMAN_HEAD_MAXSIZE	(658)
+
 // proto type -----------------------------------
 
 // データを圧縮
@@ -52,4 +55,9 @@ extern u64 Huffman_Encode( void *Src, u64 SrcSize, void *Dest ) ;
 // 戻り値:解凍後のサイズ  0 はエラー  Dest に NULL を入れると解凍データ格納に必要なサイズが返る
 extern u64 Huffman_Decode( void *Press, void *Dest ) ;
 
+// 圧縮データ全体のサイズを取得する
+// 戻り値:圧縮データの情報を含めた圧縮データのサイズ  OriginalSize に解凍後のサイズが入る( NULL 可 )
+// Press には少なくとも HUFFMAN_HEAD_MAXSIZE バイトのデータが必要
+extern u64 Huffman_GetPressSize( void *Press, u64 *OriginalSize ) ;
+
 #endif // HUFFMAN_H
\ No newline at end of file
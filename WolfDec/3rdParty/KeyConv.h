@@ -0,0 +1,118 @@
+// -------------------------------------------------------------------------------
+//
+// 		ＤＸライブラリアーカイバ 鍵 Xor 演算
+//
+//	DXArchive / DXArchive_VER5 / DXArchive_VER6 で共通の鍵 Xor 演算処理
+//
+// -------------------------------------------------------------------------------
+
+// 多重インクルード防止用定義
+#ifndef __DXARCHIVE_KEYCONV
+#define __DXARCHIVE_KEYCONV
+
+// include --------------------------------------
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+#define DXA_KEYCONV_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define DXA_KEYCONV_AVX2
+#include <immintrin.h>
+#endif
+
+// define ---------------------------------------
+
+#define DXA_KEYCONV_MAX_KEY_BYTES		(16)		// 高速処理に対応する鍵の最大バイト数
+#define DXA_KEYCONV_PATTERN_UNIT		(32)		// 鍵パターンの長さ( 鍵のバイト数の倍数 )、ベクトル幅の倍数にする
+
+// function -------------------------------------
+
+// 鍵を使用して Xor 演算( Key は KeyBytes の長さ、Position はデータ先頭の鍵上の位置 )
+// 鍵をベクトル幅の倍数の長さまで繰り返したパターンを作成し、８バイト単位か SIMD 単位で Xor する
+static inline void KeyConvXor( void *Data, s64 Size, s64 Position, const u8 *Key, int KeyBytes )
+{
+	u8 *Dest = ( u8 * )Data ;
+	s64 i ;
+	int j ;
+
+	j = ( int )( Position % KeyBytes ) ;
+
+	// データが小さい場合や鍵が長すぎる場合は１バイトずつ処理する
+	if( KeyBytes > DXA_KEYCONV_MAX_KEY_BYTES || Size < ( s64 )KeyBytes * DXA_KEYCONV_PATTERN_UNIT * 2 )
+	{
+		for( i = 0 ; i < Size ; i ++ )
+		{
+			Dest[i] ^= Key[j] ;
+
+			j ++ ;
+			if( j == KeyBytes ) j = 0 ;
+		}
+		return ;
+	}
+
+	// 書き込み先がベクトル幅の境界に揃うまでは１バイトずつ処理する
+	while( ( ( size_t )Dest & ( DXA_KEYCONV_PATTERN_UNIT - 1 ) ) != 0 )
+	{
+		*Dest ^= Key[j] ;
+		Dest ++ ;
+		Size -- ;
+
+		j ++ ;
+		if( j == KeyBytes ) j = 0 ;
+	}
+
+	// 現在の鍵の位置から始まる繰り返しパターンを作成する
+	u8 Pattern[ DXA_KEYCONV_MAX_KEY_BYTES * DXA_KEYCONV_PATTERN_UNIT ] ;
+	int PatternBytes = KeyBytes * DXA_KEYCONV_PATTERN_UNIT ;
+	int k ;
+
+	for( k = 0 ; k < PatternBytes ; k ++ )
+	{
+		Pattern[k] = Key[j] ;
+
+		j ++ ;
+		if( j == KeyBytes ) j = 0 ;
+	}
+
+	// パターン単位で Xor する( パターンの長さは鍵のバイト数の倍数なので、次のパターンも同じ位置から始まる )
+	s64 BlockNum = Size / PatternBytes ;
+	for( i = 0 ; i < BlockNum ; i ++, Dest += PatternBytes )
+	{
+#if defined( DXA_KEYCONV_AVX2 )
+		for( k = 0 ; k < PatternBytes ; k += 32 )
+		{
+			__m256i d = _mm256_load_si256( ( const __m256i * )( Dest + k ) ) ;
+			__m256i p = _mm256_loadu_si256( ( const __m256i * )( Pattern + k ) ) ;
+			_mm256_store_si256( ( __m256i * )( Dest + k ), _mm256_xor_si256( d, p ) ) ;
+		}
+#elif defined( DXA_KEYCONV_SSE2 )
+		for( k = 0 ; k < PatternBytes ; k += 16 )
+		{
+			__m128i d = _mm_load_si128( ( const __m128i * )( Dest + k ) ) ;
+			__m128i p = _mm_loadu_si128( ( const __m128i * )( Pattern + k ) ) ;
+			_mm_store_si128( ( __m128i * )( Dest + k ), _mm_xor_si128( d, p ) ) ;
+		}
+#else
+		for( k = 0 ; k < PatternBytes ; k += 8 )
+		{
+			u64 d, p ;
+			memcpy( &d, Dest + k, 8 ) ;
+			memcpy( &p, Pattern + k, 8 ) ;
+			d ^= p ;
+			memcpy( Dest + k, &d, 8 ) ;
+		}
+#endif
+	}
+
+	// 残りは１バイトずつ処理する
+	Size -= BlockNum * PatternBytes ;
+	for( k = 0 ; k < Size ; k ++ )
+	{
+		Dest[k] ^= Pattern[k] ;
+	}
+}
+
+#endif
@@ -35,6 +35,24 @@
 #include <string>
 #include <vector>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WOLF_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define WOLF_TARGET_AESNI
+#define WOLF_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define WOLF_TARGET_AESNI __attribute__((target("aes,ssse3")))
+#define WOLF_TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+// SSE2 is part of the baseline for x64 and for the default MSVC x86 target, so it needs no dispatch
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define WOLF_SSE2
+#endif
+#endif
+
 namespace
 {
 bool isV35(const uint16_t &cryptVersion)
@@ -42,6 +60,74 @@ bool isV35(const uint16_t &cryptVersion)
 	return (cryptVersion >= 0x15E && cryptVersion < 0x3E8) || cryptVersion >= 0x3FC;
 }
 
+#ifdef WOLF_X86
+bool hasAvx2()
+{
+	static const bool supported = []() {
+#ifdef _MSC_VER
+		int info[4] = { 0 };
+		__cpuid(info, 1);
+
+		// AVX (bit 28) and OSXSAVE (bit 27), then the OS has to save the YMM state
+		if (((info[2] >> 27) & 3) != 3)
+			return false;
+		if ((_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return ((info[1] >> 5) & 1) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+
+	return supported;
+}
+#endif
+
+// XOR one whole 256 byte page with pPageKey[i] ^ pageConst
+#ifdef WOLF_X86
+WOLF_TARGET_AVX2
+void wolfCryptXorPageAvx2(uint8_t *pData, const uint8_t *pPageKey, const uint8_t &pageConst)
+{
+	const __m256i c = _mm256_set1_epi8(static_cast<char>(pageConst));
+
+	for (uint32_t i = 0; i < 256; i += 32)
+	{
+		__m256i *pBlock = reinterpret_cast<__m256i *>(pData + i);
+		const __m256i k = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pPageKey + i)), c);
+		_mm256_storeu_si256(pBlock, _mm256_xor_si256(_mm256_loadu_si256(pBlock), k));
+	}
+}
+#endif
+
+void wolfCryptXorPage(uint8_t *pData, const uint8_t *pPageKey, const uint8_t &pageConst, const bool &avx2)
+{
+#ifdef WOLF_X86
+	if (avx2)
+	{
+		wolfCryptXorPageAvx2(pData, pPageKey, pageConst);
+		return;
+	}
+#endif
+
+#ifdef WOLF_SSE2
+	const __m128i c = _mm_set1_epi8(static_cast<char>(pageConst));
+
+	for (uint32_t i = 0; i < 256; i += 16)
+	{
+		__m128i *pBlock = reinterpret_cast<__m128i *>(pData + i);
+		const __m128i k = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pPageKey + i)), c);
+		_mm_storeu_si128(pBlock, _mm_xor_si128(_mm_loadu_si128(pBlock), k));
+	}
+#else
+	for (uint32_t i = 0; i < 256; i++)
+		pData[i] ^= pPageKey[i] ^ pageConst;
+#endif
+}
+
+// Within a 256 byte page only v1Cnt changes, so the keystream is the first 256 key bytes XOR one constant byte.
+// Whole pages are XORed with vector ops, a misaligned start and a partial last page byte by byte.
 void wolfCrypt(const uint8_t *pKey, uint8_t *pData, const int64_t &start, const int64_t &end, const bool &updateDataPos, const uint16_t &cryptVersion)
 {
 	if (updateDataPos)
@@ -53,32 +139,50 @@ void wolfCrypt(const uint8_t *pKey, uint8_t *pData, const int64_t &start, const
 	uint32_t v2Cnt = start / 256 % 256;
 	int32_t v3Cnt  = start / 0x10000 % 256;
 
-	if (isV35(cryptVersion))
+	const bool v35 = isV35(cryptVersion);
+	uint8_t moddedKey[512];
+	const uint8_t *pPageKey = pKey;
+
+	if (v35)
 	{
-		uint8_t moddedKey[512];
 		for (uint32_t i = 0; i < 512; i++)
 			moddedKey[i] = pKey[i % 256] ^ (7 * i);
 
-		for (uint64_t i = 0; i < length; i++)
-		{
-			pData[i] ^= moddedKey[v1Cnt++] ^ moddedKey[v2Cnt + 256];
-
-			if (v1Cnt == 256)
-			{
-				v1Cnt = 0;
-				v2Cnt = (v2Cnt + 1) % 256;
-			}
-		}
+		pPageKey = moddedKey;
 	}
-	else
+
+#ifdef WOLF_X86
+	const bool avx2 = hasAvx2();
+#else
+	const bool avx2 = false;
+#endif
+
+	uint64_t i = 0;
+
+	while (i < length)
 	{
-		for (uint64_t i = 0; i < length; i++)
+		const uint8_t pageConst = v35 ? moddedKey[v2Cnt + 256] : (pKey[v2Cnt + 256] ^ pKey[v3Cnt + 512]);
+		const uint64_t run      = std::min<uint64_t>(256 - v1Cnt, length - i);
+
+		if (run == 256)
+			wolfCryptXorPage(pData + i, pPageKey, pageConst, avx2);
+		else
+		{
+			for (uint64_t j = 0; j < run; j++)
+				pData[i + j] ^= pPageKey[v1Cnt + j] ^ pageConst;
+		}
+
+		i += run;
+		v1Cnt += static_cast<uint32_t>(run);
+
+		if (v1Cnt == 256)
 		{
-			pData[i] ^= pKey[v1Cnt++] ^ pKey[v2Cnt + 256] ^ pKey[v3Cnt + 512];
+			v1Cnt = 0;
 
-			if (v1Cnt == 256)
+			if (v35)
+				v2Cnt = (v2Cnt + 1) % 256;
+			else
 			{
-				v1Cnt = 0;
 				v2Cnt++;
 
 				if (v2Cnt == 256)
@@ -102,10 +206,23 @@ void calcSalt(const char *pStr, uint8_t *pSalt)
 		pSalt[i] = (i / len) + pStr[i % len];
 }
 
-uint32_t xorshift32(const uint32_t &seed = 0)
+// Reproduces the MSVC CRT srand/rand sequence with caller-owned state,
+// so key derivation neither depends on nor disturbs the global CRT generator
+struct MsvcRand
 {
-	static uint32_t state = 0;
+	uint32_t state;
 
+	explicit MsvcRand(const uint32_t &seed) : state(seed) {}
+
+	int operator()()
+	{
+		state = state * 214013 + 2531011;
+		return static_cast<int>((state >> 16) & 0x7FFF);
+	}
+};
+
+uint32_t xorshift32(uint32_t &state, const uint32_t &seed = 0)
+{
 	if (seed != 0)
 		state = seed;
 
@@ -141,7 +258,7 @@ void initWolfCrypt(const uint16_t &cryptVersion, const uint8_t *pPW, uint8_t *pK
 	}
 
 	const uint32_t seed = s0 * s1 + s2 + s3;
-	srand(seed);
+	MsvcRand rand(seed);
 
 	fac[s3 % 3] = rand() % 256;
 
@@ -275,7 +392,7 @@ void cryptAddresses(uint8_t *pData, const uint8_t *pKey, const uint32_t cryptVer
 	{
 		uint32_t seed = 0xC + (pKey[9] & 0xFF) * (pKey[10] & 0xFF) + (pKey[3] & 0xFF);
 
-		srand(seed);
+		MsvcRand rand(seed);
 
 		pDataB16 += 4;
 
@@ -306,7 +423,7 @@ void cryptAddresses(uint8_t *pData, const uint8_t *pKey, const uint32_t cryptVer
 	{
 		uint16_t *pDataB16 = reinterpret_cast<uint16_t *>(pData);
 
-		srand((pKey[0] & 0xFF) + (pKey[7] & 0xFF) * (pKey[12] & 0xFF));
+		MsvcRand rand((pKey[0] & 0xFF) + (pKey[7] & 0xFF) * (pKey[12] & 0xFF));
 
 		pDataB16 += 4;
 
@@ -544,8 +661,8 @@ void cipher(uint8_t *pState, const uint8_t *pRoundKey)
 	addRoundKey(pState, Nr, pRoundKey);
 }
 
-// AES_CTR_xcrypt
-void aesCtrXCrypt(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
+// AES_CTR_xcrypt, portable byte-wise version
+void aesCtrXCryptGeneric(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
 {
 	uint8_t state[AES_BLOCKLEN];
 	uint8_t *pIv = pKey + AES_KEY_EXP_SIZE;
@@ -576,6 +693,138 @@ void aesCtrXCrypt(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
 	}
 }
 
+#ifdef WOLF_X86
+bool hasAesNi()
+{
+	static const bool supported = []() {
+		uint32_t ecx = 0;
+#ifdef _MSC_VER
+		int info[4] = { 0 };
+		__cpuid(info, 1);
+		ecx = static_cast<uint32_t>(info[2]);
+#else
+		uint32_t eax, ebx, edx;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			return false;
+#endif
+		// AES-NI (bit 25) for the rounds, SSSE3 (bit 9) for the counter byte swap
+		return ((ecx >> 25) & 1) && ((ecx >> 9) & 1);
+	}();
+
+	return supported;
+}
+
+uint64_t loadBE64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (uint32_t i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+void storeBE64(uint8_t *p, uint64_t v)
+{
+	for (int32_t i = 7; i >= 0; i--, v >>= 8)
+		p[i] = static_cast<uint8_t>(v);
+}
+
+// Counter block ctr + add, where ctr is the big-endian 128 bit IV split into two halves
+WOLF_TARGET_AESNI
+__m128i aesNiCounterBlock(const uint64_t &ctrHi, const uint64_t &ctrLo, const uint64_t &add)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const uint64_t lo   = ctrLo + add;
+	const uint64_t hi   = ctrHi + (lo < ctrLo ? 1 : 0);
+
+	return _mm_shuffle_epi8(_mm_set_epi64x(static_cast<int64_t>(hi), static_cast<int64_t>(lo)), bswap);
+}
+
+// AES_CTR_xcrypt using AES-NI, encrypts 8 counter blocks per iteration
+// The round keys come straight from keyExpansion, so the modified WolfRPG schedule is kept as is
+WOLF_TARGET_AESNI
+void aesCtrXCryptAesNi(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
+{
+	static constexpr std::size_t PIPE = 8;
+
+	uint8_t *pIv = pKey + AES_KEY_EXP_SIZE;
+	__m128i rk[Nr + 1];
+
+	for (uint32_t r = 0; r <= Nr; r++)
+		rk[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pKey + r * AES_BLOCKLEN));
+
+	const uint64_t ctrHi = loadBE64(pIv);
+	const uint64_t ctrLo = loadBE64(pIv + 8);
+
+	const std::size_t fullBlocks = size / AES_BLOCKLEN;
+	const std::size_t blocks     = (size + AES_BLOCKLEN - 1) / AES_BLOCKLEN;
+	std::size_t b                = 0;
+
+	for (; b + PIPE <= fullBlocks; b += PIPE)
+	{
+		__m128i st[PIPE];
+
+		for (uint32_t k = 0; k < PIPE; k++)
+			st[k] = _mm_xor_si128(aesNiCounterBlock(ctrHi, ctrLo, b + k), rk[0]);
+
+		for (uint32_t r = 1; r < Nr; r++)
+		{
+			for (uint32_t k = 0; k < PIPE; k++)
+				st[k] = _mm_aesenc_si128(st[k], rk[r]);
+		}
+
+		for (uint32_t k = 0; k < PIPE; k++)
+		{
+			__m128i *pBlock = reinterpret_cast<__m128i *>(pData + (b + k) * AES_BLOCKLEN);
+			st[k]           = _mm_aesenclast_si128(st[k], rk[Nr]);
+			_mm_storeu_si128(pBlock, _mm_xor_si128(_mm_loadu_si128(pBlock), st[k]));
+		}
+	}
+
+	for (; b < blocks; b++)
+	{
+		__m128i st = _mm_xor_si128(aesNiCounterBlock(ctrHi, ctrLo, b), rk[0]);
+
+		for (uint32_t r = 1; r < Nr; r++)
+			st = _mm_aesenc_si128(st, rk[r]);
+
+		st = _mm_aesenclast_si128(st, rk[Nr]);
+
+		if (b < fullBlocks)
+		{
+			__m128i *pBlock = reinterpret_cast<__m128i *>(pData + b * AES_BLOCKLEN);
+			_mm_storeu_si128(pBlock, _mm_xor_si128(_mm_loadu_si128(pBlock), st));
+		}
+		else
+		{
+			uint8_t stream[AES_BLOCKLEN];
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(stream), st);
+
+			for (std::size_t i = b * AES_BLOCKLEN; i < size; i++)
+				pData[i] ^= stream[i - b * AES_BLOCKLEN];
+		}
+	}
+
+	// Leave the IV where the byte-wise version would, callers continue from it
+	const uint64_t lo = ctrLo + blocks;
+	storeBE64(pIv, ctrHi + (lo < ctrLo ? 1 : 0));
+	storeBE64(pIv + 8, lo);
+}
+#endif
+
+// AES_CTR_xcrypt
+void aesCtrXCrypt(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
+{
+#ifdef WOLF_X86
+	if (hasAesNi())
+	{
+		aesCtrXCryptAesNi(pData, pKey, size);
+		return;
+	}
+#endif
+
+	aesCtrXCryptGeneric(pData, pKey, size);
+}
+
 ////// AES CTR Crypt
 /////////////////////////////////
 
@@ -759,8 +1008,6 @@ void runCrypt(RngData &rd, const uint32_t &seed1, const uint32_t &seed2)
 	rd.seed2   = seed2;
 	rd.counter = 0;
 
-	srand(seed1);
-
 	for (uint32_t i = 0; i < rd.data.size(); i++)
 		rngChain(rd, rd.data[i]);
 }
@@ -856,7 +1103,7 @@ void aesKeyGen(CryptData &cd, RngData &rd, std::array<uint8_t, AES_KEY_SIZE> &ae
 	std::vector<uint8_t> resData(RngData::DATA_VEC_LEN, 0);
 	std::iota(indexes.begin(), indexes.end(), 0);
 
-	srand(seed);
+	MsvcRand rand(seed);
 
 	for (uint32_t i = 0; i < RngData::DATA_VEC_LEN; i++)
 	{
@@ -1151,6 +1398,188 @@ void chacha20_block_next(uint32_t *pState, uint32_t *pKeyStream)
 		counter[1]++;
 }
 
+// The vector kernels run one block per lane, block k of the batch uses counter (words 12 and 13) + k
+// just like k calls of chacha20_block_next would, and the counter is advanced past the batch afterwards
+
+#ifdef WOLF_SSE2
+#define CHACHA20_ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CHACHA20_QUARTERROUND_SSE2(x, a, b, c, d)                \
+	x[a] = _mm_add_epi32(x[a], x[b]);                            \
+	x[d] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[d], x[a]), 16);    \
+	x[c] = _mm_add_epi32(x[c], x[d]);                            \
+	x[b] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[b], x[c]), 12);    \
+	x[a] = _mm_add_epi32(x[a], x[b]);                            \
+	x[d] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[d], x[a]), 8);     \
+	x[c] = _mm_add_epi32(x[c], x[d]);                            \
+	x[b] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[b], x[c]), 7);
+
+// XOR blockCount (multiple of 4) whole 64 byte blocks, 4 blocks at a time
+void chacha20_xorBlocksSse2(uint32_t *pState, uint8_t *bytes, const uint64_t &blockCount)
+{
+	__m128i base[16];
+
+	for (uint32_t i = 0; i < 16; i++)
+		base[i] = _mm_set1_epi32(static_cast<int32_t>(pState[i]));
+
+	uint64_t counter = pState[12] | (static_cast<uint64_t>(pState[13]) << 32);
+
+	for (uint64_t blk = 0; blk < blockCount; blk += 4, bytes += 4 * 64, counter += 4)
+	{
+		__m128i orig[16];
+		__m128i x[16];
+
+		std::memcpy(orig, base, sizeof(orig));
+		orig[12] = _mm_setr_epi32(static_cast<int32_t>(counter), static_cast<int32_t>(counter + 1), static_cast<int32_t>(counter + 2), static_cast<int32_t>(counter + 3));
+		orig[13] = _mm_setr_epi32(static_cast<int32_t>(counter >> 32), static_cast<int32_t>((counter + 1) >> 32), static_cast<int32_t>((counter + 2) >> 32), static_cast<int32_t>((counter + 3) >> 32));
+		std::memcpy(x, orig, sizeof(x));
+
+		for (uint32_t i = 0; i < 10; i++)
+		{
+			CHACHA20_QUARTERROUND_SSE2(x, 0, 4, 8, 12)
+			CHACHA20_QUARTERROUND_SSE2(x, 1, 5, 9, 13)
+			CHACHA20_QUARTERROUND_SSE2(x, 2, 6, 10, 14)
+			CHACHA20_QUARTERROUND_SSE2(x, 3, 7, 11, 15)
+			CHACHA20_QUARTERROUND_SSE2(x, 0, 5, 10, 15)
+			CHACHA20_QUARTERROUND_SSE2(x, 1, 6, 11, 12)
+			CHACHA20_QUARTERROUND_SSE2(x, 2, 7, 8, 13)
+			CHACHA20_QUARTERROUND_SSE2(x, 3, 4, 9, 14)
+		}
+
+		// Transpose 4 words x 4 blocks at a time and XOR them into the data
+		for (uint32_t g = 0; g < 4; g++)
+		{
+			const __m128i a = _mm_add_epi32(x[g * 4 + 0], orig[g * 4 + 0]);
+			const __m128i b = _mm_add_epi32(x[g * 4 + 1], orig[g * 4 + 1]);
+			const __m128i c = _mm_add_epi32(x[g * 4 + 2], orig[g * 4 + 2]);
+			const __m128i d = _mm_add_epi32(x[g * 4 + 3], orig[g * 4 + 3]);
+
+			const __m128i t0 = _mm_unpacklo_epi32(a, b);
+			const __m128i t1 = _mm_unpacklo_epi32(c, d);
+			const __m128i t2 = _mm_unpackhi_epi32(a, b);
+			const __m128i t3 = _mm_unpackhi_epi32(c, d);
+
+			const __m128i ks[4] = { _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1), _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3) };
+
+			for (uint32_t k = 0; k < 4; k++)
+			{
+				__m128i *pBlock = reinterpret_cast<__m128i *>(bytes + k * 64 + g * 16);
+				_mm_storeu_si128(pBlock, _mm_xor_si128(_mm_loadu_si128(pBlock), ks[k]));
+			}
+		}
+	}
+
+	pState[12] = static_cast<uint32_t>(counter);
+	pState[13] = static_cast<uint32_t>(counter >> 32);
+}
+
+#undef CHACHA20_QUARTERROUND_SSE2
+#undef CHACHA20_ROTL_SSE2
+#endif
+
+#ifdef WOLF_X86
+#define CHACHA20_QUARTERROUND_AVX2(x, a, b, c, d)                                                           \
+	x[a] = _mm256_add_epi32(x[a], x[b]);                                                                    \
+	x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rot16);                                        \
+	x[c] = _mm256_add_epi32(x[c], x[d]);                                                                    \
+	x[b] = _mm256_xor_si256(x[b], x[c]);                                                                    \
+	x[b] = _mm256_or_si256(_mm256_slli_epi32(x[b], 12), _mm256_srli_epi32(x[b], 20));                      \
+	x[a] = _mm256_add_epi32(x[a], x[b]);                                                                    \
+	x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rot8);                                         \
+	x[c] = _mm256_add_epi32(x[c], x[d]);                                                                    \
+	x[b] = _mm256_xor_si256(x[b], x[c]);                                                                    \
+	x[b] = _mm256_or_si256(_mm256_slli_epi32(x[b], 7), _mm256_srli_epi32(x[b], 25));
+
+// XOR blockCount (multiple of 8) whole 64 byte blocks, 8 blocks at a time
+WOLF_TARGET_AVX2
+void chacha20_xorBlocksAvx2(uint32_t *pState, uint8_t *bytes, const uint64_t &blockCount)
+{
+	// Byte shuffles for the rotations by 16 and 8
+	const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8  = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3, 14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+
+	__m256i base[16];
+
+	for (uint32_t i = 0; i < 16; i++)
+		base[i] = _mm256_set1_epi32(static_cast<int32_t>(pState[i]));
+
+	uint64_t counter = pState[12] | (static_cast<uint64_t>(pState[13]) << 32);
+
+	for (uint64_t blk = 0; blk < blockCount; blk += 8, bytes += 8 * 64, counter += 8)
+	{
+		__m256i orig[16];
+		__m256i x[16];
+		int32_t lo[8];
+		int32_t hi[8];
+
+		for (uint32_t k = 0; k < 8; k++)
+		{
+			lo[k] = static_cast<int32_t>(counter + k);
+			hi[k] = static_cast<int32_t>((counter + k) >> 32);
+		}
+
+		std::memcpy(orig, base, sizeof(orig));
+		orig[12] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lo));
+		orig[13] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hi));
+		std::memcpy(x, orig, sizeof(x));
+
+		for (uint32_t i = 0; i < 10; i++)
+		{
+			CHACHA20_QUARTERROUND_AVX2(x, 0, 4, 8, 12)
+			CHACHA20_QUARTERROUND_AVX2(x, 1, 5, 9, 13)
+			CHACHA20_QUARTERROUND_AVX2(x, 2, 6, 10, 14)
+			CHACHA20_QUARTERROUND_AVX2(x, 3, 7, 11, 15)
+			CHACHA20_QUARTERROUND_AVX2(x, 0, 5, 10, 15)
+			CHACHA20_QUARTERROUND_AVX2(x, 1, 6, 11, 12)
+			CHACHA20_QUARTERROUND_AVX2(x, 2, 7, 8, 13)
+			CHACHA20_QUARTERROUND_AVX2(x, 3, 4, 9, 14)
+		}
+
+		// Transpose inside each 128 bit half: ks[g][k] holds words 4g..4g+3 of block k (low half) and block k + 4 (high half)
+		__m256i ks[4][4];
+
+		for (uint32_t g = 0; g < 4; g++)
+		{
+			const __m256i a = _mm256_add_epi32(x[g * 4 + 0], orig[g * 4 + 0]);
+			const __m256i b = _mm256_add_epi32(x[g * 4 + 1], orig[g * 4 + 1]);
+			const __m256i c = _mm256_add_epi32(x[g * 4 + 2], orig[g * 4 + 2]);
+			const __m256i d = _mm256_add_epi32(x[g * 4 + 3], orig[g * 4 + 3]);
+
+			const __m256i t0 = _mm256_unpacklo_epi32(a, b);
+			const __m256i t1 = _mm256_unpacklo_epi32(c, d);
+			const __m256i t2 = _mm256_unpackhi_epi32(a, b);
+			const __m256i t3 = _mm256_unpackhi_epi32(c, d);
+
+			ks[g][0] = _mm256_unpacklo_epi64(t0, t1);
+			ks[g][1] = _mm256_unpackhi_epi64(t0, t1);
+			ks[g][2] = _mm256_unpacklo_epi64(t2, t3);
+			ks[g][3] = _mm256_unpackhi_epi64(t2, t3);
+		}
+
+		for (uint32_t k = 0; k < 4; k++)
+		{
+			const __m256i lo01 = _mm256_permute2x128_si256(ks[0][k], ks[1][k], 0x20);
+			const __m256i lo23 = _mm256_permute2x128_si256(ks[2][k], ks[3][k], 0x20);
+			const __m256i hi01 = _mm256_permute2x128_si256(ks[0][k], ks[1][k], 0x31);
+			const __m256i hi23 = _mm256_permute2x128_si256(ks[2][k], ks[3][k], 0x31);
+
+			__m256i *pLo = reinterpret_cast<__m256i *>(bytes + k * 64);
+			__m256i *pHi = reinterpret_cast<__m256i *>(bytes + (k + 4) * 64);
+
+			_mm256_storeu_si256(pLo, _mm256_xor_si256(_mm256_loadu_si256(pLo), lo01));
+			_mm256_storeu_si256(pLo + 1, _mm256_xor_si256(_mm256_loadu_si256(pLo + 1), lo23));
+			_mm256_storeu_si256(pHi, _mm256_xor_si256(_mm256_loadu_si256(pHi), hi01));
+			_mm256_storeu_si256(pHi + 1, _mm256_xor_si256(_mm256_loadu_si256(pHi + 1), hi23));
+		}
+	}
+
+	pState[12] = static_cast<uint32_t>(counter);
+	pState[13] = static_cast<uint32_t>(counter >> 32);
+}
+
+#undef CHACHA20_QUARTERROUND_AVX2
+#endif
+
 // Slightly modified version of the default functionality
 // - Counter is initialized to (1 + startPos / 64)
 // - The number of steps done can vary at the beginning or end of the function, depending on startPos
@@ -1166,6 +1595,29 @@ void chacha20_xor(uint32_t *pState, uint32_t *pKeyStream, const uint32_t &startP
 
 	while (position < length)
 	{
+#ifdef WOLF_X86
+		// Runs of whole blocks go through the vector kernels, a misaligned start and the tail stay scalar
+		if (offset == 0)
+		{
+			const uint64_t blocks = (length - position) / 64;
+
+			if (blocks >= 8 && hasAvx2())
+			{
+				chacha20_xorBlocksAvx2(pState, bytes + position, blocks & ~7ull);
+				position += (blocks & ~7ull) * 64;
+				continue;
+			}
+#ifdef WOLF_SSE2
+			if (blocks >= 4)
+			{
+				chacha20_xorBlocksSse2(pState, bytes + position, blocks & ~3ull);
+				position += (blocks & ~3ull) * 64;
+				continue;
+			}
+#endif
+		}
+#endif
+
 		uint32_t steps = static_cast<uint32_t>(std::min(64 - offset, length - position));
 		chacha20_block_next(pState, pKeyStream);
 
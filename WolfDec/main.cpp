@@ -11,6 +11,8 @@
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <windows.h>
@@ -30,35 +32,39 @@ std::cout;
 
 using DecryptFunction = int (*)(TCHAR*, const TCHAR*, const char*);
 using EncryptFunction = int (*)(const TCHAR*, const TCHAR*, bool, const char*, uint16_t);
+using ProbeFunction = int (*)(const TCHAR*, const char*);
 
 class InvalidModeException : public std::exception{};
 
 struct CryptMode
 {
-	CryptMode(const std::wstring& name, const uint16_t& cryptVersion, const DecryptFunction& decFunc, const EncryptFunction& encFunc, const std::vector<char> key) :
+	CryptMode(const std::wstring& name, const uint16_t& cryptVersion, const DecryptFunction& decFunc, const EncryptFunction& encFunc, const ProbeFunction& probeFunc, const std::vector<char> key) :
 		name(name),
 		cryptVersion(cryptVersion),
 		decFunc(decFunc),
 		encFunc(encFunc),
+		probeFunc(probeFunc),
 		key(key)
 	{
 	}
 
-	CryptMode(const std::wstring& name, const uint16_t& cryptVersion, const DecryptFunction& decFunc, const EncryptFunction& encFunc, const std::string& key) :
+	CryptMode(const std::wstring& name, const uint16_t& cryptVersion, const DecryptFunction& decFunc, const EncryptFunction& encFunc, const ProbeFunction& probeFunc, const std::string& key) :
 		name(name),
 		cryptVersion(cryptVersion),
 		decFunc(decFunc),
 		encFunc(encFunc),
+		probeFunc(probeFunc),
 		key(key.begin(), key.end())
 	{
 		this->key.push_back(0x00); // The key needs to end with 0x00 so the parser knows when to stop
 	}
 
-	CryptMode(const std::wstring& name, const uint16_t& cryptVersion, const DecryptFunction& decFunc, const EncryptFunction& encFunc, const std::vector<unsigned char> key) :
+	CryptMode(const std::wstring& name, const uint16_t& cryptVersion, const DecryptFunction& decFunc, const EncryptFunction& encFunc, const ProbeFunction& probeFunc, const std::vector<unsigned char> key) :
 		name(name),
 		cryptVersion(cryptVersion),
 		decFunc(decFunc),
-		encFunc(encFunc)
+		encFunc(encFunc),
+		probeFunc(probeFunc)
 	{
 		std::copy(key.begin(), key.end(), std::back_inserter(this->key));
 	}
@@ -67,6 +73,7 @@ struct CryptMode
 	uint16_t cryptVersion;
 	DecryptFunction decFunc;
 	EncryptFunction encFunc;
+	ProbeFunction probeFunc; // Decodes only the header tables, returns -1 if the key doesn't fit or 0-100 for how well it does
 	std::vector<char> key;
 };
 
@@ -76,20 +83,40 @@ static constexpr uint16_t CC2_PRO_VERSION = 0xC8;
 using CryptModes = std::vector<CryptMode>;
 
 static CryptModes DEFAULT_CRYPT_MODES = {
-	{ L"Wolf RPG v2.01", 0x0, &DXArchive_VER5::DecodeArchive, &DXArchive_VER5::EncodeArchiveOneDirectory, std::vector<unsigned char>{ 0x0f, 0x53, 0xe1, 0x3e, 0x04, 0x37, 0x12, 0x17, 0x60, 0x0f, 0x53, 0xe1 } },
-	{ L"Wolf RPG v2.10", 0x0, &DXArchive_VER5::DecodeArchive, &DXArchive_VER5::EncodeArchiveOneDirectory, std::vector<unsigned char>{ 0x4c, 0xd9, 0x2a, 0xb7, 0x28, 0x9b, 0xac, 0x07, 0x3e, 0x77, 0xec, 0x4c } },
-	{ L"Wolf RPG v2.20", 0x0, &DXArchive_VER6::DecodeArchive, &DXArchive_VER6::EncodeArchiveOneDirectory, std::vector<unsigned char>{ 0x38, 0x50, 0x40, 0x28, 0x72, 0x4f, 0x21, 0x70, 0x3b, 0x73, 0x35, 0x38 } },
-	{ L"Wolf RPG v2.225", 0x0, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, "WLFRPrO!p(;s5((8P@((UFWlu$#5(=" },
-	{ L"Wolf RPG v3.00", 0x12C, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, std::vector<unsigned char>{ 0x0F, 0x53, 0xE1, 0x3E, 0x8E, 0xB5, 0x41, 0x91, 0x52, 0x16, 0x55, 0xAE, 0x34, 0xC9, 0x8F, 0x79, 0x59, 0x2F, 0x59, 0x6B, 0x95, 0x19, 0x9B, 0x1B, 0x35, 0x9A, 0x2F, 0xDE, 0xC9, 0x7C, 0x12, 0x96, 0xC3, 0x14, 0xB5, 0x0F, 0x53, 0xE1, 0x3E, 0x8E, 0x00 } },
-	{ L"Wolf RPG v3.14", 0x13A, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, std::vector<unsigned char>{ 0x31, 0xF9, 0x01, 0x36, 0xA3, 0xE3, 0x8D, 0x3C, 0x7B, 0xC3, 0x7D, 0x25, 0xAD, 0x63, 0x28, 0x19, 0x1B, 0xF7, 0x8E, 0x6C, 0xC4, 0xE5, 0xE2, 0x76, 0x82, 0xEA, 0x4F, 0xED, 0x61, 0xDA, 0xE0, 0x44, 0x5B, 0xB6, 0x46, 0x3B, 0x06, 0xD5, 0xCE, 0xB6, 0x78, 0x58, 0xD0, 0x7C, 0x82, 0x00 } },
-	{ L"Wolf RPG v3.31", 0x14B, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, std::vector<unsigned char>{ 0xCA, 0x08, 0x4C, 0x5D, 0x17, 0x0D, 0xDA, 0xA1, 0xD7, 0x27, 0xC8, 0x41, 0x54, 0x38, 0x82, 0x32, 0x54, 0xB7, 0xF9, 0x46, 0x8E, 0x13, 0x6B, 0xCA, 0xD0, 0x5C, 0x95, 0x95, 0xE2, 0xDC, 0x03, 0x53, 0x60, 0x9B, 0x4A, 0x38, 0x17, 0xF3, 0x69, 0x59, 0xA4, 0xC7, 0x9A, 0x43, 0x63, 0xE6, 0x54, 0xAF, 0xDB, 0xBB, 0x43, 0x58, 0x00 } },
-	{ L"Wolf RPG v3.50", 0x15E, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, std::vector<unsigned char>{ 0xD2, 0x84, 0xCE, 0x28, 0xCE, 0x88, 0x82, 0xE4, 0x2A, 0x18, 0x2E, 0x4C, 0x06, 0xB4, 0xEA, 0x84, 0x06, 0xB8, 0xC6, 0x88, 0x5A, 0xA0, 0x9E, 0x7C, 0x56, 0x40, 0xBA, 0x34, 0x52, 0xCC, 0xC6, 0x7C, 0x2E, 0x14, 0x12, 0x68, 0xFE, 0x5C, 0x76, 0x94, 0x86, 0x78, 0x8E, 0x4C, 0xBE, 0x88, 0x66, 0x9C, 0x1E, 0xE0, 0x8E, 0x6C, 0x00 } },
-	{ L"Wolf RPG ChaCha2 v1", 0x64, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, std::vector<unsigned char>{ 0xC9, 0x82, 0xF8, 0xB4, 0x2C, 0x93, 0x9E, 0x83, 0x0E, 0xBC, 0xBC, 0x92, 0x68, 0x8D, 0x59, 0xA1, 0x4A, 0x9E, 0x7F, 0xB0, 0xAC, 0xAF, 0x1D, 0x8F, 0x8E, 0xB8, 0x3B, 0x9E, 0xE8, 0x89, 0xD9, 0xAD, 0xFF, 0xBC, 0x2D, 0xAB, 0x9D, 0x8B, 0x0F, 0xB4, 0xBB, 0x9A, 0x69, 0x85, 0x00 } }, // First 32 bytes of the key and the next 12 byte are the nonce, 0 terminator for the unused keygen to not crash
-	{ L"Custom Key (v2.281+)", 0, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, "" }, // 8
+	{ L"Wolf RPG v2.01", 0x0, &DXArchive_VER5::DecodeArchive, &DXArchive_VER5::EncodeArchiveOneDirectory, &DXArchive_VER5::ProbeArchive, std::vector<unsigned char>{ 0x0f, 0x53, 0xe1, 0x3e, 0x04, 0x37, 0x12, 0x17, 0x60, 0x0f, 0x53, 0xe1 } },
+	{ L"Wolf RPG v2.10", 0x0, &DXArchive_VER5::DecodeArchive, &DXArchive_VER5::EncodeArchiveOneDirectory, &DXArchive_VER5::ProbeArchive, std::vector<unsigned char>{ 0x4c, 0xd9, 0x2a, 0xb7, 0x28, 0x9b, 0xac, 0x07, 0x3e, 0x77, 0xec, 0x4c } },
+	{ L"Wolf RPG v2.20", 0x0, &DXArchive_VER6::DecodeArchive, &DXArchive_VER6::EncodeArchiveOneDirectory, &DXArchive_VER6::ProbeArchive, std::vector<unsigned char>{ 0x38, 0x50, 0x40, 0x28, 0x72, 0x4f, 0x21, 0x70, 0x3b, 0x73, 0x35, 0x38 } },
+	{ L"Wolf RPG v2.225", 0x0, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, "WLFRPrO!p(;s5((8P@((UFWlu$#5(=" },
+	{ L"Wolf RPG v3.00", 0x12C, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, std::vector<unsigned char>{ 0x0F, 0x53, 0xE1, 0x3E, 0x8E, 0xB5, 0x41, 0x91, 0x52, 0x16, 0x55, 0xAE, 0x34, 0xC9, 0x8F, 0x79, 0x59, 0x2F, 0x59, 0x6B, 0x95, 0x19, 0x9B, 0x1B, 0x35, 0x9A, 0x2F, 0xDE, 0xC9, 0x7C, 0x12, 0x96, 0xC3, 0x14, 0xB5, 0x0F, 0x53, 0xE1, 0x3E, 0x8E, 0x00 } },
+	{ L"Wolf RPG v3.14", 0x13A, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, std::vector<unsigned char>{ 0x31, 0xF9, 0x01, 0x36, 0xA3, 0xE3, 0x8D, 0x3C, 0x7B, 0xC3, 0x7D, 0x25, 0xAD, 0x63, 0x28, 0x19, 0x1B, 0xF7, 0x8E, 0x6C, 0xC4, 0xE5, 0xE2, 0x76, 0x82, 0xEA, 0x4F, 0xED, 0x61, 0xDA, 0xE0, 0x44, 0x5B, 0xB6, 0x46, 0x3B, 0x06, 0xD5, 0xCE, 0xB6, 0x78, 0x58, 0xD0, 0x7C, 0x82, 0x00 } },
+	{ L"Wolf RPG v3.31", 0x14B, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, std::vector<unsigned char>{ 0xCA, 0x08, 0x4C, 0x5D, 0x17, 0x0D, 0xDA, 0xA1, 0xD7, 0x27, 0xC8, 0x41, 0x54, 0x38, 0x82, 0x32, 0x54, 0xB7, 0xF9, 0x46, 0x8E, 0x13, 0x6B, 0xCA, 0xD0, 0x5C, 0x95, 0x95, 0xE2, 0xDC, 0x03, 0x53, 0x60, 0x9B, 0x4A, 0x38, 0x17, 0xF3, 0x69, 0x59, 0xA4, 0xC7, 0x9A, 0x43, 0x63, 0xE6, 0x54, 0xAF, 0xDB, 0xBB, 0x43, 0x58, 0x00 } },
+	{ L"Wolf RPG v3.50", 0x15E, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, std::vector<unsigned char>{ 0xD2, 0x84, 0xCE, 0x28, 0xCE, 0x88, 0x82, 0xE4, 0x2A, 0x18, 0x2E, 0x4C, 0x06, 0xB4, 0xEA, 0x84, 0x06, 0xB8, 0xC6, 0x88, 0x5A, 0xA0, 0x9E, 0x7C, 0x56, 0x40, 0xBA, 0x34, 0x52, 0xCC, 0xC6, 0x7C, 0x2E, 0x14, 0x12, 0x68, 0xFE, 0x5C, 0x76, 0x94, 0x86, 0x78, 0x8E, 0x4C, 0xBE, 0x88, 0x66, 0x9C, 0x1E, 0xE0, 0x8E, 0x6C, 0x00 } },
+	{ L"Wolf RPG ChaCha2 v1", 0x64, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, std::vector<unsigned char>{ 0xC9, 0x82, 0xF8, 0xB4, 0x2C, 0x93, 0x9E, 0x83, 0x0E, 0xBC, 0xBC, 0x92, 0x68, 0x8D, 0x59, 0xA1, 0x4A, 0x9E, 0x7F, 0xB0, 0xAC, 0xAF, 0x1D, 0x8F, 0x8E, 0xB8, 0x3B, 0x9E, 0xE8, 0x89, 0xD9, 0xAD, 0xFF, 0xBC, 0x2D, 0xAB, 0x9D, 0x8B, 0x0F, 0xB4, 0xBB, 0x9A, 0x69, 0x85, 0x00 } }, // First 32 bytes of the key and the next 12 byte are the nonce, 0 terminator for the unused keygen to not crash
+	{ L"Custom Key (v2.281+)", 0, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, &DXArchive::ProbeArchive, "" }, // 8
 };
 
 uint32_t g_mode = -1;
 
+// The --include/--exclude/--regex arguments, handed on to child processes so they unpack the same selection
+std::wstring g_filterArgs;
+
+// The 2.0x/2.1x decoders have no entry filter and always unpack everything
+bool filterIgnored(const CryptMode& mode)
+{
+	return !g_filterArgs.empty() && mode.decFunc != &DXArchive::DecodeArchive;
+}
+
+// Drops what a failed attempt wrote: the retry skips files that already exist, so truncated or garbage
+// files would survive it. Only a directory this run created is removed, one that was there before is kept
+void removeFailedOutput(const std::wstring& path, bool created)
+{
+	std::error_code ec;
+	if (created)
+		std::filesystem::remove_all(path, ec);
+	else
+		std::filesystem::remove(path, ec); // only if still empty
+}
+
 int unpackArchive(const TCHAR* pFilePath, const uint32_t mode)
 {
 	TCHAR fullPath[MAX_PATH];
@@ -114,7 +141,7 @@ int unpackArchive(const TCHAR* pFilePath, const uint32_t mode)
 
 	AnalysisFileNameAndExeName(filePath, fileName, NULL);
 
-	CreateDirectory(fileName, NULL);
+	const bool createdOutput = CreateDirectory(fileName, NULL) != FALSE;
 
 	SetCurrentDirectory(fileName);
  
@@ -126,16 +153,30 @@ int unpackArchive(const TCHAR* pFilePath, const uint32_t mode)
 	if (failed) {
 		//std::wcout << "\n Failed to decode: " << wstring(fileName) << " ";
 		SetCurrentDirectory(directoryPath);
-		RemoveDirectory(fileName);
+		removeFailedOutput(fileName, createdOutput);
 	}
 	else {
 		std::wcout << L"Mode: " << std::wstring(curMode.name) << " ";
+		if (filterIgnored(curMode))
+			std::wcout << L"(filters not supported, unpacked everything) ";
 	}
 
 	return failed;
 }
 
 
+int probeArchive(const TCHAR* pFilePath, const uint32_t mode)
+{
+	const CryptMode& curMode = DEFAULT_CRYPT_MODES.at(mode);
+
+	try {
+		return curMode.probeFunc(pFilePath, curMode.key.data());
+	}
+	catch (...) {}
+
+	return -1;
+}
+
 bool runProcess(const TCHAR* pProgName, const TCHAR* pFilePath, const uint32_t mode)
 {
 	STARTUPINFO si;
@@ -145,7 +186,7 @@ bool runProcess(const TCHAR* pProgName, const TCHAR* pFilePath, const uint32_t m
 	si.cb = sizeof(si);
 	ZeroMemory(&pi, sizeof(pi));
 
-	std::wstring wstr = std::wstring(pProgName) + L" -m " + std::to_wstring(mode) + L" \"" + std::wstring(pFilePath) + L"\"";
+	std::wstring wstr = std::wstring(pProgName) + L" -m " + std::to_wstring(mode) + L" -t " + std::to_wstring(DXArchive::GetDecodeThreadNum()) + g_filterArgs + L" \"" + std::wstring(pFilePath) + L"\"";
 
 	if (!CreateProcess(NULL, const_cast<LPWSTR>(wstr.c_str()), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
 	{
@@ -192,14 +233,132 @@ uint16_t getCryptVersion(const TCHAR* pFilePath)
 }
 
 
+// Mode detection cache: remembers which mode unpacked an archive so later runs on the same game build
+// skip the detection. Archives are identified by their size and a CRC32 of their first bytes, so a
+// changed archive simply misses; an entry whose mode or key no longer matches the table is dropped.
+static constexpr size_t MODE_CACHE_FINGERPRINT_BYTES = 0x10000;
+
+struct ModeCacheEntry
+{
+	uint32_t mode;
+	uint16_t cryptVersion;
+	std::string key; // Hex of the key the mode used
+};
+
+static std::map<std::string, ModeCacheEntry> g_modeCache;
+static std::wstring g_modeCachePath;
+static bool g_modeCacheDirty = false;
+
+std::string toHex(const std::vector<char>& data)
+{
+	std::string hex;
+	for (const char c : data)
+		hex += std::format("{:02X}", static_cast<unsigned char>(c));
+	return hex.empty() ? "-" : hex;
+}
+
+std::string archiveFingerprint(const TCHAR* pFilePath)
+{
+	std::ifstream f(std::filesystem::path(pFilePath), std::ios::binary | std::ios::ate);
+	if (!f.is_open())
+		return "";
+
+	const uint64_t size = f.tellg();
+	std::vector<char> head(static_cast<size_t>(std::min<uint64_t>(size, MODE_CACHE_FINGERPRINT_BYTES)));
+	f.seekg(0);
+	f.read(head.data(), head.size());
+	if (!f)
+		return "";
+
+	return std::format("{}:{:08X}", size, DXArchive::HashCRC32(head.data(), head.size()));
+}
+
+void loadModeCache(const std::wstring& path)
+{
+	g_modeCachePath = path;
+
+	std::ifstream f{ std::filesystem::path(path) };
+	std::string fingerprint;
+	ModeCacheEntry entry;
+	while (f >> fingerprint >> entry.mode >> entry.cryptVersion >> entry.key)
+		g_modeCache[fingerprint] = entry;
+}
+
+void saveModeCache()
+{
+	if (!g_modeCacheDirty || g_modeCachePath.empty())
+		return;
+
+	std::ofstream f(std::filesystem::path(g_modeCachePath), std::ios::trunc);
+	for (const auto& [fingerprint, entry] : g_modeCache)
+		f << fingerprint << ' ' << entry.mode << ' ' << entry.cryptVersion << ' ' << entry.key << '\n';
+
+	g_modeCacheDirty = false;
+}
+
+// Returns the cached mode of the archive, or -1 if there is none or it is stale
+uint32_t findCachedMode(const TCHAR* pFilePath)
+{
+	if (g_modeCachePath.empty())
+		return -1;
+
+	const auto it = g_modeCache.find(archiveFingerprint(pFilePath));
+	if (it == g_modeCache.end())
+		return -1;
+
+	const ModeCacheEntry& entry = it->second;
+	if (entry.mode < DEFAULT_CRYPT_MODES.size()
+		&& DEFAULT_CRYPT_MODES[entry.mode].cryptVersion == entry.cryptVersion
+		&& toHex(DEFAULT_CRYPT_MODES[entry.mode].key) == entry.key)
+		return entry.mode;
+
+	g_modeCache.erase(it);
+	g_modeCacheDirty = true;
+	return -1;
+}
+
+void rememberMode(const TCHAR* pFilePath, const uint32_t mode)
+{
+	if (g_modeCachePath.empty())
+		return;
+
+	const std::string fingerprint = archiveFingerprint(pFilePath);
+	if (fingerprint.empty())
+		return;
+
+	g_modeCache[fingerprint] = { mode, DEFAULT_CRYPT_MODES[mode].cryptVersion, toHex(DEFAULT_CRYPT_MODES[mode].key) };
+	g_modeCacheDirty = true;
+}
+
+void forgetMode(const TCHAR* pFilePath)
+{
+	if (g_modeCache.erase(archiveFingerprint(pFilePath)))
+		g_modeCacheDirty = true;
+}
+
+
 int detectModeAndUnpack(const TCHAR* pProgName, const TCHAR* pFilePath, bool final=false)
 {
 	INFO_LOG << L"Unpacking: " << pFilePath << L"... ";
 
 	uint16_t cryptVersion = 0;
 	bool success = false;
+	const bool detect = g_mode == -1;
+	uint32_t usedMode = -1;
+
+	if (detect) {
+		// a previous run already found the mode of this very archive
+		const uint32_t cachedMode = findCachedMode(pFilePath);
+		if (cachedMode != -1) {
+			success = final ? !unpackArchive(pFilePath, cachedMode) : runProcess(pProgName, pFilePath, cachedMode);
+			if (success)
+				usedMode = cachedMode;
+			else
+				forgetMode(pFilePath);
+		}
+	}
 
-	if (g_mode == -1) {
+	if (g_mode == -1 && !success) {
 		cryptVersion = getCryptVersion(pFilePath);
 		if (cryptVersion != 0)
 		{
@@ -211,22 +370,143 @@ int detectModeAndUnpack(const TCHAR* pProgName, const TCHAR* pFilePath, bool fin
 				}
 		}
 		else {
-			// for 2nd: check all possible 2.XX versions
+			// for 2nd: decode only the header tables with all possible 2.XX versions,
+			// then unpack with the best match (the rest are only tried if that fails)
+			std::vector<std::pair<int, uint32_t>> candidates;
 			for (uint32_t i = 0; i < DEFAULT_CRYPT_MODES.size(); i++) {
 				if (DEFAULT_CRYPT_MODES[i].cryptVersion > 0) continue;
+				candidates.emplace_back(probeArchive(pFilePath, i), i);
+			}
+
+			std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+			// modes whose probe could not decode the tables at all are only worth a full attempt
+			// when no mode could (e.g. a header layout the probe doesn't know)
+			if (!candidates.empty() && candidates.front().first >= 0)
+				std::erase_if(candidates, [](const auto& c) { return c.first < 0; });
+
+			for (const auto& [score, i] : candidates) {
 				success = final ? !unpackArchive(pFilePath, i) : runProcess(pProgName, pFilePath, i);
-				if (success) break;
+				if (success) {
+					usedMode = i;
+					break;
+				}
 			}
 		}
 	}
 
-	if (g_mode != -1 && !success)
+	if (g_mode != -1 && !success) {
 		success = final ? !unpackArchive(pFilePath, g_mode) : runProcess(pProgName, pFilePath, g_mode);
+		usedMode = g_mode;
+	}
+
+	if (detect && success)
+		rememberMode(pFilePath, usedMode);
 
 	INFO_LOG << (success ? L"OK" : L"FAIL") << std::endl;
 	return success;
 }
 
+// Picks the mode for an archive without unpacking it: the exact version for 3rd, the best header probe for 2nd
+uint32_t findCryptMode(const TCHAR* pFilePath)
+{
+	if (g_mode != -1) return g_mode;
+
+	const uint32_t cachedMode = findCachedMode(pFilePath);
+	if (cachedMode != -1) return cachedMode;
+
+	const uint16_t cryptVersion = getCryptVersion(pFilePath);
+	uint32_t bestMode = -1;
+	int bestScore = -1;
+
+	for (uint32_t i = 0; i < DEFAULT_CRYPT_MODES.size(); i++) {
+		if (DEFAULT_CRYPT_MODES[i].cryptVersion != cryptVersion) continue;
+		if (cryptVersion != 0) return i;
+
+		const int score = probeArchive(pFilePath, i);
+		if (score > bestScore) {
+			bestScore = score;
+			bestMode = i;
+		}
+	}
+
+	return bestMode;
+}
+
+// Unpacks several archives on one shared thread pool: all of them are probed up front, the work is
+// scheduled largest first and big archives are split per entry so they don't serialize the run.
+// Archives without a validated mode, or that fail, go through detectModeAndUnpack afterwards.
+std::vector<int> unpackArchives(const TCHAR* pProgName, const std::vector<std::wstring>& files)
+{
+	std::vector<DARC_DECODEBATCH> batchList;
+	std::vector<size_t> batchIndex(files.size(), SIZE_MAX);
+	std::vector<uint32_t> modes(files.size(), -1);
+	std::vector<std::wstring> outputPaths(files.size());
+	std::vector<bool> createdOutputs(files.size(), false);
+	std::vector<int> results(files.size(), 0);
+	std::mutex legacyMutex; // The 2.0x/2.1x decoders unpack into the current directory
+
+	for (size_t i = 0; i < files.size(); i++) {
+		TCHAR fullPath[MAX_PATH];
+		TCHAR filePath[MAX_PATH];
+		TCHAR directoryPath[MAX_PATH];
+		TCHAR fileName[MAX_PATH];
+
+		ConvertFullPath__(files[i].c_str(), fullPath);
+		AnalysisFileNameAndDirPath(fullPath, filePath, directoryPath);
+		AnalysisFileNameAndExeName(filePath, fileName, NULL);
+
+		modes[i] = findCryptMode(fullPath);
+		if (modes[i] >= DEFAULT_CRYPT_MODES.size()) continue;
+
+		// Same layout as unpackArchive: a directory named after the archive next to it
+		outputPaths[i] = std::wstring(directoryPath) + L"\\" + fileName;
+		createdOutputs[i] = CreateDirectory(outputPaths[i].c_str(), NULL) != FALSE;
+
+		const CryptMode& curMode = DEFAULT_CRYPT_MODES[modes[i]];
+		DARC_DECODEBATCH batch;
+		batch.ArchiveName = fullPath;
+		batch.OutputPath = outputPaths[i];
+		batch.KeyString = curMode.key.data();
+		batch.Result = -1;
+
+		if (curMode.decFunc != &DXArchive::DecodeArchive) {
+			batch.Decode = [&legacyMutex, &curMode, archiveName = batch.ArchiveName, outputPath = batch.OutputPath]() -> int {
+				std::lock_guard<std::mutex> lock(legacyMutex);
+				try {
+					return curMode.decFunc(const_cast<TCHAR*>(archiveName.c_str()), outputPath.c_str(), curMode.key.data()) < 0 ? -1 : 0;
+				}
+				catch (...) {}
+				return -1;
+			};
+		}
+
+		batchIndex[i] = batchList.size();
+		batchList.push_back(std::move(batch));
+	}
+
+	DXArchive::DecodeArchiveBatch(&batchList);
+
+	for (size_t i = 0; i < files.size(); i++) {
+		if (batchIndex[i] != SIZE_MAX) {
+			if (batchList[batchIndex[i]].Result == 0) {
+				INFO_LOG << L"Unpacking: " << files[i] << L"... Mode: " << DEFAULT_CRYPT_MODES[modes[i]].name
+					<< (filterIgnored(DEFAULT_CRYPT_MODES[modes[i]]) ? L" (filters not supported, unpacked everything)" : L"") << L" OK" << std::endl;
+				if (g_mode == -1)
+					rememberMode(files[i].c_str(), modes[i]);
+				results[i] = true;
+				continue;
+			}
+			removeFailedOutput(outputPaths[i], createdOutputs[i]);
+			forgetMode(files[i].c_str());
+		}
+
+		results[i] = detectModeAndUnpack(pProgName, files[i].c_str());
+	}
+
+	return results;
+}
+
 std::wstring s2ws(const std::string& str)
 {
 	int size_needed = MultiByteToWideChar(CP_UTF8, 0, &str[0], (int)str.size(), NULL, 0);
@@ -281,9 +561,106 @@ std::vector<char> parse_key(std::wstring key, bool hex_mode) {
 	}
 }
 
+std::string ws2s(const std::wstring& wstr)
+{
+	int size_needed = WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), NULL, 0, NULL, NULL);
+	std::string strTo( size_needed, 0 );
+	WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
+	return strTo;
+}
+
+std::string jsonString(const std::string& str)
+{
+	std::string out = "\"";
+	for (const char c : str) {
+		if (c == '"' || c == '\\')
+			out += std::string("\\") + c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			out += std::format("\\u{:04x}", c);
+		else
+			out += c;
+	}
+	return out + "\"";
+}
+
+std::string fileTimeString(const u64 time)
+{
+	FILETIME ft{ static_cast<DWORD>(time), static_cast<DWORD>(time >> 32) };
+	SYSTEMTIME st;
+	if (!FileTimeToSystemTime(&ft, &st))
+		return "-";
+
+	return std::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+}
+
+// Prints the entries of an archive straight from its header tables; no file data is read or
+// decompressed, so this stays fast on multi-GB archives. One JSON object per entry if json is set.
+int listArchive(const TCHAR* pFilePath, bool json)
+{
+	const uint32_t mode = findCryptMode(pFilePath);
+	if (mode >= DEFAULT_CRYPT_MODES.size()) {
+		std::wcerr << L"Listing: " << pFilePath << L"... no mode found" << std::endl;
+		return 0;
+	}
+
+	const CryptMode& curMode = DEFAULT_CRYPT_MODES[mode];
+	if (curMode.decFunc != &DXArchive::DecodeArchive) {
+		std::wcerr << L"Listing: " << pFilePath << L"... not supported for " << curMode.name << std::endl;
+		return 0;
+	}
+
+	const std::string archive = ws2s(pFilePath);
+	if (!json)
+		std::cout << archive << " (" << ws2s(curMode.name) << ")\n"
+			<< std::format("{:>12} {:>12} {:>12} {:>12} {:>8} {:<19} {}\n", "Offset", "Size", "LZ", "Huffman", "Attr", "Modified", "Path");
+
+	const auto sizeString = [](const u64 size) { return size == 0xffffffffffffffff ? std::string("-") : std::to_string(size); };
+	const auto sizeJson = [](const u64 size) { return size == 0xffffffffffffffff ? std::string("null") : std::to_string(size); };
+
+	int result = -1;
+	try {
+		result = DXArchive::ListArchive(pFilePath, [&](const DARC_LISTENTRY& entry) {
+			const DARC_FILEHEAD& file = *entry.File;
+			const bool directory = (file.Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+			const std::string path = ws2s(entry.Path);
+
+			if (json)
+				std::cout << "{\"archive\":" << jsonString(archive)
+					<< ",\"path\":" << jsonString(path)
+					<< ",\"directory\":" << (directory ? "true" : "false")
+					<< ",\"offset\":" << entry.DataPosition
+					<< ",\"size\":" << file.DataSize
+					<< ",\"lzSize\":" << sizeJson(file.PressDataSize)
+					<< ",\"huffmanSize\":" << sizeJson(file.HuffPressDataSize)
+					<< ",\"attributes\":" << file.Attributes
+					<< ",\"created\":" << file.Time.Create
+					<< ",\"accessed\":" << file.Time.LastAccess
+					<< ",\"written\":" << file.Time.LastWrite
+					<< "}\n";
+			else if (directory)
+				std::cout << std::format("{:>12} {:>12} {:>12} {:>12} {:08X} {:<19} {}\\\n", "-", "-", "-", "-", file.Attributes, fileTimeString(file.Time.LastWrite), path);
+			else
+				std::cout << std::format("{:>12} {:>12} {:>12} {:>12} {:08X} {:<19} {}\n", entry.DataPosition, file.DataSize, sizeString(file.PressDataSize), sizeString(file.HuffPressDataSize), file.Attributes, fileTimeString(file.Time.LastWrite), path);
+			}, curMode.key.data());
+	}
+	catch (...) {}
+
+	if (result < 0) {
+		forgetMode(pFilePath);
+		std::wcerr << L"Listing: " << pFilePath << L"... FAIL" << std::endl;
+		return 0;
+	}
+
+	if (g_mode == -1)
+		rememberMode(pFilePath, mode);
+
+	std::cout.flush();
+	return 1;
+}
+
 void showHelp(TCHAR* programName, const argagg::parser& argparser) {
 	argagg::fmt_ostream fmt(std::wcout);
-	fmt << "Usage: " << programName << " [-m num] [-s strkey|-k hexkey] [-g] <A.wolf B.wolf...|mask>" << std::endl;
+	fmt << "Usage: " << programName << " [-m num] [-t threads] [-s strkey|-k hexkey] [-c cachefile|--no-cache] [-i pattern...] [-x pattern...] [-r] [-l [-j]] [-g] <A.wolf B.wolf...|mask>" << std::endl;
 	fmt << argparser;
 	fmt << "	Modes:" << std::endl;
 	for (uint32_t i = 0; i < DEFAULT_CRYPT_MODES.size(); i++)
@@ -390,6 +767,14 @@ int wmain(int argc, TCHAR* argv[])
 		,{ L"hex", {L"-k", L"--hexkey"}, L"Provide decoding hexadecimal key", 1}
 		,{ L"mode", {L"-m", L"--mode"}, L"Mode index (autodetected if not provided)", 1}
 		,{ L"pack", {L"-p", L"--pack"}, L"Whether to pack or unpack game files", 1}
+		,{ L"threads", {L"-t", L"--threads"}, L"Number of extraction threads (0 or omitted: all cores)", 1}
+		,{ L"cache", {L"-c", L"--cache"}, L"Mode detection cache file (default: WolfDec.cache next to the program)", 1}
+		,{ L"nocache", {L"--no-cache"}, L"Don't read or write the mode detection cache", 0}
+		,{ L"include", {L"-i", L"--include"}, L"Only unpack entries whose in-archive path matches (wildcards * and ?, repeatable)", 1}
+		,{ L"exclude", {L"-x", L"--exclude"}, L"Don't unpack entries whose in-archive path matches (repeatable)", 1}
+		,{ L"regex", {L"-r", L"--regex"}, L"Treat --include/--exclude patterns as regular expressions (matching any part of the path)", 0}
+		,{ L"list", {L"-l", L"--list"}, L"List the archive contents from the header tables instead of unpacking", 0}
+		,{ L"json", {L"-j", L"--json"}, L"With --list: print one JSON object per entry (JSON Lines)", 0}
 	} };
 
 	argagg::parser_results args;
@@ -410,30 +795,74 @@ int wmain(int argc, TCHAR* argv[])
 		return guessKey(args.pos[0]);
 	}
 	else {
-		int finalResult = 0;
+		int finalResult = EXIT_SUCCESS;
 
 		if (args[L"mode"])
 			g_mode = setupMode(args);
 
+		DXArchive::SetDecodeThreadNum(args[L"threads"] ? args[L"threads"].as<int>() : 0);
+
+		if (args[L"include"] || args[L"exclude"]) {
+			std::vector<std::wstring> include, exclude;
+			for (const auto& pattern : args[L"include"].all) {
+				include.push_back(pattern.as<std::wstring>());
+				g_filterArgs += L" -i \"" + include.back() + L"\"";
+			}
+			for (const auto& pattern : args[L"exclude"].all) {
+				exclude.push_back(pattern.as<std::wstring>());
+				g_filterArgs += L" -x \"" + exclude.back() + L"\"";
+			}
+			if (args[L"regex"])
+				g_filterArgs += L" -r";
+
+			if (DXArchive::SetDecodeFilter(include, exclude, static_cast<bool>(args[L"regex"])) < 0) {
+				std::wcerr << L"Invalid --include/--exclude regular expression" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (args[L"cache"])
+			loadModeCache(args[L"cache"].as<std::wstring>());
+		else if (!args[L"nocache"]) {
+			TCHAR programPath[MAX_PATH];
+			GetModuleFileName(NULL, programPath, MAX_PATH);
+			loadModeCache((filesystem::path(programPath).parent_path() / L"WolfDec.cache").wstring());
+		}
+
 		const TCHAR* program = args.program;
+		std::vector<std::wstring> files;
 		for (const auto& file : args.pos) {
-			int fileResult = 0;
 			if (filesystem::is_regular_file(file))
 			{
-				fileResult |= detectModeAndUnpack(program, file, true);
+				files.push_back(file);
 			}
 			else
 			{
-				fileResult |= processFileOrMask(file, [program](const TCHAR* filename) -> int {
-					std::wcout << L"Processed file: " << filename << std::endl;
-					return detectModeAndUnpack(program, filename);
+				const filesystem::path maskDir = filesystem::path(file).parent_path();
+				processFileOrMask(file, [&files, &maskDir](const TCHAR* filename) -> int {
+					files.push_back((maskDir / filename).wstring());
+					return 0;
 					});
 			}
+		}
 
-			if (fileResult != 0)
-				finalResult = fileResult;
+		std::vector<int> results;
+		if (args[L"list"])
+			for (const auto& file : files)
+				results.push_back(listArchive(file.c_str(), static_cast<bool>(args[L"json"])));
+		else if (files.size() == 1)
+			results.push_back(detectModeAndUnpack(program, files[0].c_str(), true));
+		else
+			results = unpackArchives(program, files);
+
+		// Every entry is true/1 on success; runProcess expects a child that unpacked its archive to exit with 0
+		for (const int fileResult : results) {
+			if (!fileResult)
+				finalResult = EXIT_FAILURE;
 		}
 
+		saveModeCache();
+
 		return finalResult;
 	}
 }
\ No newline at end of file
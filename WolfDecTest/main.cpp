@@ -0,0 +1,503 @@
+#include <DXArchive.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+////////////////////////
+// WolfDec self-test
+////////////////////////
+// Round-trips data through the LZ encoder at every compression level and through archives of every crypt version,
+// reads the compressed files back through the stream decoder and checks that damaged archives are rejected.
+// Run with --large to also check an archive whose data goes past 2 GB ( needs about 5 GB of free disk space )
+
+namespace fs = std::filesystem;
+
+static const char* TEST_KEY = "WolfDecSelfTestKey";
+
+static int g_failures = 0;
+
+void check(bool condition, const std::wstring& what)
+{
+	if (!condition)
+	{
+		std::wcout << L"FAIL: " << what << std::endl;
+		g_failures++;
+	}
+}
+
+// Deterministic xorshift so every run checks the same data
+struct Random
+{
+	uint64_t state;
+
+	explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return static_cast<uint32_t>(state >> 32);
+	}
+};
+
+std::vector<u8> makeRandom(size_t size, uint64_t seed)
+{
+	Random rnd(seed);
+	std::vector<u8> data(size);
+	for (u8& b : data)
+		b = static_cast<u8>(rnd.next());
+	return data;
+}
+
+// Text-like data with short and long distance repeats, which is what the match finder has to get right
+std::vector<u8> makeText(size_t size, uint64_t seed)
+{
+	static const char* WORDS[] = { "Wolf", "RPG", "Editor", "data", "map", "event", "common", "database", "picture", "sound", "\r\n", " ", "\t" };
+	Random rnd(seed);
+	std::vector<u8> data;
+	data.reserve(size);
+	while (data.size() < size)
+	{
+		if (data.size() > 4096 && rnd.next() % 16 == 0)
+		{
+			const size_t len  = std::min<size_t>(rnd.next() % 2048 + 3, size - data.size());
+			const size_t from = rnd.next() % (data.size() - len);
+			for (size_t i = 0; i < len; i++)
+				data.push_back(data[from + i]);
+		}
+		else
+		{
+			const char* word = WORDS[rnd.next() % std::size(WORDS)];
+			while (*word && data.size() < size)
+				data.push_back(static_cast<u8>(*word++));
+		}
+	}
+	return data;
+}
+
+std::vector<u8> makeRuns(size_t size, uint64_t seed)
+{
+	Random rnd(seed);
+	std::vector<u8> data;
+	data.reserve(size);
+	while (data.size() < size)
+		data.insert(data.end(), std::min<size_t>(rnd.next() % 300 + 1, size - data.size()), static_cast<u8>(rnd.next() % 4));
+	return data;
+}
+
+bool readFile(const fs::path& path, std::vector<u8>& data)
+{
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	if (!f) return false;
+	data.resize(static_cast<size_t>(f.tellg()));
+	f.seekg(0);
+	f.read(reinterpret_cast<char*>(data.data()), data.size());
+	return f.good() || data.empty();
+}
+
+bool writeFile(const fs::path& path, const std::vector<u8>& data)
+{
+	fs::create_directories(path.parent_path());
+	std::ofstream f(path, std::ios::binary | std::ios::trunc);
+	f.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return f.good();
+}
+
+void freshDirectory(const fs::path& path)
+{
+	std::error_code ec;
+	fs::remove_all(path, ec);
+	fs::create_directories(path);
+}
+
+////////////////////////
+// LZ encoder / decoder
+////////////////////////
+
+void testLz()
+{
+	std::vector<std::pair<std::wstring, std::vector<u8>>> samples = {
+		{ L"one byte", { 0x42 } },
+		{ L"zeros", std::vector<u8>(100000, 0) },
+		{ L"random", makeRandom(70000, 1) },
+		{ L"text", makeText(300000, 2) },
+		{ L"runs", makeRuns(200000, 3) },
+	};
+
+	for (const auto& [name, src] : samples)
+	{
+		for (int level = DXA_PRESSLEVEL_MIN; level <= DXA_PRESSLEVEL_MAX + 1; level++)
+		{
+			const bool maxPress = level > DXA_PRESSLEVEL_MAX;
+			const std::wstring what = L"LZ " + name + (maxPress ? L" max press" : L" level " + std::to_wstring(level));
+
+			// The encoder needs twice the source size, as FileEncode gives it
+			std::vector<u8> press(src.size() * 2 + 64);
+			const int pressSize = DXArchive::Encode(const_cast<u8*>(src.data()), static_cast<u32>(src.size()), press.data(), false, maxPress, maxPress ? -1 : level);
+			check(pressSize > 0, what + L": encode failed");
+			if (pressSize <= 0) continue;
+
+			std::vector<u8> dest(src.size());
+			check(DXArchive::Decode(press.data(), NULL, pressSize, 0) == static_cast<int>(src.size()), what + L": wrong original size");
+			check(DXArchive::Decode(press.data(), dest.data(), pressSize, dest.size()) == static_cast<int>(src.size()) && dest == src, what + L": round trip differs");
+			check(DXArchive::Decode(press.data(), dest.data(), pressSize - 1, dest.size()) < 0, what + L": truncated data accepted");
+			if (!dest.empty())
+				check(DXArchive::Decode(press.data(), dest.data(), pressSize, dest.size() - 1) < 0, what + L": too small output accepted");
+		}
+	}
+}
+
+////////////////////////
+// Archives
+////////////////////////
+
+struct ArchiveMode
+{
+	std::wstring name;
+	uint16_t cryptVersion;
+	bool wolf;
+	bool noKey;
+	bool imageCrypt; // the whole archive is encrypted, only DecodeArchive and ListArchive can open it
+};
+
+static const std::vector<ArchiveMode> ARCHIVE_MODES = {
+	{ L"DX Archive (no key)", 0, false, true, false },
+	{ L"DX Archive", 0, false, false, false },
+	{ L"Wolf RPG v3.00", 0x12C, true, false, false },
+	{ L"Wolf RPG v3.14", 0x13A, true, false, false },
+	{ L"Wolf RPG ChaCha2 v1", 0x64, true, false, false },
+	{ L"Wolf RPG v3.31", 0x14B, true, false, true },
+	{ L"Wolf RPG v3.50", 0x15E, true, false, true },
+};
+
+// Files to archive, relative to the source directory. image.bmp is always compressed, stream.bmp is large enough
+// to be extracted through the stream decoder
+void makeSource(const fs::path& dir, bool withStreamFile)
+{
+	freshDirectory(dir);
+	writeFile(dir / L"text.txt", makeText(200000, 10));
+	writeFile(dir / L"random.dat", makeRandom(65536 + 3, 11));
+	writeFile(dir / L"empty.txt", {});
+	writeFile(dir / L"image.bmp", makeRuns(3 * 1024 * 1024, 12));
+	writeFile(dir / L"BasicData" / L"sub" / L"nested.txt", makeText(5000, 13));
+	if (withStreamFile)
+		writeFile(dir / L"stream.bmp", makeText(DXA_STREAMDECODE_MINSIZE + 1024 * 1024, 14));
+}
+
+int encodeArchive(const fs::path& archive, const fs::path& source, const ArchiveMode& mode)
+{
+	if (mode.wolf)
+		return DXArchive::EncodeArchiveOneDirectoryWolf(archive.wstring().c_str(), source.wstring().c_str(), true, TEST_KEY, mode.cryptVersion);
+	return DXArchive::EncodeArchiveOneDirectory(archive.wstring().c_str(), source.wstring().c_str(), true, false, 0xff, mode.noKey ? NULL : TEST_KEY, mode.noKey, false);
+}
+
+// Reads a file of an opened archive every way the library offers and compares it with the original
+void checkArchivedFile(DXArchive& arc, const std::wstring& inArchive, const std::vector<u8>& expect, const std::wstring& what)
+{
+	const s64 size = arc.GetFileSize(inArchive.c_str());
+	check(size == static_cast<s64>(expect.size()), what + L": wrong size of " + inArchive);
+	if (size != static_cast<s64>(expect.size())) return;
+
+	std::vector<u8> data(expect.size() + 1);
+	check(arc.LoadFileToMem(inArchive.c_str(), data.data(), data.size()) == 0 && std::equal(expect.begin(), expect.end(), data.begin()), what + L": LoadFileToMem differs for " + inArchive);
+
+	for (bool lazy : { false, true })
+	{
+		DXArchiveFile* file = arc.OpenFile(inArchive.c_str(), lazy);
+		check(file != NULL, what + L": OpenFile failed for " + inArchive);
+		if (file == NULL) continue;
+
+		// Whole file in odd sized pieces, then a jump back into the middle
+		std::vector<u8> read;
+		u8 buffer[7777];
+		s64 got;
+		while ((got = file->Read(buffer, sizeof(buffer))) > 0)
+			read.insert(read.end(), buffer, buffer + got);
+		check(read == expect, what + (lazy ? L": lazy" : L": eager") + L" OpenFile read differs for " + inArchive);
+
+		if (expect.size() > 16)
+		{
+			const s64 middle = static_cast<s64>(expect.size() / 2);
+			file->Seek(middle, SEEK_SET);
+			got = file->Read(buffer, 16);
+			check(got == 16 && std::equal(buffer, buffer + 16, expect.begin() + middle), what + L": read after seek differs for " + inArchive);
+		}
+		delete file;
+	}
+}
+
+void testArchives(const fs::path& work)
+{
+	const fs::path source = work / L"source";
+	const fs::path output = work / L"output";
+
+	for (const ArchiveMode& mode : ARCHIVE_MODES)
+	{
+		const bool withStreamFile = &mode == &ARCHIVE_MODES.front();
+		const fs::path archive = work / L"archive.wolf";
+		makeSource(source, withStreamFile);
+
+		// The large file only has to be compressed, not compressed well
+		DXArchive::SetPressLevel(withStreamFile ? DXA_PRESSLEVEL_MIN : DXA_PRESSLEVEL_DEFAULT);
+		const int encodeResult = encodeArchive(archive, source, mode);
+		DXArchive::SetPressLevel(DXA_PRESSLEVEL_DEFAULT);
+		check(encodeResult >= 0, mode.name + L": encode failed");
+		if (encodeResult < 0) continue;
+
+		const char* key = mode.noKey ? NULL : TEST_KEY;
+		std::wstring archivePath = archive.wstring();
+		freshDirectory(output);
+		check(DXArchive::DecodeArchive(archivePath.data(), output.wstring().c_str(), key) == 0, mode.name + L": decode failed");
+
+		std::map<std::wstring, u64> listed;
+		check(DXArchive::ListArchive(archive.wstring().c_str(), [&](const DARC_LISTENTRY& entry) {
+			if ((entry.File->Attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) listed[entry.Path] = entry.File->DataSize;
+		}, key) == 0, mode.name + L": list failed");
+
+		std::vector<u8> image;
+		readFile(archive, image);
+		DXArchive fromFile, fromMemory;
+		const bool opened = !mode.imageCrypt &&
+			fromFile.OpenArchiveFile(archive.wstring().c_str(), key) == 0 &&
+			fromMemory.OpenArchiveMem(image.data(), image.size(), key) == 0;
+		check(opened || mode.imageCrypt, mode.name + L": open failed");
+
+		for (const auto& entry : fs::recursive_directory_iterator(source))
+		{
+			if (!entry.is_regular_file()) continue;
+			const fs::path relative = fs::relative(entry.path(), source);
+			std::vector<u8> expect, extracted;
+			readFile(entry.path(), expect);
+			check(readFile(output / relative, extracted) && extracted == expect, mode.name + L": extracted " + relative.wstring() + L" differs");
+
+			// The archive always separates directories with \ whatever the platform uses
+			std::wstring inArchive = relative.wstring();
+			std::replace(inArchive.begin(), inArchive.end(), L'/', L'\\');
+			check(listed.count(inArchive) && listed[inArchive] == expect.size(), mode.name + L": listed " + inArchive + L" differs");
+			if (!opened) continue;
+
+			checkArchivedFile(fromFile, inArchive, expect, mode.name);
+			std::vector<u8> data(expect.size());
+			check(fromMemory.LoadFileToMem(inArchive.c_str(), data.data(), data.size()) == 0 && data == expect, mode.name + L": memory archive LoadFileToMem differs for " + inArchive);
+		}
+		if (opened)
+		{
+			fromFile.CloseArchiveFile();
+			fromMemory.CloseArchiveFile();
+		}
+	}
+}
+
+////////////////////////
+// Damaged archives
+////////////////////////
+
+// Opens a damaged archive every way the library offers. They must all fail when mustFail is set, otherwise they
+// only must not crash
+void openDamaged(const fs::path& work, const std::vector<u8>& image, const ArchiveMode& mode, bool mustFail, const std::wstring& what)
+{
+	const char* key = mode.noKey ? NULL : TEST_KEY;
+	const fs::path archive = work / L"damaged.wolf";
+	const fs::path output  = work / L"damaged";
+	writeFile(archive, image);
+	freshDirectory(output);
+
+	std::wstring archivePath = archive.wstring();
+	const int decodeResult = DXArchive::DecodeArchive(archivePath.data(), output.wstring().c_str(), key);
+	const int listResult   = DXArchive::ListArchive(archive.wstring().c_str(), [](const DARC_LISTENTRY&) {}, key);
+	const int probeResult  = DXArchive::ProbeArchive(archive.wstring().c_str(), key);
+
+	DXArchive fromFile, fromFileMem, fromMemory;
+	const int fileResult    = fromFile.OpenArchiveFile(archive.wstring().c_str(), key);
+	const int fileMemResult = fromFileMem.OpenArchiveFileMem(archive.wstring().c_str(), key);
+	std::vector<u8> copy(image);
+	const int memoryResult  = fromMemory.OpenArchiveMem(copy.data(), copy.size(), key);
+
+	// Whatever opened has to survive reading every file it claims to hold
+	if (fileResult == 0)
+	{
+		DXArchive::ListArchive(archive.wstring().c_str(), [&](const DARC_LISTENTRY& entry) {
+			if (entry.File->Attributes & FILE_ATTRIBUTE_DIRECTORY) return;
+			if (DXArchiveFile* file = fromFile.OpenFile(entry.Path.c_str(), true))
+			{
+				u8 buffer[4096];
+				while (file->Read(buffer, sizeof(buffer)) > 0) {}
+				delete file;
+			}
+		}, key);
+	}
+
+	if (mustFail)
+	{
+		check(decodeResult < 0, what + L": DecodeArchive accepted it");
+		check(listResult < 0, what + L": ListArchive accepted it");
+		if (mode.imageCrypt) return; // the rest only look at the header of these
+
+		check(probeResult < 0, what + L": ProbeArchive accepted it");
+		check(fileResult < 0, what + L": OpenArchiveFile accepted it");
+		check(fileMemResult < 0, what + L": OpenArchiveFileMem accepted it");
+		check(memoryResult < 0, what + L": OpenArchiveMem accepted it");
+	}
+}
+
+template <typename T>
+void poke(std::vector<u8>& image, size_t offset, T value)
+{
+	memcpy(image.data() + offset, &value, sizeof(value));
+}
+
+void testDamaged(const fs::path& work)
+{
+	const fs::path source = work / L"source";
+	const fs::path archive = work / L"archive.wolf";
+
+	// Without a key the header can be edited directly
+	makeSource(source, false);
+	check(encodeArchive(archive, source, ARCHIVE_MODES[0]) >= 0, L"damaged: encode failed");
+	std::vector<u8> image;
+	readFile(archive, image);
+	if (image.size() < sizeof(DARC_HEAD)) return;
+
+	DARC_HEAD head;
+	memcpy(&head, image.data(), sizeof(head));
+	const u64 size = image.size();
+
+	for (size_t cut : { size_t(0), size_t(16), sizeof(DARC_HEAD) - 1, static_cast<size_t>(head.FileNameTableStartAddress) })
+		openDamaged(work, std::vector<u8>(image.begin(), image.begin() + cut), ARCHIVE_MODES[0], true, L"cut to " + std::to_wstring(cut) + L" bytes");
+
+	std::vector<u8> damaged = image;
+	poke(damaged, offsetof(DARC_HEAD, FileNameTableStartAddress), size);
+	openDamaged(work, damaged, ARCHIVE_MODES[0], true, L"tables past the end");
+
+	damaged = image;
+	poke(damaged, offsetof(DARC_HEAD, FileNameTableStartAddress), ~0ull);
+	openDamaged(work, damaged, ARCHIVE_MODES[0], true, L"tables far past the end");
+
+	damaged = image;
+	poke(damaged, offsetof(DARC_HEAD, DataStartAddress), size + 1);
+	openDamaged(work, damaged, ARCHIVE_MODES[0], true, L"data past the end");
+
+	damaged = image;
+	poke(damaged, offsetof(DARC_HEAD, HeadSize), 0xFFFFFFF0u);
+	openDamaged(work, damaged, ARCHIVE_MODES[0], true, L"huge tables");
+
+	// Huffman header of the compressed tables claiming sizes far beyond what is there
+	damaged = image;
+	memset(damaged.data() + head.FileNameTableStartAddress, 0xFF, std::min<size_t>(16, size - head.FileNameTableStartAddress));
+	openDamaged(work, damaged, ARCHIVE_MODES[0], false, L"table Huffman header");
+
+	// Huffman and LZ headers of the compressed file data
+	damaged = image;
+	for (u64 i = head.DataStartAddress; i < std::min<u64>(head.DataStartAddress + 64, head.FileNameTableStartAddress); i++)
+		damaged[static_cast<size_t>(i)] = 0xFF;
+	openDamaged(work, damaged, ARCHIVE_MODES[0], false, L"file Huffman header");
+
+	// Random damage to the tables and the data
+	Random rnd(20);
+	for (int i = 0; i < 100; i++)
+	{
+		damaged = image;
+		const size_t start = i % 2 ? static_cast<size_t>(head.FileNameTableStartAddress) : static_cast<size_t>(head.DataStartAddress);
+		for (int n = rnd.next() % 8 + 1; n > 0; n--)
+			damaged[start + rnd.next() % (size - start)] ^= static_cast<u8>(rnd.next() % 255 + 1);
+		openDamaged(work, damaged, ARCHIVE_MODES[0], false, L"random damage " + std::to_wstring(i));
+	}
+
+	// A v3.50 archive too small to hold the encrypted body
+	check(encodeArchive(archive, source, ARCHIVE_MODES.back()) >= 0, L"damaged: v3.50 encode failed");
+	readFile(archive, image);
+	image.resize(std::min<size_t>(image.size(), 1000));
+	openDamaged(work, image, ARCHIVE_MODES.back(), true, L"v3.50 cut to 1000 bytes");
+}
+
+////////////////////////
+// Archives over 2 GB
+////////////////////////
+
+void testLarge(const fs::path& work)
+{
+	const fs::path source = work / L"large";
+	const fs::path archive = work / L"large.wolf";
+	const fs::path output = work / L"large_output";
+	const u64 largeSize = 0x80000000ull + 0x100000;
+
+	// Stored without compression, so tail.txt starts past 2 GB
+	freshDirectory(source);
+	{
+		std::ofstream f(source / L"a_large.bin", std::ios::binary);
+	}
+	fs::resize_file(source / L"a_large.bin", largeSize);
+	const std::vector<u8> tail = makeText(100000, 30);
+	writeFile(source / L"b_tail.txt", tail);
+
+	const std::vector<std::wstring> files = { (source / L"a_large.bin").wstring(), (source / L"b_tail.txt").wstring() };
+	check(DXArchive::EncodeArchive(archive.wstring().c_str(), files, static_cast<int>(files.size()), false, false, 0, NULL, true, false) >= 0, L"large: encode failed");
+	fs::remove_all(source);
+
+	u64 tailPosition = 0;
+	check(DXArchive::ListArchive(archive.wstring().c_str(), [&](const DARC_LISTENTRY& entry) {
+		if (entry.Path == L"b_tail.txt") tailPosition = entry.DataPosition;
+	}) == 0, L"large: list failed");
+	check(tailPosition > 0x80000000ull, L"large: tail.txt is not stored past 2 GB");
+
+	DXArchive arc;
+	check(arc.OpenArchiveFile(archive.wstring().c_str()) == 0, L"large: OpenArchiveFile failed");
+	checkArchivedFile(arc, L"b_tail.txt", tail, L"large");
+	if (DXArchiveFile* file = arc.OpenFile(L"a_large.bin", true))
+	{
+		u8 buffer[16] = { 1 };
+		file->Seek(static_cast<s64>(largeSize) - 16, SEEK_SET);
+		check(file->Read(buffer, 16) == 16 && std::all_of(buffer, buffer + 16, [](u8 b) { return b == 0; }), L"large: end of a_large.bin differs");
+		delete file;
+	}
+	arc.CloseArchiveFile();
+
+	std::wstring archivePath = archive.wstring();
+	freshDirectory(output);
+	check(DXArchive::DecodeArchive(archivePath.data(), output.wstring().c_str()) == 0, L"large: decode failed");
+	std::vector<u8> extracted;
+	check(readFile(output / L"b_tail.txt", extracted) && extracted == tail, L"large: extracted tail.txt differs");
+	std::error_code ec;
+	check(fs::file_size(output / L"a_large.bin", ec) == largeSize, L"large: extracted a_large.bin has the wrong size");
+
+	fs::remove_all(output, ec);
+	fs::remove(archive, ec);
+}
+
+int wmain(int argc, TCHAR* argv[])
+{
+	const bool large = argc > 1 && std::wstring(argv[1]) == L"--large";
+	const fs::path work = fs::temp_directory_path() / L"WolfDecTest";
+	freshDirectory(work);
+
+	std::vector<std::pair<std::wstring, std::function<void()>>> tests = {
+		{ L"LZ round trip", testLz },
+		{ L"Archive round trip", [&] { testArchives(work); } },
+		{ L"Damaged archives", [&] { testDamaged(work); } },
+	};
+	if (large)
+		tests.push_back({ L"Archive over 2 GB", [&] { testLarge(work); } });
+
+	for (const auto& [name, test] : tests)
+	{
+		const int before = g_failures;
+		std::wcout << name << L"... " << std::flush;
+		test();
+		std::wcout << (g_failures == before ? L"OK" : L"FAILED") << std::endl;
+	}
+
+	std::error_code ec;
+	fs::remove_all(work, ec);
+
+	return g_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}